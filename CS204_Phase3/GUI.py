@@ -127,6 +127,51 @@ class SimulatorThread(QThread):
         except Exception as e:
             self.finished.emit(False, f"Error running simulation: {str(e)}")
 
+class SimulatorServer:
+    """Persistent simulator process driven through the --serve line protocol"""
+    
+    def __init__(self, executable_path, input_file, forwarding=True, trace_args=None):
+        cmd = [executable_path, "--input", input_file, "--serve"]
+        if not forwarding:
+            cmd.append("--no-forwarding")
+        if trace_args:
+            cmd.extend(trace_args)
+        self.cmd = cmd
+        # Replies come back on stdout; the simulator's own log goes to stderr
+        self.process = subprocess.Popen(cmd, stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                        stderr=subprocess.DEVNULL, text=True, bufsize=1)
+    
+    def command(self, line):
+        """Send one command and return the reply line without its "ok" prefix"""
+        self.process.stdin.write(line + "\n")
+        self.process.stdin.flush()
+        reply = self.process.stdout.readline().strip()
+        if not reply.startswith("ok"):
+            raise RuntimeError(reply or "simulator exited")
+        return reply[2:].strip()
+    
+    def status(self, reply):
+        """Turn a "cycle=.. pc=.. retired=.. finished=.." reply into a dict"""
+        return dict(field.split("=", 1) for field in reply.split())
+    
+    def snapshot_lines(self, cycle):
+        """Return the cycle_snapshots.log lines for one cycle"""
+        self.command(f"snapshot {cycle}")
+        lines = []
+        while True:
+            line = self.process.stdout.readline()
+            if line == "" or line.strip() == "end":
+                break
+            lines.append(line)
+        return lines
+    
+    def close(self):
+        try:
+            self.command("quit")
+        except Exception:
+            pass
+        self.process.wait()
+
 class PipelineVisualizerWidget(QWidget):
     """Widget for visualizing the pipeline state"""
     
@@ -346,6 +391,8 @@ class SimulatorGUI(QMainWindow):
         
         # Simulator thread
         self.sim_thread = None
+        # Persistent --serve process used by the Step button
+        self.sim_server = None
         
         # Populate test files dropdown
         self.populate_test_files()
@@ -1100,11 +1147,11 @@ class SimulatorGUI(QMainWindow):
         self.progress_bar.show()
         
         try:
-            # Custom compile command as specified by user
-            cmd = ["g++", "-o", "simulator", "trueOrignal.cpp", "nonPipelined.cpp", "-std=c++11"]
+            # Makefile.unknown holds the source list and flags; only the output name differs
+            cmd = ["make", "-f", "Makefile.unknown", "TARGET=simulator"]
             
             self.output_log.append(f"Running command: {' '.join(cmd)}")
-            process = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+            process = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, cwd=self.base_dir)
             stdout, stderr = process.communicate()
             
             if process.returncode == 0:
@@ -1246,230 +1293,16 @@ class SimulatorGUI(QMainWindow):
         
         if os.path.exists(snapshots_path):
             try:
-                self.snapshots = []
-                current_snapshot = None
-                cycle_count = 0
-                
                 with open(snapshots_path, 'r') as f:
                     self.output_log.append("Reading snapshots file...")
                     lines = f.readlines()
                     self.output_log.append(f"Found {len(lines)} lines in the file")
-                    
-                    for line in lines:
-                        line = line.strip()
-                        
-                        # Skip empty lines
-                        if not line:
-                            continue
-                            
-                        # Skip separator lines
-                        if line.startswith("---"):
-                            continue
-                        
-                        # Check if this is a cycle indicator line
-                        if "Cycle" in line and "Pipeline State" in line:
-                            try:
-                                # Extract cycle number
-                                parts = line.split()
-                                cycle_num = int(parts[1])
-                                
-                                # Create new snapshot
-                                current_snapshot = {
-                                    "clockCycles": cycle_num,
-                                    "if_id": {"valid": False},
-                                    "id_ex": {"valid": False},
-                                    "ex_mem": {"valid": False},
-                                    "mem_wb": {"valid": False}
-                                }
-                                self.snapshots.append(current_snapshot)
-                                cycle_count += 1
-                            except Exception as e:
-                                self.output_log.append(f"Error parsing cycle line: {line}")
-                                self.output_log.append(f"Error: {str(e)}")
-                            continue
-                        
-                        # Skip if no current snapshot
-                        if current_snapshot is None:
-                            continue
-                            
-                        # Parse IF stage
-                        if line.startswith("IF:"):
-                            try:
-                                # Set valid to true since stage is present
-                                current_snapshot["if_id"]["valid"] = True
-                                
-                                # Parse PC value
-                                if "PC =" in line:
-                                    pc_idx = line.find("PC =") + 5
-                                    pc_end = line.find(",", pc_idx)
-                                    if pc_end == -1:
-                                        pc_end = len(line)
-                                    pc_val = line[pc_idx:pc_end].strip()
-                                    try:
-                                        current_snapshot["if_id"]["pc"] = int(pc_val, 16)
-                                    except ValueError:
-                                        current_snapshot["if_id"]["pc"] = pc_val
-                                
-                                # Parse instruction
-                                if "Instruction =" in line:
-                                    inst_idx = line.find("Instruction =") + 13
-                                    inst_end = len(line)
-                                    inst_val = line[inst_idx:inst_end].strip()
-                                    try:
-                                        current_snapshot["if_id"]["instruction"] = int(inst_val, 16)
-                                    except ValueError:
-                                        current_snapshot["if_id"]["instruction"] = inst_val
-                            except Exception as e:
-                                self.output_log.append(f"Error parsing IF line: {line}")
-                                self.output_log.append(f"Error: {str(e)}")
-                        
-                        # Parse ID stage
-                        elif line.startswith("ID:"):
-                            try:
-                                # Set valid to true since stage is present
-                                current_snapshot["id_ex"]["valid"] = True
-                                
-                                # Parse PC value
-                                if "PC =" in line:
-                                    pc_idx = line.find("PC =") + 5
-                                    pc_end = line.find(",", pc_idx)
-                                    if pc_end == -1:
-                                        pc_end = len(line)
-                                    pc_val = line[pc_idx:pc_end].strip()
-                                    try:
-                                        current_snapshot["id_ex"]["pc"] = int(pc_val, 16)
-                                    except ValueError:
-                                        current_snapshot["id_ex"]["pc"] = pc_val
-                                
-                                # Parse instruction type
-                                if "Type =" in line:
-                                    type_idx = line.find("Type =") + 7
-                                    type_end = line.find(",", type_idx)
-                                    if type_end == -1:
-                                        type_end = len(line)
-                                    current_snapshot["id_ex"]["instType"] = line[type_idx:type_end].strip()
-                                
-                                # Parse instruction subtype
-                                if "Subtype =" in line:
-                                    subtype_idx = line.find("Subtype =") + 10
-                                    subtype_end = line.find(",", subtype_idx)
-                                    if subtype_end == -1:
-                                        subtype_end = len(line)
-                                    current_snapshot["id_ex"]["subType"] = line[subtype_idx:subtype_end].strip()
-                            except Exception as e:
-                                self.output_log.append(f"Error parsing ID line: {line}")
-                                self.output_log.append(f"Error: {str(e)}")
-                        
-                        # Parse EX stage
-                        elif line.startswith("EX:"):
-                            try:
-                                # Set valid to true since stage is present
-                                current_snapshot["ex_mem"]["valid"] = True
-                                
-                                # Parse PC value
-                                if "PC =" in line:
-                                    pc_idx = line.find("PC =") + 5
-                                    pc_end = line.find(",", pc_idx)
-                                    if pc_end == -1:
-                                        pc_end = len(line)
-                                    pc_val = line[pc_idx:pc_end].strip()
-                                    try:
-                                        current_snapshot["ex_mem"]["pc"] = int(pc_val, 16)
-                                    except ValueError:
-                                        current_snapshot["ex_mem"]["pc"] = pc_val
-                                
-                                # Parse ALU result
-                                if "ALU Result =" in line:
-                                    result_idx = line.find("ALU Result =") + 12
-                                    result_end = len(line)
-                                    result_val = line[result_idx:result_end].strip()
-                                    try:
-                                        current_snapshot["ex_mem"]["aluResult"] = int(result_val)
-                                    except ValueError:
-                                        current_snapshot["ex_mem"]["aluResult"] = result_val
-                            except Exception as e:
-                                self.output_log.append(f"Error parsing EX line: {line}")
-                                self.output_log.append(f"Error: {str(e)}")
-                        
-                        # Parse MEM stage
-                        elif line.startswith("MEM:"):
-                            try:
-                                # Set valid to true since stage is present
-                                current_snapshot["mem_wb"]["valid"] = True
-                                
-                                # Parse PC value
-                                if "PC =" in line:
-                                    pc_idx = line.find("PC =") + 5
-                                    pc_end = line.find(",", pc_idx)
-                                    if pc_end == -1:
-                                        pc_end = len(line)
-                                    pc_val = line[pc_idx:pc_end].strip()
-                                    try:
-                                        current_snapshot["mem_wb"]["pc"] = int(pc_val, 16)
-                                    except ValueError:
-                                        current_snapshot["mem_wb"]["pc"] = pc_val
-                                
-                                # Parse type as memory data
-                                if "Type =" in line:
-                                    type_idx = line.find("Type =") + 7
-                                    type_end = line.find(",", type_idx)
-                                    if type_end == -1:
-                                        type_end = len(line)
-                                    current_snapshot["mem_wb"]["memData"] = line[type_idx:type_end].strip()
-                            except Exception as e:
-                                self.output_log.append(f"Error parsing MEM line: {line}")
-                                self.output_log.append(f"Error: {str(e)}")
-                                
-                        # Parse WB stage
-                        elif line.startswith("WB:"):
-                            try:
-                                # Extract PC value
-                                if "PC =" in line:
-                                    pc_idx = line.find("PC =") + 5
-                                    pc_end = line.find(",", pc_idx)
-                                    if pc_end == -1:
-                                        pc_end = len(line)
-                                    pc_val = line[pc_idx:pc_end].strip()
-                                    try:
-                                        pc = int(pc_val, 16)
-                                        # Store in a WB field that the visualizer can access
-                                        current_snapshot["wb_pc"] = pc
-                                        current_snapshot["wb_valid"] = True
-                                    except ValueError:
-                                        pass
-                                        
-                                # Extract register write information
-                                if "Writing to" in line:
-                                    # Get destination register and value
-                                    writing_idx = line.find("Writing to") + 11
-                                    reg_idx = line.find("x", writing_idx)
-                                    equals_idx = line.find("=", writing_idx)
-                                    
-                                    if equals_idx != -1 and reg_idx != -1 and reg_idx < equals_idx:
-                                        value_str = line[equals_idx+1:].strip()
-                                        try:
-                                            # Store in a WB field that the visualizer can access
-                                            current_snapshot["wb_result"] = int(value_str)
-                                        except ValueError:
-                                            current_snapshot["wb_result"] = value_str
-                            except Exception as e:
-                                self.output_log.append(f"Error parsing WB line: {line}")
-                                self.output_log.append(f"Error: {str(e)}")
                 
-                self.output_log.append(f"Parsed {cycle_count} cycles, created {len(self.snapshots)} snapshots")
+                self.snapshots = self.parse_snapshot_lines(lines)
+                self.output_log.append(f"Parsed {len(self.snapshots)} cycles, created {len(self.snapshots)} snapshots")
                 
                 if self.snapshots:
-                    self.current_snapshot_index = 0
-                    self.cycle_slider.setMinimum(0)
-                    self.cycle_slider.setMaximum(len(self.snapshots) - 1)
-                    self.cycle_slider.setValue(0)
-                    self.cycle_slider.setEnabled(True)
-                    self.prev_button.setEnabled(False)
-                    self.next_button.setEnabled(len(self.snapshots) > 1)
-                    
-                    # Update display with the first snapshot
-                    self.update_snapshot_display()
-                    
+                    self.show_snapshot(0)
                     self.output_log.append(f"Loaded {len(self.snapshots)} snapshots from cycle_snapshots.log.")
                 else:
                     self.output_log.append("No snapshots were parsed from the file.")
@@ -1480,6 +1313,228 @@ class SimulatorGUI(QMainWindow):
         else:
             self.output_log.append("No cycle_snapshots.log file found.")
     
+    def show_snapshot(self, index):
+        """Point the cycle slider at snapshot `index` and display it"""
+        self.current_snapshot_index = index
+        self.cycle_slider.setMinimum(0)
+        self.cycle_slider.setMaximum(len(self.snapshots) - 1)
+        self.cycle_slider.setValue(index)
+        self.cycle_slider.setEnabled(True)
+        self.prev_button.setEnabled(index > 0)
+        self.next_button.setEnabled(index < len(self.snapshots) - 1)
+        
+        # Update display with the selected snapshot
+        self.update_snapshot_display()
+    
+    def parse_snapshot_lines(self, lines):
+        """Parse cycle_snapshots.log-format lines into snapshot dicts"""
+        snapshots = []
+        current_snapshot = None
+        cycle_count = 0
+        
+        for line in lines:
+            line = line.strip()
+            
+            # Skip empty lines
+            if not line:
+                continue
+                
+            # Skip separator lines
+            if line.startswith("---"):
+                continue
+            
+            # Check if this is a cycle indicator line
+            if "Cycle" in line and "Pipeline State" in line:
+                try:
+                    # Extract cycle number
+                    parts = line.split()
+                    cycle_num = int(parts[1])
+                    
+                    # Create new snapshot
+                    current_snapshot = {
+                        "clockCycles": cycle_num,
+                        "if_id": {"valid": False},
+                        "id_ex": {"valid": False},
+                        "ex_mem": {"valid": False},
+                        "mem_wb": {"valid": False}
+                    }
+                    snapshots.append(current_snapshot)
+                    cycle_count += 1
+                except Exception as e:
+                    self.output_log.append(f"Error parsing cycle line: {line}")
+                    self.output_log.append(f"Error: {str(e)}")
+                continue
+            
+            # Skip if no current snapshot
+            if current_snapshot is None:
+                continue
+                
+            # Parse IF stage
+            if line.startswith("IF:"):
+                try:
+                    # Set valid to true since stage is present
+                    current_snapshot["if_id"]["valid"] = True
+                    
+                    # Parse PC value
+                    if "PC =" in line:
+                        pc_idx = line.find("PC =") + 5
+                        pc_end = line.find(",", pc_idx)
+                        if pc_end == -1:
+                            pc_end = len(line)
+                        pc_val = line[pc_idx:pc_end].strip()
+                        try:
+                            current_snapshot["if_id"]["pc"] = int(pc_val, 16)
+                        except ValueError:
+                            current_snapshot["if_id"]["pc"] = pc_val
+                    
+                    # Parse instruction
+                    if "Instruction =" in line:
+                        inst_idx = line.find("Instruction =") + 13
+                        inst_end = len(line)
+                        inst_val = line[inst_idx:inst_end].strip()
+                        try:
+                            current_snapshot["if_id"]["instruction"] = int(inst_val, 16)
+                        except ValueError:
+                            current_snapshot["if_id"]["instruction"] = inst_val
+                except Exception as e:
+                    self.output_log.append(f"Error parsing IF line: {line}")
+                    self.output_log.append(f"Error: {str(e)}")
+            
+            # Parse ID stage
+            elif line.startswith("ID:"):
+                try:
+                    # Set valid to true since stage is present
+                    current_snapshot["id_ex"]["valid"] = True
+                    
+                    # Parse PC value
+                    if "PC =" in line:
+                        pc_idx = line.find("PC =") + 5
+                        pc_end = line.find(",", pc_idx)
+                        if pc_end == -1:
+                            pc_end = len(line)
+                        pc_val = line[pc_idx:pc_end].strip()
+                        try:
+                            current_snapshot["id_ex"]["pc"] = int(pc_val, 16)
+                        except ValueError:
+                            current_snapshot["id_ex"]["pc"] = pc_val
+                    
+                    # Parse instruction type
+                    if "Type =" in line:
+                        type_idx = line.find("Type =") + 7
+                        type_end = line.find(",", type_idx)
+                        if type_end == -1:
+                            type_end = len(line)
+                        current_snapshot["id_ex"]["instType"] = line[type_idx:type_end].strip()
+                    
+                    # Parse instruction subtype
+                    if "Subtype =" in line:
+                        subtype_idx = line.find("Subtype =") + 10
+                        subtype_end = line.find(",", subtype_idx)
+                        if subtype_end == -1:
+                            subtype_end = len(line)
+                        current_snapshot["id_ex"]["subType"] = line[subtype_idx:subtype_end].strip()
+                except Exception as e:
+                    self.output_log.append(f"Error parsing ID line: {line}")
+                    self.output_log.append(f"Error: {str(e)}")
+            
+            # Parse EX stage
+            elif line.startswith("EX:"):
+                try:
+                    # Set valid to true since stage is present
+                    current_snapshot["ex_mem"]["valid"] = True
+                    
+                    # Parse PC value
+                    if "PC =" in line:
+                        pc_idx = line.find("PC =") + 5
+                        pc_end = line.find(",", pc_idx)
+                        if pc_end == -1:
+                            pc_end = len(line)
+                        pc_val = line[pc_idx:pc_end].strip()
+                        try:
+                            current_snapshot["ex_mem"]["pc"] = int(pc_val, 16)
+                        except ValueError:
+                            current_snapshot["ex_mem"]["pc"] = pc_val
+                    
+                    # Parse ALU result
+                    if "ALU Result =" in line:
+                        result_idx = line.find("ALU Result =") + 12
+                        result_end = len(line)
+                        result_val = line[result_idx:result_end].strip()
+                        try:
+                            current_snapshot["ex_mem"]["aluResult"] = int(result_val)
+                        except ValueError:
+                            current_snapshot["ex_mem"]["aluResult"] = result_val
+                except Exception as e:
+                    self.output_log.append(f"Error parsing EX line: {line}")
+                    self.output_log.append(f"Error: {str(e)}")
+            
+            # Parse MEM stage
+            elif line.startswith("MEM:"):
+                try:
+                    # Set valid to true since stage is present
+                    current_snapshot["mem_wb"]["valid"] = True
+                    
+                    # Parse PC value
+                    if "PC =" in line:
+                        pc_idx = line.find("PC =") + 5
+                        pc_end = line.find(",", pc_idx)
+                        if pc_end == -1:
+                            pc_end = len(line)
+                        pc_val = line[pc_idx:pc_end].strip()
+                        try:
+                            current_snapshot["mem_wb"]["pc"] = int(pc_val, 16)
+                        except ValueError:
+                            current_snapshot["mem_wb"]["pc"] = pc_val
+                    
+                    # Parse type as memory data
+                    if "Type =" in line:
+                        type_idx = line.find("Type =") + 7
+                        type_end = line.find(",", type_idx)
+                        if type_end == -1:
+                            type_end = len(line)
+                        current_snapshot["mem_wb"]["memData"] = line[type_idx:type_end].strip()
+                except Exception as e:
+                    self.output_log.append(f"Error parsing MEM line: {line}")
+                    self.output_log.append(f"Error: {str(e)}")
+                    
+            # Parse WB stage
+            elif line.startswith("WB:"):
+                try:
+                    # Extract PC value
+                    if "PC =" in line:
+                        pc_idx = line.find("PC =") + 5
+                        pc_end = line.find(",", pc_idx)
+                        if pc_end == -1:
+                            pc_end = len(line)
+                        pc_val = line[pc_idx:pc_end].strip()
+                        try:
+                            pc = int(pc_val, 16)
+                            # Store in a WB field that the visualizer can access
+                            current_snapshot["wb_pc"] = pc
+                            current_snapshot["wb_valid"] = True
+                        except ValueError:
+                            pass
+                            
+                    # Extract register write information
+                    if "Writing to" in line:
+                        # Get destination register and value
+                        writing_idx = line.find("Writing to") + 11
+                        reg_idx = line.find("x", writing_idx)
+                        equals_idx = line.find("=", writing_idx)
+                        
+                        if equals_idx != -1 and reg_idx != -1 and reg_idx < equals_idx:
+                            value_str = line[equals_idx+1:].strip()
+                            try:
+                                # Store in a WB field that the visualizer can access
+                                current_snapshot["wb_result"] = int(value_str)
+                            except ValueError:
+                                current_snapshot["wb_result"] = value_str
+                except Exception as e:
+                    self.output_log.append(f"Error parsing WB line: {line}")
+                    self.output_log.append(f"Error: {str(e)}")
+        
+        return snapshots
+    
     def clear_results(self):
         """Clear all displayed results"""
         self.stats_table.setRowCount(0)
@@ -2004,6 +2059,9 @@ class SimulatorGUI(QMainWindow):
             self.clear_results()
             self.current_step = 0
             self.output_log.append(f"Starting step-by-step simulation with input file: {selected_file}")
+            if self.sim_server is not None:
+                self.sim_server.close()
+                self.sim_server = None
             
             # Clear any existing cycle_snapshots.log file to avoid confusion with old data
             snapshots_path = os.path.join(self.base_dir, "cycle_snapshots.log")
@@ -2039,6 +2097,11 @@ class SimulatorGUI(QMainWindow):
                 except ValueError:
                     self.output_log.append(f"Warning: Invalid PC value: {self.trace_pc_input.text()}")
         
+        # The pipelined simulator stays resident; each step is one command round trip
+        if self.pipelining_checkbox.isChecked():
+            self.serve_step(input_path, trace_inst_num, trace_inst_pc)
+            return
+        
         # Log the state of the pipeline print checkbox
         pipeline_print = self.print_pipeline_checkbox.isChecked()
         self.output_log.append(f"Print Pipeline Registers: {'Enabled' if pipeline_print else 'Disabled'}")
@@ -2063,6 +2126,42 @@ class SimulatorGUI(QMainWindow):
         self.sim_thread.finished.connect(self.step_finished)
         self.sim_thread.start()
     
+    def serve_step(self, input_path, trace_inst_num, trace_inst_pc):
+        """Advance the resident --serve simulator by one cycle"""
+        try:
+            if self.sim_server is None:
+                trace_args = None
+                if self.trace_inst_checkbox.isChecked():
+                    if trace_inst_num is not None:
+                        trace_args = ["--trace", str(trace_inst_num)]
+                    elif trace_inst_pc is not None:
+                        trace_args = ["--trace", hex(trace_inst_pc)]
+                self.sim_server = SimulatorServer(self.executable_path, input_path,
+                                                  forwarding=self.forwarding_checkbox.isChecked(),
+                                                  trace_args=trace_args)
+                self.output_log.append(f"Started simulator server: {' '.join(self.sim_server.cmd)}")
+            
+            status = self.sim_server.status(self.sim_server.command("step 1"))
+            self.sim_server.command("dump")
+            cycle = int(status["cycle"])
+            self.output_log.append(f"Step {self.current_step} completed (cycle {cycle}, PC {status['pc']})")
+            
+            self.snapshots.extend(self.parse_snapshot_lines(self.sim_server.snapshot_lines(cycle)))
+            self.load_results(self.base_dir)
+            if self.snapshots:
+                self.show_snapshot(len(self.snapshots) - 1)
+            if status["finished"] == "1":
+                self.output_log.append("Program finished.")
+            
+            self.step_mode_checkbox.setChecked(True)
+        except Exception as e:
+            self.output_log.append(f"Step failed: {str(e)}")
+            if self.sim_server is not None:
+                self.sim_server.close()
+                self.sim_server = None
+            self.current_step = 0
+        self.progress_bar.hide()
+    
     def step_finished(self, success, message):
         """Handle completion of a single step"""
         self.progress_bar.hide()
@@ -0,0 +1,337 @@
+// Parallel batch runner: many (program, knobs) jobs on a work-stealing pool.
+#include "batch.h"
+#include "fanout.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+//------------------------------------------------------
+// Work-Stealing Thread Pool
+//------------------------------------------------------
+WorkStealingPool::WorkStealingPool(unsigned int threads)
+    : queues(threads > 0 ? threads : 1) {
+}
+
+unsigned int WorkStealingPool::default_threads() {
+    unsigned int n = thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Own deque first (front), then steal from the back of the others
+bool WorkStealingPool::next_task(unsigned int worker, size_t &task) {
+    for (size_t i = 0; i < queues.size(); i++) {
+        TaskQueue &q = queues[(worker + i) % queues.size()];
+        lock_guard<mutex> guard(q.lock);
+        if (q.tasks.empty())
+            continue;
+        if (i == 0) {
+            task = q.tasks.front();
+            q.tasks.pop_front();
+        } else {
+            task = q.tasks.back();
+            q.tasks.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::work(unsigned int worker, TaskFunc func, void *context) {
+    size_t task;
+    while (next_task(worker, task))
+        func(context, task, worker);
+}
+
+void WorkStealingPool::run(size_t count, TaskFunc func, void *context) {
+    for (size_t t = 0; t < count; t++)
+        queues[t % queues.size()].tasks.push_back(t);
+
+    // The calling thread is worker 0
+    vector<thread> workers;
+    for (unsigned int w = 1; w < queues.size(); w++)
+        workers.push_back(thread(&WorkStealingPool::work, this, w, func, context));
+    work(0, func, context);
+    for (size_t w = 0; w < workers.size(); w++)
+        workers[w].join();
+}
+
+//------------------------------------------------------
+// Job File
+//------------------------------------------------------
+// Command line for one job, as parseCommandLineArgs() expects it
+static vector<string> job_arguments(const BatchJob &job) {
+    vector<string> args;
+    args.push_back("risc_v_simulator");
+    args.push_back("--input");
+    args.push_back(job.program);
+    args.insert(args.end(), job.options.begin(), job.options.end());
+    return args;
+}
+
+void parse_job_options(Simulator &sim, const BatchJob &job) {
+    vector<string> args = job_arguments(job);
+    vector<char *> argv;
+    for (size_t i = 0; i < args.size(); i++)
+        argv.push_back(&args[i][0]);
+    sim.parseCommandLineArgs((int)argv.size(), argv.data());
+}
+
+// Reject bad options now, on the main thread, rather than mid-batch.
+// `where` locates the job in error messages.
+bool check_batch_job(const BatchJob &job, const string &where) {
+    Simulator probe(NULL);
+    parse_job_options(probe, job);
+    const KnobSettings &knobs = probe.knobs;
+    if (!knobs.unknownOptions.empty()) {
+        cerr << "Error: " << where << ": unknown option " << knobs.unknownOptions[0] << "." << endl;
+        return false;
+    }
+    if (knobs.stepMode || knobs.serveMode || !knobs.batchFile.empty() || !knobs.sweepFile.empty() ||
+        !knobs.fanoutFile.empty()) {
+        cerr << "Error: " << where << ": step, serve, batch, sweep and fanout options can't be used in a batch job." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool load_batch_jobs(const string &jobFile, vector<BatchJob> &jobs) {
+    ifstream infile(jobFile);
+    if (!infile.is_open()) {
+        cerr << "Error: Could not open batch job file: " << jobFile << endl;
+        return false;
+    }
+    string line;
+    unsigned int lineNum = 0;
+    while (getline(infile, line)) {
+        lineNum++;
+        stringstream ss(line);
+        BatchJob job;
+        job.line = lineNum;
+        if (!(ss >> job.program) || job.program[0] == '#')
+            continue;
+        string option;
+        while (ss >> option)
+            job.options.push_back(option);
+
+        stringstream where;
+        where << jobFile << ":" << lineNum;
+        if (!check_batch_job(job, where.str()))
+            return false;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+//------------------------------------------------------
+// Running One Job
+//------------------------------------------------------
+// Status and statistics of a finished pipelined run
+void fill_pipeline_result(const Simulator &sim, RunResult run, BatchResult &result) {
+    if (run == RUN_DEBUG_STOP)
+        result.status = "breakpoint";
+    else if (run != RUN_PROGRAM_FINISHED)
+        result.status = "cycle-cap";
+    const PipelineStatistics &stats = sim.stats;
+    result.cycles = stats.totalCycles;
+    result.instructions = stats.instructionsExecuted;
+    result.CPI = (stats.instructionsExecuted > 0) ?
+                 (double)sim.clockCycles / stats.instructionsExecuted : 0.0;
+    result.totalStalls = stats.totalStalls;
+    result.dataHazardStalls = stats.dataHazardStalls;
+    result.controlHazardStalls = stats.controlHazardStalls;
+    result.branchMispredictions = stats.branchMispredCount;
+    result.btbHits = stats.btbHits;
+    result.btbMisses = stats.btbMisses;
+}
+
+// Same run as a continuous command-line invocation, minus the console log
+// and the output files.
+void run_batch_job(const BatchJob &job, BatchResult &result) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Simulator sim(NULL);
+    parse_job_options(sim, job);
+    const KnobSettings &knobs = sim.knobs;
+
+    result.status = "ok";
+    result.pipelined = knobs.pipeliningEnabled;
+    result.cycles = 0;
+    result.instructions = 0;
+    result.CPI = 0.0;
+    result.totalStalls = 0;
+    result.dataHazardStalls = 0;
+    result.controlHazardStalls = 0;
+    result.branchMispredictions = 0;
+    result.btbHits = 0;
+    result.btbMisses = 0;
+
+    if (!knobs.pipeliningEnabled) {
+        FunctionalCore &core = sim.functionalCore;
+        core.reset_proc_np();
+        core.set_jit_np(knobs.jitEnabled);
+        if (!core.load_program_memory_np(knobs.inputFile, false)) {
+            result.status = "load-error";
+        } else {
+            core.run_functional_np(0xFFFFFFFF - core.clockCycles_np);
+            result.cycles = core.clockCycles_np;
+            result.instructions = core.clockCycles_np;
+            result.CPI = 1.0;
+        }
+    } else if (!sim.guestMem.reserve()) {
+        result.status = "load-error";
+    } else {
+        sim.reset_simulator();
+        if (!sim.loadInputFile(knobs.inputFile)) {
+            result.status = "load-error";
+        } else {
+            sim.apply_fast_forward();
+            RunResult run = knobs.decoupled ? run_decoupled(sim) : sim.runUntil(RUN_TO_CYCLE, MAX_SIMULATION_CYCLES + 1);
+            fill_pipeline_result(sim, run, result);
+        }
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+//------------------------------------------------------
+// Results Table (CSV, or JSON for a .json path)
+//------------------------------------------------------
+string job_options_text(const BatchJob &job) {
+    string text;
+    for (size_t i = 0; i < job.options.size(); i++)
+        text += (i ? " " : "") + job.options[i];
+    return text;
+}
+
+string csv_quote(const string &s) {
+    string out = "\"";
+    for (size_t i = 0; i < s.size(); i++)
+        out += (s[i] == '"') ? string("\"\"") : string(1, s[i]);
+    return out + "\"";
+}
+
+string json_quote(const string &s) {
+    string out = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\')
+            out += '\\';
+        out += s[i];
+    }
+    return out + "\"";
+}
+
+bool write_batch_results(const string &path, const vector<BatchJob> &jobs, const vector<BatchResult> &results) {
+    ofstream out(path);
+    if (!out.is_open()) {
+        cerr << "Error: Could not open " << path << " for writing." << endl;
+        return false;
+    }
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    out << fixed;
+    if (json)
+        out << "[" << endl;
+    else
+        out << "job,line,program,options,mode,status,cycles,instructions,cpi,stalls,"
+               "data_hazard_stalls,control_hazard_stalls,branch_mispredictions,btb_hits,btb_misses,seconds,worker" << endl;
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchJob &job = jobs[i];
+        const BatchResult &r = results[i];
+        const char *mode = r.pipelined ? "pipelined" : "non-pipelined";
+        if (json) {
+            out << "  {\"job\": " << i << ", \"line\": " << job.line
+                << ", \"program\": " << json_quote(job.program)
+                << ", \"options\": " << json_quote(job_options_text(job))
+                << ", \"mode\": \"" << mode << "\", \"status\": \"" << r.status << "\""
+                << ", \"cycles\": " << r.cycles << ", \"instructions\": " << r.instructions
+                << ", \"cpi\": " << setprecision(4) << r.CPI
+                << ", \"stalls\": " << r.totalStalls
+                << ", \"data_hazard_stalls\": " << r.dataHazardStalls
+                << ", \"control_hazard_stalls\": " << r.controlHazardStalls
+                << ", \"branch_mispredictions\": " << r.branchMispredictions
+                << ", \"btb_hits\": " << r.btbHits << ", \"btb_misses\": " << r.btbMisses
+                << ", \"seconds\": " << setprecision(6) << r.seconds
+                << ", \"worker\": " << r.worker << "}"
+                << (i + 1 < jobs.size() ? "," : "") << endl;
+        } else {
+            out << i << "," << job.line << "," << csv_quote(job.program) << ","
+                << csv_quote(job_options_text(job)) << "," << mode << "," << r.status << ","
+                << r.cycles << "," << r.instructions << "," << setprecision(4) << r.CPI << ","
+                << r.totalStalls << "," << r.dataHazardStalls << "," << r.controlHazardStalls << ","
+                << r.branchMispredictions << "," << r.btbHits << "," << r.btbMisses << ","
+                << setprecision(6) << r.seconds << ","
+                << r.worker << endl;
+        }
+    }
+    if (json)
+        out << "]" << endl;
+    return out.good();
+}
+
+//------------------------------------------------------
+// Batch Driver
+//------------------------------------------------------
+struct BatchRun {
+    const vector<BatchJob> *jobs;
+    vector<BatchResult> *results;
+};
+
+static void batch_task(void *context, size_t task, unsigned int worker) {
+    BatchRun *run = static_cast<BatchRun *>(context);
+    BatchResult &result = (*run->results)[task];
+    run_batch_job((*run->jobs)[task], result);
+    result.worker = worker;
+}
+
+// Pool size: --jobs, else one per hardware thread, never more than the jobs
+unsigned int batch_threads(const KnobSettings &knobs, size_t jobCount) {
+    unsigned int threads = knobs.batchThreads ? knobs.batchThreads : WorkStealingPool::default_threads();
+    return threads > jobCount ? (unsigned int)jobCount : threads;
+}
+
+void run_batch_jobs(const vector<BatchJob> &jobs, vector<BatchResult> &results, unsigned int threads) {
+    results.assign(jobs.size(), BatchResult());
+    BatchRun run = {&jobs, &results};
+    WorkStealingPool pool(threads);
+    pool.run(jobs.size(), batch_task, &run);
+}
+
+int run_batch(const KnobSettings &knobs, ostream &console) {
+    vector<BatchJob> jobs;
+    if (!load_batch_jobs(knobs.batchFile, jobs))
+        return 1;
+    if (jobs.empty()) {
+        cerr << "Error: No jobs in " << knobs.batchFile << "." << endl;
+        return 1;
+    }
+
+    unsigned int threads = batch_threads(knobs, jobs.size());
+    console << "Batch mode: " << jobs.size() << " jobs from " << knobs.batchFile
+            << " on " << threads << " threads" << endl;
+
+    vector<BatchResult> results;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    run_batch_jobs(jobs, results, threads);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    unsigned int failed = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchResult &r = results[i];
+        console << "[" << i << "] " << jobs[i].program;
+        if (!jobs[i].options.empty())
+            console << " " << job_options_text(jobs[i]);
+        console << ": " << r.status << ", " << r.cycles << " cycles, "
+                << r.instructions << " instructions, CPI " << fixed << setprecision(2) << r.CPI << endl;
+        console.unsetf(ios::floatfield);
+        if (r.status == "load-error")
+            failed++;
+    }
+    console << "Batch finished in " << fixed << setprecision(3) << seconds << " s" << endl;
+    console.unsetf(ios::floatfield);
+
+    if (!write_batch_results(knobs.batchOutput, jobs, results))
+        return 1;
+    console << "Batch results written to " << knobs.batchOutput << endl;
+    return failed ? 1 : 0;
+}
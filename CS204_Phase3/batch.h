@@ -0,0 +1,90 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "simulator.h"
+
+using namespace std;
+
+//------------------------------------------------------
+// Work-Stealing Thread Pool
+//------------------------------------------------------
+// Runs tasks 0..count-1, each exactly once. Tasks are dealt round-robin onto
+// one deque per worker; a worker takes from the front of its own deque and,
+// once that is empty, steals from the back of the others. No task creates new
+// tasks, so a worker that finds every deque empty is done.
+class WorkStealingPool {
+public:
+    typedef void (*TaskFunc)(void *context, size_t task, unsigned int worker);
+
+    explicit WorkStealingPool(unsigned int threads);
+
+    unsigned int threads() const { return (unsigned int)queues.size(); }
+    void run(size_t count, TaskFunc func, void *context);
+
+    static unsigned int default_threads(); // One per hardware thread
+
+private:
+    struct TaskQueue {
+        mutex lock;
+        deque<size_t> tasks;
+    };
+
+    vector<TaskQueue> queues;
+
+    bool next_task(unsigned int worker, size_t &task);
+    void work(unsigned int worker, TaskFunc func, void *context);
+};
+
+//------------------------------------------------------
+// Batch Jobs (--batch)
+//------------------------------------------------------
+// A job file lists one run per line: a .mc program followed by the same
+// options the command line takes, e.g.
+//     fib.mc
+//     fib.mc --no-forwarding
+//     bubblesort.mc --no-pipeline --jit
+// Blank lines and lines starting with '#' are ignored. Each job runs in its
+// own Simulator with its console log discarded; no job writes
+// stats.out, register.mem or any other file, so jobs can run concurrently.
+struct BatchJob {
+    unsigned int line;              // Line number in the job file
+    string program;
+    vector<string> options;
+};
+
+struct BatchResult {
+    string status;                  // ok, cycle-cap, breakpoint or load-error
+    bool pipelined;
+    unsigned int cycles;
+    unsigned int instructions;
+    double CPI;
+    unsigned int totalStalls;
+    unsigned int dataHazardStalls;
+    unsigned int controlHazardStalls;
+    unsigned int branchMispredictions;
+    unsigned int btbHits;
+    unsigned int btbMisses;
+    double seconds;                 // Wall-clock time of the job
+    unsigned int worker;            // Pool thread that ran it
+};
+
+void parse_job_options(Simulator &sim, const BatchJob &job);
+string job_options_text(const BatchJob &job);
+bool check_batch_job(const BatchJob &job, const string &where);
+bool load_batch_jobs(const string &jobFile, vector<BatchJob> &jobs);
+void fill_pipeline_result(const Simulator &sim, RunResult run, BatchResult &result);
+void run_batch_job(const BatchJob &job, BatchResult &result);
+void run_batch_jobs(const vector<BatchJob> &jobs, vector<BatchResult> &results, unsigned int threads);
+unsigned int batch_threads(const KnobSettings &knobs, size_t jobCount);
+string csv_quote(const string &s);
+string json_quote(const string &s);
+bool write_batch_results(const string &path, const vector<BatchJob> &jobs, const vector<BatchResult> &results);
+int run_batch(const KnobSettings &knobs, ostream &console);
+
+#endif // BATCH_H
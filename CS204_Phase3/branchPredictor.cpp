@@ -0,0 +1,325 @@
+// Branch direction predictors behind the BranchPredictor interface.
+#include "branchPredictor.h"
+
+#include <istream>
+#include <ostream>
+
+using namespace std;
+
+static const char *PREDICTOR_NAMES[] = {"onebit", "static", "bimodal", "gshare", "tournament", "tage"};
+
+bool parse_predictor_kind(const string &name, PredictorKind &kind) {
+    for (unsigned int k = 0; k <= PREDICT_TAGE; k++) {
+        if (name == PREDICTOR_NAMES[k]) {
+            kind = (PredictorKind)k;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *predictor_name(PredictorKind kind) {
+    return PREDICTOR_NAMES[kind];
+}
+
+//------------------------------------------------------
+// Shared Helpers
+//------------------------------------------------------
+// 2-bit saturating counters: 0..1 predict not taken, 2..3 taken
+static inline void train_counter(unsigned char &c, bool taken) {
+    if (taken && c < 3) c++;
+    else if (!taken && c > 0) c--;
+}
+
+// Low `length` bits of the history, XOR-folded down to `bits` bits
+static unsigned int fold_history(unsigned long long history, unsigned int length, unsigned int bits) {
+    if (length < 64)
+        history &= (1ULL << length) - 1;
+    unsigned int folded = 0;
+    for (unsigned int shift = 0; shift < length; shift += bits)
+        folded ^= (unsigned int)(history >> shift);
+    return folded & ((1u << bits) - 1);
+}
+
+static bool write_table(ostream &out, const vector<unsigned char> &table) {
+    out.write(reinterpret_cast<const char*>(table.data()), table.size());
+    return out.good();
+}
+
+static bool read_table(istream &in, vector<unsigned char> &table) {
+    in.read(reinterpret_cast<char*>(table.data()), table.size());
+    return in.good();
+}
+
+//------------------------------------------------------
+// onebit / static
+//------------------------------------------------------
+// The original predictor: one last-outcome bit per BTB entry
+class OneBitPredictor : public BranchPredictor {
+public:
+    PredictorKind kind() const { return PREDICT_ONE_BIT; }
+    void reset(unsigned int btbSlots) { bits.assign(btbSlots, 0); }
+    bool predict(unsigned int, int btbSlot) const { return btbSlot >= 0 && bits[btbSlot]; }
+    void update(unsigned int, int btbSlot, bool taken) {
+        if (btbSlot >= 0)
+            bits[btbSlot] = taken;
+    }
+    bool per_btb_entry() const { return true; }
+    bool save(ostream &out) const { return write_table(out, bits); }
+    bool load(istream &in) { return read_table(in, bits); }
+
+private:
+    vector<unsigned char> bits;
+};
+
+class StaticPredictor : public BranchPredictor {
+public:
+    PredictorKind kind() const { return PREDICT_NOT_TAKEN; }
+    void reset(unsigned int) {}
+    bool predict(unsigned int, int) const { return false; }
+    void update(unsigned int, int, bool) {}
+    bool save(ostream &out) const { return out.good(); }
+    bool load(istream &in) { return in.good(); }
+};
+
+//------------------------------------------------------
+// bimodal / gshare / tournament
+//------------------------------------------------------
+class BimodalPredictor : public BranchPredictor {
+public:
+    explicit BimodalPredictor(unsigned int tableBits) : mask((1u << tableBits) - 1) {}
+
+    PredictorKind kind() const { return PREDICT_BIMODAL; }
+    void reset(unsigned int) { counters.assign(mask + 1, 1); } // Weakly not taken
+    bool predict(unsigned int pc, int) const { return counters[index(pc)] >= 2; }
+    void update(unsigned int pc, int, bool taken) { train_counter(counters[index(pc)], taken); }
+    bool save(ostream &out) const { return write_table(out, counters); }
+    bool load(istream &in) { return read_table(in, counters); }
+
+private:
+    unsigned int index(unsigned int pc) const { return (pc >> 2) & mask; }
+
+    unsigned int mask;
+    vector<unsigned char> counters;
+};
+
+class GsharePredictor : public BranchPredictor {
+public:
+    GsharePredictor(unsigned int tableBits, unsigned int historyBits)
+        : bits(tableBits), length(historyBits), history(0) {}
+
+    PredictorKind kind() const { return PREDICT_GSHARE; }
+    void reset(unsigned int) {
+        counters.assign(1u << bits, 1);
+        history = 0;
+    }
+    bool predict(unsigned int pc, int) const { return counters[index(pc)] >= 2; }
+    void update(unsigned int pc, int, bool taken) {
+        train_counter(counters[index(pc)], taken);
+        history = (history << 1) | (taken ? 1 : 0);
+    }
+    bool save(ostream &out) const {
+        out.write(reinterpret_cast<const char*>(&history), sizeof(history));
+        return write_table(out, counters);
+    }
+    bool load(istream &in) {
+        in.read(reinterpret_cast<char*>(&history), sizeof(history));
+        return read_table(in, counters);
+    }
+
+private:
+    unsigned int index(unsigned int pc) const {
+        return ((pc >> 2) ^ fold_history(history, length, bits)) & ((1u << bits) - 1);
+    }
+
+    unsigned int bits;
+    unsigned int length;
+    unsigned long long history;
+    vector<unsigned char> counters;
+};
+
+// Chooser counters (per PC): 0..1 trust bimodal, 2..3 trust gshare. The
+// chooser only learns from branches where the two components disagree.
+class TournamentPredictor : public BranchPredictor {
+public:
+    TournamentPredictor(unsigned int tableBits, unsigned int historyBits)
+        : local(tableBits), global(tableBits, historyBits), mask((1u << tableBits) - 1) {}
+
+    PredictorKind kind() const { return PREDICT_TOURNAMENT; }
+    void reset(unsigned int btbSlots) {
+        local.reset(btbSlots);
+        global.reset(btbSlots);
+        chooser.assign(mask + 1, 1);
+    }
+    bool predict(unsigned int pc, int btbSlot) const {
+        return chooser[(pc >> 2) & mask] >= 2 ? global.predict(pc, btbSlot) : local.predict(pc, btbSlot);
+    }
+    void update(unsigned int pc, int btbSlot, bool taken) {
+        bool localPred = local.predict(pc, btbSlot);
+        bool globalPred = global.predict(pc, btbSlot);
+        if (localPred != globalPred)
+            train_counter(chooser[(pc >> 2) & mask], globalPred == taken);
+        local.update(pc, btbSlot, taken);
+        global.update(pc, btbSlot, taken);
+    }
+    bool save(ostream &out) const { return local.save(out) && global.save(out) && write_table(out, chooser); }
+    bool load(istream &in) { return local.load(in) && global.load(in) && read_table(in, chooser); }
+
+private:
+    BimodalPredictor local;
+    GsharePredictor global;
+    unsigned int mask;
+    vector<unsigned char> chooser;
+};
+
+//------------------------------------------------------
+// tage
+//------------------------------------------------------
+// A compact TAGE: a bimodal base table and TAGE_TABLES tagged tables with
+// history lengths L/8, L/4, L/2 and L (L = --bp-history). The longest
+// matching table provides the prediction and the next match (or the base)
+// is the alternate. On a misprediction one entry is allocated in a longer
+// table whose useful counter is zero; if there is none, the useful counters
+// of the longer tables decay instead. Every TAGE_USEFUL_PERIOD updates all
+// useful counters are halved so stale entries can be replaced.
+static const unsigned int TAGE_TABLES = 4;
+static const unsigned int TAGE_TAG_BITS = 8;
+static const unsigned int TAGE_USEFUL_PERIOD = 1u << 18;
+
+struct TageEntry {
+    signed char counter;    // 3-bit signed, -4..3: >= 0 predicts taken
+    unsigned char useful;   // 2-bit
+    unsigned short tag;
+};
+
+class TagePredictor : public BranchPredictor {
+public:
+    TagePredictor(unsigned int tableBits, unsigned int historyBits)
+        : base(tableBits), indexBits(tableBits > 1 ? tableBits - 1 : 1), history(0), updates(0) {
+        for (unsigned int t = 0; t < TAGE_TABLES; t++) {
+            unsigned int length = historyBits >> (TAGE_TABLES - 1 - t);
+            lengths[t] = length > 0 ? length : 1;
+        }
+    }
+
+    PredictorKind kind() const { return PREDICT_TAGE; }
+    void reset(unsigned int btbSlots) {
+        base.reset(btbSlots);
+        TageEntry empty = {0, 0, 0xFFFF}; // No 8-bit tag matches
+        for (unsigned int t = 0; t < TAGE_TABLES; t++)
+            tables[t].assign(1u << indexBits, empty);
+        history = 0;
+        updates = 0;
+    }
+
+    bool predict(unsigned int pc, int btbSlot) const {
+        int provider, alternate;
+        find_providers(pc, provider, alternate);
+        return provider >= 0 ? tables[provider][index(pc, provider)].counter >= 0 : base.predict(pc, btbSlot);
+    }
+
+    void update(unsigned int pc, int btbSlot, bool taken) {
+        int provider, alternate;
+        find_providers(pc, provider, alternate);
+        bool altPred = alternate >= 0 ? tables[alternate][index(pc, alternate)].counter >= 0
+                                      : base.predict(pc, btbSlot);
+        bool pred = altPred;
+        if (provider >= 0) {
+            TageEntry &e = tables[provider][index(pc, provider)];
+            pred = e.counter >= 0;
+            if (pred != altPred) {
+                if (pred == taken && e.useful < 3) e.useful++;
+                else if (pred != taken && e.useful > 0) e.useful--;
+            }
+            if (taken && e.counter < 3) e.counter++;
+            else if (!taken && e.counter > -4) e.counter--;
+        } else {
+            base.update(pc, btbSlot, taken);
+        }
+
+        // Allocate in a longer table on a misprediction
+        if (pred != taken) {
+            bool allocated = false;
+            for (unsigned int t = provider + 1; t < TAGE_TABLES && !allocated; t++) {
+                TageEntry &e = tables[t][index(pc, t)];
+                if (e.useful == 0) {
+                    e.counter = taken ? 0 : -1;
+                    e.tag = tag(pc, t);
+                    allocated = true;
+                }
+            }
+            for (unsigned int t = provider + 1; t < TAGE_TABLES && !allocated; t++) {
+                TageEntry &e = tables[t][index(pc, t)];
+                if (e.useful > 0) e.useful--;
+            }
+        }
+        if (++updates % TAGE_USEFUL_PERIOD == 0) {
+            for (unsigned int t = 0; t < TAGE_TABLES; t++) {
+                for (size_t i = 0; i < tables[t].size(); i++)
+                    tables[t][i].useful >>= 1;
+            }
+        }
+        history = (history << 1) | (taken ? 1 : 0);
+    }
+
+    bool save(ostream &out) const {
+        out.write(reinterpret_cast<const char*>(&history), sizeof(history));
+        out.write(reinterpret_cast<const char*>(&updates), sizeof(updates));
+        for (unsigned int t = 0; t < TAGE_TABLES; t++)
+            out.write(reinterpret_cast<const char*>(tables[t].data()), sizeof(TageEntry) * tables[t].size());
+        return base.save(out);
+    }
+    bool load(istream &in) {
+        in.read(reinterpret_cast<char*>(&history), sizeof(history));
+        in.read(reinterpret_cast<char*>(&updates), sizeof(updates));
+        for (unsigned int t = 0; t < TAGE_TABLES; t++)
+            in.read(reinterpret_cast<char*>(tables[t].data()), sizeof(TageEntry) * tables[t].size());
+        return base.load(in);
+    }
+
+private:
+    unsigned int index(unsigned int pc, unsigned int t) const {
+        unsigned int p = pc >> 2;
+        return (p ^ (p >> indexBits) ^ fold_history(history, lengths[t], indexBits)) & ((1u << indexBits) - 1);
+    }
+    unsigned short tag(unsigned int pc, unsigned int t) const {
+        unsigned int h = fold_history(history, lengths[t], TAGE_TAG_BITS) ^
+                         (fold_history(history, lengths[t], TAGE_TAG_BITS - 1) << 1);
+        return (unsigned short)(((pc >> 2) ^ h) & ((1u << TAGE_TAG_BITS) - 1));
+    }
+    // Longest and second-longest tables whose entry matches pc's tag (-1: none)
+    void find_providers(unsigned int pc, int &provider, int &alternate) const {
+        provider = alternate = -1;
+        for (int t = TAGE_TABLES - 1; t >= 0; t--) {
+            if (tables[t][index(pc, t)].tag != tag(pc, t))
+                continue;
+            if (provider < 0) {
+                provider = t;
+            } else {
+                alternate = t;
+                break;
+            }
+        }
+    }
+
+    BimodalPredictor base;
+    unsigned int indexBits;
+    unsigned int lengths[TAGE_TABLES];
+    vector<TageEntry> tables[TAGE_TABLES];
+    unsigned long long history;
+    unsigned int updates;
+};
+
+//------------------------------------------------------
+// Factory
+//------------------------------------------------------
+BranchPredictor *make_branch_predictor(PredictorKind kind, unsigned int tableBits, unsigned int historyBits) {
+    switch (kind) {
+    case PREDICT_NOT_TAKEN:  return new StaticPredictor();
+    case PREDICT_BIMODAL:    return new BimodalPredictor(tableBits);
+    case PREDICT_GSHARE:     return new GsharePredictor(tableBits, historyBits);
+    case PREDICT_TOURNAMENT: return new TournamentPredictor(tableBits, historyBits);
+    case PREDICT_TAGE:       return new TagePredictor(tableBits, historyBits);
+    default:                 return new OneBitPredictor();
+    }
+}
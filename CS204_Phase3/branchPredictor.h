@@ -0,0 +1,59 @@
+#ifndef BRANCH_PREDICTOR_H
+#define BRANCH_PREDICTOR_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Direction predictor (--predictor)
+enum PredictorKind {
+    PREDICT_ONE_BIT,    // onebit: per-entry last outcome, BTB supplies the target
+    PREDICT_NOT_TAKEN,  // static: always fall through, every taken branch/jump is a miss
+    PREDICT_BIMODAL,    // bimodal: 2-bit saturating counters indexed by PC
+    PREDICT_GSHARE,     // gshare: 2-bit counters indexed by PC xor global history
+    PREDICT_TOURNAMENT, // tournament: bimodal and gshare with a per-PC chooser
+    PREDICT_TAGE        // tage: bimodal base plus four tagged, geometric-history tables
+};
+
+const unsigned int DEFAULT_PREDICTOR_TABLE_BITS = 10;  // --bp-table-bits: 1K counters
+const unsigned int MAX_PREDICTOR_TABLE_BITS = 20;
+const unsigned int DEFAULT_PREDICTOR_HISTORY = 16;     // --bp-history: global history length
+const unsigned int MAX_PREDICTOR_HISTORY = 64;
+
+bool parse_predictor_kind(const std::string &name, PredictorKind &kind);
+const char *predictor_name(PredictorKind kind);
+
+//------------------------------------------------------
+// Branch Direction Predictor Interface
+//------------------------------------------------------
+// Predicts taken/not-taken for conditional branches; the BTB supplies the
+// target, so fetch only redirects when both agree. predict() has no side
+// effects and is called at fetch; update() trains with the resolved
+// direction in EX. Global history is therefore updated at resolution
+// (non-speculatively), which keeps every run deterministic and needs no
+// history repair on a flush.
+class BranchPredictor {
+public:
+    virtual ~BranchPredictor() {}
+
+    virtual PredictorKind kind() const = 0;
+
+    // Fresh tables; btbSlots sizes a predictor whose state lives in the BTB entries
+    virtual void reset(unsigned int btbSlots) = 0;
+
+    // Direction for the branch at pc; btbSlot is its BTB entry, or -1 on a miss
+    virtual bool predict(unsigned int pc, int btbSlot) const = 0;
+    virtual void update(unsigned int pc, int btbSlot, bool taken) = 0;
+
+    // True when the state is part of each BTB entry: the entry is rewritten
+    // on every misprediction and jumps train it too (onebit)
+    virtual bool per_btb_entry() const { return false; }
+
+    virtual bool save(std::ostream &out) const = 0;
+    virtual bool load(std::istream &in) = 0;
+};
+
+// tableBits: log2 of the counter tables; historyBits: global history length
+BranchPredictor *make_branch_predictor(PredictorKind kind, unsigned int tableBits, unsigned int historyBits);
+
+#endif // BRANCH_PREDICTOR_H
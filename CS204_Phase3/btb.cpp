@@ -0,0 +1,85 @@
+#include "btb.h"
+
+#include <istream>
+#include <ostream>
+
+void BranchTargetBuffer::configure(unsigned int numSets, unsigned int numWays, unsigned int numTagBits,
+                                   ReplacementPolicy policy) {
+    sets = numSets;
+    ways = numWays;
+    tagBits = numTagBits;
+    entries.resize(sets * ways);
+    replacer.configure(sets, ways, policy);
+    clear();
+}
+
+void BranchTargetBuffer::clear() {
+    BTBEntry empty = {false, 0, 0, 0};
+    entries.assign(entries.size(), empty);
+    replacer.clear();
+}
+
+unsigned int BranchTargetBuffer::tag_of(unsigned int pc) const {
+    unsigned int tag = (pc / 4) / sets;
+    return (tagBits == 0 || tagBits >= 32) ? tag : (tag & ((1u << tagBits) - 1));
+}
+
+int BranchTargetBuffer::find(unsigned int pc) const {
+    unsigned int base = set_of(pc) * ways;
+    unsigned int tag = tag_of(pc);
+    for (unsigned int w = 0; w < ways; w++) {
+        const BTBEntry &e = entries[base + w];
+        if (e.valid && e.tag == tag)
+            return (int)(base + w);
+    }
+    return -1;
+}
+
+unsigned int BranchTargetBuffer::allocate(unsigned int pc) {
+    int hit = find(pc);
+    unsigned int base = set_of(pc) * ways;
+    unsigned int slot = base;
+    if (hit >= 0) {
+        slot = (unsigned int)hit;
+    } else {
+        unsigned int w = 0;
+        while (w < ways && entries[base + w].valid)
+            w++;
+        if (w < ways) {
+            slot = base + w;
+        } else {
+            slot = replacer.victim(base / ways);
+        }
+    }
+    touch(slot);
+    return slot;
+}
+
+//------------------------------------------------------
+// State File Section
+//------------------------------------------------------
+bool BranchTargetBuffer::save(std::ostream &out) const {
+    unsigned int policy = replacer.policy;
+    out.write(reinterpret_cast<const char*>(&sets), sizeof(sets));
+    out.write(reinterpret_cast<const char*>(&ways), sizeof(ways));
+    out.write(reinterpret_cast<const char*>(&tagBits), sizeof(tagBits));
+    out.write(reinterpret_cast<const char*>(&policy), sizeof(policy));
+    out.write(reinterpret_cast<const char*>(entries.data()), sizeof(BTBEntry) * entries.size());
+    replacer.save(out);
+    return out.good();
+}
+
+bool BranchTargetBuffer::load(std::istream &in) {
+    unsigned int numSets = 0, numWays = 0, numTagBits = 0, policy = 0;
+    in.read(reinterpret_cast<char*>(&numSets), sizeof(numSets));
+    in.read(reinterpret_cast<char*>(&numWays), sizeof(numWays));
+    in.read(reinterpret_cast<char*>(&numTagBits), sizeof(numTagBits));
+    in.read(reinterpret_cast<char*>(&policy), sizeof(policy));
+    if (!in || numSets == 0 || numWays == 0 || numWays > MAX_BTB_WAYS ||
+        numSets * numWays > MAX_BTB_SIZE || numTagBits > 32 || policy > REPLACE_RANDOM)
+        return false;
+    configure(numSets, numWays, numTagBits, (ReplacementPolicy)policy);
+    in.read(reinterpret_cast<char*>(entries.data()), sizeof(BTBEntry) * entries.size());
+    replacer.load(in);
+    return in.good();
+}
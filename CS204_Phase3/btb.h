@@ -0,0 +1,54 @@
+#ifndef BTB_H
+#define BTB_H
+
+#include <iosfwd>
+#include <vector>
+
+#include "replacement.h"
+
+const unsigned int BTB_SIZE = 16;      // Default BTB/PHT entries (--btb-entries)
+const unsigned int MAX_BTB_SIZE = 1u << 20;
+const unsigned int MAX_BTB_WAYS = 64;
+
+struct BTBEntry {
+    bool valid;
+    unsigned int branchPC;  // PC of the branch instruction
+    unsigned int targetPC;  // Predicted target if taken
+    unsigned int tag;       // Stored tag (branchPC above the set index, --btb-tag-bits wide)
+};
+
+//------------------------------------------------------
+// Set-Associative Branch Target Buffer
+//------------------------------------------------------
+// sets * ways entries, set-major: entry (set, way) is slot set * ways + way,
+// and the set of a branch is (pc / 4) % sets. With tagBits == 0 the full
+// branch PC is compared; otherwise only the low tagBits bits of
+// (pc / 4) / sets are kept, so distinct branches can alias. A slot number is
+// stable for the life of a configuration, so per-entry side tables (the
+// simulator's PHT) index by it. The default 16 x 1 full-tag buffer behaves
+// exactly like the original direct-mapped array.
+struct BranchTargetBuffer {
+    std::vector<BTBEntry> entries;
+    ReplacementState replacer;
+    unsigned int sets;
+    unsigned int ways;
+    unsigned int tagBits;                       // 0: full tags
+
+    BranchTargetBuffer() : sets(0), ways(0), tagBits(0) {}
+
+    void configure(unsigned int sets, unsigned int ways, unsigned int tagBits, ReplacementPolicy replacement);
+    void clear();           // Invalidate every entry and reset the replacement state
+
+    unsigned int size() const { return (unsigned int)entries.size(); }
+    unsigned int set_of(unsigned int pc) const { return (pc / 4) % sets; }
+    unsigned int tag_of(unsigned int pc) const;
+
+    int find(unsigned int pc) const;            // Slot holding pc's tag, or -1; no side effects
+    void touch(unsigned int slot) { replacer.touch(slot); } // Record a use for the replacement policy
+    unsigned int allocate(unsigned int pc);     // Slot to (re)fill for pc: its own, a free one or the victim
+
+    bool save(std::ostream &out) const;         // Geometry, entries and replacement state
+    bool load(std::istream &in);
+};
+
+#endif // BTB_H
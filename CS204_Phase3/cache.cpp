@@ -0,0 +1,141 @@
+#include "cache.h"
+
+#include <istream>
+#include <ostream>
+
+static bool is_power_of_two(unsigned int n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+const char *cache_config_error(const CacheConfig &config) {
+    if (config.size > MAX_CACHE_SIZE)
+        return "size is larger than 16 MB";
+    if (config.ways == 0 || config.ways > MAX_CACHE_WAYS)
+        return "needs between 1 and 64 ways";
+    if (!is_power_of_two(config.lineSize) || config.lineSize < 4)
+        return "line size must be a power of two of at least 4 bytes";
+    if (config.size % (config.ways * config.lineSize) != 0)
+        return "size must be a multiple of ways * line size";
+    if (config.replacement == REPLACE_PLRU && !is_power_of_two(config.ways))
+        return "plru replacement needs a power-of-two number of ways";
+    if (config.hitLatency == 0 || config.hitLatency > MAX_CACHE_LATENCY || config.missPenalty > MAX_CACHE_LATENCY)
+        return "hit latency must be 1 or more, and latencies at most 10000 cycles";
+    if (config.mshrs > MAX_CACHE_MSHRS)
+        return "needs at most 32 MSHRs";
+    return NULL;
+}
+
+void Cache::configure(const CacheConfig &cacheConfig) {
+    config = cacheConfig;
+    sets = config.size / (config.ways * config.lineSize);
+    lines.resize(sets * config.ways);
+    replacer.configure(sets, config.ways, config.replacement);
+    clear();
+}
+
+void Cache::clear() {
+    CacheLine empty = {false, false, false, 0};
+    lines.assign(lines.size(), empty);
+    replacer.clear();
+}
+
+bool Cache::contains(unsigned int address) const {
+    unsigned int lineAddress = address / config.lineSize;
+    unsigned int base = (lineAddress % sets) * config.ways;
+    for (unsigned int w = 0; w < config.ways; w++) {
+        if (lines[base + w].valid && lines[base + w].tag == lineAddress / sets)
+            return true;
+    }
+    return false;
+}
+
+CacheOutcome Cache::access(unsigned int address, bool write, CacheStats &counters) {
+    CacheOutcome outcome = {false, false, write && !config.writeBack, false, 0};
+    unsigned int lineAddress = address / config.lineSize;
+    unsigned int set = lineAddress % sets;
+    unsigned int tag = lineAddress / sets;
+    unsigned int base = set * config.ways;
+    for (unsigned int w = 0; w < config.ways; w++) {
+        CacheLine &line = lines[base + w];
+        if (line.valid && line.tag == tag) {
+            counters.hits++;
+            replacer.touch(base + w);
+            if (write && config.writeBack)
+                line.dirty = true;
+            if (line.prefetched) {
+                line.prefetched = false;
+                counters.usefulPrefetches++;
+            }
+            outcome.hit = true;
+            break;
+        }
+    }
+
+    if (!outcome.hit) {
+        counters.misses++;
+        if (write && !config.writeAllocate)
+            outcome.writeThrough = true;
+        else
+            allocate(lineAddress, write && config.writeBack, false, outcome, counters);
+    }
+    if (outcome.writeThrough)
+        counters.writeThroughs++;
+    return outcome;
+}
+
+CacheOutcome Cache::prefetch(unsigned int address, CacheStats &counters) {
+    CacheOutcome outcome = {false, false, false, false, 0};
+    if (contains(address)) {
+        outcome.hit = true;
+        return outcome;
+    }
+    counters.prefetches++;
+    allocate(address / config.lineSize, false, true, outcome, counters);
+    return outcome;
+}
+
+// Fill an invalid way of the line's set, else the replacement victim
+void Cache::allocate(unsigned int lineAddress, bool dirty, bool prefetched, CacheOutcome &outcome, CacheStats &counters) {
+    unsigned int set = lineAddress % sets;
+    unsigned int base = set * config.ways;
+    unsigned int slot = base;
+    while (slot < base + config.ways && lines[slot].valid)
+        slot++;
+    if (slot == base + config.ways) {
+        slot = replacer.victim(set);
+        counters.evictions++;
+        if (lines[slot].dirty) {
+            counters.writebacks++;
+            outcome.writeback = true;
+            outcome.victimAddress = (lines[slot].tag * sets + set) * config.lineSize;
+        }
+    }
+    CacheLine &line = lines[slot];
+    line.valid = true;
+    line.dirty = dirty;
+    line.prefetched = prefetched;
+    line.tag = lineAddress / sets;
+    replacer.touch(slot);
+    outcome.fill = true;
+}
+
+//------------------------------------------------------
+// State File Section
+//------------------------------------------------------
+bool Cache::save(std::ostream &out) const {
+    out.write(reinterpret_cast<const char*>(&config), sizeof(config));
+    out.write(reinterpret_cast<const char*>(lines.data()), sizeof(CacheLine) * lines.size());
+    replacer.save(out);
+    return out.good();
+}
+
+bool Cache::load(std::istream &in) {
+    CacheConfig saved;
+    in.read(reinterpret_cast<char*>(&saved), sizeof(saved));
+    if (!in || saved.replacement > REPLACE_RANDOM || cache_config_error(saved) != NULL)
+        return false;
+    configure(saved);
+    in.read(reinterpret_cast<char*>(lines.data()), sizeof(CacheLine) * lines.size());
+    replacer.load(in);
+    return in.good();
+}
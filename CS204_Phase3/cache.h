@@ -0,0 +1,99 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <iosfwd>
+#include <vector>
+
+#include "replacement.h"
+
+const unsigned int DEFAULT_CACHE_WAYS = 2;
+const unsigned int DEFAULT_CACHE_LINE = 32;         // Bytes
+const unsigned int DEFAULT_CACHE_HIT_LATENCY = 1;   // Cycles; 1 is the old single-cycle access
+const unsigned int DEFAULT_CACHE_MISS_PENALTY = 20; // Extra cycles to fill a line with nothing modelled below
+const unsigned int MAX_CACHE_SIZE = 1u << 24;
+const unsigned int MAX_CACHE_WAYS = 64;
+const unsigned int MAX_CACHE_LATENCY = 10000;
+const unsigned int MAX_CACHE_MSHRS = 32;
+
+// One cache's parameters (--icache-* / --dcache-* / --l2-*)
+struct CacheConfig {
+    unsigned int size = 0;                          // Bytes; 0: no cache, every access takes one cycle
+    unsigned int ways = DEFAULT_CACHE_WAYS;
+    unsigned int lineSize = DEFAULT_CACHE_LINE;     // Bytes, a power of two
+    ReplacementPolicy replacement = REPLACE_LRU;
+    bool writeBack = true;                          // false: write-through, stores are passed down
+    bool writeAllocate = true;                      // false: store misses write around the cache
+    unsigned int hitLatency = DEFAULT_CACHE_HIT_LATENCY;
+    unsigned int missPenalty = DEFAULT_CACHE_MISS_PENALTY;
+    unsigned int mshrs = 0;                         // Misses in flight (D-cache only); 0: a miss blocks
+};
+
+// Why the configuration cannot be built, or NULL when it can
+const char *cache_config_error(const CacheConfig &config);
+
+struct CacheStats {
+    unsigned int hits = 0;
+    unsigned int misses = 0;
+    unsigned int evictions = 0;         // Valid lines replaced by a fill
+    unsigned int writebacks = 0;        // Dirty lines written back when evicted
+    unsigned int writeThroughs = 0;     // Stores passed down (write-through or write-around)
+    unsigned int stallCycles = 0;       // Cycles the pipeline waited on this cache
+    unsigned int prefetches = 0;        // Lines a prefetcher brought in
+    unsigned int usefulPrefetches = 0;  // ... that a demand access then hit
+    unsigned int latePrefetches = 0;    // ... while they were still on their way
+    unsigned int droppedPrefetches = 0; // Prefetches not sent: every fill slot busy
+};
+
+// What an access leaves for the level below
+struct CacheOutcome {
+    bool hit;
+    bool fill;                  // The line was allocated: read it from below
+    bool writeThrough;          // Pass the store down (write-through, or a write-around miss)
+    bool writeback;             // Write a dirty victim back...
+    unsigned int victimAddress; // ... from this line address
+};
+
+struct CacheLine {
+    bool valid;
+    bool dirty;
+    bool prefetched;        // Brought in by a prefetch and not used yet
+    unsigned int tag;       // Line address / sets
+};
+
+//------------------------------------------------------
+// Set-Associative Cache Timing Model
+//------------------------------------------------------
+// Tags and state only: the data always lives in guest memory, so a cache
+// changes when an access completes but never what it returns. Lines are
+// slots set * ways + way, with the set of an address (address / lineSize) %
+// sets. access() only updates the tags and says what has to happen below;
+// the simulator turns that into time (see Simulator::begin_access).
+struct Cache {
+    std::vector<CacheLine> lines;
+    ReplacementState replacer;
+    CacheConfig config;
+    unsigned int sets;
+
+    Cache() : sets(0) {}
+
+    void configure(const CacheConfig &config);
+    void clear();           // Invalidate every line and reset the replacement state
+
+    bool enabled() const { return sets > 0; }
+
+    bool contains(unsigned int address) const;     // A hit, without touching any state
+
+    // Look up the line holding address, allocating it on a miss
+    CacheOutcome access(unsigned int address, bool write, CacheStats &counters);
+
+    // Allocate the line holding address for a prefetch (outcome.hit: it already was)
+    CacheOutcome prefetch(unsigned int address, CacheStats &counters);
+
+    bool save(std::ostream &out) const;     // Configuration, lines and replacement state
+    bool load(std::istream &in);
+
+private:
+    void allocate(unsigned int lineAddress, bool dirty, bool prefetched, CacheOutcome &outcome, CacheStats &counters);
+};
+
+#endif // CACHE_H
@@ -0,0 +1,177 @@
+#include "dram.h"
+
+#include <istream>
+#include <ostream>
+
+const char *dram_config_error(const DramConfig &config) {
+    if (config.channels > MAX_DRAM_CHANNELS)
+        return "needs at most 16 channels";
+    if (config.banks == 0 || config.banks > MAX_DRAM_BANKS)
+        return "needs between 1 and 64 banks";
+    if (config.rowSize < 64)
+        return "row size must be at least 64 bytes";
+    if (config.tRCD > MAX_DRAM_TIMING || config.tCAS > MAX_DRAM_TIMING ||
+        config.tRP > MAX_DRAM_TIMING || config.tBurst > MAX_DRAM_TIMING)
+        return "timings must be at most 10000 cycles";
+    if (config.tBurst == 0)
+        return "a burst takes at least one cycle";
+    return NULL;
+}
+
+void DramController::configure(const DramConfig &dramConfig) {
+    DramBank precharged = {false, 0, 0};
+    config = dramConfig;
+    requests.clear();
+    freeIds.clear();
+    queues.assign(config.channels, std::vector<unsigned int>());
+    banks.assign(config.channels * config.banks, precharged);
+    busFreeAt.assign(config.channels, 0);
+}
+
+unsigned int DramController::enqueue(unsigned int address, bool write, unsigned int now, DramStats &counters) {
+    unsigned int id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    } else {
+        id = (unsigned int)requests.size();
+        requests.push_back(DramRequest());
+    }
+    unsigned int chunk = address / config.rowSize;
+    DramRequest &r = requests[id];
+    r.inUse = true;
+    r.issued = false;
+    r.write = write;
+    r.channel = chunk % config.channels;
+    r.bank = (chunk / config.channels) % config.banks;
+    r.row = chunk / (config.channels * config.banks);
+    r.arrival = now;
+    r.completion = 0;
+    queues[r.channel].push_back(id);
+    if (write)
+        counters.writes++;
+    else
+        counters.reads++;
+    return id;
+}
+
+void DramController::tick(unsigned int now, DramStats &counters) {
+    for (unsigned int ch = 0; ch < config.channels; ch++) {
+        std::vector<unsigned int> &queue = queues[ch];
+        size_t chosen = queue.size();
+        for (size_t i = 0; i < queue.size(); i++) {
+            const DramRequest &r = requests[queue[i]];
+            const DramBank &bank = banks[ch * config.banks + r.bank];
+            if (bank.readyAt > now)
+                continue;
+            if (bank.rowOpen && bank.openRow == r.row) {
+                chosen = i;         // First ready: the oldest row hit
+                break;
+            }
+            if (chosen == queue.size())
+                chosen = i;         // First come: the oldest request with a free bank
+        }
+        if (chosen == queue.size())
+            continue;
+        unsigned int id = queue[chosen];
+        queue.erase(queue.begin() + chosen);
+        issue(id, now, counters);
+    }
+}
+
+void DramController::issue(unsigned int id, unsigned int now, DramStats &counters) {
+    DramRequest &r = requests[id];
+    DramBank &bank = banks[r.channel * config.banks + r.bank];
+    unsigned int latency;
+    if (bank.rowOpen && bank.openRow == r.row) {
+        latency = config.tCAS;
+        counters.rowHits++;
+    } else if (bank.rowOpen) {
+        latency = config.tRP + config.tRCD + config.tCAS;
+        counters.rowConflicts++;
+    } else {
+        latency = config.tRCD + config.tCAS;
+        counters.rowEmpty++;
+    }
+    unsigned int dataStart = now + latency;
+    if (busFreeAt[r.channel] > dataStart)
+        dataStart = busFreeAt[r.channel];
+    r.completion = dataStart + config.tBurst;
+    r.issued = true;
+    busFreeAt[r.channel] = r.completion;
+    counters.busBusyCycles += config.tBurst;
+    counters.latencyCycles += r.completion - r.arrival;
+
+    if (config.rowPolicy == ROW_OPEN) {
+        bank.rowOpen = true;
+        bank.openRow = r.row;
+        bank.readyAt = dataStart;
+    } else {
+        bank.rowOpen = false;
+        bank.readyAt = r.completion + config.tRP;
+    }
+    if (r.write)
+        release(id);
+}
+
+bool DramController::finished(unsigned int id, unsigned int &completion) const {
+    const DramRequest &r = requests[id];
+    if (!r.issued)
+        return false;
+    completion = r.completion;
+    return true;
+}
+
+void DramController::release(unsigned int id) {
+    requests[id].inUse = false;
+    freeIds.push_back(id);
+}
+
+//------------------------------------------------------
+// State File Section
+//------------------------------------------------------
+template <typename T>
+static void write_vector(std::ostream &out, const std::vector<T> &v) {
+    unsigned int count = (unsigned int)v.size();
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(v.data()), sizeof(T) * count);
+}
+
+template <typename T>
+static bool read_vector(std::istream &in, std::vector<T> &v, unsigned int limit) {
+    unsigned int count = 0;
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || count > limit)
+        return false;
+    v.resize(count);
+    in.read(reinterpret_cast<char*>(v.data()), sizeof(T) * count);
+    return in.good();
+}
+
+bool DramController::save(std::ostream &out) const {
+    out.write(reinterpret_cast<const char*>(&config), sizeof(config));
+    write_vector(out, requests);
+    write_vector(out, freeIds);
+    for (size_t ch = 0; ch < queues.size(); ch++)
+        write_vector(out, queues[ch]);
+    write_vector(out, banks);
+    write_vector(out, busFreeAt);
+    return out.good();
+}
+
+bool DramController::load(std::istream &in) {
+    const unsigned int MAX_SAVED_REQUESTS = 1u << 20;
+    DramConfig saved;
+    in.read(reinterpret_cast<char*>(&saved), sizeof(saved));
+    if (!in || saved.rowPolicy > ROW_CLOSED || dram_config_error(saved) != NULL)
+        return false;
+    configure(saved);
+    if (!read_vector(in, requests, MAX_SAVED_REQUESTS) || !read_vector(in, freeIds, MAX_SAVED_REQUESTS))
+        return false;
+    for (size_t ch = 0; ch < queues.size(); ch++) {
+        if (!read_vector(in, queues[ch], MAX_SAVED_REQUESTS))
+            return false;
+    }
+    return read_vector(in, banks, (unsigned int)banks.size()) &&
+           read_vector(in, busFreeAt, (unsigned int)busFreeAt.size());
+}
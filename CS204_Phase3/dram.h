@@ -0,0 +1,100 @@
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <iosfwd>
+#include <vector>
+
+const unsigned int MAX_DRAM_CHANNELS = 16;
+const unsigned int MAX_DRAM_BANKS = 64;
+const unsigned int MAX_DRAM_TIMING = 10000;     // Cycles, for each timing parameter
+const unsigned int NO_DRAM_REQUEST = 0xFFFFFFFF;
+
+// What a bank does after an access (--dram-row-policy)
+enum RowPolicy {
+    ROW_OPEN,       // Keep the row open: the next access to it only pays tCAS
+    ROW_CLOSED      // Precharge right away: every access pays tRCD + tCAS
+};
+
+// Timings are in CPU cycles (--dram-*)
+struct DramConfig {
+    unsigned int channels = 0;          // 0: no DRAM model, misses cost a fixed penalty
+    unsigned int banks = 8;             // Per channel
+    unsigned int rowSize = 2048;        // Bytes per row
+    RowPolicy rowPolicy = ROW_OPEN;
+    unsigned int tRCD = 14;             // Activate to column command
+    unsigned int tCAS = 14;             // Column command to data
+    unsigned int tRP = 14;              // Precharge
+    unsigned int tBurst = 4;            // Data bus cycles per line transfer
+};
+
+// Why the configuration cannot be built, or NULL when it can
+const char *dram_config_error(const DramConfig &config);
+
+struct DramStats {
+    unsigned int reads = 0;
+    unsigned int writes = 0;
+    unsigned int rowHits = 0;           // Row already open
+    unsigned int rowEmpty = 0;          // Bank precharged: activate first
+    unsigned int rowConflicts = 0;      // Another row open: precharge and activate
+    unsigned long long latencyCycles = 0;   // Enqueue to last data beat, over all requests
+    unsigned long long busBusyCycles = 0;   // Data bus cycles used, over all channels
+};
+
+struct DramRequest {
+    bool inUse;
+    bool issued;
+    bool write;             // Writes are posted: nobody waits, the slot frees on issue
+    unsigned int channel;
+    unsigned int bank;
+    unsigned int row;
+    unsigned int arrival;   // Cycle it was enqueued
+    unsigned int completion;// Cycle its last data beat is on the bus (once issued)
+};
+
+struct DramBank {
+    bool rowOpen;
+    unsigned int openRow;
+    unsigned int readyAt;   // First cycle it takes a new command
+};
+
+//------------------------------------------------------
+// DRAM Controller
+//------------------------------------------------------
+// Channels of banks with one row buffer each. Addresses map row:bank:channel
+// :column, so each rowSize-byte chunk lies in a single row, and neighbouring
+// chunks go to the next channel and then the next bank. Requests wait in a
+// per-channel queue. Each tick, every channel issues at most one of them,
+// choosing FR-FCFS: the oldest request that hits an open row, else the
+// oldest one whose bank is free. A request's latency follows from its bank's
+// row state (tCAS, tRCD + tCAS, or tRP + tRCD + tCAS), plus waiting for the
+// channel's data bus, which is busy tBurst cycles per transfer.
+class DramController {
+public:
+    DramController() {}
+
+    void configure(const DramConfig &config);
+    bool enabled() const { return config.channels > 0; }
+
+    // Queue a line access at cycle `now`; the id to poll for a read (writes need no polling)
+    unsigned int enqueue(unsigned int address, bool write, unsigned int now, DramStats &counters);
+    void tick(unsigned int now, DramStats &counters);     // Issue what can go this cycle
+
+    bool finished(unsigned int id, unsigned int &completion) const;
+    void release(unsigned int id);      // The reader is done with a finished request
+
+    bool save(std::ostream &out) const;
+    bool load(std::istream &in);
+
+    DramConfig config;
+
+private:
+    std::vector<DramRequest> requests;
+    std::vector<unsigned int> freeIds;
+    std::vector<std::vector<unsigned int> > queues;     // Per channel, oldest first
+    std::vector<DramBank> banks;                        // channel * banks + bank
+    std::vector<unsigned int> busFreeAt;                // Per channel
+
+    void issue(unsigned int id, unsigned int now, DramStats &counters);
+};
+
+#endif // DRAM_H
@@ -0,0 +1,196 @@
+// Functional fan-out: one architectural run feeding several timing models.
+#include "fanout.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+static const unsigned int FANOUT_RING_LOG2 = 16; // 64K records in flight
+
+//------------------------------------------------------
+// Config File
+//------------------------------------------------------
+bool load_fanout_models(const KnobSettings &knobs, vector<BatchJob> &models) {
+    ifstream infile(knobs.fanoutFile);
+    if (!infile.is_open()) {
+        cerr << "Error: Could not open fanout config file: " << knobs.fanoutFile << endl;
+        return false;
+    }
+    string line;
+    unsigned int lineNum = 0;
+    while (getline(infile, line)) {
+        lineNum++;
+        stringstream ss(line);
+        BatchJob model;
+        model.line = lineNum;
+        model.program = knobs.inputFile;
+        string option;
+        while (ss >> option)
+            model.options.push_back(option);
+        if (model.options.empty() || model.options[0][0] == '#')
+            continue;
+
+        stringstream where;
+        where << knobs.fanoutFile << ":" << lineNum;
+        if (!check_batch_job(model, where.str()))
+            return false;
+        Simulator probe(NULL);
+        parse_job_options(probe, model);
+        if (!probe.knobs.pipeliningEnabled || probe.knobs.fastForward != 0) {
+            cerr << "Error: " << where.str() << ": a fanout model must be pipelined and can't fast-forward." << endl;
+            return false;
+        }
+        models.push_back(model);
+    }
+    return true;
+}
+
+//------------------------------------------------------
+// Producer and Timing Models
+//------------------------------------------------------
+struct FanoutModel {
+    const BatchJob *job;
+    BatchResult *result;
+    SpmcRing<RetiredInst> *feed;
+    unsigned int reader;
+};
+
+static void run_fanout_model(FanoutModel model) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    BatchResult &result = *model.result;
+    result = BatchResult();
+    result.status = "ok";
+    result.pipelined = true;
+    result.worker = model.reader + 1;
+
+    Simulator sim(NULL);
+    parse_job_options(sim, *model.job);
+    sim.feed = model.feed;
+    sim.feedReader = model.reader;
+    if (!sim.guestMem.reserve()) {
+        result.status = "load-error";
+    } else {
+        sim.reset_simulator();
+        if (!sim.loadInputFile(sim.knobs.inputFile))
+            result.status = "load-error";
+        else
+            fill_pipeline_result(sim, sim.runUntil(RUN_TO_CYCLE, MAX_SIMULATION_CYCLES + 1), result);
+    }
+    // Let the producer run on (or stop) without this model
+    model.feed->detach(model.reader);
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Execute the program architecturally on `sim`, publishing every retired
+// instruction after the first `skip` (the consumers' fast-forward); stops at
+// the end of the program or once every reader has detached
+unsigned long long produce_stream(Simulator &sim, const string &program, unsigned int skip,
+                                  SpmcRing<RetiredInst> &feed) {
+    unsigned long long produced = 0;
+    sim.knobs.inputFile = program;
+    if (sim.guestMem.reserve()) {
+        sim.reset_simulator();
+        if (sim.loadInputFile(program)) {
+            unsigned int skipped = 0;
+            while (skipped < skip && sim.functional_step(false))
+                skipped++;
+            RetiredInst retired;
+            while (skipped == skip && sim.functional_step(false, &retired) && feed.push(retired))
+                produced++;
+        }
+    }
+    feed.close();
+    return produced;
+}
+
+// Producer thread entry; `produced` is written before the thread exits
+static void produce_stream_thread(Simulator *sim, string program, unsigned int skip, SpmcRing<RetiredInst> *feed,
+                                  unsigned long long *produced) {
+    *produced = produce_stream(*sim, program, skip, *feed);
+}
+
+//------------------------------------------------------
+// Fan-Out Driver
+//------------------------------------------------------
+int run_fanout(const KnobSettings &knobs, ostream &console) {
+    vector<BatchJob> models;
+    if (!load_fanout_models(knobs, models))
+        return 1;
+    if (models.empty()) {
+        cerr << "Error: No timing models in " << knobs.fanoutFile << "." << endl;
+        return 1;
+    }
+
+    console << "Fan-out mode: " << knobs.inputFile << " feeding " << models.size()
+            << " timing models" << endl;
+    vector<BatchResult> results(models.size());
+    SpmcRing<RetiredInst> feed(FANOUT_RING_LOG2, (unsigned int)models.size());
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // Every model must be live at once (the ring holds back the producer until
+    // the slowest has caught up), so each gets its own thread
+    vector<thread> consumers;
+    for (size_t m = 0; m < models.size(); m++) {
+        FanoutModel model = {&models[m], &results[m], &feed, (unsigned int)m};
+        consumers.push_back(thread(run_fanout_model, model));
+    }
+    Simulator producer(NULL);
+    unsigned long long produced = produce_stream(producer, knobs.inputFile, 0, feed);
+    for (size_t m = 0; m < consumers.size(); m++)
+        consumers[m].join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    unsigned int failed = 0;
+    for (size_t m = 0; m < models.size(); m++) {
+        const BatchResult &r = results[m];
+        console << "[" << m << "] " << job_options_text(models[m]) << ": " << r.status << ", "
+                << r.cycles << " cycles, " << r.instructions << " instructions, CPI "
+                << fixed << setprecision(2) << r.CPI << endl;
+        console.unsetf(ios::floatfield);
+        if (r.status == "load-error")
+            failed++;
+    }
+    console << "Functional stream: " << produced << " instructions" << endl;
+    console << "Fan-out finished in " << fixed << setprecision(3) << seconds << " s" << endl;
+    console.unsetf(ios::floatfield);
+
+    if (!write_batch_results(knobs.fanoutOutput, models, results))
+        return 1;
+    console << "Fan-out results written to " << knobs.fanoutOutput << endl;
+    return failed ? 1 : 0;
+}
+
+//------------------------------------------------------
+// Decoupled Run
+//------------------------------------------------------
+RunResult run_decoupled(Simulator &sim) {
+    // Per-cycle output, instruction traces and debug stops show the timing
+    // model's own registers and memory, which a trace-driven run doesn't keep
+    const KnobSettings &knobs = sim.knobs;
+    if (sim.debugArmed || knobs.printRegisterEachCycle || knobs.printPipelineRegisters || knobs.saveCycleSnapshots ||
+        knobs.traceInstructionNum >= 0 || knobs.traceByPC)
+        return sim.runUntil(RUN_TO_CYCLE, MAX_SIMULATION_CYCLES + 1);
+
+    SpmcRing<RetiredInst> feed(FANOUT_RING_LOG2, 1);
+    Simulator producer(NULL);
+    unsigned long long produced = 0;
+    thread producerThread(produce_stream_thread, &producer, knobs.inputFile, sim.stats.fastForwarded, &feed, &produced);
+    sim.feed = &feed;
+    sim.feedReader = 0;
+    RunResult run = sim.runUntil(RUN_TO_CYCLE, MAX_SIMULATION_CYCLES + 1);
+    feed.detach(0);
+    producerThread.join();
+    sim.feed = NULL;
+
+    // The architectural state is the producer's: exact when the program ran
+    // to the end, up to a ring's worth of instructions ahead after a cycle cap.
+    // A producer that could not start left every instruction to sim itself.
+    if (produced > 0) {
+        memcpy(sim.X, producer.X, sizeof(sim.X));
+        sim.guestMem.swap(producer.guestMem);
+    }
+    return run;
+}
@@ -0,0 +1,42 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <string>
+#include <vector>
+
+#include "batch.h"
+
+using namespace std;
+
+//------------------------------------------------------
+// Functional Fan-Out (--fanout)
+//------------------------------------------------------
+// Runs the --input program once, functionally, and feeds the retired
+// instruction stream to several pipelined timing models at the same time.
+// The config file gives one timing model per line as the options it would
+// take on the command line (blank lines and '#' comments are ignored):
+//     --forwarding on
+//     --forwarding off
+//     --btb-entries 64 --predictor static
+// Each model runs on its own thread and takes every result, load value and
+// branch outcome from the shared stream (see Simulator::execute), so it only
+// models timing and architectural execution is done once however many
+// configurations are compared. Results use the batch table.
+bool load_fanout_models(const KnobSettings &knobs, vector<BatchJob> &models);
+unsigned long long produce_stream(Simulator &sim, const string &program, unsigned int skip,
+                                  SpmcRing<RetiredInst> &feed);
+int run_fanout(const KnobSettings &knobs, ostream &console);
+
+//------------------------------------------------------
+// Decoupled Run (--decoupled)
+//------------------------------------------------------
+// The single-model case: a continuous pipelined run of `sim` (already loaded
+// and fast-forwarded) whose results come from a functional thread running
+// ahead of it, which leaves sim with the timing work alone. Wrong-path
+// instructions are squashed before they reach EX, so the functional thread
+// never needs re-steering. Same result as runUntil(); afterwards sim holds
+// the functional thread's registers and memory. Runs that print per-cycle
+// state, trace an instruction or have breakpoints use runUntil() itself.
+RunResult run_decoupled(Simulator &sim);
+
+#endif // FANOUT_H
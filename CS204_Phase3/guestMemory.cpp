@@ -0,0 +1,138 @@
+#include "guestMemory.h"
+
+#include <cstdlib>
+#include <istream>
+#include <ostream>
+
+#ifdef _WIN32
+#include <mutex>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// One extra page past the top of the address space so a word access at
+// 0xFFFFFFFD..0xFFFFFFFF stays inside the mapping instead of faulting.
+static const unsigned long long GUEST_MAPPING_SIZE = GUEST_ADDRESS_SPACE + GUEST_PAGE_SIZE;
+
+#ifdef _WIN32
+// Windows has no MAP_NORESERVE: the space is only reserved, and the first
+// access to a page, load or store, faults into commit_guest_page(), which
+// commits it (zero-filled) and retries the access.
+static std::mutex guestMappingsLock;
+static std::vector<unsigned char *> guestMappings;  // Base of every live reservation
+static PVOID commitHandler = NULL;
+
+static LONG CALLBACK commit_guest_page(PEXCEPTION_POINTERS info) {
+    const EXCEPTION_RECORD *record = info->ExceptionRecord;
+    if (record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION || record->NumberParameters < 2)
+        return EXCEPTION_CONTINUE_SEARCH;
+    unsigned char *fault = reinterpret_cast<unsigned char *>(record->ExceptionInformation[1]);
+    std::lock_guard<std::mutex> guard(guestMappingsLock);
+    for (size_t i = 0; i < guestMappings.size(); i++) {
+        unsigned char *start = guestMappings[i];
+        if (fault < start || fault >= start + GUEST_MAPPING_SIZE)
+            continue;
+        unsigned char *page = start + ((size_t)(fault - start) & ~(size_t)(GUEST_PAGE_SIZE - 1));
+        // Only a page that is still just reserved; anything else is a real fault
+        MEMORY_BASIC_INFORMATION region;
+        if (!VirtualQuery(page, &region, sizeof(region)) || region.State != MEM_RESERVE)
+            return EXCEPTION_CONTINUE_SEARCH;
+        if (!VirtualAlloc(page, GUEST_PAGE_SIZE, MEM_COMMIT, PAGE_READWRITE))
+            return EXCEPTION_CONTINUE_SEARCH;
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+#endif
+
+bool GuestMemory::reserve() {
+    if (base) return true;
+#ifdef _WIN32
+    void *p = VirtualAlloc(NULL, (SIZE_T)GUEST_MAPPING_SIZE, MEM_RESERVE, PAGE_READWRITE);
+    if (!p) return false;
+    {
+        std::lock_guard<std::mutex> guard(guestMappingsLock);
+        if (!commitHandler)
+            commitHandler = AddVectoredExceptionHandler(1, commit_guest_page);
+        guestMappings.push_back(static_cast<unsigned char *>(p));
+    }
+#else
+    void *p = mmap(NULL, (size_t)GUEST_MAPPING_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return false;
+#endif
+    base = static_cast<unsigned char *>(p);
+    pageState = static_cast<unsigned char *>(calloc(GUEST_PAGE_COUNT, 1));
+    if (!pageState) {
+        release();
+        return false;
+    }
+    return true;
+}
+
+void GuestMemory::release() {
+    if (!base) return;
+#ifdef _WIN32
+    {
+        std::lock_guard<std::mutex> guard(guestMappingsLock);
+        for (size_t i = 0; i < guestMappings.size(); i++) {
+            if (guestMappings[i] == base) {
+                guestMappings.erase(guestMappings.begin() + i);
+                break;
+            }
+        }
+    }
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    munmap(base, (size_t)GUEST_MAPPING_SIZE);
+#endif
+    base = NULL;
+    free(pageState);
+    pageState = NULL;
+    touched.clear();
+}
+
+void GuestMemory::clear() {
+    if (!base) return;
+    for (size_t i = 0; i < touched.size(); i++) {
+        memset(base + ((size_t)touched[i] << GUEST_PAGE_SHIFT), 0, GUEST_PAGE_SIZE);
+        pageState[touched[i]] = 0;
+    }
+    touched.clear();
+}
+
+void GuestMemory::markWrittenSlow(unsigned int page) {
+    if (!(pageState[page] & PAGE_TOUCHED))
+        touched.push_back(page);
+    pageState[page] |= PAGE_DIRTY | PAGE_TOUCHED;
+}
+
+bool GuestMemory::savePages(std::ostream &pageFile) {
+    for (size_t slot = 0; slot < touched.size(); slot++) {
+        unsigned int page = touched[slot];
+        if (!(pageState[page] & PAGE_DIRTY))
+            continue;
+        pageFile.seekp((std::streamoff)slot * GUEST_PAGE_SIZE);
+        pageFile.write(reinterpret_cast<const char *>(base + ((size_t)page << GUEST_PAGE_SHIFT)), GUEST_PAGE_SIZE);
+        if (!pageFile) return false;
+        pageState[page] &= ~PAGE_DIRTY;
+    }
+    return true;
+}
+
+bool GuestMemory::loadPages(std::istream &pageFile, const std::vector<unsigned int> &pages) {
+    clear();
+    for (size_t slot = 0; slot < pages.size(); slot++) {
+        unsigned int page = pages[slot];
+        if (page >= GUEST_PAGE_COUNT || (pageState[page] & PAGE_TOUCHED))
+            return false;
+        pageFile.seekg((std::streamoff)slot * GUEST_PAGE_SIZE);
+        pageFile.read(reinterpret_cast<char *>(base + ((size_t)page << GUEST_PAGE_SHIFT)), GUEST_PAGE_SIZE);
+        if (!pageFile) return false;
+        // Matches the page file, so it is clean until the next store
+        pageState[page] = PAGE_TOUCHED;
+        touched.push_back(page);
+    }
+    return true;
+}
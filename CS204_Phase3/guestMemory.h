@@ -0,0 +1,104 @@
+#ifndef GUEST_MEMORY_H
+#define GUEST_MEMORY_H
+
+#include <cstring>
+#include <iosfwd>
+#include <utility>
+#include <vector>
+
+// Size of the simulated byte-addressable 32-bit address space
+const unsigned long long GUEST_ADDRESS_SPACE = 1ULL << 32;
+
+// Guest pages used for dirty tracking, checkpoints and reset
+const unsigned int GUEST_PAGE_SHIFT = 12;
+const unsigned int GUEST_PAGE_SIZE = 1u << GUEST_PAGE_SHIFT;
+const unsigned int GUEST_PAGE_COUNT = (unsigned int)(GUEST_ADDRESS_SPACE >> GUEST_PAGE_SHIFT);
+
+// Per-page state bits
+const unsigned char PAGE_DIRTY = 1;     // Written since the last checkpoint
+const unsigned char PAGE_TOUCHED = 2;   // Written since the last reset (listed in touched)
+const unsigned char PAGE_CODE = 4;      // Holds instructions translated by the JIT
+
+//------------------------------------------------------
+// Flat Guest Address Space
+//------------------------------------------------------
+// The whole 4 GiB guest space is one host reservation (anonymous mmap with
+// MAP_NORESERVE; on Windows a MEM_RESERVE region whose pages are committed
+// on first access), so untouched pages cost nothing and every guest address maps
+// to base + address with no range checks. Accesses go through memcpy so that
+// unaligned and sub-word accesses are well defined; the host is assumed to be
+// little-endian like RISC-V.
+//
+// Every store marks its page in a byte-per-page state table. The first write
+// to a page after a reset appends it to `touched`, which gives each page a
+// stable checkpoint slot and lets clear() zero only the pages actually used.
+// Only a page in exactly the DIRTY|TOUCHED state skips the slow path, so
+// setting PAGE_CODE routes every later store to that page through it.
+struct GuestMemory {
+    unsigned char *base;                // Host address of guest address 0
+    unsigned char *pageState;           // PAGE_* bits, one byte per guest page
+    std::vector<unsigned int> touched;  // Pages written since reset, in slot order
+
+    GuestMemory() : base(NULL), pageState(NULL) {}
+    ~GuestMemory() { release(); }
+
+    bool reserve();         // Map the address space (no-op if already mapped)
+    void release();
+    void clear();           // Zero every touched page and forget them
+
+    // Incremental checkpoint: page i of `touched` lives at slot i of the page file
+    bool savePages(std::ostream &pageFile);   // Write dirty pages only, then mark them clean
+    bool loadPages(std::istream &pageFile, const std::vector<unsigned int> &pages);
+
+    // Exchange whole address spaces (a decoupled run takes over its producer's)
+    void swap(GuestMemory &other) {
+        std::swap(base, other.base);
+        std::swap(pageState, other.pageState);
+        touched.swap(other.touched);
+    }
+
+    unsigned char *host(unsigned int address) const { return base + address; }
+
+    unsigned int load32(unsigned int address) const {
+        unsigned int v;
+        memcpy(&v, base + address, 4);
+        return v;
+    }
+    unsigned short load16(unsigned int address) const {
+        unsigned short v;
+        memcpy(&v, base + address, 2);
+        return v;
+    }
+    unsigned char load8(unsigned int address) const {
+        return base[address];
+    }
+
+    void store32(unsigned int address, unsigned int v) {
+        memcpy(base + address, &v, 4);
+        markWritten(address);
+        markWritten(address + 3);
+    }
+    void store16(unsigned int address, unsigned short v) {
+        memcpy(base + address, &v, 2);
+        markWritten(address);
+        markWritten(address + 1);
+    }
+    void store8(unsigned int address, unsigned char v) {
+        base[address] = v;
+        markWritten(address);
+    }
+
+    void markWritten(unsigned int address) {
+        unsigned int page = address >> GUEST_PAGE_SHIFT;
+        if(pageState[page] != (PAGE_DIRTY | PAGE_TOUCHED))
+            markWrittenSlow(page);
+    }
+
+private:
+    void markWrittenSlow(unsigned int page);
+
+    GuestMemory(const GuestMemory &);
+    GuestMemory &operator=(const GuestMemory &);
+};
+
+#endif // GUEST_MEMORY_H
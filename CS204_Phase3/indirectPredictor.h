@@ -0,0 +1,73 @@
+#ifndef INDIRECT_PREDICTOR_H
+#define INDIRECT_PREDICTOR_H
+
+#include <vector>
+
+const unsigned int DEFAULT_ITC_BITS = 6;        // --itc-bits: 64 entries (0 disables the cache)
+const unsigned int MAX_ITC_BITS = 16;
+const unsigned int DEFAULT_ITC_HISTORY = 2;     // --itc-history: targets in the path history
+const unsigned int MAX_ITC_HISTORY = 8;
+const unsigned int ITC_HISTORY_SHIFT = 4;       // Path history bits per target
+
+struct IndirectTargetEntry {
+    bool valid;
+    unsigned short tag;     // Low 16 bits of pc / 4
+    unsigned int target;
+};
+
+//------------------------------------------------------
+// Indirect Target Cache
+//------------------------------------------------------
+// Predicts the target of a jalr that is not a return (jump tables, function
+// pointers, interpreter dispatch). Entries are indexed by the jalr's PC
+// hashed with a path history of the last few indirect targets, so one
+// dispatch site can predict a different target in each context; a tag on
+// the PC keeps other jalrs from using the entry. Like the direction
+// predictors, it is trained and its history advanced when the jalr resolves.
+struct IndirectTargetCache {
+    std::vector<IndirectTargetEntry> entries;
+    unsigned int indexBits;
+    unsigned int historyLength;     // Targets folded into pathHistory
+    unsigned int pathHistory;
+
+    IndirectTargetCache() : indexBits(0), historyLength(0), pathHistory(0) {}
+
+    void configure(unsigned int bits, unsigned int length) {
+        IndirectTargetEntry empty = {false, 0, 0};
+        indexBits = bits;
+        historyLength = length;
+        entries.assign(bits ? (1u << bits) : 0, empty);
+        pathHistory = 0;
+    }
+    bool enabled() const { return !entries.empty(); }
+
+    unsigned int index(unsigned int pc) const {
+        unsigned int h = pathHistory;
+        unsigned int folded = 0;
+        for (; h != 0; h >>= indexBits)
+            folded ^= h;
+        return ((pc >> 2) ^ folded) & ((1u << indexBits) - 1);
+    }
+    unsigned short tag(unsigned int pc) const { return (unsigned short)(pc >> 2); }
+
+    bool lookup(unsigned int pc, unsigned int &target) const {
+        const IndirectTargetEntry &e = entries[index(pc)];
+        if (!e.valid || e.tag != tag(pc))
+            return false;
+        target = e.target;
+        return true;
+    }
+
+    void update(unsigned int pc, unsigned int target) {
+        IndirectTargetEntry &e = entries[index(pc)];
+        e.valid = true;
+        e.tag = tag(pc);
+        e.target = target;
+        unsigned int historyBits = historyLength * ITC_HISTORY_SHIFT;
+        pathHistory = (pathHistory << ITC_HISTORY_SHIFT) ^ (target >> 2);
+        if (historyBits < 32)
+            pathHistory &= (1u << historyBits) - 1;
+    }
+};
+
+#endif // INDIRECT_PREDICTOR_H
@@ -0,0 +1,129 @@
+#ifndef INST_STREAM_H
+#define INST_STREAM_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//------------------------------------------------------
+// Retired Instruction Stream
+//------------------------------------------------------
+// One record per architecturally executed instruction, in program order, as
+// produced by Simulator::functional_step(). A trace-driven pipeline takes the
+// results from these records instead of computing them, so it only models
+// timing: it never runs the ALU, touches guest memory or writes registers.
+struct RetiredInst {
+    unsigned int pc;
+    unsigned int nextPC;        // Architectural successor (the target when taken)
+    int result;                 // Value written to rd: ALU result, link address or loaded value
+    int storeData;              // Value a store wrote
+    unsigned int memAddress;    // Effective address of a load or store
+    bool taken;                 // Branch/jump outcome
+};
+
+//------------------------------------------------------
+// Lock-Free Single-Producer / Multi-Consumer Ring
+//------------------------------------------------------
+// Every reader sees every item, in order. Positions are free-running 64-bit
+// counters; slot = position & mask. The producer publishes `head` with a
+// release store after writing the slot, and readers publish their own
+// position the same way once they are done with an item, so a slot is only
+// reused after the slowest attached reader has moved past it. Both sides
+// cache the other side's counter and only reload it when they would block;
+// waiting is a yield loop, so this also behaves on a single core.
+template <typename T>
+class SpmcRing {
+public:
+    SpmcRing(unsigned int capacityLog2, unsigned int readers)
+        : slots(1u << capacityLog2), mask((1u << capacityLog2) - 1), cursors(readers),
+          head(0), closed(false), localHead(0), cachedMinTail(0) {
+        for (size_t r = 0; r < cursors.size(); r++) {
+            cursors[r].pos.store(0, memory_order_relaxed);
+            cursors[r].detached.store(false, memory_order_relaxed);
+            cursors[r].cachedHead = 0;
+        }
+    }
+
+    // Producer: append one item. Returns false (dropping it) once every
+    // reader has detached, so the producer can stop early.
+    bool push(const T &item) {
+        while (localHead - cachedMinTail > mask) {
+            if (!refresh_min_tail())
+                return false;
+            if (localHead - cachedMinTail > mask)
+                this_thread::yield();
+        }
+        slots[localHead & mask] = item;
+        localHead++;
+        head.store(localHead, memory_order_release);
+        return true;
+    }
+
+    // Producer: no more items
+    void close() { closed.store(true, memory_order_release); }
+
+    // Reader: the next item, waiting for the producer if need be; NULL once
+    // the ring is closed and drained
+    const T *peek(unsigned int reader) {
+        Cursor &c = cursors[reader];
+        unsigned long long pos = c.pos.load(memory_order_relaxed);
+        while (pos == c.cachedHead) {
+            bool done = closed.load(memory_order_acquire);
+            c.cachedHead = head.load(memory_order_acquire);
+            if (pos != c.cachedHead)
+                break;
+            if (done)
+                return NULL;
+            this_thread::yield();
+        }
+        return &slots[pos & mask];
+    }
+
+    // Reader: release the item returned by peek()
+    void consume(unsigned int reader) {
+        Cursor &c = cursors[reader];
+        c.pos.store(c.pos.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    // Reader: stop holding the producer back (the reader may not peek again)
+    void detach(unsigned int reader) { cursors[reader].detached.store(true, memory_order_release); }
+
+private:
+    struct Cursor {
+        atomic<unsigned long long> pos;     // Items this reader has consumed
+        atomic<bool> detached;
+        unsigned long long cachedHead;      // Reader-local copy of head
+        char pad[40];                       // Keep readers on separate cache lines
+    };
+
+    // Recompute the slowest attached reader; false when none is left
+    bool refresh_min_tail() {
+        bool any = false;
+        unsigned long long minTail = localHead;
+        for (size_t r = 0; r < cursors.size(); r++) {
+            if (cursors[r].detached.load(memory_order_acquire))
+                continue;
+            unsigned long long pos = cursors[r].pos.load(memory_order_acquire);
+            if (pos < minTail)
+                minTail = pos;
+            any = true;
+        }
+        cachedMinTail = minTail;
+        return any;
+    }
+
+    vector<T> slots;
+    const unsigned long long mask;
+    vector<Cursor> cursors;
+    atomic<unsigned long long> head;        // Items published
+    atomic<bool> closed;
+    unsigned long long localHead;           // Producer-local copy of head
+    unsigned long long cachedMinTail;       // Producer-local slowest reader position
+
+    SpmcRing(const SpmcRing &);
+    SpmcRing &operator=(const SpmcRing &);
+};
+
+#endif // INST_STREAM_H
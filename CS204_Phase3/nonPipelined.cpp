@@ -1,213 +1,884 @@
-/* 
+/*
 The project is developed as part of Computer Architecture class
 Project Name: Functional Simulator for subset of RISCV Processor
 
 Developer's Name:
 Developer's Email id:
-Date: 
+Date:
 */
 
 /* myRISCVSim.cpp
    Purpose: Simulator for a subset of the RISC-V processor.
    Modified to handle an input file with two segments:
      1. Instruction Segment:
-         Format: 
+         Format:
          0x0 0x100000b7 , lui x1 0x10000 # <bit pattern comment>
          ...
      2. Data Segment:
          Format:
-         Address: 10000000 | Data: 0x03 0x00 0x00 0x00 
+         Address: 10000000 | Data: 0x03 0x00 0x00 0x00
          ...
    The loader pads instruction tokens to 8 hex digits.
    A termination instruction (0xffffffff) is implemented.
-   A global variable "clockCycles_np" increments once per instruction cycle,
-   and the simulator prints the cycle count at the end of each cycle.
+   The counter "clockCycles_np" increments once per instruction cycle.
    --- NEW: The "mul" instruction (R-type, func3="000", func7="0000001") is now supported.
-   --- NEW: A separate stack memory region is added with downward growth.
-         The top of the stack is defined by STACK_TOP (0x7FFFFFDC),
-         and the stack region extends downward for STACK_SIZE words.
+   --- NEW: The stack grows downward from STACK_TOP (0x7FFFFFDC).
+   --- NEW: Instructions run on a direct-threaded interpreter. Each basic block
+         is decoded once into an array of handler pointers with the operands
+         already extracted; the blocks then run back to back with no logging,
+         which makes this the high-throughput golden model for the pipeline.
+   --- NEW: Code starts out interpreted and is promoted to threaded blocks
+         (and, with --jit, to host code) once its heat count says it is hot.
 */
 
-#include <iostream>
-#include <fstream>
-#include <bitset>
-#include <iomanip>
-#include <cstring>
-#include <cstdlib>
-#include <cstdio>
-#include <string>
-using namespace std;
+#include "nonPipelined.h"
+#include "guestMemory.h"
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
 
-#define M 32
+#ifdef NP_JIT
+#include <sys/mman.h>
+#endif
 
-// Define the stack region.
 // STACK_TOP is the initial value of the stack pointer (x2).
 const unsigned int STACK_TOP = 0x7FFFFFDC;
-// Define the number of words in the stack.
-const unsigned int STACK_SIZE = 1024;  // Adjust as needed.
-// Compute the bottom address of the stack region.
-const unsigned int STACK_BOTTOM = STACK_TOP - STACK_SIZE * 4;
-
-void write_data_memory_np();
-
-// Global registers, instruction memory, data memory, and new stack memory
-static unsigned int X_np[32];       // 32 registers
-static unsigned int MEM_np[4000];     // Instruction memory (indexed by byte address)
-static int DMEM_np[1000000];          // Data memory
-static int STACKMEM_np[STACK_SIZE];   // Separate stack memory (word-addressable)
-static unsigned int instruction_word_np;
-static unsigned int operand1_np;
-static unsigned int operand2_np;
-
-// Global variables
-char Type_np = '0';
-static bitset<M> inst_np;           // 32-bit instruction
-static unsigned int des_reg_np;     // destination register
-static int des_res_np;              // result after ALU operation
-string subtype_np;                  // subtype of the instruction
-static int imm_np;                  // immediate value
-static int pc_np = 0;               // Program counter
-unsigned int sz_np = 0;             // Number of instructions
-unsigned int clockCycles_np = 0;    // Global clock variable
-
-// --- Opcode Type Determination Functions ---
-char op_R_type_np(bitset<7> op) {
-    bitset<7> opr("0110011");
-    return (op == opr) ? 'R' : '0';
+// Number of stack words written to stack_mem.mem (the stack itself is unbounded).
+const unsigned int STACK_SIZE = 1024;
+// Start of the data segment.
+const unsigned int DATA_BASE_np = 0x10000000;
+// Tags sim_state.dat files written by save_state_np().
+const unsigned int STATE_MAGIC_np = 0x4E500001;
+
+//------------------------------------------------------
+// Execution Tiers
+//------------------------------------------------------
+// Code starts out interpreted: every instruction is decoded where it runs, so
+// short programs never pay for translation. heat_np counts control transfers
+// into each block start (branches, jumps, and exits from a higher tier that
+// found no translation). A block is translated to threaded code once its
+// count reaches THREADED_THRESHOLD, and to host code at JIT_THRESHOLD when
+// --jit is on. Control only leaves a tier at a block boundary.
+const unsigned int THREADED_THRESHOLD = 16;
+const unsigned int JIT_THRESHOLD = 256;
+
+#ifdef NP_JIT
+static const size_t JIT_CACHE_SIZE = 16 << 20;         // Flushed wholesale when full
+static const unsigned int JIT_MAX_BLOCK = 128;         // Instructions per translated block
+static const size_t JIT_MAX_BLOCK_BYTES = JIT_MAX_BLOCK * 160 + 256;
+#endif
+
+//------------------------------------------------------
+// Construction and Teardown
+//------------------------------------------------------
+// Termination instruction, unknown opcode or a pc outside the program.
+// Never called: the dispatch loop stops when it reaches one.
+static ThreadedOp *np_halt(FunctionalCore &, ThreadedOp *op) {
+    return op;
+}
+
+FunctionalCore::FunctionalCore(streambuf *consoleBuf)
+    : sz_np(0), clockCycles_np(0), tierStats_np(), console(consoleBuf),
+      pc_np(0), codeLimit_np(0), halted_np(false), jitEnabled_np(false),
+      jitThreshold_np(0xFFFFFFFF) {
+    memset(X_np, 0, sizeof(X_np));
+    ThreadedOp exitOp = {np_halt, {NULL, NULL}, 0, 0, 0, 0, 0};
+    exitOp_np = tierExitOp_np = exitOp;
+#ifdef NP_JIT
+    jitCache_np = jitFirstBlock_np = jitCursor_np = jitExit_np = NULL;
+    jitEnter_np = NULL;
+    memset(&jitCtx_np, 0, sizeof(jitCtx_np));
+    jitGeneration_np = 0;
+#endif
+}
+
+FunctionalCore::~FunctionalCore() {
+    for (size_t i = 0; i < blockAt_np.size(); i++)
+        delete[] blockAt_np[i];
+#ifdef NP_JIT
+    if (jitCache_np)
+        munmap(jitCache_np, JIT_CACHE_SIZE);
+#endif
+}
+
+//------------------------------------------------------
+// Threaded Code Transfers
+//------------------------------------------------------
+ThreadedOp *FunctionalCore::tier_exit_np(unsigned int pc) {
+    tierExitOp_np.pc = pc;
+    return &tierExitOp_np;
 }
-char op_I_type_np(bitset<7> op) {
-    bitset<7> opi1("0010011");
-    bitset<7> opi2("1100111");
-    bitset<7> opi3("0000011");
-    return (op == opi1 || op == opi2 || op == opi3) ? 'I' : '0';
+
+// Count a transfer into `pc` and return its threaded block, or leave the
+// threaded tier when the target is still cold or has become hot enough to JIT
+ThreadedOp *FunctionalCore::transfer_np(unsigned int pc) {
+    if (pc >= codeLimit_np || (pc & 3)) {
+        exitOp_np.pc = pc;
+        return &exitOp_np;
+    }
+    unsigned int heat = ++heat_np[pc >> 2];
+    if (heat >= jitThreshold_np || (!blockAt_np[pc >> 2] && heat < THREADED_THRESHOLD))
+        return tier_exit_np(pc);
+    return lookup_block_np(pc);
 }
-char op_J_type_np(bitset<7> op) {
-    bitset<7> opj("1101111");
-    return (op == opj) ? 'J' : '0';
+
+// Follow (and on first use, chain) the fall-through or taken successor
+ThreadedOp *FunctionalCore::follow_np(ThreadedOp *op, int taken) {
+    ThreadedOp *next = op->link[taken];
+    if (next)
+        return (++heat_np[next->pc >> 2] < jitThreshold_np) ? next : tier_exit_np(next->pc);
+    next = transfer_np(taken ? op->pc + op->imm : op->pc + 4);
+    if (next->run != np_halt)   // Exit records are never chained
+        op->link[taken] = next;
+    return next;
 }
-char op_B_type_np(bitset<7> op) {
-    bitset<7> opb("1100011");
-    return (op == opb) ? 'B' : '0';
+
+// A store hit the code segment: drop every translation and re-enter after it
+ThreadedOp *FunctionalCore::code_written_np(ThreadedOp *op) {
+    unsigned int next = op->pc + 4;
+    flush_blocks_np();
+    return tier_exit_np(next);
 }
-char op_S_type_np(bitset<7> op) {
-    bitset<7> ops("0100011");
-    return (op == ops) ? 'S' : '0';
+
+//------------------------------------------------------
+// Instruction Handlers
+//------------------------------------------------------
+#define NP_REG_OP(name, expr)                                               \
+    static ThreadedOp *name(FunctionalCore &core, ThreadedOp *op) {         \
+        unsigned int a = core.X_np[op->rs1], b = core.X_np[op->rs2];        \
+        core.X_np[op->rd] = (expr);                                         \
+        return op + 1;                                                      \
+    }
+#define NP_IMM_OP(name, expr)                                               \
+    static ThreadedOp *name(FunctionalCore &core, ThreadedOp *op) {         \
+        unsigned int a = core.X_np[op->rs1], b = (unsigned int)op->imm;     \
+        core.X_np[op->rd] = (expr);                                         \
+        return op + 1;                                                      \
+    }
+#define NP_BRANCH_OP(name, cond)                                            \
+    static ThreadedOp *name(FunctionalCore &core, ThreadedOp *op) {         \
+        unsigned int a = core.X_np[op->rs1], b = core.X_np[op->rs2];        \
+        return core.follow_np(op, (cond) ? 1 : 0);                          \
+    }
+
+static unsigned int div_np(unsigned int a, unsigned int b) {
+    if (b == 0) return 0xFFFFFFFF;
+    if (a == 0x80000000 && b == 0xFFFFFFFF) return a; // Overflow case defined by RISC-V
+    return (unsigned int)((int)a / (int)b);
 }
-char op_U_type_np(bitset<7> op) {
-    bitset<7> opu1("0110111");
-    bitset<7> opu2("0010111");
-    return (op == opu1 || op == opu2) ? 'U' : '0';
+static unsigned int rem_np(unsigned int a, unsigned int b) {
+    if (b == 0) return a;
+    if (a == 0x80000000 && b == 0xFFFFFFFF) return 0;
+    return (unsigned int)((int)a % (int)b);
 }
 
-// --- Utility: Two's Complement Calculation ---
-string findTwoscomplement_np(string str) {
-    int n = str.length();
-    int i = 0;
-    for (i = n - 1; i >= 0; i--)
-        if (str[i] == '1')
+NP_REG_OP(np_add,  a + b)
+NP_REG_OP(np_sub,  a - b)
+NP_REG_OP(np_sll,  a << (b & 0x1F))
+NP_REG_OP(np_slt,  ((int)a < (int)b) ? 1 : 0)
+NP_REG_OP(np_sltu, (a < b) ? 1 : 0)
+NP_REG_OP(np_xor,  a ^ b)
+NP_REG_OP(np_srl,  a >> (b & 0x1F))
+NP_REG_OP(np_sra,  (unsigned int)((int)a >> (b & 0x1F)))
+NP_REG_OP(np_or,   a | b)
+NP_REG_OP(np_and,  a & b)
+NP_REG_OP(np_mul,  a * b)
+NP_REG_OP(np_div,  div_np(a, b))
+NP_REG_OP(np_rem,  rem_np(a, b))
+
+NP_IMM_OP(np_addi,  a + b)
+NP_IMM_OP(np_slti,  ((int)a < (int)b) ? 1 : 0)
+NP_IMM_OP(np_sltiu, (a < b) ? 1 : 0)
+NP_IMM_OP(np_xori,  a ^ b)
+NP_IMM_OP(np_ori,   a | b)
+NP_IMM_OP(np_andi,  a & b)
+NP_IMM_OP(np_slli,  a << b)
+NP_IMM_OP(np_srli,  a >> b)
+NP_IMM_OP(np_srai,  (unsigned int)((int)a >> b))
+
+NP_IMM_OP(np_lb,  (unsigned int)(int)(signed char)core.MEM_np.load8(a + b))
+NP_IMM_OP(np_lh,  (unsigned int)(int)(short)core.MEM_np.load16(a + b))
+NP_IMM_OP(np_lw,  core.MEM_np.load32(a + b))
+NP_IMM_OP(np_lbu, core.MEM_np.load8(a + b))
+NP_IMM_OP(np_lhu, core.MEM_np.load16(a + b))
+
+NP_BRANCH_OP(np_beq,  a == b)
+NP_BRANCH_OP(np_bne,  a != b)
+NP_BRANCH_OP(np_blt,  (int)a < (int)b)
+NP_BRANCH_OP(np_bge,  (int)a >= (int)b)
+NP_BRANCH_OP(np_bltu, a < b)
+NP_BRANCH_OP(np_bgeu, a >= b)
+
+static ThreadedOp *np_sb(FunctionalCore &core, ThreadedOp *op) {
+    unsigned int address = core.X_np[op->rs1] + op->imm;
+    core.MEM_np.store8(address, (unsigned char)core.X_np[op->rs2]);
+    return (address < core.codeLimit_np) ? core.code_written_np(op) : op + 1;
+}
+static ThreadedOp *np_sh(FunctionalCore &core, ThreadedOp *op) {
+    unsigned int address = core.X_np[op->rs1] + op->imm;
+    core.MEM_np.store16(address, (unsigned short)core.X_np[op->rs2]);
+    return (address < core.codeLimit_np) ? core.code_written_np(op) : op + 1;
+}
+static ThreadedOp *np_sw(FunctionalCore &core, ThreadedOp *op) {
+    unsigned int address = core.X_np[op->rs1] + op->imm;
+    core.MEM_np.store32(address, core.X_np[op->rs2]);
+    return (address < core.codeLimit_np) ? core.code_written_np(op) : op + 1;
+}
+
+// lui, and auipc with pc + imm folded in at translation time
+static ThreadedOp *np_li(FunctionalCore &core, ThreadedOp *op) {
+    core.X_np[op->rd] = (unsigned int)op->imm;
+    return op + 1;
+}
+static ThreadedOp *np_jal(FunctionalCore &core, ThreadedOp *op) {
+    if (op->rd)
+        core.X_np[op->rd] = op->pc + 4;
+    return core.follow_np(op, 1);
+}
+static ThreadedOp *np_jalr(FunctionalCore &core, ThreadedOp *op) {
+    unsigned int target = (core.X_np[op->rs1] + op->imm) & ~1u;
+    if (op->rd)
+        core.X_np[op->rd] = op->pc + 4;
+    return core.transfer_np(target);
+}
+// Register writes to x0 are translated into this
+static ThreadedOp *np_nop(FunctionalCore &, ThreadedOp *op) {
+    return op + 1;
+}
+//------------------------------------------------------
+// Decoder
+//------------------------------------------------------
+enum NpOp {
+    NP_HALT = 0,
+    NP_ADD, NP_SUB, NP_SLL, NP_SLT, NP_SLTU, NP_XOR, NP_SRL, NP_SRA, NP_OR, NP_AND,
+    NP_MUL, NP_DIV, NP_REM,
+    NP_ADDI, NP_SLTI, NP_SLTIU, NP_XORI, NP_ORI, NP_ANDI, NP_SLLI, NP_SRLI, NP_SRAI,
+    NP_LB, NP_LH, NP_LW, NP_LBU, NP_LHU,
+    NP_SB, NP_SH, NP_SW,
+    NP_BEQ, NP_BNE, NP_BLT, NP_BGE, NP_BLTU, NP_BGEU,
+    NP_JAL, NP_JALR,
+    NP_LUI, NP_AUIPC,
+    NP_OP_COUNT
+};
+
+struct NpOpInfo {
+    ThreadedHandler run;
+    const char *name;    // Mnemonic (step-mode report only)
+    char type;           // Instruction format
+};
+
+static const NpOpInfo NP_OPS[NP_OP_COUNT] = {
+    {np_halt, "halt", '0'},
+    {np_add, "add", 'R'}, {np_sub, "sub", 'R'}, {np_sll, "sll", 'R'}, {np_slt, "slt", 'R'},
+    {np_sltu, "sltu", 'R'}, {np_xor, "xor", 'R'}, {np_srl, "srl", 'R'}, {np_sra, "sra", 'R'},
+    {np_or, "or", 'R'}, {np_and, "and", 'R'},
+    {np_mul, "mul", 'R'}, {np_div, "div", 'R'}, {np_rem, "rem", 'R'},
+    {np_addi, "addi", 'I'}, {np_slti, "slti", 'I'}, {np_sltiu, "sltiu", 'I'}, {np_xori, "xori", 'I'},
+    {np_ori, "ori", 'I'}, {np_andi, "andi", 'I'}, {np_slli, "slli", 'I'}, {np_srli, "srli", 'I'},
+    {np_srai, "srai", 'I'},
+    {np_lb, "lb", 'I'}, {np_lh, "lh", 'I'}, {np_lw, "lw", 'I'}, {np_lbu, "lbu", 'I'}, {np_lhu, "lhu", 'I'},
+    {np_sb, "sb", 'S'}, {np_sh, "sh", 'S'}, {np_sw, "sw", 'S'},
+    {np_beq, "beq", 'B'}, {np_bne, "bne", 'B'}, {np_blt, "blt", 'B'}, {np_bge, "bge", 'B'},
+    {np_bltu, "bltu", 'B'}, {np_bgeu, "bgeu", 'B'},
+    {np_jal, "jal", 'J'}, {np_jalr, "jalr", 'I'},
+    {np_li, "lui", 'U'}, {np_li, "auipc", 'U'}
+};
+
+// Decode the word at `pc` into `op` (handler included) and return its NpOp
+static unsigned char decode_np(unsigned int word, unsigned int pc, ThreadedOp &op) {
+    unsigned int opcode = word & 0x7F;
+    unsigned int funct3 = (word >> 12) & 0x7;
+    unsigned int funct7 = (word >> 25) & 0x7F;
+    unsigned int imm_i = (word >> 20) & 0xFFF;
+    int imm_i_sext = (imm_i & 0x800) ? (int)(imm_i | 0xFFFFF000) : (int)imm_i;
+    unsigned char k = NP_HALT;
+
+    op.link[0] = op.link[1] = NULL;
+    op.pc = pc;
+    op.imm = 0;
+    op.rd = (word >> 7) & 0x1F;
+    op.rs1 = (word >> 15) & 0x1F;
+    op.rs2 = (word >> 20) & 0x1F;
+
+    if (opcode == 0x33) {
+        static const unsigned char base_ops[8] = {NP_ADD, NP_SLL, NP_SLT, NP_SLTU, NP_XOR, NP_SRL, NP_OR, NP_AND};
+        if (funct7 == 0x00)
+            k = base_ops[funct3];
+        else if (funct7 == 0x20 && funct3 == 0x0)
+            k = NP_SUB;
+        else if (funct7 == 0x20 && funct3 == 0x5)
+            k = NP_SRA;
+        else if (funct7 == 0x01 && funct3 == 0x0)
+            k = NP_MUL;
+        else if (funct7 == 0x01 && funct3 == 0x4)
+            k = NP_DIV;
+        else if (funct7 == 0x01 && funct3 == 0x6)
+            k = NP_REM;
+    }
+    else if (opcode == 0x13) {
+        static const unsigned char imm_ops[8] = {NP_ADDI, NP_SLLI, NP_SLTI, NP_SLTIU, NP_XORI, NP_SRLI, NP_ORI, NP_ANDI};
+        k = imm_ops[funct3];
+        if (funct3 == 0x5 && ((word >> 30) & 0x1))
+            k = NP_SRAI;
+        op.imm = (funct3 == 0x1 || funct3 == 0x5) ? (int)(imm_i & 0x1F) : imm_i_sext;
+    }
+    else if (opcode == 0x03) {
+        static const unsigned char load_ops[8] = {NP_LB, NP_LH, NP_LW, NP_HALT, NP_LBU, NP_LHU, NP_HALT, NP_HALT};
+        k = load_ops[funct3];
+        op.imm = imm_i_sext;
+    }
+    else if (opcode == 0x23) {
+        static const unsigned char store_ops[8] = {NP_SB, NP_SH, NP_SW, NP_HALT, NP_HALT, NP_HALT, NP_HALT, NP_HALT};
+        unsigned int imm_s = (funct7 << 5) | op.rd;
+        k = store_ops[funct3];
+        op.imm = (imm_s & 0x800) ? (int)(imm_s | 0xFFFFF000) : (int)imm_s;
+    }
+    else if (opcode == 0x63) {
+        static const unsigned char branch_ops[8] = {NP_BEQ, NP_BNE, NP_HALT, NP_HALT, NP_BLT, NP_BGE, NP_BLTU, NP_BGEU};
+        unsigned int imm_b = (((word >> 31) & 0x1) << 12) | (((word >> 7) & 0x1) << 11) |
+                             (((word >> 25) & 0x3F) << 5) | (((word >> 8) & 0xF) << 1);
+        k = branch_ops[funct3];
+        op.imm = (imm_b & 0x1000) ? (int)(imm_b | 0xFFFFE000) : (int)imm_b;
+    }
+    else if (opcode == 0x6F) {
+        unsigned int imm_j = (((word >> 31) & 0x1) << 20) | (((word >> 12) & 0xFF) << 12) |
+                             (((word >> 20) & 0x1) << 11) | (((word >> 21) & 0x3FF) << 1);
+        k = NP_JAL;
+        op.imm = (imm_j & 0x100000) ? (int)(imm_j | 0xFFF00000) : (int)imm_j;
+    }
+    else if (opcode == 0x67) {
+        k = NP_JALR;
+        op.imm = imm_i_sext;
+    }
+    else if (opcode == 0x37) {
+        k = NP_LUI;
+        op.imm = (int)(word & 0xFFFFF000);
+    }
+    else if (opcode == 0x17) {
+        k = NP_AUIPC;
+        op.imm = (int)(pc + (word & 0xFFFFF000));
+    }
+
+    op.run = NP_OPS[k].run;
+    // Results headed for x0 are dropped (loads have no side effects either)
+    bool writesRd = (k >= NP_ADD && k <= NP_LHU) || k == NP_LUI || k == NP_AUIPC;
+    if (writesRd && op.rd == 0)
+        op.run = np_nop;
+    return k;
+}
+
+//------------------------------------------------------
+// Block Translation and Lookup
+//------------------------------------------------------
+ThreadedOp *FunctionalCore::translate_block_np(unsigned int start) {
+    vector<ThreadedOp> ops;
+    for (unsigned int pc = start; ; pc += 4) {
+        ThreadedOp op;
+        // Running off the end of the program reads as a termination instruction
+        unsigned int word = (pc < codeLimit_np) ? MEM_np.load32(pc) : 0xFFFFFFFF;
+        unsigned char k = decode_np(word, pc, op);
+        ops.push_back(op);
+        if (k == NP_HALT || (k >= NP_BEQ && k <= NP_JALR))
             break;
-    if (i == -1)
-        return '1' + str;
-    for (int k = i - 1; k >= 0; k--) {
-        str[k] = (str[k] == '1') ? '0' : '1';
     }
-    return str;
+    ThreadedOp *block = new ThreadedOp[ops.size()];
+    copy(ops.begin(), ops.end(), block);
+    tierStats_np.promotions[TIER_THREADED]++;
+    return block;
 }
 
-// --- Instruction Subtype Selection ---
-string subtype_select_np(bitset<3> func3, bitset<7> func7, bitset<7> op) {
-    string Func3 = func3.to_string(), Func7 = func7.to_string(), Op = op.to_string();
-    switch (Type_np) {
-        case 'R': {
-            // Check for mul first.
-            if (Func3 == "000" && Func7 == "0000001")
-                subtype_np = "mul";
-            else if (Func3 == "100" && Func7 == "0000001")
-                subtype_np = "div";
-            else if (Func3 == "110" && Func7 == "0000001")
-                subtype_np = "rem";
-            else if (Func3 == "000" && Func7 == "0000000")
-                subtype_np = "add";
-            else if (Func3 == "111" && Func7 == "0000000")
-                subtype_np = "and";
-            else if (Func3 == "110" && Func7 == "0000000")
-                subtype_np = "or";
-            else if (Func3 == "001" && Func7 == "0000000")
-                subtype_np = "sll";
-            else if (Func3 == "010" && Func7 == "0000000")
-                subtype_np = "slt";
-            else if (Func3 == "101" && Func7 == "0100000")
-                subtype_np = "sra";
-            else if (Func3 == "101" && Func7 == "0000000")
-                subtype_np = "srl";
-            else if (Func3 == "000" && Func7 == "0100000")
-                subtype_np = "sub";
-            else if (Func3 == "100" && Func7 == "0000000")
-                subtype_np = "xor";
+ThreadedOp *FunctionalCore::lookup_block_np(unsigned int pc) {
+    if (pc >= codeLimit_np || (pc & 3)) {
+        exitOp_np.pc = pc;
+        return &exitOp_np;
+    }
+    ThreadedOp *&block = blockAt_np[pc >> 2];
+    if (!block)
+        block = translate_block_np(pc);
+    return block;
+}
+
+// Drop every translation (threaded and native) of the code segment; the
+// heat counts survive, so rewritten code is promoted again straight away
+void FunctionalCore::flush_blocks_np() {
+    for (size_t i = 0; i < blockAt_np.size(); i++)
+        delete[] blockAt_np[i];
+    blockAt_np.assign(codeLimit_np >> 2, NULL);
+    heat_np.resize(codeLimit_np >> 2, 0);
+    flush_jit_np();
+}
+
+// Interpreter tier: decode and run one instruction at a time, up to the end
+// of the current block. Branches still go through transfer_np(), which keeps
+// the heat counts and translates targets that have become warm.
+unsigned int FunctionalCore::interpret_np(unsigned int limit) {
+    unsigned int done = 0;
+    while (done < limit) {
+        ThreadedOp op;
+        unsigned int word = (pc_np < codeLimit_np && !(pc_np & 3)) ? MEM_np.load32(pc_np) : 0xFFFFFFFF;
+        unsigned char k = decode_np(word, pc_np, op);
+        if (k == NP_HALT) {
+            halted_np = true;
             break;
         }
-        case 'I': {
-            if (Func3 == "000" && Op == "0010011")
-                subtype_np = "addi";
-            else if (Func3 == "111")
-                subtype_np = "andi";
-            else if (Func3 == "110")
-                subtype_np = "ori";
-            else if (Func3 == "000" && Op == "0000011")
-                subtype_np = "lb";
-            else if (Func3 == "001" && Op == "0000011")
-                subtype_np = "lh";
-            else if (Func3 == "010" && Op == "0000011") 
-                subtype_np = "lw";
-            else if (Func3 == "011" && Op == "0000011")
-                subtype_np = "ld";
-            else if (Func3 == "000" && Op == "1100111")
-                subtype_np = "jalr";
-            else if (Func3 == "001" && Op == "0010011")
-                subtype_np = "slli";
+        ThreadedOp *next = op.run(*this, &op);
+        done++;
+        if (k >= NP_BEQ && k <= NP_JALR) {
+            pc_np = next->pc;
             break;
         }
-        case 'B': {
-            if (Func3 == "000")
-                subtype_np = "beq";
-            else if (Func3 == "001")
-                subtype_np = "bne";
-            else if (Func3 == "101")
-                subtype_np = "bge";
-            else if (Func3 == "100")
-                subtype_np = "blt";
+        pc_np += 4;
+    }
+    return done;
+}
+
+// Threaded tier: run translated blocks until the limit, a halt, or a
+// transfer into a block that belongs to another tier
+unsigned int FunctionalCore::run_threaded_np(unsigned int limit) {
+    ThreadedOp *op = lookup_block_np(pc_np);
+    unsigned int done = 0;
+    while (done < limit && op->run != np_halt) {
+        op = op->run(*this, op);
+        done++;
+    }
+    pc_np = op->pc;
+    halted_np = (op->run == np_halt && op != &tierExitOp_np);
+    return done;
+}
+
+//------------------------------------------------------
+// x86-64 Block Translation (--jit)
+//------------------------------------------------------
+// Hot basic blocks are translated to host code by a small built-in emitter.
+// While native code runs, rbx holds the JitContext, r13 the guest registers,
+// r12 guest address 0 and r14 the GuestMemory page table; every guest
+// register lives in X_np, so nothing has to be copied in or out. Each block
+// starts by charging its length to the instruction budget, so chained loops
+// still come back to run_jit_np(). Block exits start out as jumps to stubs
+// that return to the dispatcher; once the successor has been translated the
+// dispatcher patches the jump to go straight to it. Stores only take the
+// out-of-line path when their page is not plain DIRTY|TOUCHED, which is also
+// how writes to a page holding translated code (PAGE_CODE) are caught.
+#ifdef NP_JIT
+
+#define JIT_CTX(field) ((unsigned int)offsetof(JitContext, field))
+
+// x86 condition codes
+enum JitCond { JCC_B = 0x2, JCC_AE = 0x3, JCC_E = 0x4, JCC_NE = 0x5, JCC_L = 0xC, JCC_GE = 0xD };
+// Host registers that appear in encodings
+enum JitReg { JR_EAX = 0, JR_ECX = 1, JR_ESI = 6, JR_EDI = 7 };
+
+struct JitEmitter {
+    unsigned char *p;
+
+    void byte(unsigned int v) { *p++ = (unsigned char)v; }
+    void word32(unsigned int v) { memcpy(p, &v, 4); p += 4; }
+    void word64(unsigned long long v) { memcpy(p, &v, 8); p += 8; }
+
+    // <opcode> host, [r13 + 4 * reg]
+    void guest(unsigned int opcode, unsigned int host, unsigned int reg) {
+        byte(0x41); byte(opcode); byte(0x85 | (host << 3)); word32(reg * 4);
+    }
+    void loadGuest(unsigned int host, unsigned int reg) { guest(0x8B, host, reg); }
+    void storeGuest(unsigned int reg) { guest(0x89, JR_EAX, reg); }
+    void storeGuestImm(unsigned int reg, unsigned int v) {
+        byte(0x41); byte(0xC7); byte(0x85); word32(reg * 4); word32(v);
+    }
+    void imulGuest(unsigned int reg) {
+        byte(0x41); byte(0x0F); byte(0xAF); byte(0x85); word32(reg * 4);
+    }
+    // <opcode> eax, imm32 (the short accumulator forms)
+    void aluImm(unsigned int opcode, unsigned int v) { byte(opcode); word32(v); }
+    void shiftImm(unsigned int ext, unsigned int n) { byte(0xC1); byte(0xC0 | (ext << 3)); byte(n); }
+    void shiftCl(unsigned int ext) { byte(0xD3); byte(0xC0 | (ext << 3)); }
+    // setcc al; movzx eax, al
+    void setcc(unsigned int cc) {
+        byte(0x0F); byte(0x90 | cc); byte(0xC0);
+        byte(0x0F); byte(0xB6); byte(0xC0);
+    }
+    void callHelper(const void *fn) {
+        byte(0x48); byte(0xB8); word64((unsigned long long)(size_t)fn);  // mov rax, fn
+        byte(0xFF); byte(0xD0);                                          // call rax
+    }
+    // Context fields, addressed as [rbx + disp8]
+    void ctxStoreImm(unsigned int off, unsigned int v) { byte(0xC7); byte(0x43); byte(off); word32(v); }
+    void ctxStoreEax(unsigned int off) { byte(0x89); byte(0x43); byte(off); }
+    void ctxStorePtr(unsigned int off, const void *v) {
+        byte(0x48); byte(0xB8); word64((unsigned long long)(size_t)v);   // mov rax, v
+        byte(0x48); byte(0x89); byte(0x43); byte(off);                   // mov [rbx + off], rax
+    }
+    void ctxQword(unsigned int ext, unsigned int off, unsigned int v) {  // add/sub/cmp qword [rbx + off], imm32
+        byte(0x48); byte(0x81); byte(0x43 | (ext << 3)); byte(off); word32(v);
+    }
+    // Jumps with a rel32 to be filled in later; returns the rel32 address
+    unsigned char *jmp32() { byte(0xE9); word32(0); return p - 4; }
+    unsigned char *jcc32(unsigned int cc) { byte(0x0F); byte(0x80 | cc); word32(0); return p - 4; }
+};
+
+static void jit_link(unsigned char *rel, const unsigned char *target) {
+    int offset = (int)(target - (rel + 4));
+    memcpy(rel, &offset, 4);
+}
+
+// Out-of-line store bookkeeping: mark the pages written and report whether
+// either one holds translated code
+static unsigned int jit_store_slow(unsigned int address, unsigned int size, JitContext *ctx) {
+    GuestMemory &mem = *ctx->guest;
+    unsigned int last = address + size - 1;
+    mem.markWritten(address);
+    mem.markWritten(last);
+    return (mem.pageState[address >> GUEST_PAGE_SHIFT] |
+            mem.pageState[last >> GUEST_PAGE_SHIFT]) & PAGE_CODE;
+}
+
+bool FunctionalCore::jit_init_np() {
+    void *p = mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        cerr << "Warning: Could not map the JIT code cache; using the threaded interpreter." << endl;
+        return false;
+    }
+    jitCache_np = static_cast<unsigned char *>(p);
+    JitEmitter e = {jitCache_np};
+
+    // void enter(JitContext *ctx = rdi, unsigned char *code = rsi)
+    jitEnter_np = reinterpret_cast<JitEntry>(e.p);
+    e.byte(0x53);                                   // push rbx
+    e.byte(0x41); e.byte(0x54);                     // push r12
+    e.byte(0x41); e.byte(0x55);                     // push r13
+    e.byte(0x41); e.byte(0x56);                     // push r14
+    e.byte(0x41); e.byte(0x57);                     // push r15 (keeps rsp 16-byte aligned for helper calls)
+    e.byte(0x48); e.byte(0x89); e.byte(0xFB);       // mov rbx, rdi
+    e.byte(0x4C); e.byte(0x8B); e.byte(0x63); e.byte(JIT_CTX(mem));        // mov r12, [rbx + mem]
+    e.byte(0x4C); e.byte(0x8B); e.byte(0x6B); e.byte(JIT_CTX(x));          // mov r13, [rbx + x]
+    e.byte(0x4C); e.byte(0x8B); e.byte(0x73); e.byte(JIT_CTX(pageState));  // mov r14, [rbx + pageState]
+    e.byte(0xFF); e.byte(0xE6);                     // jmp rsi
+
+    jitExit_np = e.p;
+    e.byte(0x41); e.byte(0x5F);                     // pop r15
+    e.byte(0x41); e.byte(0x5E);                     // pop r14
+    e.byte(0x41); e.byte(0x5D);                     // pop r13
+    e.byte(0x41); e.byte(0x5C);                     // pop r12
+    e.byte(0x5B);                                   // pop rbx
+    e.byte(0xC3);                                   // ret
+
+    jitFirstBlock_np = jitCursor_np = e.p;
+    return true;
+}
+
+void FunctionalCore::flush_jit_np() {
+    for (size_t i = 0; i < jitCodePages_np.size(); i++)
+        MEM_np.pageState[jitCodePages_np[i]] &= ~PAGE_CODE;
+    jitCodePages_np.clear();
+    jitAt_np.assign(codeLimit_np >> 2, NULL);
+    jitCursor_np = jitFirstBlock_np;
+    jitGeneration_np++;
+}
+
+// A way out of a translated block, emitted after the block body
+struct JitExit {
+    unsigned char *rel;      // Jump that leads here
+    unsigned int pc;         // Guest pc to continue at
+    unsigned int refund;     // Charged instructions that did not run
+    bool chain;              // Direct successor: the jump may be patched to it
+    bool codeWrite;
+};
+
+// Store that missed the page-state fast path
+struct JitSlowStore {
+    unsigned char *rel[2];   // One or two page checks jump here
+    unsigned char *resume;
+    unsigned int size;
+    unsigned int pc;
+    unsigned int refund;
+};
+
+// Emit the loads, stores and ALU work of one decoded instruction
+static void jit_emit_op(JitEmitter &e, unsigned char k, const ThreadedOp &op) {
+    static const unsigned char REG_OPCODE[] = {0x03, 0x2B}; // add, sub
+    switch (k) {
+        case NP_ADD: case NP_SUB:
+            e.loadGuest(JR_EAX, op.rs1); e.guest(REG_OPCODE[k - NP_ADD], JR_EAX, op.rs2); break;
+        case NP_XOR: e.loadGuest(JR_EAX, op.rs1); e.guest(0x33, JR_EAX, op.rs2); break;
+        case NP_OR:  e.loadGuest(JR_EAX, op.rs1); e.guest(0x0B, JR_EAX, op.rs2); break;
+        case NP_AND: e.loadGuest(JR_EAX, op.rs1); e.guest(0x23, JR_EAX, op.rs2); break;
+        case NP_MUL: e.loadGuest(JR_EAX, op.rs1); e.imulGuest(op.rs2); break;
+        case NP_SLT: case NP_SLTU:
+            e.loadGuest(JR_EAX, op.rs1); e.guest(0x3B, JR_EAX, op.rs2);
+            e.setcc(k == NP_SLT ? JCC_L : JCC_B);
             break;
-        }
-        case 'J': {
-            subtype_np = "jal";
+        case NP_SLL: case NP_SRL: case NP_SRA:
+            e.loadGuest(JR_ECX, op.rs2); e.loadGuest(JR_EAX, op.rs1);
+            e.shiftCl(k == NP_SLL ? 4 : (k == NP_SRL ? 5 : 7));
             break;
-        }
-        case 'S': {
-            if (Func3 == "000")
-                subtype_np = "sb";
-            else if (Func3 == "001")
-                subtype_np = "sh";
-            else if (Func3 == "010")
-                subtype_np = "sw";
-            else if (Func3 == "011")
-                subtype_np = "sd";
+        case NP_DIV: case NP_REM:
+            e.loadGuest(JR_EDI, op.rs1); e.loadGuest(JR_ESI, op.rs2);
+            e.callHelper(reinterpret_cast<const void *>(k == NP_DIV ? div_np : rem_np));
             break;
-        }
-        case 'U': {
-            if (Op == "0010111")
-                subtype_np = "auipc";
-            else if (Op == "0110111")
-                subtype_np = "lui";
+        case NP_ADDI: e.loadGuest(JR_EAX, op.rs1); e.aluImm(0x05, op.imm); break;
+        case NP_XORI: e.loadGuest(JR_EAX, op.rs1); e.aluImm(0x35, op.imm); break;
+        case NP_ORI:  e.loadGuest(JR_EAX, op.rs1); e.aluImm(0x0D, op.imm); break;
+        case NP_ANDI: e.loadGuest(JR_EAX, op.rs1); e.aluImm(0x25, op.imm); break;
+        case NP_SLTI: case NP_SLTIU:
+            e.loadGuest(JR_EAX, op.rs1); e.aluImm(0x3D, op.imm);
+            e.setcc(k == NP_SLTI ? JCC_L : JCC_B);
+            break;
+        case NP_SLLI: case NP_SRLI: case NP_SRAI:
+            e.loadGuest(JR_EAX, op.rs1);
+            e.shiftImm(k == NP_SLLI ? 4 : (k == NP_SRLI ? 5 : 7), op.imm);
+            break;
+        case NP_LB: case NP_LH: case NP_LW: case NP_LBU: case NP_LHU: {
+            // Second opcode byte of movsx/movzx, or 0 for a plain 32-bit mov
+            static const unsigned char LOAD_OPCODE[] = {0xBE, 0xBF, 0, 0xB6, 0xB7};
+            e.loadGuest(JR_EAX, op.rs1); e.aluImm(0x05, op.imm);
+            e.byte(0x41);
+            if (LOAD_OPCODE[k - NP_LB]) { e.byte(0x0F); e.byte(LOAD_OPCODE[k - NP_LB]); }
+            else e.byte(0x8B);
+            e.byte(0x04); e.byte(0x04);             // eax <- [r12 + rax]
             break;
         }
+        case NP_LUI: case NP_AUIPC:
+            e.storeGuestImm(op.rd, op.imm);
+            return;
         default:
-            cout << "error" << endl;
+            return;
+    }
+    e.storeGuest(op.rd);
+}
+
+// Translate the block at `start`; NULL when it begins with a halt
+unsigned char *FunctionalCore::jit_compile_np(unsigned int start) {
+    ThreadedOp ops[JIT_MAX_BLOCK];
+    unsigned char kinds[JIT_MAX_BLOCK];
+    unsigned int n = 0;
+    unsigned int pc = start;
+    bool terminated = false;
+    while (n < JIT_MAX_BLOCK) {
+        unsigned int word = (pc < codeLimit_np) ? MEM_np.load32(pc) : 0xFFFFFFFF;
+        kinds[n] = decode_np(word, pc, ops[n]);
+        if (kinds[n] == NP_HALT)
+            break;
+        pc += 4;
+        terminated = (kinds[n] >= NP_BEQ && kinds[n] <= NP_JALR);
+        n++;
+        if (terminated)
+            break;
+    }
+    if (n == 0)
+        return NULL;
+    if (jitCursor_np + JIT_MAX_BLOCK_BYTES > jitCache_np + JIT_CACHE_SIZE)
+        flush_jit_np();
+
+    JitEmitter e = {jitCursor_np};
+    unsigned char *entry = e.p;
+    vector<JitExit> exits;
+    vector<JitSlowStore> slowStores;
+
+    // Charge the whole block up front; leave if the budget cannot cover it
+    e.ctxQword(7, JIT_CTX(budget), n);
+    JitExit budgetExit = {e.jcc32(JCC_L), start, 0, false, false};
+    exits.push_back(budgetExit);
+    e.ctxQword(5, JIT_CTX(budget), n);
+
+    for (unsigned int i = 0; i < n; i++) {
+        const ThreadedOp &op = ops[i];
+        unsigned char k = kinds[i];
+        if (k >= NP_SB && k <= NP_SW) {
+            // eax = address, ecx = value, then check the page(s) written
+            static const unsigned int STORE_SIZE[] = {1, 2, 4};
+            unsigned int size = STORE_SIZE[k - NP_SB];
+            e.loadGuest(JR_EAX, op.rs1); e.aluImm(0x05, op.imm);
+            e.loadGuest(JR_ECX, op.rs2);
+            if (k == NP_SH) e.byte(0x66);
+            e.byte(0x41); e.byte(k == NP_SB ? 0x88 : 0x89); e.byte(0x0C); e.byte(0x04);  // [r12 + rax] <- ecx
+            JitSlowStore slow = {{NULL, NULL}, NULL, size, op.pc, n - i - 1};
+            for (unsigned int check = 0; check < (size > 1 ? 2u : 1u); check++) {
+                if (check == 0) { e.byte(0x89); e.byte(0xC2); }                      // mov edx, eax
+                else { e.byte(0x8D); e.byte(0x50); e.byte(size - 1); }                // lea edx, [rax + size - 1]
+                e.byte(0xC1); e.byte(0xEA); e.byte(GUEST_PAGE_SHIFT);                 // shr edx, 12
+                e.byte(0x41); e.byte(0x80); e.byte(0x3C); e.byte(0x16);               // cmp byte [r14 + rdx],
+                e.byte(PAGE_DIRTY | PAGE_TOUCHED);                                    //     DIRTY|TOUCHED
+                slow.rel[check] = e.jcc32(JCC_NE);
+            }
+            slow.resume = e.p;
+            slowStores.push_back(slow);
+        }
+        else if (k >= NP_BEQ && k <= NP_BGEU) {
+            static const unsigned char BRANCH_CC[] = {JCC_E, JCC_NE, JCC_L, JCC_GE, JCC_B, JCC_AE};
+            e.loadGuest(JR_EAX, op.rs1); e.guest(0x3B, JR_EAX, op.rs2);
+            e.byte(0x70 | BRANCH_CC[k - NP_BEQ]); e.byte(5);                          // jcc over the fall-through jump
+            JitExit fall = {e.jmp32(), op.pc + 4, 0, true, false};
+            JitExit taken = {e.jmp32(), op.pc + op.imm, 0, true, false};
+            exits.push_back(fall);
+            exits.push_back(taken);
+        }
+        else if (k == NP_JAL) {
+            if (op.rd)
+                e.storeGuestImm(op.rd, op.pc + 4);
+            JitExit target = {e.jmp32(), op.pc + op.imm, 0, true, false};
+            exits.push_back(target);
+        }
+        else if (k == NP_JALR) {
+            e.loadGuest(JR_EAX, op.rs1); e.aluImm(0x05, op.imm);
+            e.byte(0x83); e.byte(0xE0); e.byte(0xFE);                                 // and eax, ~1
+            if (op.rd)
+                e.storeGuestImm(op.rd, op.pc + 4);
+            e.ctxStoreEax(JIT_CTX(exitPC));
+            e.ctxStorePtr(JIT_CTX(patchSite), NULL);
+            jit_link(e.jmp32(), jitExit_np);
+        }
+        else if (op.run != np_nop) {
+            jit_emit_op(e, k, op);
+        }
+    }
+    if (!terminated) {
+        // Block cap or a halt: continue (or stop) at the next pc
+        JitExit next = {e.jmp32(), pc, 0, true, false};
+        exits.push_back(next);
+    }
+
+    for (size_t i = 0; i < slowStores.size(); i++) {
+        const JitSlowStore &slow = slowStores[i];
+        for (int check = 0; check < 2; check++)
+            if (slow.rel[check])
+                jit_link(slow.rel[check], e.p);
+        e.byte(0x89); e.byte(0xC7);                                                   // mov edi, eax
+        e.byte(0xBE); e.word32(slow.size);                                            // mov esi, size
+        e.byte(0x48); e.byte(0x89); e.byte(0xDA);                                     // mov rdx, rbx
+        e.callHelper(reinterpret_cast<const void *>(jit_store_slow));
+        e.byte(0x85); e.byte(0xC0);                                                   // test eax, eax
+        JitExit codeWrite = {e.jcc32(JCC_NE), slow.pc + 4, slow.refund, false, true};
+        exits.push_back(codeWrite);
+        jit_link(e.jmp32(), slow.resume);
+    }
+    for (size_t i = 0; i < exits.size(); i++) {
+        const JitExit &exit = exits[i];
+        jit_link(exit.rel, e.p);
+        e.ctxStoreImm(JIT_CTX(exitPC), exit.pc);
+        e.ctxStorePtr(JIT_CTX(patchSite), exit.chain ? exit.rel : NULL);
+        if (exit.refund)
+            e.ctxQword(0, JIT_CTX(budget), exit.refund);
+        if (exit.codeWrite)
+            e.ctxStoreImm(JIT_CTX(codeWritten), 1);
+        jit_link(e.jmp32(), jitExit_np);
+    }
+    jitCursor_np = e.p;
+
+    // Later stores to these pages must invalidate the translation
+    for (unsigned int page = start >> GUEST_PAGE_SHIFT; page <= (pc - 1) >> GUEST_PAGE_SHIFT; page++) {
+        if (!(MEM_np.pageState[page] & PAGE_CODE)) {
+            MEM_np.pageState[page] |= PAGE_CODE;
+            jitCodePages_np.push_back(page);
+        }
     }
-    return Func3;
+    tierStats_np.promotions[TIER_JIT]++;
+    return entry;
+}
+
+// Native code for `pc`, translating it if it is hot enough; NULL otherwise
+unsigned char *FunctionalCore::jit_entry_np(unsigned int pc) {
+    if (pc >= codeLimit_np || (pc & 3))
+        return NULL;
+    if (!jitAt_np[pc >> 2]) {
+        if (heat_np[pc >> 2] < jitThreshold_np)
+            return NULL;
+        unsigned char *code = jit_compile_np(pc);
+        jitAt_np[pc >> 2] = code;   // After the compile, which may have flushed
+    }
+    return jitAt_np[pc >> 2];
+}
+
+// JIT tier: run native code until the budget is down to less than one block,
+// or until control reaches a block without a translation
+unsigned int FunctionalCore::run_jit_np(unsigned int limit) {
+    if (!jitCache_np && !jit_init_np()) {
+        jitEnabled_np = false;
+        jitThreshold_np = 0xFFFFFFFF;
+        return 0;
+    }
+    jitCtx_np.x = X_np;
+    jitCtx_np.mem = MEM_np.base;
+    jitCtx_np.pageState = MEM_np.pageState;
+    jitCtx_np.guest = &MEM_np;
+    jitCtx_np.budget = limit;
+    jitCtx_np.codeWritten = 0;
+
+    unsigned char *code = jit_entry_np(pc_np);
+    while (code && jitCtx_np.budget >= JIT_MAX_BLOCK) {
+        jitCtx_np.patchSite = NULL;
+        jitEnter_np(&jitCtx_np, code);
+        pc_np = jitCtx_np.exitPC;
+        if (jitCtx_np.codeWritten) {
+            jitCtx_np.codeWritten = 0;
+            flush_blocks_np();
+        }
+        unsigned char *site = jitCtx_np.patchSite;
+        unsigned int generation = jitGeneration_np;
+        if (pc_np < codeLimit_np && !(pc_np & 3))
+            heat_np[pc_np >> 2]++;
+        code = jit_entry_np(pc_np);
+        if (code && site && generation == jitGeneration_np)
+            jit_link(site, code);   // Chain: next time the block jumps straight here
+    }
+    return limit - (unsigned int)jitCtx_np.budget;
+}
+
+#endif // NP_JIT
+
+#ifndef NP_JIT
+void FunctionalCore::flush_jit_np() {}
+#endif
+
+void FunctionalCore::set_jit_np(bool enabled) {
+#ifdef NP_JIT
+    jitEnabled_np = enabled;
+    jitThreshold_np = enabled ? JIT_THRESHOLD : 0xFFFFFFFF;
+#else
+    if (enabled)
+        cerr << "Warning: --jit needs an x86-64 host; using the threaded interpreter." << endl;
+#endif
+}
+
+// Execute up to `limit` instructions from pc_np, each block in the tier its
+// heat calls for; returns how many ran
+unsigned int FunctionalCore::run_functional_np(unsigned int limit) {
+    unsigned int done = 0;
+    halted_np = false;
+    while (done < limit && !halted_np) {
+        unsigned int left = limit - done;
+        unsigned int heat = (pc_np < codeLimit_np && !(pc_np & 3)) ? heat_np[pc_np >> 2] : 0;
+        ExecTier_np tier = TIER_INTERPRET;
+        unsigned int ran = 0;
+#ifdef NP_JIT
+        if (heat >= jitThreshold_np && left >= JIT_MAX_BLOCK) {
+            tier = TIER_JIT;
+            ran = run_jit_np(left);
+        }
+        else
+#endif
+        if (heat >= THREADED_THRESHOLD) {
+            tier = TIER_THREADED;
+            ran = run_threaded_np(left);
+        }
+        if (ran == 0 && !halted_np) {
+            // Cold block, or a higher tier could not start here
+            tier = TIER_INTERPRET;
+            ran = interpret_np(left);
+        }
+        tierStats_np.instructions[tier] += ran;
+        done += ran;
+    }
+    clockCycles_np += done;
+    return done;
+}
+
+unsigned int FunctionalCore::read_word_np(unsigned int address) {
+    return MEM_np.load32(address);
 }
 
 // --- Memory and Register Dumping Functions ---
-void load_resister_np() {
+void FunctionalCore::load_resister_np() {
     FILE *fp = fopen("register.mem", "w");
     if (fp == NULL) {
         printf("Error opening register.mem for writing.");
@@ -219,28 +890,28 @@ void load_resister_np() {
     fclose(fp);
 }
 
-void load_Memory_np() {
+void FunctionalCore::load_Memory_np() {
     FILE *fp = fopen("D_Memory.mem", "w");
     if (fp == NULL) {
         printf("Error opening D_Memory.mem for writing.");
         return;
     }
-    
+
     fprintf(fp, "=== DATA MEMORY CONTENTS ===\n");
-    // Dump a portion of DMEM_np (e.g., first 50 words)
+    // Dump a portion of data memory (e.g., first 50 words)
     for (unsigned int i = 0; i < 50; i++) {
-        unsigned int addr = 0x10000000 + i * 4;
-        fprintf(fp, "Addr 0x%08x: 0x%08x\n", addr, DMEM_np[i]);
+        unsigned int addr = DATA_BASE_np + i * 4;
+        fprintf(fp, "Addr 0x%08x: 0x%08x\n", addr, read_word_np(addr));
     }
     fclose(fp);
-    
+
     // Also print to console for immediate visibility
-    cout << "DATA MEMORY DUMP (first 50 locations):" << endl;
+    console << "DATA MEMORY DUMP (first 50 locations):" << endl;
     for (int i = 0; i < 50; i++) {
-        cout << "DMEM_np[" << i << "] (addr 0x" << hex << (0x10000000 + i * 4)
-             << "): 0x" << DMEM_np[i] << dec << endl;
+        console << "DMEM[" << i << "] (addr 0x" << hex << (DATA_BASE_np + i * 4)
+             << "): 0x" << read_word_np(DATA_BASE_np + i * 4) << dec << endl;
     }
-    
+
     // Dump Stack Memory
     fp = fopen("stack_mem.mem", "w");
     if (fp == NULL) {
@@ -251,92 +922,67 @@ void load_Memory_np() {
     for (unsigned int i = 0; i < STACK_SIZE; i++) {
         // Compute the effective address for each word in the stack.
         unsigned int addr = STACK_TOP - i * 4;
-        fprintf(fp, "Addr 0x%08x: 0x%08x\n", addr, STACKMEM_np[i]);
+        fprintf(fp, "Addr 0x%08x: 0x%08x\n", addr, read_word_np(addr));
     }
     fclose(fp);
-    
-    cout << "\nSTACK MEMORY DUMP (first 50 locations):" << endl;
+
+    console << "\nSTACK MEMORY DUMP (first 50 locations):" << endl;
     for (int i = 0; i < 50 && i < (int)STACK_SIZE; i++) {
-        cout << "STACKMEM_np[" << i << "] (addr 0x" << hex << (STACK_TOP - i * 4)
-             << "): 0x" << STACKMEM_np[i] << dec << endl;
+        console << "STACKMEM[" << i << "] (addr 0x" << hex << (STACK_TOP - i * 4)
+             << "): 0x" << read_word_np(STACK_TOP - i * 4) << dec << endl;
     }
 }
 
-// Exit the simulator (writing out memories first)
-void swi_exit_np() {
-    cout << "Terminating simulation after " << clockCycles_np << " clock cycles." << endl;
-    load_resister_np();
-    load_Memory_np();
-    // Remove persistent state file so that next run resets the state.
-    if (remove("sim_state.dat") != 0) {
-        perror("Error deleting state file");
-    } else {
-        cout << "State reset (sim_state.dat removed)." << endl;
-    }
-    exit(0);
+// Remove persistent state file so that next run resets the state.
+void FunctionalCore::remove_state_np() {
+    if (remove("sim_state.dat") == 0)
+        console << "State reset (sim_state.dat removed)." << endl;
 }
 
 // --- Processor Initialization ---
-void reset_proc_np() {
+void FunctionalCore::reset_proc_np() {
+    if (!MEM_np.reserve()) {
+        cerr << "Error: Could not reserve the 4 GiB guest address space." << endl;
+        exit(1);
+    }
     for (int i = 0; i < 32; i++)
         X_np[i] = 0;
     // Initialize the stack pointer (x2) to the top of the stack.
-    X_np[2] = STACK_TOP;  
-    for (int i = 0; i < 4000; i++)
-        MEM_np[i] = 0;
-    for (int i = 0; i < 1000000; i++)
-        DMEM_np[i] = 0;
-    // Initialize STACKMEM_np to 0.
-    for (int i = 0; i < STACK_SIZE; i++)
-        STACKMEM_np[i] = 0;
-}
-
-// --- Read and Write Word Helpers ---
-int read_word_np(unsigned int *mem, unsigned int address) {
-    int *data = (int *)(mem + address);
-    return *data;
-}
-void write_word_np(unsigned int *mem, unsigned int address, unsigned int data) {
-    int *data_p = (int *)(mem + address);
-    *data_p = data;
-    sz_np++;  // count the number of instructions
-}
-
-// Write the data memory to file (if needed)
-void write_data_memory_np() {
-    FILE *fp = fopen("data_out.mc", "w");
-    if (fp == NULL) {
-        printf("Error opening data_out.mc for writing.");
-        return;
-    }
-    for (unsigned int i = 0; i < 1000000; i += 4) {
-        fprintf(fp, "Address: %08x Data: %08x\n", 0x10000000 + i, DMEM_np[i]);
-    }
-    fclose(fp);
+    X_np[2] = STACK_TOP;
+    MEM_np.clear();
+    pc_np = 0;
+    sz_np = 0;
+    clockCycles_np = 0;
+    codeLimit_np = 0;
+    halted_np = false;
+    tierStats_np = TierStats_np();
+    heat_np.clear();
+    flush_blocks_np();
 }
 
 // --- Modified Loader: Handles Both Instruction and Data Segments ---
-// Reads from "optimizedbbs.mc". For instruction lines, expects:
+// For instruction lines, expects:
 //   "0x<addr> 0x<instruction> , <assembly> # <comment>"
 // The loader pads the instruction field to 8 hex digits.
 // Modify load_program_memory_np to support assembler directives
-void load_program_memory_np(bool skipdata) {
-    FILE *fp = fopen("factorial.mc", "r");
+bool FunctionalCore::load_program_memory_np(const string &inputFile, bool skipdata) {
+    FILE *fp = fopen(inputFile.c_str(), "r");
     if (fp == NULL) {
-        printf("Error opening input file optimizedbbs.mc\n");
-        exit(1);
+        printf("Error opening input file %s\n", inputFile.c_str());
+        return false;
     }
-    
+    inputFile_np = inputFile;
+    sz_np = 0;
+
     char line[1024];
     bool in_text_segment = true;  // By default, we start in the text segment
-    unsigned int current_addr = 0;
-    unsigned int data_addr = 0x10000000;
-    
+    unsigned int data_addr = DATA_BASE_np;
+
     // Process each line
     while (fgets(line, sizeof(line), fp)) {
         // Skip empty lines
         if (strlen(line) < 2) continue;
-        
+
         // Handle directives
         if (line[0] == '.') {
             // Handle .text directive
@@ -358,10 +1004,7 @@ void load_program_memory_np(bool skipdata) {
                     // Parse byte value
                     int value;
                     if (sscanf(line + 5, "%i", &value) == 1) {
-                        unsigned int index = (data_addr - 0x10000000) / 4;
-                        int byte_pos = data_addr % 4;
-                        unsigned int mask = ~(0xFF << (byte_pos * 8));
-                        DMEM_np[index] = (DMEM_np[index] & mask) | ((value & 0xFF) << (byte_pos * 8));
+                        MEM_np.store8(data_addr, value & 0xFF);
                         data_addr += 1;
                     }
                 }
@@ -371,10 +1014,7 @@ void load_program_memory_np(bool skipdata) {
                     if (sscanf(line + 5, "%i", &value) == 1) {
                         // Ensure address is aligned
                         data_addr = (data_addr + 1) & ~1;
-                        unsigned int index = (data_addr - 0x10000000) / 4;
-                        int half_pos = (data_addr % 4) / 2;
-                        unsigned int mask = ~(0xFFFF << (half_pos * 16));
-                        DMEM_np[index] = (DMEM_np[index] & mask) | ((value & 0xFFFF) << (half_pos * 16));
+                        MEM_np.store16(data_addr, value & 0xFFFF);
                         data_addr += 2;
                     }
                 }
@@ -384,8 +1024,7 @@ void load_program_memory_np(bool skipdata) {
                     if (sscanf(line + 5, "%i", &value) == 1) {
                         // Ensure address is aligned
                         data_addr = (data_addr + 3) & ~3;
-                        unsigned int index = (data_addr - 0x10000000) / 4;
-                        DMEM_np[index] = value;
+                        MEM_np.store32(data_addr, value);
                         data_addr += 4;
                     }
                 }
@@ -395,75 +1034,54 @@ void load_program_memory_np(bool skipdata) {
                     if (sscanf(line + 6, "%lli", &value) == 1) {
                         // Ensure address is aligned
                         data_addr = (data_addr + 7) & ~7;
-                        unsigned int index = (data_addr - 0x10000000) / 4;
-                        DMEM_np[index] = value & 0xFFFFFFFF;
-                        DMEM_np[index + 1] = (value >> 32) & 0xFFFFFFFF;
+                        MEM_np.store32(data_addr, value & 0xFFFFFFFF);
+                        MEM_np.store32(data_addr + 4, (value >> 32) & 0xFFFFFFFF);
                         data_addr += 8;
                     }
                 }
                 else if (strncmp(line, ".asciz", 6) == 0) {
                     // Parse null-terminated string
-                    char str[256];
                     char* p = line + 6;
                     while (*p && (*p == ' ' || *p == '\t')) p++; // Skip whitespace
-                    
+
                     if (*p == '"') {
                         p++; // Skip opening quote
-                        int i = 0;
-                        while (*p && *p != '"' && *p != '\n') {
-                            str[i++] = *p++;
-                        }
-                        str[i] = '\0'; // Null terminate
-                        
                         // Store string including null terminator
-                        for (i = 0; str[i] != '\0'; i++) {
-                            unsigned int index = (data_addr - 0x10000000) / 4;
-                            int byte_pos = data_addr % 4;
-                            unsigned int mask = ~(0xFF << (byte_pos * 8));
-                            DMEM_np[index] = (DMEM_np[index] & mask) | ((str[i] & 0xFF) << (byte_pos * 8));
-                            data_addr++;
+                        while (*p && *p != '"' && *p != '\n') {
+                            MEM_np.store8(data_addr++, *p++);
                         }
-                        // Add null terminator
-                        unsigned int index = (data_addr - 0x10000000) / 4;
-                        int byte_pos = data_addr % 4;
-                        unsigned int mask = ~(0xFF << (byte_pos * 8));
-                        DMEM_np[index] = (DMEM_np[index] & mask);
-                        data_addr++;
+                        MEM_np.store8(data_addr++, 0);
                     }
                 }
                 continue;
             }
         }
-        
+
         // Check if we reached a data segment marker
         if (strstr(line, ";; DATA SEGMENT") != NULL) {
             in_text_segment = false;
             continue;
         }
-        
+
         // Process instruction or data line depending on current segment
         if (in_text_segment) {
             // Process instruction
             char addrStr[64], instStr[64];
-            if (sscanf(line, "%s %s", addrStr, instStr) == 2) {
+            if (sscanf(line, "%63s %63s", addrStr, instStr) == 2) {
                 // Remove trailing comma if present
                 int len = strlen(instStr);
                 if (instStr[len - 1] == ',') {
                     instStr[len - 1] = '\0';
                 }
-                
+
                 // Process hex instruction
                 if (strncmp(instStr, "0x", 2) == 0) {
-                    char hexDigits[64];
-                    strcpy(hexDigits, instStr + 2);
-                    int dlen = strlen(hexDigits);
-                    char padded[9];
-                    memset(padded, '0', 8);
-                    padded[8] = '\0';
-                    strcpy(padded + (8 - dlen), hexDigits);
-                    unsigned int instruction = strtoul(padded, NULL, 16);
+                    unsigned int instruction = strtoul(instStr + 2, NULL, 16);
                     unsigned int address = strtoul(addrStr, NULL, 16);
-                    write_word_np(MEM_np, address, instruction);
+                    MEM_np.store32(address, instruction);
+                    sz_np++;  // count the number of instructions
+                    if (address + 4 > codeLimit_np)
+                        codeLimit_np = address + 4;
                 }
             }
         } else if (!skipdata) {
@@ -472,699 +1090,155 @@ void load_program_memory_np(bool skipdata) {
                 unsigned int d_address, b0, b1, b2, b3;
                 if (sscanf(line, "Address: %x | Data: %x %x %x %x", &d_address, &b0, &b1, &b2, &b3) == 5) {
                     unsigned int data = (b3 << 24) | (b2 << 16) | (b1 << 8) | b0;
-                    unsigned int index = (d_address - 0x10000000) / 4;
-                    DMEM_np[index] = data;
-                    cout << "Loaded data at address 0x" << hex << d_address 
-                         << " (index " << dec << index << "): 0x" 
-                         << hex << data << dec << endl;
+                    MEM_np.store32(d_address, data);
+                    console << "Loaded data at address 0x" << hex << d_address
+                         << ": 0x" << data << dec << endl;
                 }
             }
         }
     }
-    
+
     fclose(fp);
+    // Code changed, so every translated block is stale
+    flush_blocks_np();
     if (!skipdata){
     pc_np = 0;
     }
+    halted_np = false;
+    return true;
 }
 
-// --- Simulation Stages ---
-void fetch_np() {
-    inst_np = MEM_np[pc_np];
-    cout << "fetch_np instruction: 0x" << setw(8) << setfill('0') << hex << inst_np.to_ulong()
-         << " from address 0x" << setw(8) << setfill('0') << hex << pc_np << endl;
-    // Terminate if the instruction equals 0xffffffff.
-    if (inst_np.to_ulong() == 0xffffffff)
-        swi_exit_np();
-}
-
-void decode_np() {
-    cout << "Decode:" << endl;
-    bitset<7> op, func7;
-    bitset<3> func3;
-    bitset<5> rs1, rs2, rd;
-    
-    for (int i = 0; i < 7; i++)
-        op[i] = inst_np[i];
-    
-    // Determine instruction type
-    while (1) {
-        if (Type_np == '0')
-            Type_np = op_R_type_np(op);
-        if (Type_np == '0')
-            Type_np = op_I_type_np(op);
-        if (Type_np == '0')
-            Type_np = op_J_type_np(op);
-        if (Type_np == '0')
-            Type_np = op_B_type_np(op);
-        if (Type_np == '0')
-            Type_np = op_S_type_np(op);
-        if (Type_np == '0')
-            Type_np = op_U_type_np(op);
-        break;
-    }
-    cout << "Format of instruction: " << Type_np << endl;
-    
-    int j = 0;
-    for (int i = 25; i < 32; i++) {
-        func7[j++] = inst_np[i];
-    }
-    j = 0;
-    for (int i = 12; i < 15; i++) {
-        func3[j++] = inst_np[i];
-    }
-    j = 0;
-    for (int i = 15; i < 20; i++) {
-        rs1[j++] = inst_np[i];
-    }
-    operand1_np = rs1.to_ulong();
-    j = 0;
-    for (int i = 20; i < 25; i++) {
-        rs2[j++] = inst_np[i];
-    }
-    operand2_np = rs2.to_ulong();
-    
-    switch (Type_np) {
-        case 'R': {
-            j = 0;
-            for (int i = 7; i < 12; i++) {
-                rd[j++] = inst_np[i];
-            }
-            des_reg_np = rd.to_ulong();
-            cout << "Operand1: " << operand1_np << ", Operand2: " << operand2_np
-                 << ", RD: " << des_reg_np << endl;
-            break;
-        }
-        case 'I': {
-            bitset<12> immb;
-            j = 0;
-            bool isneg = false;
-            for (int i = 7; i < 12; i++) {
-                rd[j++] = inst_np[i];
-            }
-            des_reg_np = rd.to_ulong();
-            j = 0;
-            for (int i = 20; i < 32; i++) {
-                immb[j++] = inst_np[i];
-            }
-            cout << "DEBUG: I-type immediate bits: " << immb << endl;
-            if (immb[11] == 1) {
-                isneg = true;
-                string s1 = immb.to_string();
-                string s = findTwoscomplement_np(s1);
-                bitset<12> opl(s);
-                immb = opl;
-            }
-            imm_np = immb.to_ulong();
-            if (isneg)
-                imm_np = -1 * imm_np;
-            cout << "DEBUG: Final immediate value: " << imm_np << " (0x" << hex << imm_np << dec << ")" << endl;
-            cout << "Immediate: " << imm_np << ", Operand1: " << operand1_np
-                 << ", RD: " << des_reg_np << endl;
-            break;
-        }
-        case 'S': {
-            bitset<12> immb;
-            j = 0;
-            for (int i = 7; i < 12; i++) {
-                immb[j++] = inst_np[i];
-            }
-            for (int i = 25; i < 32; i++) {
-                immb[j++] = inst_np[i];
-            }
-            imm_np = immb.to_ulong();
-            if (immb[11] == 1)
-                imm_np = -1 * imm_np;
-            cout << "Immediate: " << imm_np << ", Operand1: " << operand1_np
-                 << ", Operand2: " << operand2_np << endl;
-            break;
-        }
-        case 'B': {
-            bitset<13> immb;
-            bool isneg = false;
-            immb[0] = 0;
-            j = 1;
-            for (int i = 8; i < 12; i++) {
-                immb[j++] = inst_np[i];
-            }
-            for (int i = 25; i < 31; i++) {
-                immb[j++] = inst_np[i];
-            }
-            immb[j++] = inst_np[7];
-            immb[j++] = inst_np[31];
-            if (immb[12] == 1) {
-                isneg = true;
-                string s1 = immb.to_string();
-                string s = findTwoscomplement_np(s1);
-                bitset<13> opl(s);
-                immb = opl;
-            }
-            imm_np = immb.to_ulong();
-            if (isneg)
-                imm_np = -1 * imm_np;
-            cout << "Immediate: " << imm_np << ", Operand1: " << operand1_np
-                 << ", Operand2: " << operand2_np << endl;
-            break;
-        }
-        case 'U': {
-            j = 0;
-            for (int i = 7; i < 12; i++) {
-                rd[j++] = inst_np[i];
-            }
-            des_reg_np = rd.to_ulong();
-            bitset<20> immb;
-            j = 0;
-            for (int i = 12; i < 32; i++) {
-                immb[j++] = inst_np[i];
-            }
-            imm_np = immb.to_ulong();
-            cout << "Immediate: " << imm_np << ", RD: " << des_reg_np << endl;
-            break;
-        }
-        case 'J': {
-            j = 0;
-            bitset<21> immb;
-            bool isneg = false;
-            immb[0] = 0;
-            j = 12;
-            for (int i = 12; i < 20; i++) {
-                immb[j++] = inst_np[i];
-            }
-            immb[11] = inst_np[20];
-            j = 1;
-            for (int i = 21; i < 31; i++) {
-                immb[j++] = inst_np[i];
-            }
-            immb[20] = inst_np[31];
-            if (immb[20] == 1) {
-                isneg = true;
-                string s1 = immb.to_string();
-                string s = findTwoscomplement_np(s1);
-                bitset<21> opl(s);
-                immb = opl;
-            }
-            imm_np = immb.to_ulong();
-            if (isneg)
-                imm_np = -1 * imm_np;
-            j = 0;
-            for (int i = 7; i < 12; i++) {
-                rd[j++] = inst_np[i];
-            }
-            des_reg_np = rd.to_ulong();
-            cout << "Immediate: " << imm_np << ", RD: " << des_reg_np << endl;
-            break;
-        }
-        default:
-            cout << "error" << endl;
-    }
-    subtype_select_np(func3, func7, op);
-}
-
-void execute_np() {
-    cout << "Operation is " << subtype_np << endl;
-    cout << "execute_np:" << endl;
-    if (Type_np == 'R') {
-        if (subtype_np == "add") {
-            des_res_np = X_np[operand1_np] + X_np[operand2_np];
-            cout << "Adding " << operand1_np << " and " << operand2_np << endl;
-        }
-        else if (subtype_np == "mul") {
-            des_res_np = X_np[operand1_np] * X_np[operand2_np];
-            cout << "Multiplying " << operand1_np << " and " << operand2_np << endl;
-        }
-        else if (subtype_np == "div") {
-            if (X_np[operand2_np] == 0) {
-                des_res_np = -1; // Handle division by zero
-                cout << "Division by zero! Setting result to -1" << endl;
-            } else {
-                des_res_np = static_cast<int>(X_np[operand1_np]) / static_cast<int>(X_np[operand2_np]);
-                cout << "Dividing " << operand1_np << " by " << operand2_np << endl;
-            }
-        }
-        else if (subtype_np == "rem") {
-            if (X_np[operand2_np] == 0) {
-                des_res_np = X_np[operand1_np]; // Handle remainder by zero
-                cout << "Remainder by zero! Setting result to the dividend" << endl;
-            } else {
-                des_res_np = static_cast<int>(X_np[operand1_np]) % static_cast<int>(X_np[operand2_np]);
-                cout << "Remainder of " << operand1_np << " divided by " << operand2_np << endl;
-            }
-        }
-        else if (subtype_np == "sub") {
-            des_res_np = X_np[operand1_np] - X_np[operand2_np];
-            cout << "Subtracting " << operand1_np << " and " << operand2_np << endl;
-        }
-        else if (subtype_np == "and") {
-            des_res_np = X_np[operand1_np] & X_np[operand2_np];
-            cout << "Bitwise AND " << operand1_np << " and " << operand2_np << endl;
-        }
-        else if (subtype_np == "or") {
-            des_res_np = X_np[operand1_np] | X_np[operand2_np];
-            cout << "Bitwise OR " << operand1_np << " and " << operand2_np << endl;
-        }
-        else if (subtype_np == "sll") {
-            des_res_np = X_np[operand1_np] << X_np[operand2_np];
-            cout << "Shift Left " << operand1_np << " and " << operand2_np << endl;
-        }
-        else if (subtype_np == "slt") {
-            des_res_np = (X_np[operand1_np] < X_np[operand2_np]) ? 1 : 0;
-            cout << "Set Less Than " << operand1_np << " and " << operand2_np << endl;
-        }
-        else if (subtype_np == "sra") {
-            des_res_np = X_np[operand1_np] >> X_np[operand2_np];
-            cout << "Shift Right Arithmetic " << operand1_np << " and " << operand2_np << endl;
-        }
-        else if (subtype_np == "srl") {
-            des_res_np = X_np[operand1_np] >> X_np[operand2_np];
-            cout << "Shift Right Logical " << operand1_np << " and " << operand2_np << endl;
-        }
-        else if (subtype_np == "xor") {
-            des_res_np = X_np[operand1_np] ^ X_np[operand2_np];
-            cout << "Bitwise XOR " << operand1_np << " and " << operand2_np << endl;
-        }
-        pc_np = pc_np + 4;
-    }
-    else if (Type_np == 'I') {
-        if (subtype_np == "addi") {
-            des_res_np = X_np[operand1_np] + imm_np;
-            cout << "Adding " << operand1_np << " and " << imm_np << endl;
-        }
-        else if (subtype_np == "andi") {
-            des_res_np = X_np[operand1_np] & imm_np;
-            cout << "Bitwise AND " << operand1_np << " and " << imm_np << endl;
-        }
-        else if (subtype_np == "ori") {
-            des_res_np = X_np[operand1_np] | imm_np;
-            cout << "Bitwise OR " << operand1_np << " and " << imm_np << endl;
-        }
-        else if (subtype_np == "lb" || subtype_np == "lh" || subtype_np == "lw") {
-            des_res_np = X_np[operand1_np] + imm_np;
-            cout << "Calculating memory address: " << operand1_np << " + " << imm_np << endl;
-        }
-        else if (subtype_np == "jalr") {
-            des_res_np = pc_np + 4;
-            pc_np = X_np[operand1_np] + imm_np;
-            cout << "jalr: new PC = " << X_np[operand1_np] + imm_np << endl;
-        }
-        else if (subtype_np == "slli") {
-            des_res_np = X_np[operand1_np] << imm_np;
-            cout << "Shift Left " << operand1_np << " by " << imm_np << endl;
-        }
-        if (subtype_np != "jalr")
-            pc_np = pc_np + 4;
-    }
-    else if (Type_np == 'B') {
-        if (subtype_np == "beq") {
-            if (X_np[operand1_np] == X_np[operand2_np]) {
-                pc_np += imm_np;
-                cout << "Branch taken (beq): PC += " << imm_np << endl;
-            } else {
-                pc_np += 4;
-                cout << "Branch not taken (beq): PC += 4" << endl;
-            }
-        }
-        else if (subtype_np == "bne") {
-            if (X_np[operand1_np] != X_np[operand2_np]) {
-                pc_np += imm_np;
-                cout << "Branch taken (bne): PC += " << imm_np << endl;
-            } else {
-                pc_np += 4;
-                cout << "Branch not taken (bne): PC += 4" << endl;
-            }
-        }
-        else if (subtype_np == "bge") {
-            if (X_np[operand1_np] >= X_np[operand2_np]) {
-                pc_np += imm_np;
-                cout << "Branch taken (bge): PC += " << imm_np << endl;
-            } else {
-                pc_np += 4;
-                cout << "Branch not taken (bge): PC += 4" << endl;
-            }
-        }
-        else if (subtype_np == "blt") {
-            if (X_np[operand1_np] < X_np[operand2_np]) {
-                pc_np += imm_np;
-                cout << "Branch taken (blt): PC += " << imm_np << endl;
-            } else {
-                pc_np += 4;
-                cout << "Branch not taken (blt): PC += 4" << endl;
-            }
-        }
-    }
-    else if (Type_np == 'J') {
-        des_res_np = pc_np + 4;
-        pc_np += imm_np;
-        cout << "Jump (jal): new PC = " << pc_np << " (immediate " << imm_np << ")" << endl;
-    }
-    else if (Type_np == 'S') {
-        des_res_np = X_np[operand1_np] + imm_np;
-        pc_np = pc_np + 4;
-        cout << "Store: calculated memory address = " << des_res_np << endl;
-    }
-    else if (Type_np == 'U') {
-        if (subtype_np == "auipc") {
-            des_res_np = pc_np + (imm_np << 12);
-            cout << "auipc: PC + (imm<<12) = " << des_res_np << endl;
-        }
-        else if (subtype_np == "lui") {
-            des_res_np = imm_np << 12;
-            cout << "lui: imm << 12 = " << des_res_np << endl;
-        }
-        pc_np = pc_np + 4;
-    }
-}
-
-// Modify the mem_op_np function to handle ld and sd 
-void mem_op_np() {
-    cout << "Memory stage:" << endl;
-    // For load instructions
-    if (subtype_np == "lw" || subtype_np == "lh" || subtype_np == "lb" || subtype_np == "ld") {
-        cout << "Loading from memory at effective address 0x" 
-             << setw(8) << setfill('0') << hex << des_res_np << dec << endl;
-        
-        // Check if the effective address is in the stack region.
-        if (des_res_np >= STACK_BOTTOM && des_res_np <= STACK_TOP) {
-            // Compute index based on downward growth.
-            unsigned int index = (STACK_TOP - des_res_np) / 4;
-            unsigned int orig_des_res = des_res_np;
-            
-            if (subtype_np == "lb") {
-                // Load byte (8 bits) and sign-extend
-                int byte_offset = des_res_np % 4;
-                unsigned char byte_val = (STACKMEM_np[index] >> (byte_offset * 8)) & 0xFF;
-                des_res_np = (byte_val & 0x80) ? (byte_val | 0xFFFFFF00) : byte_val;
-            } 
-            else if (subtype_np == "lh") {
-                // Load half-word (16 bits) and sign-extend
-                int hw_offset = (des_res_np % 4) / 2;
-                unsigned short hw_val = (STACKMEM_np[index] >> (hw_offset * 16)) & 0xFFFF;
-                des_res_np = (hw_val & 0x8000) ? (hw_val | 0xFFFF0000) : hw_val;
-            }
-            else if (subtype_np == "lw") {
-                // Load word (32 bits)
-                des_res_np = STACKMEM_np[index];
-            }
-            else if (subtype_np == "ld") {
-                // Load double word (64 bits) - in 32-bit implementation, use two words
-                // For simplicity, just load the lower 32 bits
-                des_res_np = STACKMEM_np[index];
-                cout << "Note: ld only loading lower 32 bits in this 32-bit implementation" << endl;
-            }
-            
-            cout << "  Address 0x" << hex << orig_des_res 
-                 << " → STACKMEM_np[" << dec << index << "] = 0x" 
-                 << hex << des_res_np << dec << endl;
-        }
-        // Otherwise, if address falls in data memory region.
-        else if (des_res_np >= 0x10000000) {
-            unsigned int index = (des_res_np - 0x10000000) / 4;
-            unsigned int orig_des_res = des_res_np;
-            
-            if (subtype_np == "lb") {
-                // Load byte (8 bits) and sign-extend
-                int byte_offset = des_res_np % 4;
-                unsigned char byte_val = (DMEM_np[index] >> (byte_offset * 8)) & 0xFF;
-                des_res_np = (byte_val & 0x80) ? (byte_val | 0xFFFFFF00) : byte_val;
-            } 
-            else if (subtype_np == "lh") {
-                // Load half-word (16 bits) and sign-extend
-                int hw_offset = (des_res_np % 4) / 2;
-                unsigned short hw_val = (DMEM_np[index] >> (hw_offset * 16)) & 0xFFFF;
-                des_res_np = (hw_val & 0x8000) ? (hw_val | 0xFFFF0000) : hw_val;
-            }
-            else if (subtype_np == "lw") {
-                // Load word (32 bits)
-                des_res_np = DMEM_np[index];
-            }
-            else if (subtype_np == "ld") {
-                // Load double word (64 bits) - in 32-bit implementation, use two words
-                // For simplicity, just load the lower 32 bits
-                des_res_np = DMEM_np[index];
-                cout << "Note: ld only loading lower 32 bits in this 32-bit implementation" << endl;
-            }
-            
-            cout << "  Address 0x" << hex << orig_des_res 
-                 << " → DMEM_np[" << dec << index << "] = 0x" 
-                 << hex << des_res_np << dec << endl;
-        } else {
-            cout << "Error: Address 0x" << hex << des_res_np << " out of bounds." << dec << endl;
-            des_res_np = 0;
-        }
-    }
-    // For store instructions
-    else if (subtype_np == "sw" || subtype_np == "sh" || subtype_np == "sb" || subtype_np == "sd") {
-        cout << "Storing to memory at effective address 0x" 
-             << setw(8) << setfill('0') << hex << des_res_np << dec << endl;
-        // Check if the effective address is in the stack region.
-        if (des_res_np >= STACK_BOTTOM && des_res_np <= STACK_TOP) {
-            unsigned int index = (STACK_TOP - des_res_np) / 4;
-            unsigned int old_value = STACKMEM_np[index];
-            
-            if (subtype_np == "sb") {
-                // Store byte (8 bits)
-                int byte_offset = des_res_np % 4;
-                unsigned int mask = ~(0xFF << (byte_offset * 8));
-                STACKMEM_np[index] = (STACKMEM_np[index] & mask) | ((X_np[operand2_np] & 0xFF) << (byte_offset * 8));
-            }
-            else if (subtype_np == "sh") {
-                // Store half-word (16 bits)
-                int hw_offset = (des_res_np % 4) / 2;
-                unsigned int mask = ~(0xFFFF << (hw_offset * 16));
-                STACKMEM_np[index] = (STACKMEM_np[index] & mask) | ((X_np[operand2_np] & 0xFFFF) << (hw_offset * 16));
-            }
-            else if (subtype_np == "sw") {
-                // Store word (32 bits)
-                STACKMEM_np[index] = X_np[operand2_np];
-            }
-            else if (subtype_np == "sd") {
-                // Store double word (64 bits) - in 32-bit implementation, only lower 32 bits
-                STACKMEM_np[index] = X_np[operand2_np];
-                cout << "Note: sd only storing lower 32 bits in this 32-bit implementation" << endl;
-            }
-            
-            cout << "  Address 0x" << hex << des_res_np 
-                 << " → STACKMEM_np[" << dec << index << "] = 0x" 
-                 << hex << X_np[operand2_np] << " (was 0x" << old_value << ")" << dec << endl;
-        }
-        // Otherwise, if address is in data memory.
-        else if (des_res_np >= 0x10000000) {
-            unsigned int index = (des_res_np - 0x10000000) / 4;
-            unsigned int old_value = DMEM_np[index];
-            
-            if (subtype_np == "sb") {
-                // Store byte (8 bits)
-                int byte_offset = des_res_np % 4;
-                unsigned int mask = ~(0xFF << (byte_offset * 8));
-                DMEM_np[index] = (DMEM_np[index] & mask) | ((X_np[operand2_np] & 0xFF) << (byte_offset * 8));
-            }
-            else if (subtype_np == "sh") {
-                // Store half-word (16 bits)
-                int hw_offset = (des_res_np % 4) / 2;
-                unsigned int mask = ~(0xFFFF << (hw_offset * 16));
-                DMEM_np[index] = (DMEM_np[index] & mask) | ((X_np[operand2_np] & 0xFFFF) << (hw_offset * 16));
-            }
-            else if (subtype_np == "sw") {
-                // Store word (32 bits)
-                DMEM_np[index] = X_np[operand2_np];
-            }
-            else if (subtype_np == "sd") {
-                // Store double word (64 bits) - in 32-bit implementation, only lower 32 bits
-                DMEM_np[index] = X_np[operand2_np];
-                cout << "Note: sd only storing lower 32 bits in this 32-bit implementation" << endl;
-            }
-            
-            cout << "  Address 0x" << hex << des_res_np 
-                 << " → DMEM_np[" << dec << index << "] = 0x" 
-                 << hex << X_np[operand2_np] << " (was 0x" << old_value << ")" << dec << endl;
-        } else {
-            cout << "Error: Address 0x" << hex << des_res_np << " out of bounds." << dec << endl;
-        }
-    }
-    else {
-        cout << "No memory operation performed." << endl;
-    }
-}
-
-void write_back_np() {
-    cout << "WriteBack stage:" << endl;
-    if (Type_np != 'S' && Type_np != 'B') {
-        X_np[des_reg_np] = des_res_np;
-        cout << "Storing " << des_res_np << " into register " << des_reg_np << endl;
-    } else {
-        cout << "No WriteBack operation for this instruction." << endl;
-    }
-    X_np[0] = 0;  // Ensure x0 remains 0.
-    Type_np = '0';
-}
-void save_state_np() {
+// Save pc, counters, registers and every written guest page
+void FunctionalCore::save_state_np() {
     FILE *fp = fopen("sim_state.dat", "wb");
     if (fp == NULL) {
         perror("Error saving state");
         return;
     }
-    // Save program counter and clockCycles_np
+    const vector<unsigned int> &pages = MEM_np.touched;
+    unsigned int pageCount = pages.size();
+    fwrite(&STATE_MAGIC_np, sizeof(STATE_MAGIC_np), 1, fp);
     fwrite(&pc_np, sizeof(pc_np), 1, fp);
     fwrite(&clockCycles_np, sizeof(clockCycles_np), 1, fp);
-    // Save registers
+    fwrite(&sz_np, sizeof(sz_np), 1, fp);
+    fwrite(&codeLimit_np, sizeof(codeLimit_np), 1, fp);
     fwrite(X_np, sizeof(unsigned int), 32, fp);
-    // Save DMEM_np (all 1,000,000 integers) – adjust if you only need part of DMEM_np
-    fwrite(DMEM_np, sizeof(int), 1000000, fp);
-    // Save STACKMEMs
-    fwrite(STACKMEM_np, sizeof(int), STACK_SIZE, fp);
+    fwrite(&pageCount, sizeof(pageCount), 1, fp);
+    if (pageCount > 0)
+        fwrite(&pages[0], sizeof(unsigned int), pageCount, fp);
+    for (unsigned int i = 0; i < pageCount; i++)
+        fwrite(MEM_np.host(pages[i] << GUEST_PAGE_SHIFT), 1, GUEST_PAGE_SIZE, fp);
     fclose(fp);
-    cout << "State saved to sim_state.dat" << endl;
+    console << "State saved to sim_state.dat" << endl;
 }
 
 // Function to load state from the binary file, if it exists.
-bool load_state_np() {
+bool FunctionalCore::load_state_np() {
     FILE *fp = fopen("sim_state.dat", "rb");
     if (fp == NULL) {
         // File does not exist – no state to load.
         return false;
     }
-    // Load program counter and clockCycles_np
-    fread(&pc_np, sizeof(pc_np), 1, fp);
-    fread(&clockCycles_np, sizeof(clockCycles_np), 1, fp);
-    // Load registers
-    fread(X_np, sizeof(unsigned int), 32, fp);
-    // Load DMEM_np
-    fread(DMEM_np, sizeof(int), 1000000, fp);
-    // Load STACKMEM_np
-    fread(STACKMEM_np, sizeof(int), STACK_SIZE, fp);
+    unsigned int magic = 0, pageCount = 0;
+    if (fread(&magic, sizeof(magic), 1, fp) != 1 || magic != STATE_MAGIC_np) {
+        // Missing, or written by the pipelined simulator
+        fclose(fp);
+        return false;
+    }
+    reset_proc_np();
+    bool ok = fread(&pc_np, sizeof(pc_np), 1, fp) == 1 &&
+              fread(&clockCycles_np, sizeof(clockCycles_np), 1, fp) == 1 &&
+              fread(&sz_np, sizeof(sz_np), 1, fp) == 1 &&
+              fread(&codeLimit_np, sizeof(codeLimit_np), 1, fp) == 1 &&
+              fread(X_np, sizeof(unsigned int), 32, fp) == 32 &&
+              fread(&pageCount, sizeof(pageCount), 1, fp) == 1 &&
+              pageCount <= GUEST_PAGE_COUNT;
+    vector<unsigned int> pages(ok ? pageCount : 0);
+    if (ok && pageCount > 0)
+        ok = fread(&pages[0], sizeof(unsigned int), pageCount, fp) == pageCount;
+    for (unsigned int i = 0; ok && i < pageCount; i++) {
+        unsigned int address = pages[i] << GUEST_PAGE_SHIFT;
+        ok = pages[i] < GUEST_PAGE_COUNT &&
+             fread(MEM_np.host(address), 1, GUEST_PAGE_SIZE, fp) == GUEST_PAGE_SIZE;
+        if (ok)
+            MEM_np.markWritten(address);
+    }
     fclose(fp);
-    cout << "State loaded from sim_state.dat" << endl;
+    if (!ok) {
+        cerr << "Error: sim_state.dat is truncated or corrupt; starting over." << endl;
+        reset_proc_np();
+        return false;
+    }
+    flush_blocks_np();
+    console << "State loaded from sim_state.dat" << endl;
     return true;
 }
 
 
-void run_riscvsim_np() {
-    while (true) {
-        cout << "-----------------------------------------------------" << endl;
-        fetch_np();
-        decode_np();
-        execute_np();
-        mem_op_np();
-        write_back_np();
-        clockCycles_np++;
-        cout << "Clock cycles so far: " << clockCycles_np << endl;
-    }
+void FunctionalCore::run_riscvsim_np() {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    unsigned int done = run_functional_np(0xFFFFFFFF - clockCycles_np);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    console << "Terminating simulation after " << clockCycles_np << " clock cycles (PC 0x"
+         << hex << pc_np << dec << ")." << endl;
+    if (seconds > 0)
+        console << "Executed " << done << " instructions in " << fixed << setprecision(6) << seconds
+             << " s (" << setprecision(2) << done / seconds / 1e6 << " MIPS)." << endl;
+    console.unsetf(ios::floatfield);
+    remove_state_np();
 }
 
 // Function to execute a single instruction step in non-pipelined mode
-int run_step_np() {
-    cout << "-----------------------------------------------------" << endl;
-    cout << "Executing single instruction step (non-pipelined mode)" << endl;
-
-    // Variables to hold saved state values - add state loading similar to nonPipelined_main
-    unsigned int saved_pc = 0;
-    bool stateLoaded = load_state_np();
-    if (stateLoaded) {
-        // Save the loaded pc
-        saved_pc = pc_np;
-        // Load instructions from file, since instructions are not saved in sim_state.dat
-        load_program_memory_np(true);
-        // Restore the saved pc so execution continues where it left off
-        pc_np = saved_pc;
-        cout << "Loaded saved state - continuing from PC: 0x" << hex << pc_np << dec << endl;
+int FunctionalCore::run_step_np() {
+    console << "-----------------------------------------------------" << endl;
+    console << "Executing single instruction step (non-pipelined mode)" << endl;
+
+    if (load_state_np()) {
+        // Memory (code included) comes back from the state file
+        console << "Loaded saved state - continuing from PC: 0x" << hex << pc_np << dec << endl;
     } else {
         // First run or reset - initialize everything
-        cout << "No saved state found - initializing new execution" << endl;
+        console << "No saved state found - initializing new execution" << endl;
         reset_proc_np();
-        load_program_memory_np(false);
+        if (!load_program_memory_np(inputFile_np, false))
+            return 1;
     }
 
-    // Check if we have finished execution (PC is beyond instruction memory)
-    if (pc_np >= sz_np * 4) {
-        cout << "Program execution complete. No more instructions to execute." << endl;
+    // Execute one instruction cycle
+    unsigned int stepPC = pc_np;
+    if (run_functional_np(1) == 0) {
+        console << "Program execution complete. No more instructions to execute." << endl;
         load_resister_np();
         load_Memory_np();
         // Clean up state file on completion
-        if (remove("sim_state.dat") != 0) {
-            perror("Error deleting state file");
-        } else {
-            cout << "State reset (sim_state.dat removed)." << endl;
-        }
+        remove_state_np();
         return 1; // Return 1 to indicate completion
     }
 
-    // Execute one instruction cycle
-    fetch_np();
-    decode_np();
-    execute_np();
-    mem_op_np();
-    write_back_np();
-    clockCycles_np++;
-    
     // Print current status
-    cout << "Executed instruction at PC: 0x" << hex << setw(8) << setfill('0') << pc_np - 4 << dec << endl;
-    cout << "Instruction word: 0x" << hex << setw(8) << setfill('0') << inst_np.to_ulong() << dec << endl;
-    cout << "Instruction type: " << Type_np << ", subtype: " << subtype_np << endl;
-    cout << "Clock cycles so far: " << clockCycles_np << endl;
-    
+    ThreadedOp op;
+    unsigned int word = read_word_np(stepPC);
+    const NpOpInfo &info = NP_OPS[decode_np(word, stepPC, op)];
+    console << "Executed instruction at PC: 0x" << hex << setw(8) << setfill('0') << stepPC << dec << endl;
+    console << "Instruction word: 0x" << hex << setw(8) << setfill('0') << word << dec << setfill(' ') << endl;
+    console << "Instruction type: " << info.type << ", subtype: " << info.name << endl;
+    console << "Clock cycles so far: " << clockCycles_np << endl;
+
     // Write out current state to files so the GUI can read them
     load_resister_np();
     load_Memory_np();
-    
-    // Save the state for next step
-    save_state_np();
-    
-    // Check if the instruction was the termination instruction (0xffffffff)
-    if (inst_np.to_ulong() == 0xffffffff) {
-        cout << "Termination instruction encountered." << endl;
+
+    // Check if the next instruction is the termination instruction
+    if (halted_np) {
+        console << "Termination instruction encountered." << endl;
         // Clean up state file
-        if (remove("sim_state.dat") != 0) {
-            perror("Error deleting state file");
-        } else {
-            cout << "State reset (sim_state.dat removed)." << endl;
-        }
+        remove_state_np();
         return 1; // Return 1 to indicate completion
     }
-    
-    cout << "Ready for next step." << endl;
+
+    // Save the state for next step
+    save_state_np();
+    console << "Ready for next step." << endl;
     return 0; // Return 0 to continue execution
 }
-
-// Replace the main function with a separate standalone function for direct use
-int nonPipelined_main(int argc, char *argv[]) {
-    bool stepMode = false;
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--step") == 0) {
-            stepMode = true;
-        }
-    }
-
-    // Variables to hold saved state values.
-    unsigned int saved_pc = 0;
-    bool stateLoaded = load_state_np();
-    if (stateLoaded) {
-        // Save the loaded pc
-        saved_pc = pc_np;
-        // Load instructions from file, since instructions are not saved in sim_state.dat.
-        load_program_memory_np(true);
-        // Restore the saved pc so execution continues where it left off.
-        pc_np = saved_pc;
-    } else {
-        reset_proc_np();
-        load_program_memory_np(false);
-    }
-
-    if (stepMode) {
-        // execute_np one instruction cycle
-        fetch_np();
-        decode_np();
-        execute_np();
-        mem_op_np();
-        write_back_np();
-        clockCycles_np++;
-        // Write out current state to files so the GUI can read them
-        load_resister_np();
-        load_Memory_np();
-        // Save the state for next step
-        save_state_np();
-        return 0;
-    } else {
-        // Run in continuous mode
-        run_riscvsim_np();
-    }
-    return 0;
-}
\ No newline at end of file
@@ -10,43 +10,141 @@
 #include <cstdlib>
 #include <cstdio>
 #include <string>
+#include <vector>
+
+#include "guestMemory.h"
 
 using namespace std;
 
-// Define all global variables with _np suffix to avoid conflicts
-static unsigned int X_np[32];              // Registers
-static unsigned int MEM_np[4000];          // Instruction memory
-static int DMEM_np[1000000];               // Data memory
-static int STACKMEM_np[1024];              // Stack memory
-static unsigned int instruction_word_np;
-static unsigned int operand1_np;
-static unsigned int operand2_np;
-
-// Global variables
-static char Type_np = '0';
-static bitset<32> inst_np;                // 32-bit instruction
-static unsigned int des_reg_np;           // destination register
-static int des_res_np;                    // result after ALU operation
-static string subtype_np;                 // subtype of the instruction
-static int imm_np;                        // immediate value
-static unsigned int pc_np = 0;            // Program counter
-static unsigned int sz_np = 0;            // Number of instructions
-static unsigned int clockCycles_np = 0;   // Global clock variable
-
-// Function declarations for non-pipelined mode
-void reset_proc_np();
-void load_program_memory_np( bool skipdata);
-void run_riscvsim_np();
-int run_step_np();
-void fetch_np();
-void decode_np();
-void execute_np();
-void mem_op_np();
-void write_back_np();
-void save_state_np();
-bool load_state_np();
-
-// Rest of the file implementation with _np suffix for all functions and variables...
-// (Include all the function implementations from original nonPipelined.cpp)
-
-#endif // NON_PIPELINE_H
\ No newline at end of file
+// The JIT tier emits x86-64 code for the System V calling convention
+#if defined(__x86_64__) && !defined(_WIN32)
+#define NP_JIT
+#endif
+
+// Execution tiers of the functional engine, coldest first
+enum ExecTier_np { TIER_INTERPRET, TIER_THREADED, TIER_JIT, TIER_COUNT };
+
+struct TierStats_np {
+    unsigned long long instructions[TIER_COUNT];  // Instructions executed in each tier
+    unsigned int promotions[TIER_COUNT];          // Blocks translated into each tier
+};
+
+//------------------------------------------------------
+// Threaded Code
+//------------------------------------------------------
+// A basic block is translated once into a contiguous array of ThreadedOp
+// records ending in a branch, jump or halt. Each handler executes its
+// instruction and returns the next record: op + 1 inside a block, or the
+// first record of the successor block. Branch and jal records remember their
+// successors in `link`, so after the first pass a hot loop never goes back
+// through the block table. pc_np is only materialised when a run stops.
+class FunctionalCore;
+struct ThreadedOp;
+typedef ThreadedOp *(*ThreadedHandler)(FunctionalCore &core, ThreadedOp *op);
+
+struct ThreadedOp {
+    ThreadedHandler run;
+    ThreadedOp *link[2];   // Chained successors: [0] fall-through, [1] taken
+    unsigned int pc;       // Address of this instruction
+    int imm;               // Sign-extended immediate (auipc: pc + imm)
+    unsigned char rd;
+    unsigned char rs1;
+    unsigned char rs2;
+};
+
+#ifdef NP_JIT
+// Shared with translated code, which keeps a pointer to it in rbx
+struct JitContext {
+    unsigned int *x;             // Guest registers (X_np), kept in r13
+    unsigned char *mem;          // Host address of guest address 0, kept in r12
+    unsigned char *pageState;    // GuestMemory page bits, kept in r14
+    long long budget;            // Instructions left to run
+    unsigned char *patchSite;    // rel32 of the exit jump taken, if it can be chained
+    unsigned int exitPC;         // Guest pc to continue at
+    unsigned int codeWritten;    // A store hit a PAGE_CODE page
+    GuestMemory *guest;          // For the out-of-line store helper
+};
+typedef void (*JitEntry)(JitContext *ctx, unsigned char *code);
+#endif
+
+//------------------------------------------------------
+// Non-Pipelined (Functional) Simulator
+//------------------------------------------------------
+// One complete functional machine: registers, guest memory, translation
+// caches and counters. Cores share nothing, so independent cores can run on
+// different threads. Console output goes to the stream buffer given at
+// construction (stdout by default); the dump and state files are still
+// written to the working directory.
+class FunctionalCore {
+public:
+    explicit FunctionalCore(streambuf *consoleBuf = cout.rdbuf());
+    ~FunctionalCore();
+
+    // Architectural state
+    unsigned int X_np[32];              // Registers
+    unsigned int sz_np;                 // Number of instructions
+    unsigned int clockCycles_np;        // Clock (one instruction per cycle)
+    TierStats_np tierStats_np;
+    ostream console;
+
+    void reset_proc_np();
+    bool load_program_memory_np(const string &inputFile, bool skipdata);
+    void run_riscvsim_np();
+    int run_step_np();
+    unsigned int run_functional_np(unsigned int limit);
+    void set_jit_np(bool enabled);
+    unsigned int read_word_np(unsigned int address);
+    void load_resister_np();
+    void load_Memory_np();
+    void save_state_np();
+    bool load_state_np();
+
+    // Engine state, also used by the instruction handlers in nonPipelined.cpp
+    GuestMemory MEM_np;                 // Instructions, data and stack in one flat address space
+    unsigned int pc_np;                 // Program counter
+    unsigned int codeLimit_np;          // One past the highest loaded instruction address
+    bool halted_np;                     // pc_np is at a termination instruction
+    string inputFile_np;                // Program reloaded by run_step_np()
+    bool jitEnabled_np;                 // Run long stretches as translated host code
+    vector<unsigned int> heat_np;       // Transfers into each code word (heat_np[pc / 4])
+    unsigned int jitThreshold_np;       // JIT_THRESHOLD with --jit, otherwise never
+    vector<ThreadedOp *> blockAt_np;    // First record of the block at each code word
+    ThreadedOp exitOp_np;               // Stands in for every pc outside the code segment
+    ThreadedOp tierExitOp_np;           // Hands pc back to run_functional_np() (not a halt)
+
+    ThreadedOp *tier_exit_np(unsigned int pc);
+    ThreadedOp *transfer_np(unsigned int pc);
+    ThreadedOp *follow_np(ThreadedOp *op, int taken);
+    ThreadedOp *code_written_np(ThreadedOp *op);
+
+private:
+    ThreadedOp *translate_block_np(unsigned int start);
+    ThreadedOp *lookup_block_np(unsigned int pc);
+    void flush_blocks_np();
+    void flush_jit_np();
+    unsigned int interpret_np(unsigned int limit);
+    unsigned int run_threaded_np(unsigned int limit);
+    void remove_state_np();
+
+#ifdef NP_JIT
+    unsigned char *jitCache_np;           // Code cache, mapped on first use
+    unsigned char *jitFirstBlock_np;      // First byte after the entry/exit trampolines
+    unsigned char *jitCursor_np;          // Next free byte
+    unsigned char *jitExit_np;            // Restores host registers and returns
+    JitEntry jitEnter_np;
+    vector<unsigned char *> jitAt_np;     // Native entry per code word, NULL until translated
+    vector<unsigned int> jitCodePages_np;
+    JitContext jitCtx_np;
+    unsigned int jitGeneration_np;        // Bumped on every flush
+
+    bool jit_init_np();
+    unsigned char *jit_compile_np(unsigned int start);
+    unsigned char *jit_entry_np(unsigned int pc);
+    unsigned int run_jit_np(unsigned int limit);
+#endif
+
+    FunctionalCore(const FunctionalCore &);
+    FunctionalCore &operator=(const FunctionalCore &);
+};
+
+#endif // NON_PIPELINE_H
@@ -0,0 +1,202 @@
+// Cache prefetchers behind the Prefetcher interface.
+#include "prefetcher.h"
+
+#include <istream>
+#include <ostream>
+
+using namespace std;
+
+static const char *PREFETCHER_NAMES[] = {"none", "next-line", "stride", "stream"};
+
+bool parse_prefetcher_kind(const string &name, PrefetcherKind &kind) {
+    for (unsigned int k = 0; k <= PREFETCH_STREAM; k++) {
+        if (name == PREFETCHER_NAMES[k]) {
+            kind = (PrefetcherKind)k;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *prefetcher_name(PrefetcherKind kind) {
+    return PREFETCHER_NAMES[kind];
+}
+
+const char *prefetch_config_error(const PrefetchConfig &config) {
+    if (config.degree == 0 || config.degree > MAX_PREFETCH_DEGREE)
+        return "prefetch degree must be between 1 and 16";
+    if (config.distance == 0 || config.distance > MAX_PREFETCH_DISTANCE)
+        return "prefetch distance must be between 1 and 64";
+    return NULL;
+}
+
+template <typename T>
+static bool write_entries(ostream &out, const vector<T> &entries) {
+    out.write(reinterpret_cast<const char*>(entries.data()), sizeof(T) * entries.size());
+    return out.good();
+}
+
+template <typename T>
+static bool read_entries(istream &in, vector<T> &entries) {
+    in.read(reinterpret_cast<char*>(entries.data()), sizeof(T) * entries.size());
+    return in.good();
+}
+
+//------------------------------------------------------
+// next-line
+//------------------------------------------------------
+// Tagged next-line: a miss, or the first hit on a prefetched line, asks for
+// the `degree` lines starting `distance` lines after it
+class NextLinePrefetcher : public Prefetcher {
+public:
+    NextLinePrefetcher(const PrefetchConfig &config, unsigned int lineSize)
+        : degree(config.degree), distance(config.distance), lineSize(lineSize) {}
+
+    PrefetcherKind kind() const { return PREFETCH_NEXT_LINE; }
+    void reset() {}
+    void observe(unsigned int, unsigned int address, bool trigger, vector<unsigned int> &prefetches) {
+        if (!trigger)
+            return;
+        unsigned int line = address / lineSize;
+        for (unsigned int k = 0; k < degree; k++)
+            prefetches.push_back((line + distance + k) * lineSize);
+    }
+    bool save(ostream &out) const { return out.good(); }
+    bool load(istream &in) { return in.good(); }
+
+private:
+    unsigned int degree, distance, lineSize;
+};
+
+//------------------------------------------------------
+// stride
+//------------------------------------------------------
+// Reference prediction table: one entry per load/store PC (direct-mapped,
+// full-PC tag) with its last address and stride. A 2-bit confidence counter
+// goes up when the stride repeats and down when it does not; the stride is
+// only replaced once confidence is gone. From confidence 2 on, every access
+// by the PC asks for address + stride * (distance .. distance + degree - 1).
+struct StrideEntry {
+    unsigned int pc;
+    unsigned int lastAddress;
+    int stride;
+    unsigned char confidence;
+    bool valid;
+};
+
+class StridePrefetcher : public Prefetcher {
+public:
+    explicit StridePrefetcher(const PrefetchConfig &config) : degree(config.degree), distance(config.distance) {}
+
+    PrefetcherKind kind() const { return PREFETCH_STRIDE; }
+    void reset() {
+        StrideEntry empty = {0, 0, 0, 0, false};
+        table.assign(STRIDE_TABLE_ENTRIES, empty);
+    }
+    void observe(unsigned int pc, unsigned int address, bool, vector<unsigned int> &prefetches) {
+        StrideEntry &e = table[(pc >> 2) % STRIDE_TABLE_ENTRIES];
+        if (!e.valid || e.pc != pc) {
+            StrideEntry fresh = {pc, address, 0, 0, true};
+            e = fresh;
+            return;
+        }
+        int stride = (int)(address - e.lastAddress);
+        if (stride == e.stride) {
+            if (e.confidence < 3)
+                e.confidence++;
+        } else if (e.confidence > 0) {
+            e.confidence--;
+        } else {
+            e.stride = stride;
+        }
+        e.lastAddress = address;
+        if (e.confidence < 2 || e.stride == 0)
+            return;
+        for (unsigned int k = 0; k < degree; k++)
+            prefetches.push_back(address + (unsigned int)e.stride * (distance + k));
+    }
+    bool save(ostream &out) const { return write_entries(out, table); }
+    bool load(istream &in) { return read_entries(in, table); }
+
+private:
+    unsigned int degree, distance;
+    vector<StrideEntry> table;
+};
+
+//------------------------------------------------------
+// stream
+//------------------------------------------------------
+// Stream detection in the style of stream buffers: a miss (or prefetch hit)
+// next to a stream's last line fixes its direction, and every further one
+// in that direction advances it and asks for `degree` lines starting
+// `distance` lines ahead. Anything else starts a new stream in the least
+// recently used slot. The lines go into the cache itself, not a side buffer.
+struct StreamEntry {
+    bool valid;
+    int direction;              // +1 or -1 once known, 0 while only one line has been seen
+    unsigned int lastLine;
+    unsigned long long lastUse;
+};
+
+class StreamPrefetcher : public Prefetcher {
+public:
+    StreamPrefetcher(const PrefetchConfig &config, unsigned int lineSize)
+        : degree(config.degree), distance(config.distance), lineSize(lineSize), useClock(0) {}
+
+    PrefetcherKind kind() const { return PREFETCH_STREAM; }
+    void reset() {
+        StreamEntry empty = {false, 0, 0, 0};
+        streams.assign(STREAM_COUNT, empty);
+        useClock = 0;
+    }
+    void observe(unsigned int, unsigned int address, bool trigger, vector<unsigned int> &prefetches) {
+        if (!trigger)
+            return;
+        unsigned int line = address / lineSize;
+        StreamEntry *victim = &streams[0];
+        for (size_t s = 0; s < streams.size(); s++) {
+            StreamEntry &stream = streams[s];
+            if (stream.valid) {
+                int step = (int)(line - stream.lastLine);
+                bool follows = (stream.direction != 0) ? (step == stream.direction) : (step == 1 || step == -1);
+                if (follows) {
+                    stream.direction = step;
+                    stream.lastLine = line;
+                    stream.lastUse = ++useClock;
+                    for (unsigned int k = 0; k < degree; k++)
+                        prefetches.push_back((line + (unsigned int)(step * (int)(distance + k))) * lineSize);
+                    return;
+                }
+            }
+            if (!stream.valid || (victim->valid && stream.lastUse < victim->lastUse))
+                victim = &stream;
+        }
+        StreamEntry fresh = {true, 0, line, ++useClock};
+        *victim = fresh;
+    }
+    bool save(ostream &out) const {
+        out.write(reinterpret_cast<const char*>(&useClock), sizeof(useClock));
+        return write_entries(out, streams);
+    }
+    bool load(istream &in) {
+        in.read(reinterpret_cast<char*>(&useClock), sizeof(useClock));
+        return read_entries(in, streams);
+    }
+
+private:
+    unsigned int degree, distance, lineSize;
+    unsigned long long useClock;
+    vector<StreamEntry> streams;
+};
+
+Prefetcher *make_prefetcher(const PrefetchConfig &config, unsigned int lineSize) {
+    Prefetcher *prefetcher;
+    switch (config.kind) {
+    case PREFETCH_NEXT_LINE: prefetcher = new NextLinePrefetcher(config, lineSize); break;
+    case PREFETCH_STRIDE:    prefetcher = new StridePrefetcher(config); break;
+    case PREFETCH_STREAM:    prefetcher = new StreamPrefetcher(config, lineSize); break;
+    default:                 return NULL;
+    }
+    prefetcher->reset();
+    return prefetcher;
+}
@@ -0,0 +1,59 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Prefetcher attached to an L1 (--icache-prefetch / --dcache-prefetch)
+enum PrefetcherKind {
+    PREFETCH_NONE,      // none: lines only come in on a demand miss
+    PREFETCH_NEXT_LINE, // next-line: the lines after one that missed (or was a prefetch hit)
+    PREFETCH_STRIDE,    // stride: per-PC address strides from a reference prediction table
+    PREFETCH_STREAM     // stream: ascending or descending runs of lines, a few streams at once
+};
+
+const unsigned int MAX_PREFETCH_DEGREE = 16;
+const unsigned int MAX_PREFETCH_DISTANCE = 64;
+const unsigned int STRIDE_TABLE_ENTRIES = 64;   // Reference prediction table, indexed by PC
+const unsigned int STREAM_COUNT = 4;            // Streams followed at once, least recently used replaced
+
+struct PrefetchConfig {
+    PrefetcherKind kind = PREFETCH_NONE;
+    unsigned int degree = 1;            // Lines requested each time the prefetcher fires
+    unsigned int distance = 1;          // How far ahead the first one is: in lines, or in strides for stride
+};
+
+bool parse_prefetcher_kind(const std::string &name, PrefetcherKind &kind);
+const char *prefetcher_name(PrefetcherKind kind);
+
+// Why the configuration cannot be built, or NULL when it can
+const char *prefetch_config_error(const PrefetchConfig &config);
+
+//------------------------------------------------------
+// Prefetcher Interface
+//------------------------------------------------------
+// Sees every demand access to its cache, in program order: fetch() for the
+// I-cache, the load or store in MEM for the D-cache. It only proposes
+// addresses; the simulator drops the ones already cached or on their way
+// and fills the rest from below like a miss, without stalling anything.
+class Prefetcher {
+public:
+    virtual ~Prefetcher() {}
+
+    virtual PrefetcherKind kind() const = 0;
+    virtual void reset() = 0;
+
+    // The instruction at pc accessed address; trigger: it missed, or hit a
+    // line a prefetch brought in. Appends the byte addresses to prefetch.
+    virtual void observe(unsigned int pc, unsigned int address, bool trigger,
+                         std::vector<unsigned int> &prefetches) = 0;
+
+    virtual bool save(std::ostream &out) const = 0;
+    virtual bool load(std::istream &in) = 0;
+};
+
+// NULL for PREFETCH_NONE; lineSize is the cache's, in bytes
+Prefetcher *make_prefetcher(const PrefetchConfig &config, unsigned int lineSize);
+
+#endif // PREFETCHER_H
@@ -0,0 +1,89 @@
+#include "replacement.h"
+
+#include <istream>
+#include <ostream>
+
+bool parse_replacement_policy(const std::string &name, ReplacementPolicy &policy) {
+    if (name == "lru")
+        policy = REPLACE_LRU;
+    else if (name == "plru")
+        policy = REPLACE_PLRU;
+    else if (name == "random")
+        policy = REPLACE_RANDOM;
+    else
+        return false;
+    return true;
+}
+
+void ReplacementState::configure(unsigned int sets, unsigned int numWays, ReplacementPolicy replacement) {
+    ways = numWays;
+    policy = replacement;
+    lastUse.resize(sets * ways);
+    plruBits.resize(ways > 0 ? sets * (ways - 1) : 0);
+    clear();
+}
+
+void ReplacementState::clear() {
+    lastUse.assign(lastUse.size(), 0);
+    plruBits.assign(plruBits.size(), 0);
+    useClock = 0;
+    randomState = 1;
+}
+
+// PLRU: walk from the root towards the way, pointing every node away from it
+void ReplacementState::touch(unsigned int slot) {
+    lastUse[slot] = ++useClock;
+    if (policy != REPLACE_PLRU || ways == 1)
+        return;
+    unsigned char *tree = &plruBits[(slot / ways) * (ways - 1)];
+    unsigned int way = slot % ways;
+    unsigned int node = 0, first = 0;
+    for (unsigned int span = ways / 2; span > 0; span /= 2) {
+        bool right = way >= first + span;
+        tree[node] = right ? 0 : 1;     // 1: the victim is in the right half
+        node = 2 * node + 1 + (right ? 1 : 0);
+        if (right)
+            first += span;
+    }
+}
+
+unsigned int ReplacementState::victim(unsigned int set) {
+    unsigned int base = set * ways;
+    unsigned int slot = base;
+    if (policy == REPLACE_LRU) {
+        for (unsigned int w = 1; w < ways; w++) {
+            if (lastUse[base + w] < lastUse[slot])
+                slot = base + w;
+        }
+    } else if (policy == REPLACE_PLRU) {
+        const unsigned char *tree = &plruBits[set * (ways - 1)];
+        unsigned int node = 0, first = 0;
+        for (unsigned int span = ways / 2; span > 0; span /= 2) {
+            bool right = tree[node] != 0;
+            node = 2 * node + 1 + (right ? 1 : 0);
+            if (right)
+                first += span;
+        }
+        slot = base + first;
+    } else {
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        slot = base + randomState % ways;
+    }
+    return slot;
+}
+
+void ReplacementState::save(std::ostream &out) const {
+    out.write(reinterpret_cast<const char*>(lastUse.data()), sizeof(unsigned long long) * lastUse.size());
+    out.write(reinterpret_cast<const char*>(plruBits.data()), plruBits.size());
+    out.write(reinterpret_cast<const char*>(&useClock), sizeof(useClock));
+    out.write(reinterpret_cast<const char*>(&randomState), sizeof(randomState));
+}
+
+void ReplacementState::load(std::istream &in) {
+    in.read(reinterpret_cast<char*>(lastUse.data()), sizeof(unsigned long long) * lastUse.size());
+    in.read(reinterpret_cast<char*>(plruBits.data()), plruBits.size());
+    in.read(reinterpret_cast<char*>(&useClock), sizeof(useClock));
+    in.read(reinterpret_cast<char*>(&randomState), sizeof(randomState));
+}
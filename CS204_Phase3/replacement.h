@@ -0,0 +1,44 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Victim choice within a full set (--btb-replacement, --icache-replacement, --dcache-replacement)
+enum ReplacementPolicy {
+    REPLACE_LRU,            // Least recently looked up or filled
+    REPLACE_PLRU,           // Tree pseudo-LRU, ways - 1 bits per set
+    REPLACE_RANDOM          // xorshift32, seeded on every clear() so runs repeat
+};
+
+bool parse_replacement_policy(const std::string &name, ReplacementPolicy &policy);
+
+//------------------------------------------------------
+// Set Replacement State
+//------------------------------------------------------
+// The bookkeeping behind a policy for sets * ways slots, numbered set-major
+// (slot = set * ways + way) like the structures that use it. The owner calls
+// touch() on every use and victim() only when a set has no free way.
+struct ReplacementState {
+    std::vector<unsigned long long> lastUse;    // LRU: use stamp per slot
+    std::vector<unsigned char> plruBits;        // PLRU: ways - 1 tree bits per set
+    unsigned int ways;
+    ReplacementPolicy policy;
+    unsigned long long useClock;
+    unsigned int randomState;
+
+    ReplacementState() : ways(0), policy(REPLACE_LRU), useClock(0), randomState(1) {}
+
+    void configure(unsigned int sets, unsigned int ways, ReplacementPolicy policy);
+    void clear();
+
+    void touch(unsigned int slot);
+    unsigned int victim(unsigned int set);      // Slot to evict from a full set
+
+    // Stamps, tree bits and the random seed; the geometry is the owner's to save
+    void save(std::ostream &out) const;
+    void load(std::istream &in);
+};
+
+#endif // REPLACEMENT_H
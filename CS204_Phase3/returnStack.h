@@ -0,0 +1,69 @@
+#ifndef RETURN_STACK_H
+#define RETURN_STACK_H
+
+#include <vector>
+
+const unsigned int DEFAULT_RAS_DEPTH = 8;   // --ras-depth (0 disables the stack)
+const unsigned int MAX_RAS_DEPTH = 1024;
+
+// Enough to undo wrong-path pushes and pops: the stack pointer, the depth
+// and the value on top (the entry a wrong-path push would overwrite)
+struct RASCheckpoint {
+    unsigned int top;
+    unsigned int count;
+    unsigned int topValue;
+};
+
+//------------------------------------------------------
+// Return Address Stack
+//------------------------------------------------------
+// A circular stack of return addresses: calls push at fetch, returns pop
+// their predicted target. On overflow the oldest entry is overwritten; on
+// underflow the caller falls back to the BTB. Every fetched instruction
+// carries a checkpoint taken after its own push/pop down the pipeline, and a
+// misprediction restores the one of the mispredicted instruction.
+struct ReturnAddressStack {
+    std::vector<unsigned int> entries;
+    unsigned int top;       // Slot of the next push
+    unsigned int count;     // Valid entries, at most entries.size()
+
+    ReturnAddressStack() : top(0), count(0) {}
+
+    void configure(unsigned int depth) {
+        entries.assign(depth, 0);
+        top = 0;
+        count = 0;
+    }
+    unsigned int depth() const { return (unsigned int)entries.size(); }
+    bool empty() const { return count == 0; }
+
+    // Returns true when the push overwrote the oldest entry
+    bool push(unsigned int returnPC) {
+        entries[top] = returnPC;
+        top = (top + 1) % depth();
+        if (count < depth()) {
+            count++;
+            return false;
+        }
+        return true;
+    }
+    unsigned int pop() {
+        top = (top + depth() - 1) % depth();
+        count--;
+        return entries[top];
+    }
+
+    RASCheckpoint checkpoint() const {
+        RASCheckpoint cp = {top, count, depth() ? entries[(top + depth() - 1) % depth()] : 0};
+        return cp;
+    }
+    void restore(const RASCheckpoint &cp) {
+        if (depth() == 0)
+            return;
+        top = cp.top;
+        count = cp.count;
+        entries[(top + depth() - 1) % depth()] = cp.topValue;
+    }
+};
+
+#endif // RETURN_STACK_H
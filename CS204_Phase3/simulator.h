@@ -0,0 +1,671 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+#include "branchPredictor.h"
+#include "btb.h"
+#include "cache.h"
+#include "dram.h"
+#include "guestMemory.h"
+#include "indirectPredictor.h"
+#include "instStream.h"
+#include "nonPipelined.h"
+#include "prefetcher.h"
+#include "returnStack.h"
+
+using namespace std;
+
+//------------------------------------------------------
+// Memory Configuration Constants
+//------------------------------------------------------
+const unsigned int STACK_TOP = 0x7FFFFFDC;
+const unsigned int STACK_SIZE = 1024;  // in words (dump window)
+const unsigned int DATA_MEMORY_SIZE = 1000000; // in words (dump/print window)
+const unsigned int DATA_MEMORY_BASE = 0x10000000; // Base address of data memory
+
+//------------------------------------------------------
+// Instruction Trace Record (--trace)
+//------------------------------------------------------
+struct InstructionTrace {
+    int instructionNum;
+    bool active;
+    unsigned int pc;
+    unsigned int instruction;
+    
+    // Cycle counters for each stage
+    int fetchCycle;
+    int decodeCycle;
+    int executeCycle;
+    int memoryCycle;
+    int writebackCycle;
+    
+    // Results at each stage
+    string decodeInfo;
+    int executeResult;
+    int memoryResult;
+    int writebackResult;
+    
+InstructionTrace() : instructionNum(-1), active(false), pc(0), instruction(0),
+                     fetchCycle(-1), decodeCycle(-1), executeCycle(-1), 
+                     memoryCycle(-1), writebackCycle(-1), decodeInfo(""),
+                     executeResult(0), memoryResult(0), writebackResult(0){}
+};
+
+//------------------------------------------------------
+// Control Signals Structure
+//------------------------------------------------------
+struct ControlSignals {
+    bool regWrite : 1;
+    bool memRead : 1;
+    bool memWrite : 1;
+    bool memToReg : 1;
+    bool aluSrc : 1;
+    bool branch : 1;
+    bool jump : 1;
+    unsigned int aluOp : 2;   // ALU operation code
+};
+
+//------------------------------------------------------
+// Predecoded Instruction Records
+//------------------------------------------------------
+// Every word of instruction memory is decoded once at load time into a
+// compact record, so decode() only copies fields instead of re-parsing bits.
+enum InstOp {
+    OP_UNKNOWN = 0,
+    OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA, OP_OR, OP_AND,
+    OP_MUL, OP_DIV, OP_REM,
+    OP_ADDI, OP_SLTI, OP_SLTIU, OP_XORI, OP_ORI, OP_ANDI, OP_SLLI, OP_SRLI, OP_SRAI,
+    OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU,
+    OP_SB, OP_SH, OP_SW,
+    OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+    OP_JAL, OP_JALR,
+    OP_LUI, OP_AUIPC,
+    OP_COUNT
+};
+
+// Statistics class of an instruction (counted in decode)
+enum InstClass {
+    CLASS_ALU,
+    CLASS_DATA_TRANSFER,
+    CLASS_CONTROL
+};
+
+// Register-use mask bits
+const unsigned char USES_RS1 = 0x1;
+const unsigned char USES_RS2 = 0x2;
+
+struct DecodedInst {
+    unsigned char op;        // InstOp
+    char instType;           // 'R', 'I', 'S', 'B', 'U', 'J' or 0 for an unknown opcode
+    unsigned char instClass; // InstClass
+    unsigned char useMask;   // USES_RS1 / USES_RS2
+    unsigned char rs1;
+    unsigned char rs2;
+    unsigned char rd;
+    int immediate;           // Sign-extended immediate
+    ControlSignals control;
+};
+
+// Stop conditions for runUntil()
+enum RunLimit {
+    RUN_CYCLES,     // run `value` more cycles
+    RUN_TO_PC,      // until the instruction at PC `value` is fetched
+    RUN_TO_CYCLE,   // until clockCycles reaches `value`
+    RUN_TO_RETIRE   // until `value` instructions have completed write-back
+};
+
+struct KnobSettings {
+    bool printDataMemoryAtEnd = true; // Print DMEM at simulation end
+    int dataPrintStart = 0;    
+    int dataPrintCount = 10;
+    
+    bool pipeliningEnabled = true;    
+    bool forwardingEnabled = true;    
+    unsigned int btbEntries = BTB_SIZE;   // --btb-entries N (sets * ways)
+    unsigned int btbWays = 1;             // --btb-ways N: associativity
+    unsigned int btbTagBits = 0;          // --btb-tag-bits N: 0 compares the full PC
+    ReplacementPolicy btbReplacement = REPLACE_LRU; // --btb-replacement lru|plru|random
+    PredictorKind predictor = PREDICT_ONE_BIT; // --predictor onebit|static|bimodal|gshare|tournament|tage
+    unsigned int predictorTableBits = DEFAULT_PREDICTOR_TABLE_BITS; // --bp-table-bits N
+    unsigned int predictorHistory = DEFAULT_PREDICTOR_HISTORY;      // --bp-history N
+    unsigned int rasDepth = DEFAULT_RAS_DEPTH; // --ras-depth N: return address stack, 0 disables
+    unsigned int itcBits = DEFAULT_ITC_BITS;   // --itc-bits N: indirect target cache of 2^N entries, 0 disables
+    unsigned int itcHistory = DEFAULT_ITC_HISTORY; // --itc-history N: indirect targets in its path history
+    CacheConfig icache;                   // --icache-*: L1 instruction cache, off until --icache-size
+    CacheConfig dcache;                   // --dcache-*: L1 data cache, off until --dcache-size
+    PrefetchConfig icachePrefetch;        // --icache-prefetch*: none until --icache-prefetch
+    PrefetchConfig dcachePrefetch;        // --dcache-prefetch*: likewise
+    CacheConfig l2;                       // --l2-*: unified L2 behind both, off until --l2-size
+    DramConfig dram;                      // --dram-*: DRAM behind the caches, off until --dram-channels
+    bool printRegisterEachCycle = false;    
+    bool printPipelineRegisters = false;    
+    bool printBranchPredictorInfo = false;    
+    bool saveCycleSnapshots = false;    
+    string inputFile = "";
+    vector<string> unknownOptions;        // Arguments parseCommandLineArgs does not know
+
+    // Functional fast-forward before the pipelined model takes over
+    unsigned int fastForward = 0;         // --fast-forward N (instructions)
+    bool fastForwardWarmBP = false;       // --ff-warm-bp: train BTB/PHT while fast-forwarding
+
+    // Continuous runs: functional execution on a second thread, ahead of the timing model
+    bool decoupled = false;               // --decoupled (see run_decoupled)
+
+    // Non-pipelined (functional) engine
+    bool jitEnabled = false;              // --jit: translate hot blocks to x86-64 code
+
+    // Step mode: restore sim_state.dat, run until the limit, save it again
+    bool stepMode = false;
+    RunLimit stepLimit = RUN_CYCLES;      // --step [N] / --run-to-pc / --run-to-cycle / --run-to-retire
+    unsigned int stepValue = 1;
+
+    // Serve mode: keep one process alive and take commands (see serve_session)
+    bool serveMode = false;
+    string serveSocket = "";              // Unix socket path; stdin/stdout when empty
+
+    // Batch mode: run every job in a job file on a thread pool (see batch.h)
+    string batchFile = "";                // --batch <jobfile>
+    string batchOutput = "batch_results.csv"; // --batch-out <file> (.json for JSON)
+    unsigned int batchThreads = 0;        // --jobs N; one per hardware thread when 0 (batch and sweep)
+
+    // Sweep mode: every point of a parameter grid against a workload set (see sweep.h)
+    string sweepFile = "";                // --sweep <gridfile>
+    string sweepOutput = "sweep_results.csv"; // --sweep-out <file> (.json for JSON)
+
+    // Fan-out mode: one functional stream drives several timing models (see fanout.h)
+    string fanoutFile = "";               // --fanout <configfile>
+    string fanoutOutput = "fanout_results.csv"; // --fanout-out <file> (.json for JSON)
+    
+    // Trace functionality settings
+    bool traceInstructionEnabled = true;  // Knob5: Trace a specific instruction number
+    int traceInstructionNum = -1;         // Instruction number to trace
+    unsigned int traceInstructionPC = 0;  // PC address to trace
+    bool traceByPC = false;              // Whether to trace by PC rather than sequence number
+};
+
+struct PipelineStatistics {
+    unsigned int totalCycles = 0;           // Stat1: Total cycles
+    unsigned int instructionsExecuted = 0;  // Stat2: Total instructions executed
+    double CPI = 0.0;                       // Stat3: CPI
+    unsigned int dataTransferInst = 0;      // Stat4: Number of load/store instructions executed
+    unsigned int aluInst = 0;               // Stat5: Number of ALU instructions executed
+    unsigned int controlInst = 0;           // Stat6: Number of control instructions executed
+    unsigned int totalStalls = 0;           // Stat7: Total pipeline stalls inserted
+    unsigned int dataHazardCount = 0;       // Stat8: Data hazards detected
+    unsigned int controlHazardCount = 0;    // Stat9: Control hazards detected
+    unsigned int branchMispredCount = 0;    // Stat10: Branch mispredictions
+    unsigned int conditionalMispredCount = 0; // ... of conditional branches
+    unsigned int indirectMispredCount = 0;  // ... of jalr other than returns
+    unsigned int indirectJumps = 0;         // jalr other than returns executed
+    unsigned int dataHazardStalls = 0;      // Stat11: Stalls due to data hazards
+    unsigned int controlHazardStalls = 0;   // Stat12: Stalls due to control hazards
+    unsigned int instructionsRetired = 0;   // Instructions that completed write-back
+    unsigned int fastForwarded = 0;         // Instructions run functionally before timing started
+    unsigned int btbHits = 0;               // Fetch-time BTB lookups that found the PC
+    unsigned int btbMisses = 0;
+    unsigned int rasPredictions = 0;        // Returns whose target came from the RAS
+    unsigned int rasMispredictions = 0;     // ... and turned out wrong
+    unsigned int rasOverflows = 0;          // Calls that overwrote the oldest entry
+    unsigned int rasUnderflows = 0;         // Returns fetched with the RAS empty (BTB used)
+    CacheStats icache;                      // L1 instruction cache
+    CacheStats dcache;                      // L1 data cache
+    unsigned int mshrMerges = 0;            // ... misses to a line an MSHR was already filling
+    unsigned int missUseStalls = 0;         // ... cycles spent waiting on a missing load's register
+    unsigned int mshrFullStalls = 0;        // ... cycles a miss waited for a free MSHR
+    CacheStats l2;                          // Unified L2
+    DramStats dram;
+    unsigned int memoryFills = 0;           // L1 misses served from below
+    unsigned long long memoryFillCycles = 0; // ... and their total access latency
+};
+
+//------------------------------------------------------
+// Pipeline Register Structures
+//------------------------------------------------------
+// All latch structures are standard-layout PODs so a whole bank can be
+// snapshotted or checkpointed with a plain memcpy.
+
+// IF/ID Pipeline Register
+struct IF_ID_Register {
+    bool valid;             // true if valid, false if bubble
+    unsigned int pc;        // PC value of fetched instruction
+    unsigned int instruction; // 32-bit fetched instruction
+    unsigned int predictedPC; // Predicted next PC from branch predictor
+    bool rasPredicted;        // predictedPC was popped off the return address stack
+    RASCheckpoint ras;        // RAS state after this instruction's fetch
+};
+ 
+// ID/EX Pipeline Register
+struct ID_EX_Register {
+    bool valid;
+    char instType;          // 'R', 'I', 'S', 'B', 'U', or 'J'
+    unsigned char op;       // InstOp (OP_NAMES[op] for printing)
+    ControlSignals control;
+    unsigned int pc;
+    unsigned int rs1;       // Source register numbers
+    unsigned int rs2;
+    unsigned int rd;
+    int rs1Value;           // Operand values (may be forwarded)
+    int rs2Value;
+    int immediate;
+    unsigned int predictedPC;     // Fetch's prediction, checked when the instruction resolves
+    bool rasPredicted;
+    RASCheckpoint ras;            // Restored if this instruction mispredicts
+    unsigned int instructionWord;
+    unsigned int instructionNum;  // Unique sequence number
+};
+ 
+// EX/MEM Pipeline Register
+struct EX_MEM_Register {
+    bool valid;
+    char instType;
+    unsigned char op;       // InstOp (OP_NAMES[op] for printing)
+    bool branchTaken;     // Outcome of branch computation
+    ControlSignals control;
+    unsigned int pc;
+    unsigned int rd;
+    int aluResult;
+    int rs2Value;         // For store instructions
+    unsigned int memAddress; // Computed memory address for loads/stores
+    int loadValue;        // Trace-driven: the loaded value, from the stream
+    bool traced;          // Results came from the functional stream (see execute())
+    unsigned int instructionWord;
+    unsigned int instructionNum;
+};
+ 
+// MEM/WB Pipeline Register
+struct MEM_WB_Register {
+    bool valid;
+    char instType;
+    unsigned char op;       // InstOp (OP_NAMES[op] for printing)
+    ControlSignals control;
+    unsigned int pc;
+    unsigned int rd;
+    int aluResult;
+    int memData;
+    bool traced;          // Trace-driven: leave the register file alone
+    unsigned int instructionWord;
+    unsigned int instructionNum;
+};
+
+// Instruction that completed write-back this cycle (for visualization)
+struct WB_Complete_Register {
+    bool valid;
+    char instType;
+    unsigned char op;       // InstOp (OP_NAMES[op] for printing)
+    bool regWrite; // Whether this instruction wrote to a register
+    unsigned int pc;
+    unsigned int rd;
+    int result;    // Final value written to register
+    unsigned int destReg; // Register written to
+    unsigned int instructionNum;
+};
+
+// One complete set of pipeline latches
+struct PipelineLatches {
+    IF_ID_Register if_id;
+    ID_EX_Register id_ex;
+    EX_MEM_Register ex_mem;
+    MEM_WB_Register mem_wb;
+    WB_Complete_Register wb_complete;
+};
+
+static_assert(is_standard_layout<PipelineLatches>::value && is_trivially_copyable<PipelineLatches>::value,
+              "pipeline latches must stay POD so they can be copied as raw bytes");
+
+//------------------------------------------------------
+// Double-Buffered Latch Bank
+//------------------------------------------------------
+// Stages read their input latch from the current bank and write their output
+// latch into the next bank; update_pipeline() advances the pipeline by
+// flipping the index instead of copying the latches.
+struct LatchBank {
+    PipelineLatches bank[2];
+    unsigned int cur;       // Index of the bank visible at the start of the cycle
+};
+
+//------------------------------------------------------
+// Pipeline Snapshot Structure for Cycle-by-Cycle Visualization
+//------------------------------------------------------
+struct PipelineSnapshot {
+    PipelineLatches stages;
+    unsigned int pc;
+    unsigned int clockCycles;
+    vector<BTBEntry> BTB_state;
+    vector<unsigned char> PHT_state;
+};
+
+//------------------------------------------------------
+// Temporary Results Structure for In-Flight Values
+//------------------------------------------------------
+struct TempResults {
+    bool exValid;
+    unsigned int exRd;
+    int exResult;
+    bool exRegWrite;
+    
+    bool memValid;
+    unsigned int memRd;
+    int memResult;
+    int memData;
+    bool memRegWrite;
+    bool memToReg;
+ 
+    TempResults() : exValid(false), exRd(0), exResult(0), exRegWrite(false),
+                   memValid(false), memRd(0), memResult(0), memData(0), memRegWrite(false), 
+                   memToReg(false) {}
+                   
+    // Add a clear method to reset state
+    void clear() {
+        exValid = false;
+        exRd = 0;
+        exResult = 0;
+        exRegWrite = false;
+        
+        memValid = false;
+        memRd = 0;
+        memResult = 0;
+        memData = 0;
+        memRegWrite = false;
+        memToReg = false;
+    }
+};
+
+// only two forwarding‐source stages
+enum ForwardStage {
+    EX_MEM,    // data sitting in EX/MEM
+    MEM_WB     // data sitting in MEM/WB (or tempResults)
+};
+
+
+struct ForwardingInfo {
+    int          value;
+    ForwardStage stage;
+};
+
+struct ForwardingBuffer {
+    ForwardingInfo saved[32];
+    bool           valid[32];
+
+    ForwardingBuffer() {
+        for(int i = 0; i < 32; i++) valid[i] = false;
+    }
+
+    void saveValue(unsigned reg, int val, ForwardStage src) {
+        if (reg == 0) return;
+        saved[reg].value = val;
+        saved[reg].stage = src;
+        valid[reg] = true;
+    }
+
+    bool getValue(unsigned reg, int &outVal, ForwardStage &outStage) const {
+        if (reg != 0 && valid[reg]) {
+            outVal   = saved[reg].value;
+            outStage = saved[reg].stage;
+            return true;
+        }
+        return false;
+    }
+};
+
+//------------------------------------------------------
+// Breakpoints and Watchpoints
+//------------------------------------------------------
+enum WatchKind {
+    WATCH_READ = 1,
+    WATCH_WRITE = 2,
+    WATCH_CHANGE = 4    // a store that changes the watched bytes
+};
+
+struct Watchpoint {
+    unsigned int address;
+    unsigned int length;    // bytes
+    unsigned char kinds;    // WatchKind bits
+};
+
+enum DebugStop { STOP_NONE, STOP_FETCH, STOP_RETIRE, STOP_READ, STOP_WRITE, STOP_CHANGE };
+
+struct DebugHit {
+    unsigned char reason;   // DebugStop
+    unsigned int pc;        // Instruction that triggered the stop
+    unsigned int address;   // Data address (watchpoints)
+    unsigned int oldValue;  // Watched bytes before/after the access
+    unsigned int newValue;
+};
+
+const unsigned int MAX_SIMULATION_CYCLES = 500000; // Runaway guard for every run loop
+const unsigned int NO_FETCH_WAIT = 0xFFFFFFFF;      // fetchWaitPC when no I-cache fill is pending
+const unsigned int ACCESS_NOT_READY = 0xFFFFFFFF;   // PendingAccess::readyCycle while DRAM has not answered
+
+// An L1 access in flight: done in readyCycle, which a line fill from DRAM
+// only learns once the request has been issued (see Simulator::access_done)
+struct PendingAccess {
+    unsigned int startCycle;
+    unsigned int readyCycle;
+    unsigned int dramRequest;       // NO_DRAM_REQUEST unless waiting on DRAM...
+    unsigned int dramOverhead;      // ... plus these cycles for the cache lookups
+    bool fill;                      // A miss: counts towards the average memory latency
+};
+
+const unsigned char NO_MSHR = 0xFF;                 // regMshr[] of a register no miss is filling
+
+const unsigned int MAX_PREFETCH_FILLS = 8;         // Prefetches in flight per L1; more are dropped
+
+// A prefetched line on its way into an L1 (already in its tags)
+struct PrefetchFill {
+    bool valid;
+    unsigned int lineAddress;
+    PendingAccess access;
+};
+
+// An L1's prefetcher and the fills it has in flight
+struct PrefetchUnit {
+    PrefetchConfig config;
+    unique_ptr<Prefetcher> engine;  // NULL: no prefetching
+    PrefetchFill fills[MAX_PREFETCH_FILLS];
+    vector<unsigned int> requests;  // Scratch: what the engine asked for on one access
+};
+
+// A miss status holding register: one D-cache line fill in flight (--dcache-mshrs)
+struct Mshr {
+    bool valid;
+    unsigned int lineAddress;       // Address / line size; later misses to it merge here
+    PendingAccess access;
+};
+
+// Why runUntil() returned
+enum RunResult {
+    RUN_LIMIT_REACHED,
+    RUN_PROGRAM_FINISHED,
+    RUN_CYCLE_CAP,  // MAX_SIMULATION_CYCLES exceeded
+    RUN_DEBUG_STOP  // breakpoint or watchpoint hit (see debugHit)
+};
+
+//------------------------------------------------------
+// Pipelined Simulator
+//------------------------------------------------------
+// Everything one simulation needs: the architectural state, the pipeline
+// latches and predictor, the knobs it was configured with, its statistics and
+// a FunctionalCore for --no-pipeline runs. Simulators share nothing, so
+// several can run in one process on different threads. Console output goes
+// to the stream buffer given at construction; the .mem, stats and snapshot
+// files are still written to the working directory.
+class Simulator {
+public:
+    explicit Simulator(streambuf *consoleBuf = cout.rdbuf());
+
+    // Register file and memory
+    unsigned int X[32];             // 32 registers
+    GuestMemory guestMem;           // Flat 32-bit guest address space (code, data and stack)
+    bool pageFileValid;             // sim_pages.dat slots match guestMem.touched (incremental checkpoints)
+    unsigned int instruction_word;
+
+    // Simulation variables
+    int pc;                         // Program counter (byte-addressed)
+    unsigned int sz;                // Number of instructions (set by the loader)
+    unsigned int clockCycles;       // Clock cycle counter
+    InstructionTrace currentTrace;
+
+    vector<DecodedInst> PREDECODED; // PC-indexed decoded view of the code segment (PREDECODED[pc / 4], sz entries)
+
+    // Branch prediction: the BTB supplies targets, `direction` (--predictor) taken/not taken
+    BranchTargetBuffer BTB;
+    unique_ptr<BranchPredictor> direction;
+    ReturnAddressStack RAS;         // Calls and returns (--ras-depth); off with the static predictor
+    IndirectTargetCache ITC;        // Other jalr targets (--itc-bits); off with the static predictor
+
+    // Memory hierarchy (timing only, see cache.h and dram.h)
+    Cache icache;
+    Cache dcache;
+    Cache l2;
+    DramController dram;
+    PrefetchUnit iprefetch;
+    PrefetchUnit dprefetch;
+
+    KnobSettings knobs;
+    PipelineStatistics stats;
+    unsigned int instructionCounter; // Unique instruction sequence number
+
+    // Pipeline latches, snapshots and control flags
+    LatchBank latches;
+    vector<PipelineSnapshot> snapshots;
+    bool stall_fetch;
+    bool stall_decode;
+    bool flush_pipeline;
+    bool stall_memory;              // MEM waits on the D-cache: everything behind it holds
+    unsigned int nextPC;            // New PC after flush
+    PendingAccess fetchAccess;      // Fetch waits on this I-cache access...
+    unsigned int fetchWaitPC;       // ... then delivers this PC without a second lookup (NO_FETCH_WAIT: none)
+    PendingAccess memAccess;        // The D-cache access of the load/store in EX/MEM...
+    bool memAccessStarted;          // ... once it has been started
+    Mshr mshrs[MAX_CACHE_MSHRS];    // D-cache fills in flight; the first dcache.config.mshrs are used
+    unsigned char regMshr[32];      // The MSHR filling each register's load (NO_MSHR: none)
+    bool stall_miss_use;            // Decode waits on regMshr[] (counted as a D-cache stall)
+    TempResults tempResults;
+
+    // PC breakpoint bitmaps over the code segment (bit pc / 4), checked at fetch and retire
+    vector<unsigned int> fetchBreakBits;
+    vector<unsigned int> retireBreakBits;
+    vector<unsigned int> pendingBreaks; // Set before a program was loaded: address | 1 for retire
+    bool debugArmed;
+    vector<Watchpoint> watchpoints;
+    DebugHit debugHit;
+
+    // Trace-driven timing (--fanout, --decoupled): results come from a functional stream
+    SpmcRing<RetiredInst> *feed;    // NULL: execute from this simulator's own registers
+    unsigned int feedReader;        // This simulator's reader slot in *feed
+
+    bool finalReported;             // Serve mode: stats.out written for this run
+    ostream console;                // Simulator log (stdout unless redirected)
+    FunctionalCore functionalCore;  // Non-pipelined engine (--no-pipeline)
+
+    // Loading, reset and the cycle driver
+    bool loadInputFile(const string &filename);
+    void predecode_range(unsigned int first, unsigned int last);
+    void predecode_program();
+    void reset_simulator();
+    void initializeBranchPredictor();
+    void initializeCaches();
+    void reset_latches();
+    PipelineLatches &cur_latches() { return latches.bank[latches.cur]; }
+    PipelineLatches &next_latches() { return latches.bank[latches.cur ^ 1]; }
+    bool pipelineEmpty();
+    bool programFinished();
+    void run_cycle();
+    void report_cycle();
+    RunResult runUntil(RunLimit limit, unsigned int value);
+
+    // Pipeline stages
+    void hazardDetection();
+    void fetch();
+    void decode();
+    void execute();
+    void mem_op();
+    void write_back();
+    void update_pipeline();
+    bool icache_ready();
+    bool dcache_busy();
+    bool start_nonblocking_access(const EX_MEM_Register &ex_mem);
+    void complete_misses();
+    bool waits_on_miss(const DecodedInst &inst) const;
+    PendingAccess begin_access(Cache &l1, CacheStats &counters, unsigned int address, bool write);
+    PendingAccess demand_access(Cache &l1, CacheStats &counters, PrefetchUnit &prefetch, unsigned int pc,
+                                unsigned int address, bool write);
+    void read_below(Cache &l1, unsigned int address, unsigned int latency, PendingAccess &access);
+    bool claim_prefetch(Cache &l1, CacheStats &counters, PrefetchUnit &prefetch, unsigned int address, bool write,
+                        PendingAccess &access);
+    void run_prefetcher(Cache &l1, CacheStats &counters, PrefetchUnit &prefetch, unsigned int pc,
+                        unsigned int address, bool trigger);
+    void complete_prefetches(PrefetchUnit &prefetch);
+    bool access_done(PendingAccess &access);
+    void write_below(unsigned int address);
+    void saveForwardingData(ForwardingBuffer &fBuffer, const EX_MEM_Register &ex_mem);
+    unsigned int predict_next_pc(unsigned int fetchPC, bool countLookup);
+    unsigned int predict_jump_target(unsigned int fetchPC, unsigned int predicted, bool countStats, bool &fromRAS);
+    bool resolve_prediction(unsigned int branchPC, bool conditional, bool taken, unsigned int actualPC,
+                            unsigned int predictedPC);
+    void resolve_branch(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, bool taken, unsigned int targetPC);
+    void resolve_jal(const ID_EX_Register &id_ex, unsigned int targetPC);
+    void resolve_jalr(const ID_EX_Register &id_ex, unsigned int targetPC);
+    void exec_unknown(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2);
+    void exec_alu(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2);
+    void exec_mem_address(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2);
+    void exec_branch(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2);
+    void exec_jal(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2);
+    void exec_jalr(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2);
+    void exec_lui(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2);
+    void exec_auipc(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2);
+
+    // Functional fast-forward
+    bool functional_step(bool warmPredictor, RetiredInst *retired = NULL);
+    unsigned int fast_forward(unsigned int count, bool warmPredictor);
+    void apply_fast_forward();
+
+    // Breakpoints and watchpoints
+    void update_debug_armed();
+    bool set_pc_breakpoint(unsigned int address, bool atRetire);
+    void add_watchpoint(unsigned int address, unsigned int length, unsigned char kinds);
+    void clear_debug_points();
+    void record_debug_hit(unsigned char reason, unsigned int pc, unsigned int address,
+                          unsigned int oldValue, unsigned int newValue);
+    unsigned int watched_bytes(unsigned int address, unsigned char op);
+    void check_watchpoints(unsigned int pc, unsigned int address, unsigned char op,
+                           bool isWrite, unsigned int before);
+    void describe_debug_hit(ostream &out);
+
+    // Reports, dumps and step-mode state
+    void outputPipelineStageDetails();
+    void outputPipelineRegisterSummary();
+    void outputDataHazardInfo(unsigned int src_reg, unsigned int dest_reg);
+    void outputForwardingInfo(unsigned reg, ForwardStage from, const char *toStageStr, int val);
+    void outputControlHazardInfo(unsigned int branch_pc, bool predicted, bool actual);
+    void printBranchPredictor();
+    void printDataMemory(int startIndex, int count);
+    void printFinalStatistics();
+    void store_pipeline_snapshot();
+    void dump_pipeline_snapshots();
+    void dump_registers();
+    void dump_memory();
+    void dump_BP();
+    void save_state();
+    bool load_state();
+
+    // Command line, serve mode and the top-level driver
+    void parseCommandLineArgs(int argc, char *argv[]);
+    void serve_status(ostream &out, bool stopped = false);
+    bool serve_reset();
+    bool serve_session(istream &in, ostream &out);
+    int serve_socket(const string &path);
+    int serve(streambuf *replies);
+    int mainEntry(int argc, char *argv[]);
+
+private:
+    Simulator(const Simulator &);
+    Simulator &operator=(const Simulator &);
+};
+
+#endif // SIMULATOR_H
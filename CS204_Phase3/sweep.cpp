@@ -0,0 +1,252 @@
+// Design-space sweep: every point of a parameter grid against a workload set.
+#include "sweep.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+//------------------------------------------------------
+// Grid File
+//------------------------------------------------------
+static bool is_number(const string &token) {
+    char *end = NULL;
+    strtod(token.c_str(), &end);
+    return !token.empty() && *end == '\0';
+}
+
+bool load_sweep_grid(const string &gridFile, SweepGrid &grid) {
+    ifstream infile(gridFile);
+    if (!infile.is_open()) {
+        cerr << "Error: Could not open sweep grid file: " << gridFile << endl;
+        return false;
+    }
+    string line;
+    unsigned int lineNum = 0;
+    while (getline(infile, line)) {
+        lineNum++;
+        stringstream ss(line);
+        string name, value;
+        if (!(ss >> name) || name[0] == '#')
+            continue;
+        vector<string> values;
+        while (ss >> value)
+            values.push_back(value);
+        if (values.empty()) {
+            cerr << "Error: " << gridFile << ":" << lineNum << ": '" << name << "' has no values." << endl;
+            return false;
+        }
+        if (name == "workloads") {
+            grid.workloads.insert(grid.workloads.end(), values.begin(), values.end());
+            continue;
+        }
+        SweepAxis axis;
+        axis.name = name;
+        axis.values = values;
+        axis.numeric = true;
+        for (size_t i = 0; i < values.size(); i++)
+            axis.numeric = axis.numeric && is_number(values[i]);
+        grid.axes.push_back(axis);
+    }
+    if (grid.workloads.empty()) {
+        cerr << "Error: " << gridFile << " has no 'workloads' line." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Options for one grid point, in axis order
+static vector<string> point_options(const SweepGrid &grid, const vector<unsigned int> &choice) {
+    vector<string> options;
+    for (size_t a = 0; a < grid.axes.size(); a++) {
+        options.push_back("--" + grid.axes[a].name);
+        options.push_back(grid.axes[a].values[choice[a]]);
+    }
+    return options;
+}
+
+static string point_label(const SweepGrid &grid, const vector<unsigned int> &choice) {
+    string label;
+    for (size_t a = 0; a < grid.axes.size(); a++)
+        label += (a ? " " : "") + grid.axes[a].name + "=" + grid.axes[a].values[choice[a]];
+    return label.empty() ? "(defaults)" : label;
+}
+
+//------------------------------------------------------
+// Pareto Summary
+//------------------------------------------------------
+// Points that share every non-numeric parameter (predictor, forwarding, ...)
+// are compared with each other. Within such a group a point is on the Pareto
+// front unless another point has no higher CPI and no larger value on any
+// numeric parameter (BTB entries, sizes), and is strictly better somewhere.
+static bool dominates(const SweepGrid &grid, const SweepPoint &p, const SweepPoint &q) {
+    bool better = p.CPI < q.CPI;
+    if (p.CPI > q.CPI)
+        return false;
+    for (size_t a = 0; a < grid.axes.size(); a++) {
+        const SweepAxis &axis = grid.axes[a];
+        if (!axis.numeric) {
+            if (p.choice[a] != q.choice[a])
+                return false; // Different group
+            continue;
+        }
+        double pv = strtod(axis.values[p.choice[a]].c_str(), NULL);
+        double qv = strtod(axis.values[q.choice[a]].c_str(), NULL);
+        if (pv > qv)
+            return false;
+        better = better || pv < qv;
+    }
+    return better;
+}
+
+void mark_pareto_points(const SweepGrid &grid, vector<SweepPoint> &points) {
+    for (size_t i = 0; i < points.size(); i++) {
+        points[i].pareto = points[i].status == "ok";
+        for (size_t j = 0; j < points.size() && points[i].pareto; j++) {
+            if (j != i && points[j].status == "ok" && dominates(grid, points[j], points[i]))
+                points[i].pareto = false;
+        }
+    }
+}
+
+//------------------------------------------------------
+// Results Table (CSV, or JSON for a .json path)
+//------------------------------------------------------
+bool write_sweep_results(const string &path, const SweepGrid &grid, const vector<SweepPoint> &points) {
+    ofstream out(path);
+    if (!out.is_open()) {
+        cerr << "Error: Could not open " << path << " for writing." << endl;
+        return false;
+    }
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    out << fixed << setprecision(4);
+    if (json) {
+        out << "[" << endl;
+    } else {
+        out << "point";
+        for (size_t a = 0; a < grid.axes.size(); a++)
+            out << "," << grid.axes[a].name;
+        out << ",workloads,status,cycles,instructions,cpi,stalls,data_hazard_stalls,"
+               "control_hazard_stalls,branch_mispredictions,btb_hits,btb_misses,pareto" << endl;
+    }
+
+    for (size_t i = 0; i < points.size(); i++) {
+        const SweepPoint &p = points[i];
+        if (json) {
+            out << "  {\"point\": " << i;
+            for (size_t a = 0; a < grid.axes.size(); a++)
+                out << ", " << json_quote(grid.axes[a].name) << ": " << json_quote(grid.axes[a].values[p.choice[a]]);
+            out << ", \"workloads\": " << grid.workloads.size() << ", \"status\": " << json_quote(p.status)
+                << ", \"cycles\": " << p.cycles << ", \"instructions\": " << p.instructions
+                << ", \"cpi\": " << p.CPI << ", \"stalls\": " << p.totalStalls
+                << ", \"data_hazard_stalls\": " << p.dataHazardStalls
+                << ", \"control_hazard_stalls\": " << p.controlHazardStalls
+                << ", \"branch_mispredictions\": " << p.branchMispredictions
+                << ", \"btb_hits\": " << p.btbHits << ", \"btb_misses\": " << p.btbMisses
+                << ", \"pareto\": " << (p.pareto ? "true" : "false") << "}"
+                << (i + 1 < points.size() ? "," : "") << endl;
+        } else {
+            out << i;
+            for (size_t a = 0; a < grid.axes.size(); a++)
+                out << "," << csv_quote(grid.axes[a].values[p.choice[a]]);
+            out << "," << grid.workloads.size() << "," << p.status << "," << p.cycles << ","
+                << p.instructions << "," << p.CPI << "," << p.totalStalls << ","
+                << p.dataHazardStalls << "," << p.controlHazardStalls << ","
+                << p.branchMispredictions << "," << p.btbHits << "," << p.btbMisses << ","
+                << (p.pareto ? 1 : 0) << endl;
+        }
+    }
+    if (json)
+        out << "]" << endl;
+    return out.good();
+}
+
+//------------------------------------------------------
+// Sweep Driver
+//------------------------------------------------------
+int run_sweep(const KnobSettings &knobs, ostream &console) {
+    SweepGrid grid;
+    if (!load_sweep_grid(knobs.sweepFile, grid))
+        return 1;
+
+    // Enumerate the grid, first axis slowest
+    vector<SweepPoint> points;
+    vector<unsigned int> choice(grid.axes.size(), 0);
+    while (true) {
+        SweepPoint p = SweepPoint();
+        p.choice = choice;
+        points.push_back(p);
+        int a = (int)grid.axes.size() - 1;
+        while (a >= 0 && ++choice[a] == grid.axes[a].values.size())
+            choice[a--] = 0;
+        if (a < 0)
+            break;
+    }
+
+    // One batch job per (point, workload), checked before anything runs
+    vector<BatchJob> jobs;
+    for (size_t i = 0; i < points.size(); i++) {
+        for (size_t w = 0; w < grid.workloads.size(); w++) {
+            BatchJob job;
+            job.line = 0;
+            job.program = grid.workloads[w];
+            job.options = point_options(grid, points[i].choice);
+            if (w == 0 && !check_batch_job(job, knobs.sweepFile + ": " + point_label(grid, points[i].choice)))
+                return 1;
+            jobs.push_back(job);
+        }
+    }
+
+    unsigned int threads = batch_threads(knobs, jobs.size());
+    console << "Sweep mode: " << points.size() << " points x " << grid.workloads.size()
+            << " workloads on " << threads << " threads" << endl;
+    vector<BatchResult> results;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    run_batch_jobs(jobs, results, threads);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // Totals per point; CPI weights each workload by its instruction count
+    for (size_t i = 0; i < points.size(); i++) {
+        SweepPoint &p = points[i];
+        double clocks = 0.0;
+        p.status = "ok";
+        for (size_t w = 0; w < grid.workloads.size(); w++) {
+            const BatchResult &r = results[i * grid.workloads.size() + w];
+            if (r.status != "ok" && p.status == "ok")
+                p.status = r.status;
+            p.cycles += r.cycles;
+            p.instructions += r.instructions;
+            clocks += r.CPI * r.instructions;
+            p.totalStalls += r.totalStalls;
+            p.dataHazardStalls += r.dataHazardStalls;
+            p.controlHazardStalls += r.controlHazardStalls;
+            p.branchMispredictions += r.branchMispredictions;
+            p.btbHits += r.btbHits;
+            p.btbMisses += r.btbMisses;
+        }
+        p.CPI = p.instructions > 0 ? clocks / p.instructions : 0.0;
+    }
+    mark_pareto_points(grid, points);
+
+    console << fixed << setprecision(4);
+    for (size_t i = 0; i < points.size(); i++) {
+        const SweepPoint &p = points[i];
+        console << "[" << i << "] " << point_label(grid, p.choice) << ": " << p.status
+                << ", CPI " << p.CPI << ", stalls " << p.totalStalls
+                << ", mispredictions " << p.branchMispredictions << endl;
+    }
+    console << "Pareto front (CPI vs numeric parameters, per setting of the others):" << endl;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (points[i].pareto)
+            console << "  [" << i << "] " << point_label(grid, points[i].choice)
+                    << ": CPI " << points[i].CPI << endl;
+    }
+    console << "Sweep finished in " << setprecision(3) << seconds << " s" << endl;
+    console.unsetf(ios::floatfield);
+
+    if (!write_sweep_results(knobs.sweepOutput, grid, points))
+        return 1;
+    console << "Sweep results written to " << knobs.sweepOutput << endl;
+    return 0;
+}
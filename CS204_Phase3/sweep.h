@@ -0,0 +1,56 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <string>
+#include <vector>
+
+#include "batch.h"
+
+using namespace std;
+
+//------------------------------------------------------
+// Design-Space Sweep (--sweep)
+//------------------------------------------------------
+// A grid file names the workloads and one parameter per line with the values
+// to try; blank lines and '#' comments are ignored:
+//     workloads fib.mc factorial.mc bubblesort.mc
+//     btb-entries 4 16 64
+//     predictor onebit static gshare
+//     forwarding on off
+// Parameter P with value V is passed to each run as the option "--P V", so
+// any knob that takes a value can be swept without touching this file. Every
+// point of the grid runs against every workload as one batch job, all on the
+// batch thread pool.
+struct SweepAxis {
+    string name;
+    vector<string> values;
+    bool numeric;               // Every value is a number: smaller counts as cheaper
+};
+
+struct SweepGrid {
+    vector<string> workloads;
+    vector<SweepAxis> axes;
+};
+
+// Totals over the workload set for one grid point
+struct SweepPoint {
+    vector<unsigned int> choice;    // Value index per axis
+    string status;                  // ok, or the first job status that wasn't
+    unsigned long long cycles;
+    unsigned long long instructions;
+    double CPI;                     // Clock cycles / instructions over all workloads
+    unsigned long long totalStalls;
+    unsigned long long dataHazardStalls;
+    unsigned long long controlHazardStalls;
+    unsigned long long branchMispredictions;
+    unsigned long long btbHits;
+    unsigned long long btbMisses;
+    bool pareto;
+};
+
+bool load_sweep_grid(const string &gridFile, SweepGrid &grid);
+void mark_pareto_points(const SweepGrid &grid, vector<SweepPoint> &points);
+bool write_sweep_results(const string &path, const SweepGrid &grid, const vector<SweepPoint> &points);
+int run_sweep(const KnobSettings &knobs, ostream &console);
+
+#endif // SWEEP_H
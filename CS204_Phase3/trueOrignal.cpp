@@ -8,293 +8,282 @@
 #include <cstdio>
 #include <string>
 #include <vector>
+#include <type_traits>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
-#include "nonPipelined.h"
+#include "simulator.h"
+#include "batch.h"
+#include "sweep.h"
+#include "fanout.h"
 
 
 
 #define M 32
 
-//------------------------------------------------------
-// Memory Configuration Constants
-//------------------------------------------------------
-const unsigned int STACK_TOP = 0x7FFFFFDC;
-const unsigned int STACK_SIZE = 1024;  // in words
-const unsigned int STACK_BOTTOM = STACK_TOP - STACK_SIZE * 4;
-const unsigned int INSTRUCTION_MEMORY_SIZE = 4000; // in words
-const unsigned int DATA_MEMORY_SIZE = 1000000; // in words
-const unsigned int STACK_MEMORY_SIZE = 1024; // same as STACK_SIZE
-const unsigned int DATA_MEMORY_BASE = 0x10000000; // Base address of data memory
-
-//------------------------------------------------------
-// Global Register File and Memories
-//------------------------------------------------------
-static unsigned int X[32];       // 32 registers
-static unsigned int MEM[INSTRUCTION_MEMORY_SIZE];     // Instruction memory (word-addressed)
-static int DMEM[DATA_MEMORY_SIZE];          // Data memory
-static int STACKMEM[STACK_MEMORY_SIZE];   // Stack memory
-static unsigned int instruction_word;
 
 //------------------------------------------------------
-// Global Simulation Variables
+// Predecoded Instruction Records
 //------------------------------------------------------
-static bitset<M> inst;           // 32-bit instruction as bitset
-static unsigned int des_reg;     // destination register
-static int des_res;              // ALU result
-string subtype;                  // Instruction subtype string
-static int imm;                  // Immediate value
-static int pc = 0;               // Program counter (byte-addressed)
-unsigned int sz = 0;             // Number of instructions (set by the loader)
-unsigned int clockCycles = 0;    // Clock cycle counter
-
-
-// Add after the PipelineStatistics structure definition
-
 
-struct InstructionTrace {
-    int instructionNum;
-    bool active;
-    unsigned int pc;
-    unsigned int instruction;
-    
-    // Cycle counters for each stage
-    int fetchCycle;
-    int decodeCycle;
-    int executeCycle;
-    int memoryCycle;
-    int writebackCycle;
-    
-    // Results at each stage
-    string decodeInfo;
-    int executeResult;
-    int memoryResult;
-    int writebackResult;
-    
-InstructionTrace() : instructionNum(-1), active(false), pc(0), instruction(0),
-                     fetchCycle(-1), decodeCycle(-1), executeCycle(-1), 
-                     memoryCycle(-1), writebackCycle(-1), decodeInfo(""),
-                     executeResult(0), memoryResult(0), writebackResult(0){}
-};
-// Global trace object
-InstructionTrace currentTrace;
-
-//------------------------------------------------------
-// Global Control Signals Structure
-//------------------------------------------------------
-struct ControlSignals {
-    bool regWrite;
-    bool memRead;
-    bool memWrite;
-    bool memToReg;
-    bool aluSrc;
-    bool branch;
-    bool jump;
-    int aluOp;        // ALU operation code
+// Mnemonics indexed by InstOp (used for printing only)
+static const char *const OP_NAMES[OP_COUNT] = {
+    "unknown",
+    "add", "sub", "sll", "slt", "sltu", "xor", "srl", "sra", "or", "and",
+    "mul", "div", "rem",
+    "addi", "slti", "sltiu", "xori", "ori", "andi", "slli", "srli", "srai",
+    "lb", "lh", "lw", "lbu", "lhu",
+    "sb", "sh", "sw",
+    "beq", "bne", "blt", "bge", "bltu", "bgeu",
+    "jal", "jalr",
+    "lui", "auipc"
 };
 
 //------------------------------------------------------
-// Branch Predictor Structures
+// Decode one instruction word into a DecodedInst record
 //------------------------------------------------------
-const unsigned int BTB_SIZE = 16;
- 
-struct BTBEntry {
-    bool valid;
-    unsigned int branchPC;  // PC of the branch instruction
-    unsigned int targetPC;  // Predicted target if taken
-};
- 
-// Global BTB and one-bit PHT (PHT[i]==true means predict taken)
-BTBEntry BTB[BTB_SIZE];
-bool PHT[BTB_SIZE];
- 
-struct KnobSettings {
-    bool printDataMemoryAtEnd = true; // Print DMEM at simulation end
-    int dataPrintStart = 0;    
-    int dataPrintCount = 10;
-    
-    bool pipeliningEnabled = true;    
-    bool forwardingEnabled = true;    
-    bool printRegisterEachCycle = false;    
-    bool printPipelineRegisters = false;    
-    bool printBranchPredictorInfo = false;    
-    bool saveCycleSnapshots = false;    
-    string inputFile = "";
-    
-    // Trace functionality settings
-    bool traceInstructionEnabled = true;  // Knob5: Trace a specific instruction number
-    int traceInstructionNum = -1;         // Instruction number to trace
-    unsigned int traceInstructionPC = 0;  // PC address to trace
-    bool traceByPC = false;              // Whether to trace by PC rather than sequence number
-};
-
-struct PipelineStatistics {
-    unsigned int totalCycles = 0;           // Stat1: Total cycles
-    unsigned int instructionsExecuted = 0;  // Stat2: Total instructions executed
-    double CPI = 0.0;                       // Stat3: CPI
-    unsigned int dataTransferInst = 0;      // Stat4: Number of load/store instructions executed
-    unsigned int aluInst = 0;               // Stat5: Number of ALU instructions executed
-    unsigned int controlInst = 0;           // Stat6: Number of control instructions executed
-    unsigned int totalStalls = 0;           // Stat7: Total pipeline stalls inserted
-    unsigned int dataHazardCount = 0;       // Stat8: Data hazards detected
-    unsigned int controlHazardCount = 0;    // Stat9: Control hazards detected
-    unsigned int branchMispredCount = 0;    // Stat10: Branch mispredictions
-    unsigned int dataHazardStalls = 0;      // Stat11: Stalls due to data hazards
-    unsigned int controlHazardStalls = 0;   // Stat12: Stalls due to control hazards
-};
+DecodedInst predecode_word(unsigned int instruction) {
+    DecodedInst d = {OP_UNKNOWN, 0, CLASS_ALU, 0, 0, 0, 0, 0, {false, false, false, false, false, false, false, 0}};
+    unsigned int opcode = instruction & 0x7F;
+    unsigned int rd = (instruction >> 7) & 0x1F;
+    unsigned int funct3 = (instruction >> 12) & 0x7;
+    unsigned int rs1 = (instruction >> 15) & 0x1F;
+    unsigned int rs2 = (instruction >> 20) & 0x1F;
+    unsigned int funct7 = (instruction >> 25) & 0x7F;
+    // I-type immediate, shared by ALU-immediate, load and jalr encodings
+    unsigned int imm_i = (instruction >> 20) & 0xFFF;
+    int imm_i_sext = (imm_i & 0x800) ? (int)(imm_i | 0xFFFFF000) : (int)imm_i;
 
-KnobSettings knobs;
-PipelineStatistics stats;
-unsigned int instructionCounter = 0; // Unique instruction sequence number
+    if(opcode == 0x33) { // R-type
+        static const unsigned char base_ops[8] = {OP_ADD, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_OR, OP_AND};
+        d.instType = 'R';
+        d.rs1 = rs1;
+        d.rs2 = rs2;
+        d.rd = rd;
+        if(funct7 == 0x00)
+            d.op = base_ops[funct3];
+        else if(funct7 == 0x20 && funct3 == 0x0)
+            d.op = OP_SUB;
+        else if(funct7 == 0x20 && funct3 == 0x5)
+            d.op = OP_SRA;
+        else if(funct7 == 0x01 && funct3 == 0x0)
+            d.op = OP_MUL;
+        else if(funct7 == 0x01 && funct3 == 0x4)
+            d.op = OP_DIV;
+        else if(funct7 == 0x01 && funct3 == 0x6)
+            d.op = OP_REM;
+        d.useMask = USES_RS1 | USES_RS2;
+        d.control.regWrite = true;
+        d.control.aluOp = 2;
+        d.instClass = CLASS_ALU;
+    }
+    else if(opcode == 0x13) { // I-type ALU
+        static const unsigned char imm_ops[8] = {OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU, OP_XORI, OP_SRLI, OP_ORI, OP_ANDI};
+        d.instType = 'I';
+        d.rs1 = rs1;
+        d.rd = rd;
+        d.immediate = imm_i_sext;
+        d.op = imm_ops[funct3];
+        if(funct3 == 0x5 && ((instruction >> 30) & 0x1))
+            d.op = OP_SRAI;
+        d.useMask = USES_RS1;
+        d.control.regWrite = true;
+        d.control.aluSrc = true;
+        d.control.aluOp = 2;
+        d.instClass = CLASS_ALU;
+    }
+    else if(opcode == 0x03) { // I-type Load
+        static const unsigned char load_ops[8] = {OP_LB, OP_LH, OP_LW, OP_UNKNOWN, OP_LBU, OP_LHU, OP_UNKNOWN, OP_UNKNOWN};
+        d.instType = 'I';
+        d.rs1 = rs1;
+        d.rd = rd;
+        d.immediate = imm_i_sext;
+        d.op = load_ops[funct3];
+        d.useMask = USES_RS1;
+        d.control.regWrite = true;
+        d.control.memRead = true;
+        d.control.memToReg = true;
+        d.control.aluSrc = true;
+        d.instClass = CLASS_DATA_TRANSFER;
+    }
+    else if(opcode == 0x23) { // S-type (Store)
+        static const unsigned char store_ops[8] = {OP_SB, OP_SH, OP_SW, OP_UNKNOWN, OP_UNKNOWN, OP_UNKNOWN, OP_UNKNOWN, OP_UNKNOWN};
+        unsigned int imm_unsigned = (funct7 << 5) | rd;
+        d.instType = 'S';
+        d.rs1 = rs1;
+        d.rs2 = rs2;
+        d.immediate = (imm_unsigned & 0x800) ? (int)(imm_unsigned | 0xFFFFF000) : (int)imm_unsigned;
+        d.op = store_ops[funct3];
+        d.useMask = USES_RS1 | USES_RS2;
+        d.control.memWrite = true;
+        d.control.aluSrc = true;
+        d.instClass = CLASS_DATA_TRANSFER;
+    }
+    else if(opcode == 0x63) { // B-type (Branch)
+        static const unsigned char branch_ops[8] = {OP_BEQ, OP_BNE, OP_UNKNOWN, OP_UNKNOWN, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU};
+        unsigned int imm_11 = (instruction >> 7) & 0x1;
+        unsigned int imm_4_1 = (instruction >> 8) & 0xF;
+        unsigned int imm_10_5 = (instruction >> 25) & 0x3F;
+        unsigned int imm_12 = (instruction >> 31) & 0x1;
+        unsigned int imm_unsigned = (imm_12 << 12) | (imm_11 << 11) | (imm_10_5 << 5) | (imm_4_1 << 1);
+        d.instType = 'B';
+        d.rs1 = rs1;
+        d.rs2 = rs2;
+        d.immediate = (imm_unsigned & 0x1000) ? (int)(imm_unsigned | 0xFFFFE000) : (int)imm_unsigned;
+        d.op = branch_ops[funct3];
+        d.useMask = USES_RS1 | USES_RS2;
+        d.control.branch = true;
+        d.control.aluOp = 1;
+        d.instClass = CLASS_CONTROL;
+    }
+    else if(opcode == 0x6F) { // J-type (jal)
+        unsigned int imm_20 = (instruction >> 31) & 0x1;
+        unsigned int imm_10_1 = (instruction >> 21) & 0x3FF;
+        unsigned int imm_11 = (instruction >> 20) & 0x1;
+        unsigned int imm_19_12 = (instruction >> 12) & 0xFF;
+        unsigned int imm_unsigned = (imm_20 << 20) | (imm_19_12 << 12) | (imm_11 << 11) | (imm_10_1 << 1);
+        d.instType = 'J';
+        d.rd = rd;
+        d.immediate = (imm_unsigned & 0x100000) ? (int)(imm_unsigned | 0xFFF00000) : (int)imm_unsigned;
+        d.op = OP_JAL;
+        d.control.regWrite = true;
+        d.control.jump = true;
+        d.instClass = CLASS_CONTROL;
+    }
+    else if(opcode == 0x67) { // I-type (jalr)
+        d.instType = 'I';
+        d.rs1 = rs1;
+        d.rd = rd;
+        d.immediate = imm_i_sext;
+        d.op = OP_JALR;
+        d.useMask = USES_RS1;
+        d.control.regWrite = true;
+        d.control.jump = true;
+        d.control.aluSrc = true;
+        d.instClass = CLASS_CONTROL;
+    }
+    else if(opcode == 0x37 || opcode == 0x17) { // U-type (lui / auipc)
+        d.instType = 'U';
+        d.rd = rd;
+        d.immediate = (int)(instruction & 0xFFFFF000);
+        d.op = (opcode == 0x37) ? OP_LUI : OP_AUIPC;
+        d.control.regWrite = true;
+        d.control.aluSrc = true;
+        d.instClass = CLASS_ALU;
+    }
+    return d;
+}
 
 //------------------------------------------------------
-// Pipeline Register Structures
+// Rebuild PREDECODED[] for instruction words [first, last)
 //------------------------------------------------------
-// IF/ID Pipeline Register
-struct IF_ID_Register {
-    bool valid;             // true if valid, false if bubble
-    unsigned int pc;        // PC value of fetched instruction
-    unsigned int instruction; // 32-bit fetched instruction
-    unsigned int predictedPC; // Predicted next PC from branch predictor
-};
- 
-// ID/EX Pipeline Register
-struct ID_EX_Register {
-    bool valid;
-    unsigned int pc;
-    char instType;          // 'R', 'I', 'S', 'B', 'U', or 'J'
-    string subType;
-    unsigned int rs1;       // Source register numbers
-    unsigned int rs2;
-    unsigned int rd;
-    int rs1Value;           // Operand values (may be forwarded)
-    int rs2Value;
-    int immediate;
-    ControlSignals control;
-    unsigned int instructionWord;
-    unsigned int instructionNum;  // Unique sequence number
-};
- 
-// EX/MEM Pipeline Register
-struct EX_MEM_Register {
-    bool valid;
-    unsigned int pc;
-    char instType;
-    string subType;
-    unsigned int rd;
-    int aluResult;
-    int rs2Value;         // For store instructions
-    unsigned int memAddress; // Computed memory address for loads/stores
-    bool branchTaken;     // Outcome of branch computation
-    ControlSignals control;
-    unsigned int instructionWord;
-    unsigned int instructionNum;
-};
- 
-// MEM/WB Pipeline Register
-struct MEM_WB_Register {
-    bool valid;
-    unsigned int pc;
-    char instType;
-    string subType;
-    unsigned int rd;
-    int aluResult;
-    int memData;
-    ControlSignals control;
-    unsigned int instructionWord;
-    unsigned int instructionNum;
-};
-
-
-// Add this after the other pipeline register structures
-struct WB_Complete_Register {
-    bool valid;
-    unsigned int pc;
-    char instType;
-    string subType;
-    unsigned int rd;
-    int result;    // Final value written to register
-    bool regWrite; // Whether this instruction wrote to a register
-    unsigned int destReg; // Register written to
-    unsigned int instructionNum;
-};
+void Simulator::predecode_range(unsigned int first, unsigned int last) {
+    if(last > PREDECODED.size())
+        last = PREDECODED.size();
+    for(unsigned int i = first; i < last; i++)
+        PREDECODED[i] = predecode_word(guestMem.load32(i * 4));
+}
 
-// Global instance
-WB_Complete_Register wb_complete = {false, 0, '0', "", 0, 0, false, 0, 0};
+// Predecode the whole code segment (called whenever it is (re)loaded)
+void Simulator::predecode_program() {
+    PREDECODED.assign(sz, DecodedInst());
+    predecode_range(0, sz);
+    // Every fetchable PC must be covered so the break check needs no bounds
+    // test, and nothing else is: fetch never leaves the code segment
+    fetchBreakBits.resize((sz + 31) / 32, 0);
+    retireBreakBits.resize((sz + 31) / 32, 0);
+    for(size_t i = 0; i < pendingBreaks.size(); i++) {
+        unsigned int address = pendingBreaks[i] & ~3u;
+        if(!set_pc_breakpoint(address, (pendingBreaks[i] & 1) != 0))
+            console << "Warning: Breakpoint at 0x" << hex << address << dec
+                    << " is outside the code segment and is ignored." << endl;
+    }
+    pendingBreaks.clear();
+    update_debug_armed();
+}
 
 //------------------------------------------------------
-// Pipeline Snapshot Structure for Cycle-by-Cycle Visualization
-//------------------------------------------------------
-struct PipelineSnapshot {
-    IF_ID_Register if_id;
-    ID_EX_Register id_ex;
-    EX_MEM_Register ex_mem;
-    MEM_WB_Register mem_wb;
-    WB_Complete_Register wb_complete;  // Add this line
-    unsigned int pc;
-    unsigned int clockCycles;
-    BTBEntry BTB_state[BTB_SIZE];
-    bool PHT_state[BTB_SIZE];
+// Operation Dispatch Tables
+//------------------------------------------------------
+// Pure ALU / compare functions, indexed by InstOp. Shifts and products are
+// computed on unsigned values so that wrap-around is well defined.
+typedef int (*AluFunc)(int a, int b);
+
+static int alu_zero(int, int)  { return 0; }
+static int alu_add(int a, int b)  { return (int)((unsigned int)a + (unsigned int)b); }
+static int alu_sub(int a, int b)  { return (int)((unsigned int)a - (unsigned int)b); }
+static int alu_sll(int a, int b)  { return (int)((unsigned int)a << (b & 0x1F)); }
+static int alu_slt(int a, int b)  { return (a < b) ? 1 : 0; }
+static int alu_sltu(int a, int b) { return ((unsigned int)a < (unsigned int)b) ? 1 : 0; }
+static int alu_xor(int a, int b)  { return a ^ b; }
+static int alu_srl(int a, int b)  { return (int)((unsigned int)a >> (b & 0x1F)); }
+static int alu_sra(int a, int b)  { return a >> (b & 0x1F); }
+static int alu_or(int a, int b)   { return a | b; }
+static int alu_and(int a, int b)  { return a & b; }
+static int alu_mul(int a, int b)  { return (int)((unsigned int)a * (unsigned int)b); }
+static int alu_div(int a, int b) {
+    if(b == 0) return -1;
+    if(a == (int)0x80000000 && b == -1) return a; // Overflow case defined by RISC-V
+    return a / b;
+}
+static int alu_rem(int a, int b) {
+    if(b == 0) return a;
+    if(a == (int)0x80000000 && b == -1) return 0;
+    return a % b;
+}
+static int alu_eq(int a, int b)   { return a == b; }
+static int alu_ne(int a, int b)   { return a != b; }
+static int alu_ge(int a, int b)   { return a >= b; }
+static int alu_geu(int a, int b)  { return (unsigned int)a >= (unsigned int)b; }
+static int alu_lui(int, int b)    { return b; }
+
+static const AluFunc ALU_FUNCS[OP_COUNT] = {
+    alu_zero,                                                   // unknown
+    alu_add, alu_sub, alu_sll, alu_slt, alu_sltu, alu_xor, alu_srl, alu_sra, alu_or, alu_and,
+    alu_mul, alu_div, alu_rem,
+    alu_add, alu_slt, alu_sltu, alu_xor, alu_or, alu_and, alu_sll, alu_srl, alu_sra,
+    alu_add, alu_add, alu_add, alu_add, alu_add,                // loads: address
+    alu_add, alu_add, alu_add,                                  // stores: address
+    alu_eq, alu_ne, alu_slt, alu_ge, alu_sltu, alu_geu,         // branches: condition
+    alu_add, alu_add,                                           // jal / jalr: target
+    alu_lui, alu_add                                            // lui / auipc
 };
- 
-// Container to store snapshots
-vector<PipelineSnapshot> snapshots;
- 
-// Flag to enable snapshot saving
-bool saveCycleSnapshots = false;
- 
-// Global Pipeline Registers
-IF_ID_Register if_id = {false, 0, 0, 0};
-ID_EX_Register id_ex = {false, 0, '0', "", 0, 0, 0, 0, 0, 0, {false, false, false, false, false, false, false, 0}, 0, 0};
-EX_MEM_Register ex_mem = {false, 0, '0', "", 0, 0, 0, 0, false, {false, false, false, false, false, false, false, 0}, 0, 0};
-MEM_WB_Register mem_wb = {false, 0, '0', "", 0, 0, 0, {false, false, false, false, false, false, false, 0}, 0, 0};
- 
-//------------------------------------------------------
-// Pipeline Control Flags
-//------------------------------------------------------
-bool stall_fetch = false;
-bool stall_decode = false;
-bool flush_pipeline = false;
-unsigned int nextPC = 0; // New PC after flush
- 
+
 //------------------------------------------------------
-// Temporary Results Structure for In-Flight Values
+// Construction
 //------------------------------------------------------
-struct TempResults {
-    bool exValid;
-    unsigned int exRd;
-    int exResult;
-    bool exRegWrite;
-    
-    bool memValid;
-    unsigned int memRd;
-    int memResult;
-    int memData;
-    bool memRegWrite;
-    bool memToReg;
- 
-    TempResults() : exValid(false), exRd(0), exResult(0), exRegWrite(false),
-                   memValid(false), memRd(0), memResult(0), memData(0), memRegWrite(false), 
-                   memToReg(false) {}
-                   
-    // Add a clear method to reset state
-    void clear() {
-        exValid = false;
-        exRd = 0;
-        exResult = 0;
-        exRegWrite = false;
-        
-        memValid = false;
-        memRd = 0;
-        memResult = 0;
-        memData = 0;
-        memRegWrite = false;
-        memToReg = false;
-    }
-};
- 
-TempResults tempResults;
- 
+Simulator::Simulator(streambuf *consoleBuf)
+    : pageFileValid(false), instruction_word(0), pc(0), sz(0), clockCycles(0),
+      BTB(), direction(make_branch_predictor(PREDICT_ONE_BIT, DEFAULT_PREDICTOR_TABLE_BITS, DEFAULT_PREDICTOR_HISTORY)),
+      instructionCounter(0), stall_fetch(false), stall_decode(false), flush_pipeline(false),
+      nextPC(0), debugArmed(false), feed(NULL), feedReader(0), finalReported(false), console(consoleBuf),
+      functionalCore(consoleBuf) {
+    memset(X, 0, sizeof(X));
+    memset(&debugHit, 0, sizeof(debugHit));
+    BTB.configure(BTB_SIZE, 1, 0, REPLACE_LRU);
+    direction->reset(BTB.size());
+    reset_latches();
+}
+
+// Empty latches, with no cache access or miss in flight
+void Simulator::reset_latches() {
+    memset(&latches, 0, sizeof(latches));
+    stall_memory = false;
+    memset(&fetchAccess, 0, sizeof(fetchAccess));
+    fetchWaitPC = NO_FETCH_WAIT;
+    memset(&memAccess, 0, sizeof(memAccess));
+    memAccessStarted = false;
+    memset(mshrs, 0, sizeof(mshrs));
+    memset(regMshr, NO_MSHR, sizeof(regMshr));
+    memset(iprefetch.fills, 0, sizeof(iprefetch.fills));
+    memset(dprefetch.fills, 0, sizeof(dprefetch.fills));
+    stall_miss_use = false;
+}
+
 //------------------------------------------------------
 // Utility: Trim whitespace from both ends
 //------------------------------------------------------
@@ -304,45 +293,9 @@ string trim(const string &s) {
     return (start == string::npos) ? "" : s.substr(start, end - start + 1);
 }
 
-// only two forwarding‐source stages
-enum ForwardStage {
-    EX_MEM,    // data sitting in EX/MEM
-    MEM_WB     // data sitting in MEM/WB (or tempResults)
-};
-
-
-struct ForwardingInfo {
-    int          value;
-    ForwardStage stage;
-};
-
-struct ForwardingBuffer {
-    ForwardingInfo saved[32];
-    bool           valid[32];
-
-    ForwardingBuffer() {
-        for(int i = 0; i < 32; i++) valid[i] = false;
-    }
-
-    void saveValue(unsigned reg, int val, ForwardStage src) {
-        if (reg == 0) return;
-        saved[reg].value = val;
-        saved[reg].stage = src;
-        valid[reg] = true;
-    }
-
-    bool getValue(unsigned reg, int &outVal, ForwardStage &outStage) const {
-        if (reg != 0 && valid[reg]) {
-            outVal   = saved[reg].value;
-            outStage = saved[reg].stage;
-            return true;
-        }
-        return false;
-    }
-};
 
  
-void saveForwardingData(ForwardingBuffer &fBuffer) {
+void Simulator::saveForwardingData(ForwardingBuffer &fBuffer, const EX_MEM_Register &ex_mem) {
     // MEM/WB source
     if (tempResults.memValid && tempResults.memRegWrite && tempResults.memRd != 0) {
         int v = tempResults.memToReg ? tempResults.memData : tempResults.memResult;
@@ -359,175 +312,227 @@ void saveForwardingData(ForwardingBuffer &fBuffer) {
 //------------------------------------------------------
 // Output Detailed Pipeline Stage Information
 //------------------------------------------------------
-void outputPipelineStageDetails() {
+void Simulator::outputPipelineStageDetails() {
     if (knobs.traceInstructionEnabled && !knobs.printPipelineRegisters) {
         return;
     }
-    cout << "-------------------------------------" << endl;
-    cout << "Cycle " << clockCycles << " Pipeline Details:" << endl;
+    const PipelineLatches &stages = cur_latches();
+    const IF_ID_Register &if_id = stages.if_id;
+    const ID_EX_Register &id_ex = stages.id_ex;
+    const EX_MEM_Register &ex_mem = stages.ex_mem;
+    const MEM_WB_Register &mem_wb = stages.mem_wb;
+    console << "-------------------------------------" << endl;
+    console << "Cycle " << clockCycles << " Pipeline Details:" << endl;
    
     // IF stage
     if(if_id.valid) {
-        cout << "IF: PC = 0x" << hex << if_id.pc
-             << ", Instruction = 0x" << hex << if_id.instruction << endl;
+        console << "IF: PC = 0x" << hex << if_id.pc
+                << ", Instruction = 0x" << hex << if_id.instruction << endl;
     } else {
-        cout << "IF: Bubble" << endl;
+        console << "IF: Bubble" << endl;
     }
    
     // ID stage
     if(id_ex.valid) {
-        cout << "ID: PC = 0x" << hex << id_ex.pc
-             << ", Instruction Type = " << id_ex.instType
-             << ", Subtype = " << id_ex.subType
-             << ", rs1 = x" << dec << id_ex.rs1
-             << ", rs2 = x" << dec << id_ex.rs2
-             << ", rd = x" << dec << id_ex.rd << endl;
+        console << "ID: PC = 0x" << hex << id_ex.pc
+                << ", Instruction Type = " << id_ex.instType
+                << ", Subtype = " << OP_NAMES[id_ex.op]
+                << ", rs1 = x" << dec << id_ex.rs1
+                << ", rs2 = x" << dec << id_ex.rs2
+                << ", rd = x" << dec << id_ex.rd << endl;
     } else {
-        cout << "ID: Bubble" << endl;
+        console << "ID: Bubble" << endl;
     }
    
     // EX stage
     if(ex_mem.valid) {
-        cout << "EX: PC = 0x" << hex << ex_mem.pc
-             << ", Instruction Type = " << ex_mem.instType
-             << ", Subtype = " << ex_mem.subType
-             << ", ALU Result = " << dec << ex_mem.aluResult << endl;
+        console << "EX: PC = 0x" << hex << ex_mem.pc
+                << ", Instruction Type = " << ex_mem.instType
+                << ", Subtype = " << OP_NAMES[ex_mem.op]
+                << ", ALU Result = " << dec << ex_mem.aluResult << endl;
     } else {
-        cout << "EX: Bubble" << endl;
+        console << "EX: Bubble" << endl;
     }
    
     // MEM stage
     if(mem_wb.valid) {
-        cout << "MEM: PC = 0x" << hex << mem_wb.pc
-             << ", Instruction Type = " << mem_wb.instType
-             << ", Subtype = " << mem_wb.subType;
+        console << "MEM: PC = 0x" << hex << mem_wb.pc
+                << ", Instruction Type = " << mem_wb.instType
+                << ", Subtype = " << OP_NAMES[mem_wb.op];
         if(mem_wb.control.memRead) {
-            cout << ", Read Data = " << dec << mem_wb.memData;
+            console << ", Read Data = " << dec << mem_wb.memData;
         }
-        cout << endl;
+        console << endl;
     } else {
-        cout << "MEM: Bubble" << endl;
+        console << "MEM: Bubble" << endl;
     }
    
     // WB stage
     if(mem_wb.valid && mem_wb.control.regWrite && mem_wb.rd != 0) {
-        cout << "WB: PC = 0x" << hex << mem_wb.pc
-             << ", Writing to x" << dec << mem_wb.rd
-             << " = " << dec << (mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult) << endl;
+        console << "WB: PC = 0x" << hex << mem_wb.pc
+                << ", Writing to x" << dec << mem_wb.rd
+                << " = " << dec << (mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult) << endl;
     } else {
-        cout << "WB: Bubble or no register write" << endl;
+        console << "WB: Bubble or no register write" << endl;
     }
 }
  
+//------------------------------------------------------
+// One-line-per-latch summary of the pipeline registers
+//------------------------------------------------------
+void Simulator::outputPipelineRegisterSummary() {
+    const PipelineLatches &stages = cur_latches();
+    const IF_ID_Register &if_id = stages.if_id;
+    const ID_EX_Register &id_ex = stages.id_ex;
+    const EX_MEM_Register &ex_mem = stages.ex_mem;
+    const MEM_WB_Register &mem_wb = stages.mem_wb;
+    console << "--- Pipeline Register Summary ---" << endl;
+    console << "IF/ID:  Valid=" << (if_id.valid ? "T" : "F") << ", PC=0x" << hex << if_id.pc << ", Inst=0x" << if_id.instruction << ", PredPC=0x" << if_id.predictedPC << dec << endl;
+    console << "ID/EX:  Valid=" << (id_ex.valid ? "T" : "F"); if(id_ex.valid) console << ", PC=0x" << hex << id_ex.pc << ", Type=" << id_ex.instType << ", Sub=" << OP_NAMES[id_ex.op] << dec; console << endl;
+    console << "EX/MEM: Valid=" << (ex_mem.valid ? "T" : "F"); if(ex_mem.valid) console << ", PC=0x" << hex << ex_mem.pc << ", Type=" << ex_mem.instType << ", Sub=" << OP_NAMES[ex_mem.op] << ", ALU= " << dec << ex_mem.aluResult; console << endl;
+    console << "MEM/WB: Valid=" << (mem_wb.valid ? "T" : "F"); if(mem_wb.valid) console << ", PC=0x" << hex << mem_wb.pc << ", Type=" << mem_wb.instType << ", Sub=" << OP_NAMES[mem_wb.op]; console << endl;
+    console << "-------------------------------" << endl;
+}
+
+// True when no valid instruction is left in IF/ID through MEM/WB
+bool Simulator::pipelineEmpty() {
+    const PipelineLatches &stages = cur_latches();
+    return !stages.if_id.valid && !stages.id_ex.valid && !stages.ex_mem.valid && !stages.mem_wb.valid;
+}
+ 
 //------------------------------------------------------
 // NEW: Save a snapshot of the current pipeline registers and state
 //------------------------------------------------------
-void store_pipeline_snapshot() {
+void Simulator::store_pipeline_snapshot() {
     PipelineSnapshot snap;
-    snap.if_id = if_id;
-    snap.id_ex = id_ex;
-    snap.ex_mem = ex_mem;
-    snap.mem_wb = mem_wb;
-    snap.wb_complete = wb_complete;  // Add this line
+    snap.stages = cur_latches();
     snap.pc = pc;
     snap.clockCycles = clockCycles;
     // Save branch predictor state too
-    for (unsigned int i = 0; i < BTB_SIZE; i++) {
-        snap.BTB_state[i] = BTB[i];
-        snap.PHT_state[i] = PHT[i];
-    }
+    snap.BTB_state = BTB.entries;
+    snap.PHT_state.resize(BTB.size());
+    for (unsigned int i = 0; i < BTB.size(); i++)
+        snap.PHT_state[i] = direction->predict(BTB.entries[i].branchPC, i);
     snapshots.push_back(snap);
 }
  
 //------------------------------------------------------
-// NEW: Dump all pipeline snapshots to "cycle_snapshots.log"
+// Write one pipeline snapshot in the cycle_snapshots.log format
 //------------------------------------------------------
-void dump_pipeline_snapshots() {
-    ofstream snapFile("cycle_snapshots.log");
-    if(!snapFile.is_open()){
-        cerr << "Error: Could not open cycle_snapshots.log for writing." << endl;
-        return;
+void write_pipeline_snapshot(ostream &snapFile, const PipelineSnapshot &snap) {
+    snapFile << "----------------------------------------------------" << endl;
+    snapFile << "Cycle " << snap.clockCycles << " Pipeline State:" << endl;
+   
+    // IF stage
+    if(snap.stages.if_id.valid) {
+        snapFile << "IF: PC = 0x" << hex << snap.stages.if_id.pc
+                 << ", Instruction = 0x" << hex << snap.stages.if_id.instruction << dec << endl;
+    } else {
+        snapFile << "IF: Bubble" << endl;
     }
    
-    for(const auto& snap : snapshots) {
-        snapFile << "----------------------------------------------------" << endl;
-        snapFile << "Cycle " << snap.clockCycles << " Pipeline State:" << endl;
-       
-        // IF stage
-        if(snap.if_id.valid) {
-            snapFile << "IF: PC = 0x" << hex << snap.if_id.pc
-                     << ", Instruction = 0x" << hex << snap.if_id.instruction << dec << endl;
-        } else {
-            snapFile << "IF: Bubble" << endl;
-        }
-       
-        // ID stage
-        if(snap.id_ex.valid) {
-            snapFile << "ID: PC = 0x" << hex << snap.id_ex.pc
-                     << ", Type = " << snap.id_ex.instType
-                     << ", Subtype = " << snap.id_ex.subType << dec
-                     << ", rs1 = x" << snap.id_ex.rs1
-                     << ", rs2 = x" << snap.id_ex.rs2
-                     << ", rd = x" << snap.id_ex.rd << endl;
-        } else {
-            snapFile << "ID: Bubble" << endl;
-        }
-       
-        // EX stage
-        if(snap.ex_mem.valid) {
-            snapFile << "EX: PC = 0x" << hex << snap.ex_mem.pc
-                     << ", Type = " << snap.ex_mem.instType
-                     << ", Subtype = " << snap.ex_mem.subType << dec
-                     << ", ALU Result = " << snap.ex_mem.aluResult << endl;
-        } else {
-            snapFile << "EX: Bubble" << endl;
-        }
-       
-        // MEM stage - Use mem_wb for MEM stage, not ex_mem
-        if(snap.mem_wb.valid) {
-            snapFile << "MEM: PC = 0x" << hex << snap.mem_wb.pc
-                     << ", Type = " << snap.mem_wb.instType
-                     << ", Subtype = " << snap.mem_wb.subType << dec;
-            if(snap.mem_wb.control.memRead) {
-                snapFile << ", Read Data = " << snap.mem_wb.memData;
-            }
-            snapFile << endl;
-        } else {
-            snapFile << "MEM: Bubble" << endl;
+    // ID stage
+    if(snap.stages.id_ex.valid) {
+        snapFile << "ID: PC = 0x" << hex << snap.stages.id_ex.pc
+                 << ", Type = " << snap.stages.id_ex.instType
+                 << ", Subtype = " << OP_NAMES[snap.stages.id_ex.op] << dec
+                 << ", rs1 = x" << snap.stages.id_ex.rs1
+                 << ", rs2 = x" << snap.stages.id_ex.rs2
+                 << ", rd = x" << snap.stages.id_ex.rd << endl;
+    } else {
+        snapFile << "ID: Bubble" << endl;
+    }
+   
+    // EX stage
+    if(snap.stages.ex_mem.valid) {
+        snapFile << "EX: PC = 0x" << hex << snap.stages.ex_mem.pc
+                 << ", Type = " << snap.stages.ex_mem.instType
+                 << ", Subtype = " << OP_NAMES[snap.stages.ex_mem.op] << dec
+                 << ", ALU Result = " << snap.stages.ex_mem.aluResult << endl;
+    } else {
+        snapFile << "EX: Bubble" << endl;
+    }
+   
+    // MEM stage - Use mem_wb for MEM stage, not ex_mem
+    if(snap.stages.mem_wb.valid) {
+        snapFile << "MEM: PC = 0x" << hex << snap.stages.mem_wb.pc
+                 << ", Type = " << snap.stages.mem_wb.instType
+                 << ", Subtype = " << OP_NAMES[snap.stages.mem_wb.op] << dec;
+        if(snap.stages.mem_wb.control.memRead) {
+            snapFile << ", Read Data = " << snap.stages.mem_wb.memData;
         }
-       
-        // WB stage - Now using wb_complete for the completed instruction
-        if(snap.wb_complete.valid) {
-            snapFile << "WB: PC = 0x" << hex << snap.wb_complete.pc
-                     << ", Type = " << snap.wb_complete.instType
-                     << ", Subtype = " << snap.wb_complete.subType << dec;
-            if(snap.wb_complete.regWrite && snap.wb_complete.destReg != 0) {
-                snapFile << ", Writing to x" << snap.wb_complete.destReg
-                       << " = " << snap.wb_complete.result;
-            }
-            snapFile << endl;
+        snapFile << endl;
+    } else {
+        snapFile << "MEM: Bubble" << endl;
+    }
+   
+    // WB stage - Now using wb_complete for the completed instruction
+    if(snap.stages.wb_complete.valid) {
+        snapFile << "WB: PC = 0x" << hex << snap.stages.wb_complete.pc
+                 << ", Type = " << snap.stages.wb_complete.instType
+                 << ", Subtype = " << OP_NAMES[snap.stages.wb_complete.op] << dec;
+        if(snap.stages.wb_complete.regWrite && snap.stages.wb_complete.destReg != 0) {
+            snapFile << ", Writing to x" << snap.stages.wb_complete.destReg
+                   << " = " << snap.stages.wb_complete.result;
         }
+        snapFile << endl;
+    }
 
-        // Completed instruction (post-writeback)
-        if(snap.wb_complete.valid) {
-            snapFile << "Completed: PC = 0x" << hex << snap.wb_complete.pc
-                     << ", Type = " << snap.wb_complete.instType 
-                     << ", Subtype = " << snap.wb_complete.subType << dec;
-            if(snap.wb_complete.regWrite && snap.wb_complete.destReg != 0) {
-                snapFile << ", Wrote x" << snap.wb_complete.destReg
-                       << " = " << snap.wb_complete.result;
-            }
-            snapFile << endl;
+    // Completed instruction (post-writeback)
+    if(snap.stages.wb_complete.valid) {
+        snapFile << "Completed: PC = 0x" << hex << snap.stages.wb_complete.pc
+                 << ", Type = " << snap.stages.wb_complete.instType 
+                 << ", Subtype = " << OP_NAMES[snap.stages.wb_complete.op] << dec;
+        if(snap.stages.wb_complete.regWrite && snap.stages.wb_complete.destReg != 0) {
+            snapFile << ", Wrote x" << snap.stages.wb_complete.destReg
+                   << " = " << snap.stages.wb_complete.result;
         }
+        snapFile << endl;
+    }
+}
+ 
+//------------------------------------------------------
+// NEW: Dump all pipeline snapshots to "cycle_snapshots.log"
+//------------------------------------------------------
+void Simulator::dump_pipeline_snapshots() {
+    ofstream snapFile("cycle_snapshots.log");
+    if(!snapFile.is_open()){
+        cerr << "Error: Could not open cycle_snapshots.log for writing." << endl;
+        return;
     }
+   
+    for(const auto& snap : snapshots)
+        write_pipeline_snapshot(snapFile, snap);
     snapFile.close();
-    cout << "Pipeline snapshots written to cycle_snapshots.log" << endl;
+    console << "Pipeline snapshots written to cycle_snapshots.log" << endl;
 }
  
+// A prefetcher's configuration, its tables and its fills in flight
+static void save_prefetch_unit(ostream &out, const PrefetchUnit &unit) {
+    out.write(reinterpret_cast<const char*>(&unit.config), sizeof(unit.config));
+    if (unit.engine)
+        unit.engine->save(out);
+    out.write(reinterpret_cast<const char*>(unit.fills), sizeof(unit.fills));
+}
+
+static bool load_prefetch_unit(istream &in, PrefetchUnit &unit, const Cache &l1) {
+    PrefetchConfig saved;
+    in.read(reinterpret_cast<char*>(&saved), sizeof(saved));
+    if (!in || saved.kind > PREFETCH_STREAM || prefetch_config_error(saved) != NULL ||
+        (saved.kind != PREFETCH_NONE && !l1.enabled()))
+        return false;
+    unit.config = saved;
+    unit.engine.reset(make_prefetcher(saved, l1.config.lineSize));
+    if (unit.engine && !unit.engine->load(in))
+        return false;
+    in.read(reinterpret_cast<char*>(unit.fills), sizeof(unit.fills));
+    return in.good();
+}
+
 //------------------------------------------------------
 // NEW: Save simulator state to file for step functionality
 //------------------------------------------------------
-void save_state() {
+void Simulator::save_state() {
     ofstream outfile("sim_state.dat", ios::binary | ios::trunc); // Use trunc to overwrite
     if (!outfile) {
         cerr << "Error: Could not open file 'sim_state.dat' for saving state." << endl;
@@ -535,7 +540,7 @@ void save_state() {
     }
 
     // Define a version marker for format tracking
-    const unsigned int STATE_VERSION = 0x03000001; // Increment if format changes
+    const unsigned int STATE_VERSION = 0x03000010; // Increment if format changes
     outfile.write(reinterpret_cast<const char*>(&STATE_VERSION), sizeof(STATE_VERSION));
 
     // Save core simulation state
@@ -547,29 +552,53 @@ void save_state() {
     // Save registers
     outfile.write(reinterpret_cast<const char*>(X), sizeof(X));
 
-    // Save all memory areas (use constants for size)
-    outfile.write(reinterpret_cast<const char*>(MEM), sizeof(unsigned int) * INSTRUCTION_MEMORY_SIZE);
-    outfile.write(reinterpret_cast<const char*>(DMEM), sizeof(int) * DATA_MEMORY_SIZE);
-    outfile.write(reinterpret_cast<const char*>(STACKMEM), sizeof(int) * STACK_MEMORY_SIZE);
-
-    // In save_state():
-    // filepath: /home/arth/Desktop/FinalPipeline/trueOrignal.cpp
-    // Save pipeline registers
-    outfile.write(reinterpret_cast<const char*>(&if_id), sizeof(if_id));
-    outfile.write(reinterpret_cast<const char*>(&id_ex), sizeof(id_ex));
-    outfile.write(reinterpret_cast<const char*>(&ex_mem), sizeof(ex_mem));
-    outfile.write(reinterpret_cast<const char*>(&mem_wb), sizeof(mem_wb));
-    outfile.write(reinterpret_cast<const char*>(&wb_complete), sizeof(wb_complete)); // Add this line
-
-    // Save branch predictor state
-    outfile.write(reinterpret_cast<const char*>(BTB), sizeof(BTB));
-    outfile.write(reinterpret_cast<const char*>(PHT), sizeof(PHT));
+    // Save guest memory: only pages dirtied since the last checkpoint go to
+    // sim_pages.dat; the state file keeps the page list in slot order
+    fstream pagefile("sim_pages.dat", ios::binary | ios::in | ios::out | (pageFileValid ? ios::openmode() : ios::trunc));
+    if (!pagefile || !guestMem.savePages(pagefile)) {
+        cerr << "Error: Failed to write guest pages to sim_pages.dat." << endl;
+        return;
+    }
+    pagefile.close();
+    pageFileValid = true;
+    unsigned int pageCount = guestMem.touched.size();
+    outfile.write(reinterpret_cast<const char*>(&pageCount), sizeof(pageCount));
+    outfile.write(reinterpret_cast<const char*>(guestMem.touched.data()), sizeof(unsigned int) * pageCount);
+
+    // Save pipeline registers (the latch bank is POD, so one raw block)
+    outfile.write(reinterpret_cast<const char*>(&latches), sizeof(latches));
+
+    // Save branch predictor state (BTB geometry first, then the direction predictor's configuration and tables)
+    BTB.save(outfile);
+    unsigned int predictorConfig[3] = {(unsigned int)direction->kind(), knobs.predictorTableBits, knobs.predictorHistory};
+    outfile.write(reinterpret_cast<const char*>(predictorConfig), sizeof(predictorConfig));
+    direction->save(outfile);
+    unsigned int rasState[3] = {RAS.depth(), RAS.top, RAS.count};
+    outfile.write(reinterpret_cast<const char*>(rasState), sizeof(rasState));
+    outfile.write(reinterpret_cast<const char*>(RAS.entries.data()), sizeof(unsigned int) * RAS.depth());
+    unsigned int itcState[3] = {ITC.indexBits, ITC.historyLength, ITC.pathHistory};
+    outfile.write(reinterpret_cast<const char*>(itcState), sizeof(itcState));
+    outfile.write(reinterpret_cast<const char*>(ITC.entries.data()), sizeof(IndirectTargetEntry) * ITC.entries.size());
+
+    // Save cache tags and replacement state (the data is in guest memory)
+    icache.save(outfile);
+    dcache.save(outfile);
+    l2.save(outfile);
+    dram.save(outfile);
+    save_prefetch_unit(outfile, iprefetch);
+    save_prefetch_unit(outfile, dprefetch);
 
     // Save pipeline control flags
     outfile.write(reinterpret_cast<const char*>(&stall_fetch), sizeof(stall_fetch));
     outfile.write(reinterpret_cast<const char*>(&stall_decode), sizeof(stall_decode));
     outfile.write(reinterpret_cast<const char*>(&flush_pipeline), sizeof(flush_pipeline));
     outfile.write(reinterpret_cast<const char*>(&nextPC), sizeof(nextPC));
+    outfile.write(reinterpret_cast<const char*>(&fetchAccess), sizeof(fetchAccess));
+    outfile.write(reinterpret_cast<const char*>(&fetchWaitPC), sizeof(fetchWaitPC));
+    outfile.write(reinterpret_cast<const char*>(&memAccess), sizeof(memAccess));
+    outfile.write(reinterpret_cast<const char*>(&memAccessStarted), sizeof(memAccessStarted));
+    outfile.write(reinterpret_cast<const char*>(mshrs), sizeof(mshrs));
+    outfile.write(reinterpret_cast<const char*>(regMshr), sizeof(regMshr));
 
     // Save statistics
     outfile.write(reinterpret_cast<const char*>(&stats), sizeof(stats));
@@ -586,7 +615,7 @@ void save_state() {
     }
 
     outfile.close();
-    cout << "State saved to sim_state.dat (Version: " << hex << STATE_VERSION << dec << ")" << endl;
+    console << "State saved to sim_state.dat (Version: " << hex << STATE_VERSION << dec << ")" << endl;
 
     // Save data memory to a separate text file for visualization (optional but useful)
     ofstream dmem_file("D_Memory.mem");
@@ -601,9 +630,10 @@ void save_state() {
             unsigned int mem_index = print_start + i;
             if (mem_index >= DATA_MEMORY_SIZE) break; // Boundary check
             unsigned int addr = DATA_MEMORY_BASE + mem_index * 4;
+            unsigned int word = guestMem.load32(addr);
             dmem_file << "Addr 0x" << hex << setw(8) << setfill('0') << addr
-                      << ": 0x" << hex << setw(8) << setfill('0') << DMEM[mem_index]
-                      << " (" << dec << DMEM[mem_index] << ")" << endl;
+                      << ": 0x" << hex << setw(8) << setfill('0') << word
+                      << " (" << dec << (int)word << ")" << endl;
         }
         dmem_file.close();
     }
@@ -613,13 +643,13 @@ void save_state() {
     if(stack_file) {
         stack_file << "=== STACK MEMORY CONTENTS (Top Down) ===" << endl;
         // Print top 100 words or STACK_SIZE, whichever is smaller
-        int stack_print_count = min((int)STACK_MEMORY_SIZE, 100);
+        int stack_print_count = min((int)STACK_SIZE, 100);
         for(int i = 0; i < stack_print_count; ++i) {
-             if (i >= STACK_MEMORY_SIZE) break; // Boundary check
             unsigned int addr = STACK_TOP - i * 4;
+            unsigned int word = guestMem.load32(addr);
             stack_file << "Addr 0x" << hex << setw(8) << setfill('0') << addr
-                       << ": 0x" << hex << setw(8) << setfill('0') << STACKMEM[i]
-                       << " (" << dec << STACKMEM[i] << ")" << endl;
+                       << ": 0x" << hex << setw(8) << setfill('0') << word
+                       << " (" << dec << (int)word << ")" << endl;
         }
         stack_file.close();
     }
@@ -637,16 +667,16 @@ void save_state() {
 //------------------------------------------------------
 // NEW: Load simulator state from file for step functionality
 //------------------------------------------------------
-bool load_state() {
+bool Simulator::load_state() {
     ifstream infile("sim_state.dat", ios::binary);
     if (!infile) {
         // This is expected on the very first run, not necessarily an error yet.
-        // cout << "Info: State file 'sim_state.dat' not found. Starting fresh." << endl;
+        // console << "Info: State file 'sim_state.dat' not found. Starting fresh." << endl;
         return false;
     }
 
     // Define the expected version marker
-    const unsigned int EXPECTED_STATE_VERSION = 0x03000001;
+    const unsigned int EXPECTED_STATE_VERSION = 0x03000010;
     unsigned int file_version = 0;
 
     // Read and check version marker first
@@ -667,30 +697,100 @@ bool load_state() {
     // Read registers
     infile.read(reinterpret_cast<char*>(X), sizeof(X));
 
-    // Read all memory areas
-    infile.read(reinterpret_cast<char*>(MEM), sizeof(unsigned int) * INSTRUCTION_MEMORY_SIZE);
-    infile.read(reinterpret_cast<char*>(DMEM), sizeof(int) * DATA_MEMORY_SIZE);
-    infile.read(reinterpret_cast<char*>(STACKMEM), sizeof(int) * STACK_MEMORY_SIZE);
+    // Read the guest page list and pull each page from its slot in sim_pages.dat
+    unsigned int pageCount = 0;
+    infile.read(reinterpret_cast<char*>(&pageCount), sizeof(pageCount));
+    if (!infile || pageCount > GUEST_PAGE_COUNT) {
+        cerr << "Error: State file 'sim_state.dat' has a corrupt page list." << endl;
+        infile.close();
+        return false;
+    }
+    vector<unsigned int> pages(pageCount);
+    infile.read(reinterpret_cast<char*>(pages.data()), sizeof(unsigned int) * pageCount);
+    ifstream pagefile("sim_pages.dat", ios::binary);
+    if (!infile || !pagefile || !guestMem.loadPages(pagefile, pages)) {
+        cerr << "Error: Could not restore guest memory from 'sim_pages.dat'." << endl;
+        guestMem.clear();
+        infile.close();
+        return false;
+    }
+    pageFileValid = true;
+    predecode_program(); // Code segment was rewritten
 
     // Read pipeline registers
-    // In load_state():
-    // filepath: /home/arth/Desktop/FinalPipeline/trueOrignal.cpp
-    // Read pipeline registers
-    infile.read(reinterpret_cast<char*>(&if_id), sizeof(if_id));
-    infile.read(reinterpret_cast<char*>(&id_ex), sizeof(id_ex));
-    infile.read(reinterpret_cast<char*>(&ex_mem), sizeof(ex_mem));
-    infile.read(reinterpret_cast<char*>(&mem_wb), sizeof(mem_wb));
-    infile.read(reinterpret_cast<char*>(&wb_complete), sizeof(wb_complete)); // Add this line
+    infile.read(reinterpret_cast<char*>(&latches), sizeof(latches));
+
+    // Read branch predictor state; its geometry comes from the state file
+    if (!BTB.load(infile)) {
+        cerr << "Error: State file 'sim_state.dat' has a corrupt branch predictor." << endl;
+        infile.close();
+        return false;
+    }
+    knobs.btbEntries = BTB.size();
+    knobs.btbWays = BTB.ways;
+    knobs.btbTagBits = BTB.tagBits;
+    knobs.btbReplacement = BTB.replacer.policy;
+    unsigned int predictorConfig[3] = {0, 0, 0};
+    infile.read(reinterpret_cast<char*>(predictorConfig), sizeof(predictorConfig));
+    if (!infile || predictorConfig[0] > PREDICT_TAGE || predictorConfig[1] == 0 ||
+        predictorConfig[1] > MAX_PREDICTOR_TABLE_BITS || predictorConfig[2] > MAX_PREDICTOR_HISTORY) {
+        cerr << "Error: State file 'sim_state.dat' has a corrupt branch predictor." << endl;
+        infile.close();
+        return false;
+    }
+    knobs.predictor = (PredictorKind)predictorConfig[0];
+    knobs.predictorTableBits = predictorConfig[1];
+    knobs.predictorHistory = predictorConfig[2];
+    direction.reset(make_branch_predictor(knobs.predictor, knobs.predictorTableBits, knobs.predictorHistory));
+    direction->reset(BTB.size());
+    direction->load(infile);
+    unsigned int rasState[3] = {0, 0, 0};
+    infile.read(reinterpret_cast<char*>(rasState), sizeof(rasState));
+    if (!infile || rasState[0] > MAX_RAS_DEPTH || (rasState[0] > 0 && (rasState[1] >= rasState[0] || rasState[2] > rasState[0]))) {
+        cerr << "Error: State file 'sim_state.dat' has a corrupt return address stack." << endl;
+        infile.close();
+        return false;
+    }
+    RAS.configure(rasState[0]);
+    RAS.top = rasState[1];
+    RAS.count = rasState[2];
+    infile.read(reinterpret_cast<char*>(RAS.entries.data()), sizeof(unsigned int) * RAS.depth());
+    unsigned int itcState[3] = {0, 0, 0};
+    infile.read(reinterpret_cast<char*>(itcState), sizeof(itcState));
+    if (!infile || itcState[0] > MAX_ITC_BITS || itcState[1] > MAX_ITC_HISTORY) {
+        cerr << "Error: State file 'sim_state.dat' has a corrupt indirect target cache." << endl;
+        infile.close();
+        return false;
+    }
+    ITC.configure(itcState[0], itcState[1]);
+    ITC.pathHistory = itcState[2];
+    infile.read(reinterpret_cast<char*>(ITC.entries.data()), sizeof(IndirectTargetEntry) * ITC.entries.size());
 
-    // Read branch predictor state
-    infile.read(reinterpret_cast<char*>(BTB), sizeof(BTB));
-    infile.read(reinterpret_cast<char*>(PHT), sizeof(PHT));
+    // Read cache and DRAM state; the saved configuration replaces the knobs
+    if (!icache.load(infile) || !dcache.load(infile) || !l2.load(infile) || !dram.load(infile) ||
+        !load_prefetch_unit(infile, iprefetch, icache) || !load_prefetch_unit(infile, dprefetch, dcache)) {
+        cerr << "Error: State file 'sim_state.dat' has a corrupt cache or DRAM state." << endl;
+        infile.close();
+        return false;
+    }
+    knobs.icache = icache.config;
+    knobs.dcache = dcache.config;
+    knobs.l2 = l2.config;
+    knobs.dram = dram.config;
+    knobs.icachePrefetch = iprefetch.config;
+    knobs.dcachePrefetch = dprefetch.config;
 
     // Read pipeline control flags
     infile.read(reinterpret_cast<char*>(&stall_fetch), sizeof(stall_fetch));
     infile.read(reinterpret_cast<char*>(&stall_decode), sizeof(stall_decode));
     infile.read(reinterpret_cast<char*>(&flush_pipeline), sizeof(flush_pipeline));
     infile.read(reinterpret_cast<char*>(&nextPC), sizeof(nextPC));
+    infile.read(reinterpret_cast<char*>(&fetchAccess), sizeof(fetchAccess));
+    infile.read(reinterpret_cast<char*>(&fetchWaitPC), sizeof(fetchWaitPC));
+    infile.read(reinterpret_cast<char*>(&memAccess), sizeof(memAccess));
+    infile.read(reinterpret_cast<char*>(&memAccessStarted), sizeof(memAccessStarted));
+    infile.read(reinterpret_cast<char*>(mshrs), sizeof(mshrs));
+    infile.read(reinterpret_cast<char*>(regMshr), sizeof(regMshr));
 
     // Read statistics
     infile.read(reinterpret_cast<char*>(&stats), sizeof(stats));
@@ -716,25 +816,27 @@ bool load_state() {
 
 
     infile.close();
-    cout << "State loaded successfully from sim_state.dat (Version: " << hex << file_version << dec << ")" << endl;
+    console << "State loaded successfully from sim_state.dat (Version: " << hex << file_version << dec << ")" << endl;
     return true;
 }
  
 //------------------------------------------------------
 // Output Data Hazard Information
 //------------------------------------------------------
-void outputDataHazardInfo(unsigned int src_reg, unsigned int dest_reg) {
-    cout << "DATA HAZARD DETECTED: Between registers x" << src_reg << " and x" << dest_reg << endl;
-    cout << "  Instruction at PC 0x" << hex << id_ex.pc << " needs data from PC 0x" << ex_mem.pc << endl;
+void Simulator::outputDataHazardInfo(unsigned int src_reg, unsigned int dest_reg) {
+    const ID_EX_Register &id_ex = cur_latches().id_ex;
+    const EX_MEM_Register &ex_mem = cur_latches().ex_mem;
+    console << "DATA HAZARD DETECTED: Between registers x" << src_reg << " and x" << dest_reg << endl;
+    console << "  Instruction at PC 0x" << hex << id_ex.pc << " needs data from PC 0x" << ex_mem.pc << endl;
 }
  
-void outputForwardingInfo(unsigned reg,
+void Simulator::outputForwardingInfo(unsigned reg,
     ForwardStage from,
     const char* toStageStr,
     int val)
 {
     const char* fromStr = (from == EX_MEM ? "EX/MEM" : "MEM/WB");
-    cout << "FORWARDING: "
+    console << "FORWARDING: "
     << fromStr
     << "→ "
     << toStageStr
@@ -745,36 +847,46 @@ void outputForwardingInfo(unsigned reg,
 //------------------------------------------------------
 // Output Control Hazard Information
 //------------------------------------------------------
-void outputControlHazardInfo(unsigned int branch_pc, bool predicted, bool actual) {
-    cout << "CONTROL HAZARD: Branch at PC 0x" << hex << branch_pc << endl;
-    cout << "  Predicted: " << (predicted ? "Taken" : "Not Taken")
-         << ", Actual: " << (actual ? "Taken" : "Not Taken") << endl;
-    cout << "  Branch Misprediction: Flushing pipeline" << endl;
+void Simulator::outputControlHazardInfo(unsigned int branch_pc, bool predicted, bool actual) {
+    console << "CONTROL HAZARD: Branch at PC 0x" << hex << branch_pc << endl;
+    console << "  Predicted: " << (predicted ? "Taken" : "Not Taken")
+            << ", Actual: " << (actual ? "Taken" : "Not Taken") << endl;
+    console << "  Branch Misprediction: Flushing pipeline" << endl;
 }
  
 //------------------------------------------------------
 // Initialize Branch Predictor Tables
 //------------------------------------------------------
-void initializeBranchPredictor() {
+void Simulator::initializeBranchPredictor() {
     // Clear BTB entries
-    for(unsigned int i = 0; i < BTB_SIZE; i++) {
-        BTB[i].valid = false;
-        BTB[i].branchPC = 0;
-        BTB[i].targetPC = 0;
-    }
+    BTB.configure(knobs.btbEntries / knobs.btbWays, knobs.btbWays, knobs.btbTagBits, knobs.btbReplacement);
    
-    // Initialize Pattern History Table to predict not taken
-    for(unsigned int i = 0; i < BTB_SIZE; i++) {
-        PHT[i] = false;  // Initialize to predict "not taken"
-    }
+    // Fresh direction predictor (onebit: every entry predicts not taken)
+    direction.reset(make_branch_predictor(knobs.predictor, knobs.predictorTableBits, knobs.predictorHistory));
+    direction->reset(BTB.size());
+    RAS.configure(knobs.predictor == PREDICT_NOT_TAKEN ? 0 : knobs.rasDepth);
+    ITC.configure(knobs.predictor == PREDICT_NOT_TAKEN ? 0 : knobs.itcBits, knobs.itcHistory);
    
-    cout << "Branch predictor initialized with " << BTB_SIZE << " entries" << endl;
+    console << "Branch predictor initialized with " << knobs.btbEntries << " entries" << endl;
+}
+
+// Cold caches, untrained prefetchers and idle DRAM; a cache of size 0 (or DRAM
+// with no channels) stays disabled
+void Simulator::initializeCaches() {
+    icache.configure(knobs.icache);
+    dcache.configure(knobs.dcache);
+    l2.configure(knobs.l2);
+    dram.configure(knobs.dram);
+    iprefetch.config = knobs.icachePrefetch;
+    iprefetch.engine.reset(make_prefetcher(knobs.icachePrefetch, icache.config.lineSize));
+    dprefetch.config = knobs.dcachePrefetch;
+    dprefetch.engine.reset(make_prefetcher(knobs.dcachePrefetch, dcache.config.lineSize));
 }
  
 //------------------------------------------------------
 // Dump Register File to "register.mem"
 //------------------------------------------------------
-void dump_registers() {
+void Simulator::dump_registers() {
     FILE *fp = fopen("register.mem", "w");
     if(fp == NULL) {
         perror("Error opening register.mem for writing");
@@ -789,8 +901,8 @@ void dump_registers() {
 //------------------------------------------------------
 // Dump Data Memory and Stack Memory to files
 //------------------------------------------------------
-void dump_memory() {
-    // Dump DMEM
+void Simulator::dump_memory() {
+    // Dump the start of the data segment
     FILE *fp = fopen("D_Memory.mem", "w");
     if(fp == NULL) {
         perror("Error opening D_Memory.mem for writing");
@@ -799,11 +911,11 @@ void dump_memory() {
     fprintf(fp, "=== DATA MEMORY CONTENTS ===\n");
     for(unsigned int i = 0; i < DATA_MEMORY_SIZE && i < 50; i++) {
         unsigned int addr = DATA_MEMORY_BASE + i * 4;
-        fprintf(fp, "Addr 0x%08x: 0x%08x\n", addr, DMEM[i]);
+        fprintf(fp, "Addr 0x%08x: 0x%08x\n", addr, guestMem.load32(addr));
     }
     fclose(fp);
  
-    // Dump STACKMEM
+    // Dump the top of the stack
     fp = fopen("stack_mem.mem", "w");
     if(fp == NULL) {
         perror("Error opening stack_mem.mem for writing");
@@ -812,7 +924,7 @@ void dump_memory() {
     fprintf(fp, "=== STACK MEMORY CONTENTS ===\n");
     for(unsigned int i = 0; i < STACK_SIZE && i < 50; i++) {
         unsigned int addr = STACK_TOP - i * 4;
-        fprintf(fp, "Addr 0x%08x: 0x%08x\n", addr, STACKMEM[i]);
+        fprintf(fp, "Addr 0x%08x: 0x%08x\n", addr, guestMem.load32(addr));
     }
     fclose(fp);
 }
@@ -820,7 +932,7 @@ void dump_memory() {
 //------------------------------------------------------
 // Dump Branch Predictor Info to "BP_info.txt"
 //------------------------------------------------------
-void dump_BP() {
+void Simulator::dump_BP() {
     ofstream bpFile("BP_info.txt");
     if(!bpFile.is_open()) {
         cerr << "Error: Could not open BP_info.txt for writing." << endl;
@@ -828,11 +940,11 @@ void dump_BP() {
     }
     bpFile << "Branch Predictor Status:\n";
     bpFile << "Index\tValid\tBranchPC\tTargetPC\tPrediction\n";
-    for(unsigned int i = 0; i < BTB_SIZE; i++) {
-        bpFile << i << "\t" << (BTB[i].valid ? "Yes" : "No")
-               << "\t0x" << hex << BTB[i].branchPC
-               << "\t0x" << hex << BTB[i].targetPC
-               << "\t" << (PHT[i] ? "Taken" : "Not Taken") << "\n";
+    for(unsigned int i = 0; i < BTB.size(); i++) {
+        bpFile << i << "\t" << (BTB.entries[i].valid ? "Yes" : "No")
+               << "\t0x" << hex << BTB.entries[i].branchPC
+               << "\t0x" << hex << BTB.entries[i].targetPC
+               << "\t" << (direction->predict(BTB.entries[i].branchPC, i) ? "Taken" : "Not Taken") << "\n";
     }
     bpFile.close();
 }
@@ -840,20 +952,21 @@ void dump_BP() {
 //------------------------------------------------------
 // Print Data Memory Contents (for debugging)
 //------------------------------------------------------
-void printDataMemory(int startIndex, int count) {
-    cout << "-------------------------------------" << endl;
-    cout << "Data Memory Contents:" << endl;
-    for (int i = startIndex; i < startIndex + count && i < DATA_MEMORY_SIZE; i++) {
-        cout << "DMEM[" << dec << i << "] (Address 0x" << hex << (DATA_MEMORY_BASE + i * 4)
-             << "): 0x" << hex << DMEM[i] << " (" << dec << DMEM[i] << ")" << endl;
+void Simulator::printDataMemory(int startIndex, int count) {
+    console << "-------------------------------------" << endl;
+    console << "Data Memory Contents:" << endl;
+    for (int i = startIndex; i < startIndex + count && i < (int)DATA_MEMORY_SIZE; i++) {
+        unsigned int word = guestMem.load32(DATA_MEMORY_BASE + i * 4);
+        console << "DMEM[" << dec << i << "] (Address 0x" << hex << (DATA_MEMORY_BASE + i * 4)
+                << "): 0x" << hex << word << " (" << dec << (int)word << ")" << endl;
     }
-    cout << "-------------------------------------" << endl;
+    console << "-------------------------------------" << endl;
 }
  
 //------------------------------------------------------
 // Loader: Parse input file containing text and data segments
 //------------------------------------------------------
-bool loadInputFile(const string &filename) {
+bool Simulator::loadInputFile(const string &filename) {
     ifstream infile(filename);
     if (!infile.is_open()) {
         cerr << "Error: Could not open input file: " << filename << endl;
@@ -888,12 +1001,7 @@ bool loadInputFile(const string &filename) {
                 instToken.pop_back();
             unsigned int address = stoul(addrToken, nullptr, 16);
             unsigned int instVal = stoul(instToken, nullptr, 16);
-            unsigned int index = address / 4;
-            if(index < INSTRUCTION_MEMORY_SIZE)
-                MEM[index] = instVal;
-            else {
-                cerr << "Warning: Instruction address 0x" << hex << address << " exceeds MEM size." << endl;
-            }
+            guestMem.store32(address, instVal);
             if(address > maxInstAddress)
                 maxInstAddress = address;
             // Continue processing even if termination marker encountered.
@@ -905,14 +1013,9 @@ bool loadInputFile(const string &filename) {
                 unsigned int d_address, b0, b1, b2, b3;
                 if(sscanf(line.c_str(), "Address: %x | Data: %x %x %x %x", &d_address, &b0, &b1, &b2, &b3) == 5) {
                     unsigned int data = (b3 << 24) | (b2 << 16) | (b1 << 8) | b0;
-                    unsigned int index = (d_address - DATA_MEMORY_BASE) / 4;
-                    cout << "Loaded data at address 0x" << hex << d_address
-                         << " (DMEM index " << dec << index << "): 0x" << hex
-                         << setw(8) << setfill('0') << data << dec << endl;
-                    if(index < DATA_MEMORY_SIZE)
-                        DMEM[index] = data;
-                    else
-                        cerr << "Warning: Data address 0x" << hex << d_address << " exceeds DMEM size." << dec << endl;
+                    console << "Loaded data at address 0x" << hex << d_address << ": 0x"
+                            << setw(8) << setfill('0') << data << dec << endl;
+                    guestMem.store32(d_address, data);
                 } else {
                     cerr << "Warning: Failed to parse data line: " << line << endl;
                 }
@@ -921,29 +1024,45 @@ bool loadInputFile(const string &filename) {
     }
     infile.close();
     sz = (maxInstAddress / 4) + 1;
-    cout << "Loaded " << sz << " instructions from " << filename << endl;
+    predecode_program();
+    console << "Loaded " << sz << " instructions from " << filename << endl;
     return true;
 }
  
 //------------------------------------------------------
 // Hazard Detection Unit: Load-Use Hazard Check
 //------------------------------------------------------
-void hazardDetection() {
+void Simulator::hazardDetection() {
+    const IF_ID_Register &if_id = cur_latches().if_id;
+    const ID_EX_Register &id_ex = cur_latches().id_ex;
+    const EX_MEM_Register &ex_mem = cur_latches().ex_mem;
     stall_decode = false;
     stall_fetch = false;
 
+    // --- Loads Still Missing in the D-Cache (--dcache-mshrs) ---
+    // Hit-under-miss: only an instruction that reads (or overwrites) a
+    // register whose load has not been filled yet waits, here in decode.
+    if(if_id.valid && waits_on_miss(PREDECODED[if_id.pc / 4])) {
+        stall_decode = stall_fetch = stall_miss_use = true;
+        stats.missUseStalls++;
+        stats.dcache.stallCycles++;
+        stats.totalStalls++;
+        if (knobs.printPipelineRegisters)
+            console << "STALL: Waiting on a D-cache miss (PC 0x" << hex << if_id.pc << dec << ")" << endl;
+        return;
+    }
+
     // --- Existing Load-Use Hazard Detection ---
     // This correctly stalls when forwarding is off for load-use cases.
     if(if_id.valid && id_ex.valid) {
         if(id_ex.control.memRead) {
-            unsigned int instr = if_id.instruction;
-            unsigned int rs1_field = (instr >> 15) & 0x1F;
-            unsigned int rs2_field = (instr >> 20) & 0x1F;
-           // if((id_ex.rd != 0) && ((id_ex.rd == rs1_field) || (id_ex.rd == rs2_field))) {
+            const DecodedInst &next = PREDECODED[if_id.pc / 4];
+            // Only compare source fields the instruction actually reads
+            unsigned int rs1_field = (next.useMask & USES_RS1) ? next.rs1 : 0;
+            unsigned int rs2_field = (next.useMask & USES_RS2) ? next.rs2 : 0;
             if((id_ex.rd != 0) && ((id_ex.rd == rs1_field) || (id_ex.rd == rs2_field))) {
                     // if it's a store and we have forwarding, skip the stall
-                    unsigned int nextOpcode = instr & 0x7F;
-                    bool isStore = (nextOpcode == 0x23);
+                    bool isStore = (next.instType == 'S');
                     if(knobs.forwardingEnabled && isStore) {
                         // we'll forward MEM/WB→EX/MEM for stores, so no stall
                     } else {
@@ -953,9 +1072,9 @@ void hazardDetection() {
                         stats.totalStalls++;
 
                         if (knobs.printPipelineRegisters) {
-                            cout << "STALL: Load-Use Hazard Detected (Forwarding "
-                                 << (knobs.forwardingEnabled ? "Enabled - Store Special Case" : "Disabled")
-                                 << ")" << endl;
+                            console << "STALL: Load-Use Hazard Detected (Forwarding "
+                                    << (knobs.forwardingEnabled ? "Enabled - Store Special Case" : "Disabled")
+                                    << ")" << endl;
                             outputDataHazardInfo(
                                 id_ex.rd,
                                 (id_ex.rd == rs1_field) ? rs1_field : rs2_field
@@ -970,19 +1089,12 @@ void hazardDetection() {
     // This checks for dependencies on instructions in ID/EX and EX/MEM
     // when forwarding is disabled.
     if (!knobs.forwardingEnabled && if_id.valid && !stall_decode) { // Only check if not already stalled
-        unsigned int instr_in_if_id = if_id.instruction;
-        unsigned int rs1_needed = (instr_in_if_id >> 15) & 0x1F;
-        unsigned int rs2_needed = (instr_in_if_id >> 20) & 0x1F;
-        bool needs_rs1 = (rs1_needed != 0);
-        bool needs_rs2 = false; // Determine if rs2 is actually used by the opcode type
-
-        // Rough check for instructions using rs2 (R, S, B types primarily)
-        unsigned int opcode = instr_in_if_id & 0x7F;
-        if (opcode == 0x33 || opcode == 0x23 || opcode == 0x63) {
-             needs_rs2 = (rs2_needed != 0);
-        }
-        // Note: This rs2 check is simplified; a full decode would be more accurate,
-        // but this covers the most common cases needing rs2.
+        const DecodedInst &next = PREDECODED[if_id.pc / 4];
+        unsigned int rs1_needed = next.rs1;
+        unsigned int rs2_needed = next.rs2;
+        // The predecoded use mask says exactly which source registers are read
+        bool needs_rs1 = (next.useMask & USES_RS1) && (rs1_needed != 0);
+        bool needs_rs2 = (next.useMask & USES_RS2) && (rs2_needed != 0);
 
         bool hazard_found = false;
 
@@ -991,9 +1103,9 @@ void hazardDetection() {
             if ((needs_rs1 && id_ex.rd == rs1_needed) || (needs_rs2 && id_ex.rd == rs2_needed)) {
                 hazard_found = true;
                  if (knobs.printPipelineRegisters) {
-                     cout << "STALL: RAW Hazard Detected (No Forwarding): IF/ID needs x"
-                          << (needs_rs1 && id_ex.rd == rs1_needed ? rs1_needed : rs2_needed)
-                          << " from ID/EX (PC 0x" << hex << id_ex.pc << ")" << dec << endl;
+                     console << "STALL: RAW Hazard Detected (No Forwarding): IF/ID needs x"
+                             << (needs_rs1 && id_ex.rd == rs1_needed ? rs1_needed : rs2_needed)
+                             << " from ID/EX (PC 0x" << hex << id_ex.pc << ")" << dec << endl;
                  }
             }
         }
@@ -1003,9 +1115,9 @@ void hazardDetection() {
              if ((needs_rs1 && ex_mem.rd == rs1_needed) || (needs_rs2 && ex_mem.rd == rs2_needed)) {
                  hazard_found = true;
                  if (knobs.printPipelineRegisters) {
-                     cout << "STALL: RAW Hazard Detected (No Forwarding): IF/ID needs x"
-                          << (needs_rs1 && ex_mem.rd == rs1_needed ? rs1_needed : rs2_needed)
-                          << " from EX/MEM (PC 0x" << hex << ex_mem.pc << ")" << dec << endl;
+                     console << "STALL: RAW Hazard Detected (No Forwarding): IF/ID needs x"
+                             << (needs_rs1 && ex_mem.rd == rs1_needed ? rs1_needed : rs2_needed)
+                             << " from EX/MEM (PC 0x" << hex << ex_mem.pc << ")" << dec << endl;
                  }
              }
         }
@@ -1022,23 +1134,307 @@ void hazardDetection() {
 
     // Check for control hazards for branch/jump instructions in decode stage.
     if (id_ex.valid && (id_ex.instType == 'B' || id_ex.instType == 'J' ||
-        (id_ex.instType == 'I' && id_ex.subType == "jalr"))) {
+        (id_ex.instType == 'I' && id_ex.op == OP_JALR))) {
         // Additional early branch hazard handling can be added here if needed.
     }
 }
  
+//------------------------------------------------------
+// Breakpoints and Watchpoints
+//------------------------------------------------------
+// PC breakpoints are bits in fetchBreakBits/retireBreakBits; data watchpoints
+// are address ranges checked in mem_op(). The pipeline only ever tests
+// debugArmed, so nothing is paid while no breakpoint or watchpoint is set.
+// A hit is latched in debugHit and runUntil() stops at the end of that cycle.
+
+// Access width of each load/store (OP_LB..OP_SW)
+static const unsigned char MEM_ACCESS_BYTES[OP_SW - OP_LB + 1] = {
+    1, 2, 4, 1, 2,      // lb lh lw lbu lhu
+    1, 2, 4             // sb sh sw
+};
+
+void Simulator::update_debug_armed() {
+    debugArmed = !watchpoints.empty();
+    for(size_t i = 0; i < fetchBreakBits.size() && !debugArmed; i++)
+        debugArmed = fetchBreakBits[i] != 0 || retireBreakBits[i] != 0;
+}
+
+// False when address is outside the code segment, where fetch never goes.
+// Before a program is loaded the breakpoint waits in pendingBreaks until
+// predecode_program() can check it.
+bool Simulator::set_pc_breakpoint(unsigned int address, bool atRetire) {
+    if(PREDECODED.empty()) {
+        pendingBreaks.push_back((address & ~3u) | (atRetire ? 1 : 0));
+        return true;
+    }
+    if(address / 4 >= sz)
+        return false;
+    vector<unsigned int> &bits = atRetire ? retireBreakBits : fetchBreakBits;
+    unsigned int word = address / 4;
+    bits[word / 32] |= 1u << (word % 32);
+    debugArmed = true;
+    return true;
+}
+
+void Simulator::add_watchpoint(unsigned int address, unsigned int length, unsigned char kinds) {
+    Watchpoint w = {address, length ? length : 1, kinds};
+    watchpoints.push_back(w);
+    debugArmed = true;
+}
+
+void Simulator::clear_debug_points() {
+    fill(fetchBreakBits.begin(), fetchBreakBits.end(), 0);
+    fill(retireBreakBits.begin(), retireBreakBits.end(), 0);
+    watchpoints.clear();
+    update_debug_armed();
+}
+
+static inline bool pc_break_set(const vector<unsigned int> &bits, unsigned int pc) {
+    return (bits[pc >> 7] >> ((pc >> 2) & 31)) & 1;
+}
+
+void Simulator::record_debug_hit(unsigned char reason, unsigned int pc, unsigned int address,
+                                        unsigned int oldValue, unsigned int newValue) {
+    if(debugHit.reason != STOP_NONE)
+        return; // First hit in the cycle wins
+    debugHit.reason = reason;
+    debugHit.pc = pc;
+    debugHit.address = address;
+    debugHit.oldValue = oldValue;
+    debugHit.newValue = newValue;
+}
+
+// Read the bytes a load/store of `op` touches, zero-extended
+unsigned int Simulator::watched_bytes(unsigned int address, unsigned char op) {
+    unsigned int bytes = MEM_ACCESS_BYTES[op - OP_LB];
+    unsigned int value = guestMem.load32(address);
+    return bytes == 4 ? value : value & ((1u << (bytes * 8)) - 1);
+}
+
+// Called from mem_op() (only when armed) after the access has been performed
+void Simulator::check_watchpoints(unsigned int pc, unsigned int address, unsigned char op,
+                                         bool isWrite, unsigned int before) {
+    unsigned int bytes = MEM_ACCESS_BYTES[op - OP_LB];
+    unsigned int after = watched_bytes(address, op);
+    for(size_t i = 0; i < watchpoints.size(); i++) {
+        const Watchpoint &w = watchpoints[i];
+        if(address - w.address >= w.length && w.address - address >= bytes)
+            continue; // No overlap
+        if(!isWrite && (w.kinds & WATCH_READ))
+            record_debug_hit(STOP_READ, pc, address, after, after);
+        else if(isWrite && (w.kinds & WATCH_WRITE))
+            record_debug_hit(STOP_WRITE, pc, address, before, after);
+        else if(isWrite && (w.kinds & WATCH_CHANGE) && before != after)
+            record_debug_hit(STOP_CHANGE, pc, address, before, after);
+    }
+}
+
+void Simulator::describe_debug_hit(ostream &out) {
+    static const char *const STOP_NAMES[] = {"none", "fetch", "retire", "read", "write", "change"};
+    out << STOP_NAMES[debugHit.reason] << "@0x" << hex << debugHit.pc;
+    if(debugHit.reason == STOP_READ)
+        out << " addr=0x" << debugHit.address << " value=0x" << debugHit.newValue;
+    else if(debugHit.reason >= STOP_WRITE)
+        out << " addr=0x" << debugHit.address << " old=0x" << debugHit.oldValue
+            << " new=0x" << debugHit.newValue;
+    out << dec;
+}
+ 
 //------------------------------------------------------
 // Update the parseCommandLineArgs function
 //------------------------------------------------------
-void parseCommandLineArgs(int argc, char *argv[]) {
+// Parse a decimal or 0x-prefixed hex command-line/protocol number
+static bool parse_number(const string &token, unsigned int &value) {
+    if(token.empty())
+        return false;
+    char *end = NULL;
+    unsigned long v = strtoul(token.c_str(), &end, 0);
+    if(*end != '\0')
+        return false;
+    value = (unsigned int)v;
+    return true;
+}
+
+// One --icache-* or --dcache-* option (prefix is "--icache-" or "--dcache-");
+// false when arg is not one. The write policy options are D-cache only.
+// Geometry is checked once every option is in, see parseCommandLineArgs.
+static bool parse_cache_option(const string &arg, const string &prefix, bool writes,
+                               int argc, char *argv[], int &i, CacheConfig &cache) {
+    if(arg.compare(0, prefix.size(), prefix) != 0)
+        return false;
+    string name = arg.substr(prefix.size());
+    unsigned int *number = NULL;
+    if(name == "size") number = &cache.size;
+    else if(name == "ways") number = &cache.ways;
+    else if(name == "line") number = &cache.lineSize;
+    else if(name == "hit-latency") number = &cache.hitLatency;
+    else if(name == "miss-penalty") number = &cache.missPenalty;
+    if(number) {
+        if(i + 1 >= argc || !parse_number(argv[++i], *number)) {
+            cerr << "Error: " << arg << " needs a number." << endl;
+            exit(1);
+        }
+        return true;
+    }
+    if(name != "replacement" && !(writes && (name == "write-policy" || name == "write-allocate")))
+        return false;
+    string value = (i + 1 < argc) ? argv[++i] : "";
+    if(name == "replacement" && !parse_replacement_policy(value, cache.replacement)) {
+        cerr << "Error: " << arg << " needs lru, plru or random." << endl;
+        exit(1);
+    }
+    if(name == "write-policy") {
+        if(value != "back" && value != "through") {
+            cerr << "Error: " << arg << " needs back or through." << endl;
+            exit(1);
+        }
+        cache.writeBack = (value == "back");
+    }
+    if(name == "write-allocate") {
+        if(value != "on" && value != "off") {
+            cerr << "Error: " << arg << " needs on or off." << endl;
+            exit(1);
+        }
+        cache.writeAllocate = (value == "on");
+    }
+    return true;
+}
+
+// --icache-prefetch* / --dcache-prefetch* (prefix "--icache-" or "--dcache-")
+static bool parse_prefetch_option(const string &arg, const string &prefix, int argc, char *argv[], int &i,
+                                  PrefetchConfig &prefetch) {
+    if(arg.compare(0, prefix.size(), prefix) != 0)
+        return false;
+    string name = arg.substr(prefix.size());
+    if(name == "prefetch") {
+        if(i + 1 >= argc || !parse_prefetcher_kind(argv[++i], prefetch.kind)) {
+            cerr << "Error: " << arg << " needs none, next-line, stride or stream." << endl;
+            exit(1);
+        }
+        return true;
+    }
+    unsigned int *number = NULL;
+    if(name == "prefetch-degree") number = &prefetch.degree;
+    else if(name == "prefetch-distance") number = &prefetch.distance;
+    else return false;
+    if(i + 1 >= argc || !parse_number(argv[++i], *number)) {
+        cerr << "Error: " << arg << " needs a number." << endl;
+        exit(1);
+    }
+    return true;
+}
+
+// One --dram-* option; false when arg is not one
+static bool parse_dram_option(const string &arg, int argc, char *argv[], int &i, DramConfig &dram) {
+    unsigned int *number = NULL;
+    if(arg == "--dram-channels") number = &dram.channels;
+    else if(arg == "--dram-banks") number = &dram.banks;
+    else if(arg == "--dram-row-size") number = &dram.rowSize;
+    else if(arg == "--dram-trcd") number = &dram.tRCD;
+    else if(arg == "--dram-tcas") number = &dram.tCAS;
+    else if(arg == "--dram-trp") number = &dram.tRP;
+    else if(arg == "--dram-tburst") number = &dram.tBurst;
+    if(number) {
+        if(i + 1 >= argc || !parse_number(argv[++i], *number)) {
+            cerr << "Error: " << arg << " needs a number." << endl;
+            exit(1);
+        }
+        return true;
+    }
+    if(arg != "--dram-row-policy")
+        return false;
+    string value = (i + 1 < argc) ? argv[++i] : "";
+    if(value != "open" && value != "closed") {
+        cerr << "Error: --dram-row-policy needs open or closed." << endl;
+        exit(1);
+    }
+    dram.rowPolicy = (value == "open") ? ROW_OPEN : ROW_CLOSED;
+    return true;
+}
+
+void Simulator::parseCommandLineArgs(int argc, char *argv[]) {
     for (int i = 1; i < argc; i++) {
         string arg = argv[i];
         if(arg == "--no-pipeline")
             knobs.pipeliningEnabled = false;
         else if(arg == "--no-forwarding")
             knobs.forwardingEnabled = false;
-        else if(arg == "--print-registers")
-            knobs.printRegisterEachCycle = true;
+        else if(arg == "--forwarding") {
+            string value = (i + 1 < argc) ? argv[++i] : "";
+            if(value != "on" && value != "off") {
+                cerr << "Error: --forwarding needs on or off." << endl;
+                exit(1);
+            }
+            knobs.forwardingEnabled = (value == "on");
+        }
+        else if(arg == "--btb-entries") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.btbEntries) ||
+               knobs.btbEntries == 0 || knobs.btbEntries > MAX_BTB_SIZE) {
+                cerr << "Error: --btb-entries needs a count between 1 and " << MAX_BTB_SIZE << "." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--btb-ways") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.btbWays) ||
+               knobs.btbWays == 0 || knobs.btbWays > MAX_BTB_WAYS) {
+                cerr << "Error: --btb-ways needs a count between 1 and " << MAX_BTB_WAYS << "." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--btb-tag-bits") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.btbTagBits) || knobs.btbTagBits > 32) {
+                cerr << "Error: --btb-tag-bits needs a width between 0 (full) and 32." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--btb-replacement") {
+            string value = (i + 1 < argc) ? argv[++i] : "";
+            if(!parse_replacement_policy(value, knobs.btbReplacement)) {
+                cerr << "Error: --btb-replacement needs lru, plru or random." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--predictor") {
+            string value = (i + 1 < argc) ? argv[++i] : "";
+            if(!parse_predictor_kind(value, knobs.predictor)) {
+                cerr << "Error: --predictor needs onebit, static, bimodal, gshare, tournament or tage." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--ras-depth") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.rasDepth) || knobs.rasDepth > MAX_RAS_DEPTH) {
+                cerr << "Error: --ras-depth needs a depth between 0 (off) and " << MAX_RAS_DEPTH << "." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--itc-bits") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.itcBits) || knobs.itcBits > MAX_ITC_BITS) {
+                cerr << "Error: --itc-bits needs a value between 0 (off) and " << MAX_ITC_BITS << "." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--itc-history") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.itcHistory) || knobs.itcHistory > MAX_ITC_HISTORY) {
+                cerr << "Error: --itc-history needs a length between 0 and " << MAX_ITC_HISTORY << "." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--bp-table-bits") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.predictorTableBits) ||
+               knobs.predictorTableBits == 0 || knobs.predictorTableBits > MAX_PREDICTOR_TABLE_BITS) {
+                cerr << "Error: --bp-table-bits needs a width between 1 and " << MAX_PREDICTOR_TABLE_BITS << "." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--bp-history") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.predictorHistory) ||
+               knobs.predictorHistory > MAX_PREDICTOR_HISTORY) {
+                cerr << "Error: --bp-history needs a length between 0 and " << MAX_PREDICTOR_HISTORY << "." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--print-registers")
+            knobs.printRegisterEachCycle = true;
         else if(arg == "--print-pipeline")
             knobs.printPipelineRegisters = true;
         // Modify this part in parseCommandLineArgs
@@ -1055,11 +1451,11 @@ void parseCommandLineArgs(int argc, char *argv[]) {
                     unsigned int trace_pc = stoul(trace_val, nullptr, 16);
                     knobs.traceInstructionPC = trace_pc;
                     knobs.traceByPC = true;
-                    cout << "Will trace instruction at PC 0x" << hex << trace_pc << dec << endl;
+                    console << "Will trace instruction at PC 0x" << hex << trace_pc << dec << endl;
                 } else {
                     // It's a standard instruction number
                     knobs.traceInstructionNum = stoi(trace_val);
-                    cout << "Will trace instruction #" << knobs.traceInstructionNum << endl;
+                    console << "Will trace instruction #" << knobs.traceInstructionNum << endl;
                 }
             }
         }
@@ -1078,116 +1474,463 @@ void parseCommandLineArgs(int argc, char *argv[]) {
             }
         }
         else if(arg == "--step") {
-            // Flag for step mode.
+            knobs.stepMode = true;
+            knobs.stepLimit = RUN_CYCLES;
+            knobs.stepValue = 1;
+            // Optional cycle count
+            if(i + 1 < argc && parse_number(argv[i + 1], knobs.stepValue))
+                i++;
+        }
+        else if(arg == "--run-to-pc" || arg == "--run-to-cycle" || arg == "--run-to-retire") {
+            knobs.stepMode = true;
+            knobs.stepLimit = (arg == "--run-to-pc") ? RUN_TO_PC :
+                              (arg == "--run-to-cycle") ? RUN_TO_CYCLE : RUN_TO_RETIRE;
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.stepValue)) {
+                cerr << "Error: " << arg << " needs a numeric argument." << endl;
+                exit(1);
+            }
         }
         else if(arg == "--save-snapshots") {
             knobs.saveCycleSnapshots = true;
         }
+        else if(arg == "--break-pc" || arg == "--break-retire") {
+            unsigned int address;
+            if(i + 1 >= argc || !parse_number(argv[++i], address)) {
+                cerr << "Error: " << arg << " needs an address." << endl;
+                exit(1);
+            }
+            if(!set_pc_breakpoint(address, arg == "--break-retire")) {
+                cerr << "Error: " << arg << " address is outside the code segment." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--watch" || arg == "--watch-read" || arg == "--watch-change") {
+            // ADDR or ADDR:LEN (bytes, default 4)
+            string range = (i + 1 < argc) ? argv[++i] : "";
+            size_t colon = range.find(':');
+            unsigned int address, length = 4;
+            if(!parse_number(range.substr(0, colon), address) ||
+               (colon != string::npos && !parse_number(range.substr(colon + 1), length))) {
+                cerr << "Error: " << arg << " needs ADDR or ADDR:LEN." << endl;
+                exit(1);
+            }
+            add_watchpoint(address, length, arg == "--watch" ? WATCH_WRITE :
+                                            arg == "--watch-read" ? WATCH_READ : WATCH_CHANGE);
+        }
+        else if(arg == "--fast-forward") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.fastForward)) {
+                cerr << "Error: --fast-forward needs an instruction count." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--ff-warm-bp") {
+            knobs.fastForwardWarmBP = true;
+        }
+        else if(arg == "--decoupled") {
+            knobs.decoupled = true;
+        }
+        else if(arg == "--jit") {
+            knobs.jitEnabled = true;
+        }
+        else if(arg == "--serve") {
+            knobs.serveMode = true;
+        }
+        else if(arg == "--serve-socket") {
+            knobs.serveMode = true;
+            if(i + 1 < argc)
+                knobs.serveSocket = argv[++i];
+        }
+        else if(arg == "--batch") {
+            if(i + 1 < argc)
+                knobs.batchFile = argv[++i];
+        }
+        else if(arg == "--batch-out") {
+            if(i + 1 < argc)
+                knobs.batchOutput = argv[++i];
+        }
+        else if(arg == "--sweep") {
+            if(i + 1 < argc)
+                knobs.sweepFile = argv[++i];
+        }
+        else if(arg == "--sweep-out") {
+            if(i + 1 < argc)
+                knobs.sweepOutput = argv[++i];
+        }
+        else if(arg == "--fanout") {
+            if(i + 1 < argc)
+                knobs.fanoutFile = argv[++i];
+        }
+        else if(arg == "--fanout-out") {
+            if(i + 1 < argc)
+                knobs.fanoutOutput = argv[++i];
+        }
+        else if(arg == "--jobs") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.batchThreads)) {
+                cerr << "Error: --jobs needs a thread count." << endl;
+                exit(1);
+            }
+        }
+        else if(arg == "--dcache-mshrs") {
+            if(i + 1 >= argc || !parse_number(argv[++i], knobs.dcache.mshrs) || knobs.dcache.mshrs > MAX_CACHE_MSHRS) {
+                cerr << "Error: --dcache-mshrs needs a value between 0 (blocking) and " << MAX_CACHE_MSHRS << "." << endl;
+                exit(1);
+            }
+        }
+        else if(parse_cache_option(arg, "--icache-", false, argc, argv, i, knobs.icache) ||
+                parse_cache_option(arg, "--dcache-", true, argc, argv, i, knobs.dcache) ||
+                parse_cache_option(arg, "--l2-", true, argc, argv, i, knobs.l2) ||
+                parse_prefetch_option(arg, "--icache-", argc, argv, i, knobs.icachePrefetch) ||
+                parse_prefetch_option(arg, "--dcache-", argc, argv, i, knobs.dcachePrefetch) ||
+                parse_dram_option(arg, argc, argv, i, knobs.dram)) {
+            // Taken by parse_cache_option / parse_dram_option
+        }
+        else
+            knobs.unknownOptions.push_back(arg);
+    }
+
+    // BTB geometry: the options may come in any order
+    if(knobs.btbEntries % knobs.btbWays != 0) {
+        cerr << "Error: --btb-entries must be a multiple of --btb-ways." << endl;
+        exit(1);
+    }
+    if(knobs.btbReplacement == REPLACE_PLRU && (knobs.btbWays & (knobs.btbWays - 1)) != 0) {
+        cerr << "Error: --btb-replacement plru needs a power-of-two --btb-ways." << endl;
+        exit(1);
+    }
+
+    // Cache geometry, likewise
+    const char *problem = cache_config_error(knobs.icache);
+    if(problem) {
+        cerr << "Error: --icache-*: " << problem << "." << endl;
+        exit(1);
+    }
+    problem = cache_config_error(knobs.dcache);
+    if(problem) {
+        cerr << "Error: --dcache-*: " << problem << "." << endl;
+        exit(1);
+    }
+    problem = cache_config_error(knobs.l2);
+    if(problem) {
+        cerr << "Error: --l2-*: " << problem << "." << endl;
+        exit(1);
+    }
+    problem = dram_config_error(knobs.dram);
+    if(problem) {
+        cerr << "Error: --dram-*: " << problem << "." << endl;
+        exit(1);
+    }
+    problem = prefetch_config_error(knobs.icachePrefetch);
+    if(!problem && knobs.icachePrefetch.kind != PREFETCH_NONE && knobs.icache.size == 0)
+        problem = "a prefetcher needs the cache (--icache-size)";
+    if(problem) {
+        cerr << "Error: --icache-prefetch*: " << problem << "." << endl;
+        exit(1);
+    }
+    problem = prefetch_config_error(knobs.dcachePrefetch);
+    if(!problem && knobs.dcachePrefetch.kind != PREFETCH_NONE && knobs.dcache.size == 0)
+        problem = "a prefetcher needs the cache (--dcache-size)";
+    if(problem) {
+        cerr << "Error: --dcache-prefetch*: " << problem << "." << endl;
+        exit(1);
     }
 }
  
 //------------------------------------------------------
-// Print Branch Predictor Status (BTB and PHT)
+// Print Branch Predictor Status (BTB and direction per entry)
 //------------------------------------------------------
-void printBranchPredictor() {
-    cout << "-------------------------------------" << endl;
-    cout << "Cycle: " << clockCycles << endl;
-    cout << "-------------------------------------" << endl;
-    cout << "Branch Predictor Status:" << endl;
-    cout << "Index\tValid\tBranchPC\tTargetPC\tPrediction" << endl;
-    for (unsigned int i = 0; i < BTB_SIZE; i++) {
-        cout << i << "\t"
-             << (BTB[i].valid ? "Yes" : "No") << "\t0x" << hex << BTB[i].branchPC
-             << "\t0x" << hex << BTB[i].targetPC << "\t"
-             << (PHT[i] ? "Taken" : "Not Taken") << endl;
+void Simulator::printBranchPredictor() {
+    console << "-------------------------------------" << endl;
+    console << "Cycle: " << clockCycles << endl;
+    console << "-------------------------------------" << endl;
+    console << "Branch Predictor Status:" << endl;
+    console << "Index\tValid\tBranchPC\tTargetPC\tPrediction" << endl;
+    for (unsigned int i = 0; i < BTB.size(); i++) {
+        console << i << "\t"
+                << (BTB.entries[i].valid ? "Yes" : "No") << "\t0x" << hex << BTB.entries[i].branchPC
+                << "\t0x" << hex << BTB.entries[i].targetPC << "\t"
+                << (direction->predict(BTB.entries[i].branchPC, i) ? "Taken" : "Not Taken") << endl;
     }
 }
  
+//------------------------------------------------------
+// Memory Hierarchy Below the L1 Caches
+//------------------------------------------------------
+// An L1 miss is filled from the unified L2 when there is one, and from DRAM
+// when the L2 misses too (or there is no L2). A level that is not modelled
+// costs the fixed --*-miss-penalty of the cache above it instead. Writes
+// never stall: dirty victims and written-through stores go into write
+// buffers, updating the L2 (which allocates without reading the line) and
+// taking their turn at the DRAM banks and bus.
+void Simulator::write_below(unsigned int address) {
+    if(l2.enabled()) {
+        CacheOutcome below = l2.access(address, true, stats.l2);
+        if(below.writeback && dram.enabled())
+            dram.enqueue(below.victimAddress, true, clockCycles, stats.dram);
+        if(below.writeThrough && dram.enabled())
+            dram.enqueue(address, true, clockCycles, stats.dram);
+    } else if(dram.enabled()) {
+        dram.enqueue(address, true, clockCycles, stats.dram);
+    }
+}
+
+// Look address up in an L1 and start whatever that takes: a hit is done after
+// the L1's hit latency, a fill after the L2's or DRAM's on top of it
+PendingAccess Simulator::begin_access(Cache &l1, CacheStats &counters, unsigned int address, bool write) {
+    CacheOutcome outcome = l1.access(address, write, counters);
+    if(outcome.writeback)
+        write_below(outcome.victimAddress);
+    if(outcome.writeThrough)
+        write_below(address);
+    PendingAccess access = {clockCycles, 0, NO_DRAM_REQUEST, 0, outcome.fill};
+    if(outcome.fill)
+        read_below(l1, address, l1.config.hitLatency, access);
+    else
+        access.readyCycle = clockCycles + l1.config.hitLatency - 1;
+    return access;
+}
+
+// Time the fill of an L1 line, `latency` cycles having been spent in the L1
+void Simulator::read_below(Cache &l1, unsigned int address, unsigned int latency, PendingAccess &access) {
+    bool fromDram = dram.enabled();
+    if(l2.enabled()) {
+        CacheOutcome below = l2.access(address, false, stats.l2);
+        if(below.writeback && dram.enabled())
+            dram.enqueue(below.victimAddress, true, clockCycles, stats.dram);
+        latency += l2.config.hitLatency;
+        if(!below.hit && !dram.enabled())
+            latency += l2.config.missPenalty;
+        fromDram = fromDram && !below.hit;
+    } else if(!dram.enabled()) {
+        latency += l1.config.missPenalty;
+    }
+    if(fromDram) {
+        access.dramRequest = dram.enqueue(address, false, clockCycles, stats.dram);
+        access.dramOverhead = latency - 1;
+        access.readyCycle = ACCESS_NOT_READY;
+    } else {
+        access.readyCycle = clockCycles + latency - 1;
+    }
+}
+
+// True from the cycle the access completes in
+bool Simulator::access_done(PendingAccess &access) {
+    unsigned int completion;
+    if(access.dramRequest != NO_DRAM_REQUEST && dram.finished(access.dramRequest, completion)) {
+        dram.release(access.dramRequest);
+        access.dramRequest = NO_DRAM_REQUEST;
+        access.readyCycle = completion + access.dramOverhead;
+    }
+    if(clockCycles < access.readyCycle)
+        return false;
+    if(access.fill) {
+        stats.memoryFills++;
+        stats.memoryFillCycles += access.readyCycle - access.startCycle + 1;
+        access.fill = false;
+    }
+    return true;
+}
+
+//------------------------------------------------------
+// L1 Prefetching
+//------------------------------------------------------
+// Each L1 may have a prefetcher (see prefetcher.h) watching its demand
+// accesses. A prefetch allocates its line in the L1 tags right away, marked
+// as prefetched, and fills it from below in one of MAX_PREFETCH_FILLS slots;
+// nothing waits on it. A demand access that finds the line still in a slot
+// takes that fill over (a late prefetch). Prefetch fills are kept out of the
+// average memory latency, which covers demand misses only.
+
+// A demand access from fetch() or the load/store in MEM, shown to the prefetcher afterwards
+PendingAccess Simulator::demand_access(Cache &l1, CacheStats &counters, PrefetchUnit &prefetch, unsigned int pc,
+                                       unsigned int address, bool write) {
+    unsigned int misses = counters.misses, useful = counters.usefulPrefetches;
+    PendingAccess access;
+    if(!claim_prefetch(l1, counters, prefetch, address, write, access))
+        access = begin_access(l1, counters, address, write);
+    if(prefetch.engine)
+        run_prefetcher(l1, counters, prefetch, pc, address,
+                       counters.misses != misses || counters.usefulPrefetches != useful);
+    return access;
+}
+
+// If a prefetch is still bringing address's line in, make the access hit it and take its fill
+bool Simulator::claim_prefetch(Cache &l1, CacheStats &counters, PrefetchUnit &prefetch, unsigned int address,
+                               bool write, PendingAccess &access) {
+    if(!prefetch.engine)
+        return false;
+    unsigned int lineAddress = address / l1.config.lineSize;
+    for(unsigned int f = 0; f < MAX_PREFETCH_FILLS; f++) {
+        PrefetchFill &fill = prefetch.fills[f];
+        if(!fill.valid || fill.lineAddress != lineAddress || !l1.contains(address))
+            continue;
+        CacheOutcome outcome = l1.access(address, write, counters);
+        if(outcome.writeThrough)
+            write_below(address);
+        counters.latePrefetches++;
+        access = fill.access;
+        fill.valid = false;
+        return true;
+    }
+    return false;
+}
+
+// Feed one demand access to the prefetcher and start the fills it asks for
+void Simulator::run_prefetcher(Cache &l1, CacheStats &counters, PrefetchUnit &prefetch, unsigned int pc,
+                               unsigned int address, bool trigger) {
+    prefetch.requests.clear();
+    prefetch.engine->observe(pc, address, trigger, prefetch.requests);
+    for(size_t r = 0; r < prefetch.requests.size(); r++) {
+        unsigned int target = prefetch.requests[r];
+        unsigned int lineAddress = target / l1.config.lineSize;
+        if(l1.contains(target))
+            continue; // Cached, or already on its way
+        unsigned int freeFill = MAX_PREFETCH_FILLS;
+        for(unsigned int f = 0; f < MAX_PREFETCH_FILLS && freeFill == MAX_PREFETCH_FILLS; f++) {
+            if(!prefetch.fills[f].valid)
+                freeFill = f;
+        }
+        if(freeFill == MAX_PREFETCH_FILLS) {
+            counters.droppedPrefetches++;
+            continue;
+        }
+        CacheOutcome outcome = l1.prefetch(target, counters);
+        if(outcome.writeback)
+            write_below(outcome.victimAddress);
+        PrefetchFill fill = {true, lineAddress, {clockCycles, 0, NO_DRAM_REQUEST, 0, false}};
+        read_below(l1, target, l1.config.hitLatency, fill.access);
+        prefetch.fills[freeFill] = fill;
+    }
+}
+
+// Free the fill slots whose line has arrived
+void Simulator::complete_prefetches(PrefetchUnit &prefetch) {
+    for(unsigned int f = 0; f < MAX_PREFETCH_FILLS; f++) {
+        if(prefetch.fills[f].valid && access_done(prefetch.fills[f].access))
+            prefetch.fills[f].valid = false;
+    }
+}
+
+//------------------------------------------------------
+// I-Cache Timing at Fetch
+//------------------------------------------------------
+// A lookup that takes more than a cycle holds fetch, sending bubbles, until
+// the line is in; the waiting PC is then delivered without a second lookup.
+// A redirect in the meantime still waits out the fill (the cache blocks).
+bool Simulator::icache_ready() {
+    if(fetchWaitPC != NO_FETCH_WAIT) {
+        if(!access_done(fetchAccess)) {
+            stats.icache.stallCycles++;
+            stats.totalStalls++;
+            return false;
+        }
+        bool filled = (fetchWaitPC == (unsigned int)pc);
+        fetchWaitPC = NO_FETCH_WAIT;
+        if(filled)
+            return true;
+    }
+    fetchAccess = demand_access(icache, stats.icache, iprefetch, pc, pc, false);
+    if(access_done(fetchAccess))
+        return true;
+    fetchWaitPC = pc;
+    stats.icache.stallCycles++;
+    stats.totalStalls++;
+    return false;
+}
+
 //------------------------------------------------------
 // Fetch Stage with Branch Prediction
 //------------------------------------------------------
-void fetch() {
+void Simulator::fetch() {
+    IF_ID_Register &if_id = next_latches().if_id;
     if(stall_fetch)
         return;
     if(flush_pipeline) {
         if_id.valid = false;
         return;
     }
+    if((unsigned int)pc < sz * 4 && icache.enabled() && !icache_ready()) {
+        if_id.valid = false;
+        if(knobs.printPipelineRegisters)
+            console << "Fetch: Waiting on the I-cache." << endl;
+        return;
+    }
     if(pc < sz * 4) { // 4 bytes per instruction
-        unsigned int index = (pc / 4) % BTB_SIZE;
-        unsigned int predicted = pc + 4; // default sequential prediction
-        if(BTB[index].valid && BTB[index].branchPC == pc) {
-            if(PHT[index])
-                predicted = BTB[index].targetPC;
-            else
-                predicted = pc + 4;
-        }
+        bool fromRAS;
+        unsigned int predicted = predict_jump_target(pc, predict_next_pc(pc, true), true, fromRAS);
+        instruction_word = guestMem.load32(pc);
  
-        instruction_word = MEM[pc / 4];
         if_id.valid = true;
         if_id.pc = pc;
         if_id.instruction = instruction_word;
         if_id.predictedPC = predicted;
+        if_id.rasPredicted = fromRAS;
+        if_id.ras = RAS.checkpoint();
+        if(debugArmed && pc_break_set(fetchBreakBits, pc))
+            record_debug_hit(STOP_FETCH, pc, 0, 0, 0);
  
         pc = predicted;
         nextPC = pc;
  
         if(knobs.printPipelineRegisters) {
-            cout << "Fetch: Fetched 0x" << hex << instruction_word
-                 << " from address 0x" << hex << if_id.pc
-                 << ", predicted next PC: 0x" << hex << predicted << endl;
+            console << "Fetch: Fetched 0x" << hex << instruction_word
+                    << " from address 0x" << hex << if_id.pc
+                    << ", predicted next PC: 0x" << hex << predicted << endl;
         }
     } else {
         if_id.valid = false;
         if(knobs.printPipelineRegisters)
-            cout << "Fetch: No instruction to fetch." << endl;
+            console << "Fetch: No instruction to fetch." << endl;
     }
     // Add at the end of the fetch() function, just before the closing brace
 
     // Track instruction if tracing is enabled
-    if ((knobs.traceInstructionEnabled && instructionCounter == knobs.traceInstructionNum) ||
-        (knobs.traceInstructionEnabled && knobs.traceByPC && if_id.pc == knobs.traceInstructionPC)) {
+    if (if_id.valid &&
+        ((knobs.traceInstructionEnabled && instructionCounter == knobs.traceInstructionNum) ||
+         (knobs.traceInstructionEnabled && knobs.traceByPC && if_id.pc == knobs.traceInstructionPC))) {
         currentTrace.active = true;
         currentTrace.instructionNum = instructionCounter;
         currentTrace.pc = if_id.pc;
         currentTrace.instruction = instruction_word;
         currentTrace.fetchCycle = clockCycles + 1; // +1 because we increment later
         
-        cout << "\n--- TRACE: Instruction #" << dec<<instructionCounter
+        console << "\n--- TRACE: Instruction #" << dec<<instructionCounter
         << " (0x" << hex << instruction_word << ") ---" << endl;
-        cout << "FETCH at cycle " << dec << clockCycles + 1 << endl;
-        cout<< "Contents of F/Dec buffer are: " << endl;
-        cout << "  PC: 0x" << hex << if_id.pc << endl;
-        cout << "  Instruction: 0x" << hex << instruction_word << endl;
-        cout << "  Predicted next PC: 0x" << hex << if_id.predictedPC << endl;
+        console << "FETCH at cycle " << dec << clockCycles + 1 << endl;
+        console<< "Contents of F/Dec buffer are: " << endl;
+        console << "  PC: 0x" << hex << if_id.pc << endl;
+        console << "  Instruction: 0x" << hex << instruction_word << endl;
+        console << "  Predicted next PC: 0x" << hex << if_id.predictedPC << endl;
         // check if it is control instruction or not
         unsigned int opcode = instruction_word & 0x7F;
         if (opcode == 0x63 || opcode == 0x6F) {
-            cout << "  Control instruction detected." << endl;
+            console << "  Control instruction detected." << endl;
         } else {
-            cout << "  Not a control instruction." << endl;
+            console << "  Not a control instruction." << endl;
         }
         // BTB hit or not
-        unsigned int index = (pc / 4) % BTB_SIZE; // Calculate BTB index
-        if (BTB[index].valid && BTB[index].branchPC == pc) {
-            cout << "  BTB hit." << endl;
+        int slot = BTB.find(pc);
+        if (slot >= 0) {
+            console << "  BTB hit." << endl;
         } else {
-            cout << "  BTB miss." << endl;
+            console << "  BTB miss." << endl;
         }
         // BP
-        if (PHT[index]) {
-            cout << "  Prediction: Taken." << endl;
+        if (slot >= 0 && direction->predict(pc, slot)) {
+            console << "  Prediction: Taken." << endl;
         } else {
-            cout << "  Prediction: Not Taken." << endl;
+            console << "  Prediction: Not Taken." << endl;
         }
-        cout << "-------------------------------------" << endl;
+        console << "-------------------------------------" << endl;
     }
 }
  
 //------------------------------------------------------
 // Decode Stage with Two-Pass Data Forwarding
 //------------------------------------------------------
-void decode() {
+void Simulator::decode() {
+    const IF_ID_Register &if_id = cur_latches().if_id;
+    ID_EX_Register &id_ex = next_latches().id_ex;
+    const EX_MEM_Register &ex_mem = next_latches().ex_mem; // Just produced by execute()
     if(stall_decode || !if_id.valid) {
         id_ex.valid = false;
         return;
@@ -1195,226 +1938,38 @@ void decode() {
     if (if_id.valid){
         id_ex.instructionNum=instructionCounter++; 
     }
-    unsigned int instruction = if_id.instruction;
-    inst = bitset<M>(instruction);
+    const DecodedInst &d = PREDECODED[if_id.pc / 4];
     id_ex.valid = true;
     id_ex.pc = if_id.pc;
-    id_ex.instructionWord = instruction;
+    id_ex.instructionWord = if_id.instruction;
+    id_ex.predictedPC = if_id.predictedPC;
+    id_ex.rasPredicted = if_id.rasPredicted;
+    id_ex.ras = if_id.ras;
     id_ex.instructionNum = instructionCounter++;
-    ControlSignals control = {false, false, false, false, false, false, false, 0};
-    unsigned int opcode = instruction & 0x7F;
-    // Decode instruction based on opcode...
-    if(opcode == 0x33) { // R-type
-        id_ex.instType = 'R';
-        id_ex.rs1 = (instruction >> 15) & 0x1F;
-        id_ex.rs2 = (instruction >> 20) & 0x1F;
-        id_ex.rd = (instruction >> 7) & 0x1F;
-        string funct3 = bitset<3>((instruction >> 12) & 0x7).to_string();
-        string funct7 = bitset<7>((instruction >> 25) & 0x7F).to_string();
-        if(funct3 == "000") {
-            if(funct7 == "0000000")
-                id_ex.subType = "add";
-            else if(funct7 == "0100000")
-                id_ex.subType = "sub";
-            else if(funct7 == "0000001")
-                id_ex.subType = "mul";
-        } else if(funct3 == "001" && funct7 == "0000000")
-            id_ex.subType = "sll";
-        else if(funct3 == "010" && funct7 == "0000000")
-            id_ex.subType = "slt";
-        else if(funct3 == "011" && funct7 == "0000000")
-            id_ex.subType = "sltu";
-        else if(funct3 == "100") {
-            if(funct7 == "0000000")
-                id_ex.subType = "xor";
-            else if(funct7 == "0000001")
-                id_ex.subType = "div";
-        } else if(funct3 == "101") {
-            if(funct7 == "0000000")
-                id_ex.subType = "srl";
-            else if(funct7 == "0100000")
-                id_ex.subType = "sra";
-        } else if(funct3 == "110") {
-            if(funct7 == "0000000")
-                id_ex.subType = "or";
-            else if(funct7 == "0000001")
-                id_ex.subType = "rem";
-        } else if(funct3 == "111" && funct7 == "0000000")
-            id_ex.subType = "and";
-        control.regWrite = true;
-        control.aluOp = 2;
-        // Initially read register file values.
-        id_ex.rs1Value = X[id_ex.rs1];
-        id_ex.rs2Value = X[id_ex.rs2];
-        stats.aluInst++;
+    if(d.instType == 0) { // Unknown opcode (e.g. the 0xffffffff terminator)
+        id_ex.valid = false;
+        return;
     }
-    else if(opcode == 0x13) { // I-type ALU
-        id_ex.instType = 'I';
-        id_ex.rs1 = (instruction >> 15) & 0x1F;
-        id_ex.rd = (instruction >> 7) & 0x1F;
-        unsigned int imm_unsigned = (instruction >> 20) & 0xFFF;
-        id_ex.immediate = (imm_unsigned & 0x800) ? (imm_unsigned | 0xFFFFF000) : imm_unsigned;
-        string funct3 = bitset<3>((instruction >> 12) & 0x7).to_string();
-        if(funct3 == "000")
-            id_ex.subType = "addi";
-        else if(funct3 == "001")
-            id_ex.subType = "slli";
-        else if(funct3 == "010")
-            id_ex.subType = "slti";
-        else if(funct3 == "011")
-            id_ex.subType = "sltiu";
-        else if(funct3 == "100")
-            id_ex.subType = "xori";
-        else if(funct3 == "101") {
-            if((imm_unsigned >> 5) & 0x1)
-                id_ex.subType = "srai";
-            else
-                id_ex.subType = "srli";
-        }
-        else if(funct3 == "110")
-            id_ex.subType = "ori";
-        else if(funct3 == "111")
-            id_ex.subType = "andi";
-        control.regWrite = true;
-        control.aluSrc = true;
-        control.aluOp = 2;
-        id_ex.rs1Value = X[id_ex.rs1];
-        id_ex.rs2 = 0;
+    id_ex.instType = d.instType;
+    id_ex.op = d.op;
+    id_ex.rs1 = d.rs1;
+    id_ex.rs2 = d.rs2;
+    id_ex.rd = d.rd;
+    id_ex.immediate = d.immediate;
+    id_ex.control = d.control;
+    // Initially read register file values (x0 reads as 0 for unused fields).
+    id_ex.rs1Value = X[d.rs1];
+    id_ex.rs2Value = X[d.rs2];
+    if(d.instClass == CLASS_ALU)
         stats.aluInst++;
-    }
-    else if(opcode == 0x03) { // I-type Load
-        id_ex.instType = 'I';
-        id_ex.rs1 = (instruction >> 15) & 0x1F;
-        id_ex.rd = (instruction >> 7) & 0x1F;
-        unsigned int imm_unsigned = (instruction >> 20) & 0xFFF;
-        id_ex.immediate = (imm_unsigned & 0x800) ? (imm_unsigned | 0xFFFFF000) : imm_unsigned;
-        string funct3 = bitset<3>((instruction >> 12) & 0x7).to_string();
-        if(funct3 == "000")
-            id_ex.subType = "lb";
-        else if(funct3 == "001")
-            id_ex.subType = "lh";
-        else if(funct3 == "010")
-            id_ex.subType = "lw";
-        else if(funct3 == "100")
-            id_ex.subType = "lbu";
-        else if(funct3 == "101")
-            id_ex.subType = "lhu";
-        control.regWrite = true;
-        control.memRead = true;
-        control.memToReg = true;
-        control.aluSrc = true;
-        control.aluOp = 0;
-        id_ex.rs1Value = X[id_ex.rs1];
-        id_ex.rs2 = 0;
+    else if(d.instClass == CLASS_DATA_TRANSFER)
         stats.dataTransferInst++;
-    }
-    else if(opcode == 0x23) { // S-type (Store)
-        id_ex.instType = 'S';
-        id_ex.rs1 = (instruction >> 15) & 0x1F;
-        id_ex.rs2 = (instruction >> 20) & 0x1F;
-        unsigned int imm_upper = (instruction >> 25) & 0x7F;
-        unsigned int imm_lower = (instruction >> 7) & 0x1F;
-        unsigned int imm_unsigned = (imm_upper << 5) | imm_lower;
-        id_ex.immediate = (imm_unsigned & 0x800) ? (imm_unsigned | 0xFFFFF000) : imm_unsigned;
-        string funct3 = bitset<3>((instruction >> 12) & 0x7).to_string();
-        if(funct3 == "000")
-            id_ex.subType = "sb";
-        else if(funct3 == "001")
-            id_ex.subType = "sh";
-        else if(funct3 == "010")
-            id_ex.subType = "sw";
-        control.memWrite = true;
-        control.aluSrc = true;
-        control.aluOp = 0;
-        id_ex.rs1Value = X[id_ex.rs1];
-        id_ex.rs2Value = X[id_ex.rs2];
-        id_ex.rd = 0;
-        stats.dataTransferInst++;
-    }
-    else if(opcode == 0x63) { // B-type (Branch)
-        id_ex.instType = 'B';
-        id_ex.rs1 = (instruction >> 15) & 0x1F;
-        id_ex.rs2 = (instruction >> 20) & 0x1F;
-        unsigned int imm_11 = (instruction >> 7) & 0x1;
-        unsigned int imm_4_1 = (instruction >> 8) & 0xF;
-        unsigned int imm_10_5 = (instruction >> 25) & 0x3F;
-        unsigned int imm_12 = (instruction >> 31) & 0x1;
-        unsigned int imm_unsigned = (imm_12 << 12) | (imm_11 << 11) | (imm_10_5 << 5) | (imm_4_1 << 1);
-        id_ex.immediate = (imm_unsigned & 0x1000) ? (imm_unsigned | 0xFFFFE000) : imm_unsigned;
-        string funct3 = bitset<3>((instruction >> 12) & 0x7).to_string();
-        if(funct3 == "000")
-            id_ex.subType = "beq";
-        else if(funct3 == "001")
-            id_ex.subType = "bne";
-        else if(funct3 == "100")
-            id_ex.subType = "blt";
-        else if(funct3 == "101")
-            id_ex.subType = "bge";
-        else if(funct3 == "110")
-            id_ex.subType = "bltu";
-        else if(funct3 == "111")
-            id_ex.subType = "bgeu";
-        control.branch = true;
-        control.aluOp = 1;
-        id_ex.rs1Value = X[id_ex.rs1];
-        id_ex.rs2Value = X[id_ex.rs2];
-        id_ex.rd = 0;
+    else
         stats.controlInst++;
-    }
-    else if(opcode == 0x6F) { // J-type (jal)
-        id_ex.instType = 'J';
-        id_ex.rd = (instruction >> 7) & 0x1F;
-        unsigned int imm_20 = (instruction >> 31) & 0x1;
-        unsigned int imm_10_1 = (instruction >> 21) & 0x3FF;
-        unsigned int imm_11 = (instruction >> 20) & 0x1;
-        unsigned int imm_19_12 = (instruction >> 12) & 0xFF;
-        unsigned int imm_unsigned = (imm_20 << 20) | (imm_19_12 << 12) | (imm_11 << 11) | (imm_10_1 << 1);
-        id_ex.immediate = (imm_unsigned & 0x100000) ? (imm_unsigned | 0xFFF00000) : imm_unsigned;
-        id_ex.subType = "jal";
-        control.regWrite = true;
-        control.jump = true;
-        id_ex.rs1 = 0;
-        id_ex.rs2 = 0;
-        stats.controlInst++;
-    }
-    else if(opcode == 0x67) { // I-type (jalr)
-        id_ex.instType = 'I';
-        id_ex.rs1 = (instruction >> 15) & 0x1F;
-        id_ex.rd = (instruction >> 7) & 0x1F;
-        unsigned int imm_unsigned = (instruction >> 20) & 0xFFF;
-        id_ex.immediate = (imm_unsigned & 0x800) ? (imm_unsigned | 0xFFFFF000) : imm_unsigned;
-        id_ex.subType = "jalr";
-        control.regWrite = true;
-        control.jump = true;
-        control.aluSrc = true;
-        id_ex.rs1Value = X[id_ex.rs1];
-        id_ex.rs2 = 0;
-        stats.controlInst++;
-    }
-    else if(opcode == 0x37 || opcode == 0x17) { // U-type (lui / auipc)
-        id_ex.instType = 'U';
-        id_ex.rd = (instruction >> 7) & 0x1F;
-        unsigned int imm_unsigned = (instruction >> 12) & 0xFFFFF;
-        id_ex.immediate = imm_unsigned << 12;
-        if(opcode == 0x37)
-            id_ex.subType = "lui";
-        else
-            id_ex.subType = "auipc";
-        control.regWrite = true;
-        control.aluSrc = true;
-        id_ex.rs1 = 0;
-        id_ex.rs2 = 0;
-        stats.aluInst++;
-    }
-    else {
-        id_ex.valid = false;
-        return;
-    }
-    id_ex.control = control;
  
     if (knobs.forwardingEnabled) {
         ForwardingBuffer fBuffer;
-        saveForwardingData(fBuffer);
+        saveForwardingData(fBuffer, ex_mem);
     
         int          fval;
         ForwardStage fsrc;
@@ -1452,60 +2007,252 @@ void decode() {
     if (currentTrace.active && if_id.pc == currentTrace.pc) {
         currentTrace.decodeCycle = clockCycles + 1;
         stringstream ss;
-        ss << "Type: " << id_ex.instType << ", Subtype: " << id_ex.subType;
+        ss << "Type: " << id_ex.instType << ", Subtype: " << OP_NAMES[id_ex.op];
         if (id_ex.rs1 != 0) ss << ", rs1: x" << id_ex.rs1 << " = " << id_ex.rs1Value;
         if (id_ex.rs2 != 0) ss << ", rs2: x" << id_ex.rs2 << " = " << id_ex.rs2Value;
         if (id_ex.rd != 0) ss << ", rd: x" << id_ex.rd;
         if (id_ex.immediate != 0) ss << ", imm: " << id_ex.immediate;
         currentTrace.decodeInfo = ss.str();
     
-        cout << "\nDECODE at cycle " << dec << clockCycles + 1 << endl;
-        cout << "  " << currentTrace.decodeInfo << endl;
-        if (stall_decode) cout << "  ** Stalled due to data hazard **" << endl;
-        cout << "Contents of Dec/Exec buffer are: " << endl;
-        cout << "  PC: 0x" << hex << id_ex.pc << endl;
-        cout << "  Instruction: 0x" << hex << id_ex.instructionWord << endl;
+        console << "\nDECODE at cycle " << dec << clockCycles + 1 << endl;
+        console << "  " << currentTrace.decodeInfo << endl;
+        if (stall_decode) console << "  ** Stalled due to data hazard **" << endl;
+        console << "Contents of Dec/Exec buffer are: " << endl;
+        console << "  PC: 0x" << hex << id_ex.pc << endl;
+        console << "  Instruction: 0x" << hex << id_ex.instructionWord << endl;
     
         // Data/control dependency
         if (id_ex.control.regWrite) {
-            cout << "  Register write enabled." << endl;
+            console << "  Register write enabled." << endl;
         } else {
-            cout << "  Register write disabled." << endl;
+            console << "  Register write disabled." << endl;
         }
     
         // Check and print data forwarding paths
         if (knobs.forwardingEnabled) {
             ForwardingBuffer fBuffer;
-            saveForwardingData(fBuffer);
+            saveForwardingData(fBuffer, ex_mem);
     
             int fval;
             ForwardStage fsrc;
     
-            cout << "  Forwarding paths to be used:" << endl;
+            console << "  Forwarding paths to be used:" << endl;
     
             // Check forwarding for rs1
             if (id_ex.rs1 != 0 && fBuffer.getValue(id_ex.rs1, fval, fsrc)) {
-                cout << "    rs1 (x" << id_ex.rs1 << ") forwarded from "
-                     << (fsrc == EX_MEM ? "EX/MEM" : "MEM/WB")
-                     << " with value " << fval << endl;
+                console << "    rs1 (x" << id_ex.rs1 << ") forwarded from "
+                        << (fsrc == EX_MEM ? "EX/MEM" : "MEM/WB")
+                        << " with value " << fval << endl;
             }
     
             // Check forwarding for rs2 (for R, B, S types)
             if ((id_ex.instType == 'R' || id_ex.instType == 'B' || id_ex.instType == 'S') &&
                 id_ex.rs2 != 0 && fBuffer.getValue(id_ex.rs2, fval, fsrc)) {
-                cout << "    rs2 (x" << id_ex.rs2 << ") forwarded from "
-                     << (fsrc == EX_MEM ? "EX/MEM" : "MEM/WB")
-                     << " with value " << fval << endl;
+                console << "    rs2 (x" << id_ex.rs2 << ") forwarded from "
+                        << (fsrc == EX_MEM ? "EX/MEM" : "MEM/WB")
+                        << " with value " << fval << endl;
             }
         }
     }
 
 }
  
+//------------------------------------------------------
+// Execute-stage handlers, one per InstOp (see EXEC_HANDLERS)
+//------------------------------------------------------
+typedef void (Simulator::*ExecHandler)(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2);
+
+void Simulator::exec_unknown(const ID_EX_Register &, EX_MEM_Register &ex_mem, int, int) {
+    ex_mem.aluResult = 0;
+}
+
+void Simulator::exec_alu(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2) {
+    ex_mem.aluResult = ALU_FUNCS[id_ex.op](operand1, operand2);
+}
+
+void Simulator::exec_mem_address(const ID_EX_Register &, EX_MEM_Register &ex_mem, int operand1, int operand2) {
+    ex_mem.aluResult = alu_add(operand1, operand2);
+    ex_mem.memAddress = ex_mem.aluResult;
+}
+
+// Next fetch PC for the instruction at fetchPC: the BTB target when the BTB
+// hits and the direction predictor (always, for jumps) says taken. Predecode
+// bits stand in for the real thing, so a partial-tag alias can only redirect
+// a control instruction. countLookup: fetch's lookup, counted in the stats
+// and seen by the replacement policy; predictor warming passes false.
+unsigned int Simulator::predict_next_pc(unsigned int fetchPC, bool countLookup) {
+    if(knobs.predictor == PREDICT_NOT_TAKEN)
+        return fetchPC + 4;
+    int slot = BTB.find(fetchPC);
+    if(slot < 0) {
+        if(countLookup)
+            stats.btbMisses++;
+        return fetchPC + 4;
+    }
+    if(countLookup) {
+        stats.btbHits++;
+        BTB.touch(slot);
+    }
+    const ControlSignals &control = PREDECODED[fetchPC / 4].control;
+    if(control.jump || (control.branch && direction->predict(fetchPC, slot)))
+        return BTB.entries[slot].targetPC;
+    return fetchPC + 4;
+}
+
+// A jalr that returns: jalr x0 through the link register x1
+static inline bool is_return(unsigned int rd, unsigned int rs1) {
+    return rd == 0 && rs1 == 1;
+}
+
+// Jump targets at fetch. A call (jal/jalr writing x1) pushes its return
+// address on the RAS and a return pops its predicted target; any other jalr
+// asks the indirect target cache. When neither has a prediction (stack empty,
+// cache miss, or disabled), `predicted` (the BTB's guess) stands.
+unsigned int Simulator::predict_jump_target(unsigned int fetchPC, unsigned int predicted, bool countStats, bool &fromRAS) {
+    fromRAS = false;
+    const DecodedInst &d = PREDECODED[fetchPC / 4];
+    if(d.op != OP_JAL && d.op != OP_JALR)
+        return predicted;
+    if(d.op == OP_JALR && !is_return(d.rd, d.rs1) && ITC.enabled())
+        ITC.lookup(fetchPC, predicted);
+    if(RAS.depth() == 0)
+        return predicted;
+    if(d.op == OP_JALR && is_return(d.rd, d.rs1)) {
+        if(!RAS.empty()) {
+            predicted = RAS.pop();
+            fromRAS = true;
+        } else if(countStats) {
+            stats.rasUnderflows++;
+        }
+    }
+    if(d.rd == 1 && RAS.push(fetchPC + 4) && countStats)
+        stats.rasOverflows++;
+    return predicted;
+}
+
+// Check fetch's prediction for the control instruction at branchPC against
+// its resolved next PC and train the BTB and direction predictor; returns
+// true on a misprediction. A misprediction refills the BTB entry with the
+// taken target (any outcome for onebit, whose bit lives in the entry).
+// Shared by the execute handlers and the functional engine's predictor warming.
+bool Simulator::resolve_prediction(unsigned int branchPC, bool conditional, bool taken, unsigned int actualPC,
+                                   unsigned int predictedPC) {
+    bool mispredicted = (actualPC != predictedPC);
+    if(knobs.predictor == PREDICT_NOT_TAKEN)
+        return mispredicted; // Nothing to train
+    int slot = BTB.find(branchPC);
+    if(mispredicted && (taken || direction->per_btb_entry())) {
+        slot = BTB.allocate(branchPC);
+        BTB.entries[slot].valid = true;
+        BTB.entries[slot].branchPC = branchPC;
+        BTB.entries[slot].targetPC = actualPC;
+        BTB.entries[slot].tag = BTB.tag_of(branchPC);
+    }
+    if(conditional || direction->per_btb_entry())
+        direction->update(branchPC, slot, taken);
+    return mispredicted;
+}
+
+// Resolve a control instruction whose outcome is known: check fetch's
+// prediction and redirect on a misprediction. The exec_ handlers compute the
+// outcome; a trace-driven execute() takes it from the stream.
+void Simulator::resolve_branch(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, bool branch_taken,
+                               unsigned int targetPC) {
+    if(resolve_prediction(id_ex.pc, true, branch_taken, targetPC, id_ex.predictedPC)) {
+        flush_pipeline = true;
+        nextPC = targetPC;
+        RAS.restore(id_ex.ras);
+        stats.controlHazardCount++;
+        stats.controlHazardStalls++;
+        stats.branchMispredCount++;
+        stats.conditionalMispredCount++;
+        if (knobs.printPipelineRegisters) {
+            outputControlHazardInfo(id_ex.pc, id_ex.predictedPC != id_ex.pc + 4, branch_taken);
+        }
+    }
+    ex_mem.branchTaken = branch_taken;
+    ex_mem.aluResult = id_ex.pc+4;
+}
+
+void Simulator::resolve_jal(const ID_EX_Register &id_ex, unsigned int targetPC) {
+    if(resolve_prediction(id_ex.pc, false, true, targetPC, id_ex.predictedPC)) {
+        flush_pipeline = true;
+        nextPC = targetPC;
+        RAS.restore(id_ex.ras);
+        stats.controlHazardCount++;
+        stats.controlHazardStalls++;
+        stats.branchMispredCount++;
+        if (knobs.printPipelineRegisters) {
+            outputControlHazardInfo(id_ex.pc, id_ex.predictedPC != id_ex.pc + 4, true);
+        }
+    }
+}
+
+void Simulator::resolve_jalr(const ID_EX_Register &id_ex, unsigned int targetPC) {
+    bool mispredicted = resolve_prediction(id_ex.pc, false, true, targetPC, id_ex.predictedPC);
+    if(id_ex.rasPredicted) {
+        stats.rasPredictions++;
+        if(mispredicted)
+            stats.rasMispredictions++;
+    }
+    if(!is_return(id_ex.rd, id_ex.rs1)) {
+        stats.indirectJumps++;
+        if(mispredicted)
+            stats.indirectMispredCount++;
+        if(ITC.enabled())
+            ITC.update(id_ex.pc, targetPC);
+    }
+    if(mispredicted) {
+        flush_pipeline = true;
+        nextPC = targetPC;
+        RAS.restore(id_ex.ras);
+        stats.controlHazardCount++;
+        stats.controlHazardStalls++;
+        stats.branchMispredCount++;
+    }
+}
+
+void Simulator::exec_branch(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2) {
+    bool branch_taken = ALU_FUNCS[id_ex.op](operand1, operand2) != 0;
+    resolve_branch(id_ex, ex_mem, branch_taken, branch_taken ? id_ex.pc + id_ex.immediate : id_ex.pc + 4);
+}
+
+void Simulator::exec_jal(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int, int) {
+    ex_mem.aluResult = id_ex.pc+4;
+    resolve_jal(id_ex, id_ex.pc + id_ex.immediate);
+}
+
+void Simulator::exec_jalr(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int operand1, int operand2) {
+    ex_mem.aluResult = id_ex.pc+4;
+    resolve_jalr(id_ex, (operand1 + operand2) & ~1);
+}
+
+void Simulator::exec_lui(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int, int) {
+    ex_mem.aluResult = id_ex.immediate;
+}
+
+void Simulator::exec_auipc(const ID_EX_Register &id_ex, EX_MEM_Register &ex_mem, int, int) {
+    ex_mem.aluResult = id_ex.pc + id_ex.immediate;
+}
+
+static const ExecHandler EXEC_HANDLERS[OP_COUNT] = {
+    &Simulator::exec_unknown,
+    &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu,
+    &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu,
+    &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu, &Simulator::exec_alu,
+    &Simulator::exec_mem_address, &Simulator::exec_mem_address, &Simulator::exec_mem_address, &Simulator::exec_mem_address, &Simulator::exec_mem_address,
+    &Simulator::exec_mem_address, &Simulator::exec_mem_address, &Simulator::exec_mem_address,
+    &Simulator::exec_branch, &Simulator::exec_branch, &Simulator::exec_branch, &Simulator::exec_branch, &Simulator::exec_branch, &Simulator::exec_branch,
+    &Simulator::exec_jal, &Simulator::exec_jalr,
+    &Simulator::exec_lui, &Simulator::exec_auipc
+};
+
 //------------------------------------------------------
 // Execute Stage with Branch Predictor Update
 //------------------------------------------------------
-void execute() {
+void Simulator::execute() {
+    const ID_EX_Register &id_ex = cur_latches().id_ex;
+    EX_MEM_Register &ex_mem = next_latches().ex_mem;
     if(!id_ex.valid) {
         ex_mem.valid = false;
         return;
@@ -1513,140 +2260,40 @@ void execute() {
     ex_mem.valid = true;
     ex_mem.pc = id_ex.pc;
     ex_mem.instType = id_ex.instType;
-    ex_mem.subType = id_ex.subType;
+    ex_mem.op = id_ex.op;
     ex_mem.rd = id_ex.rd;
     ex_mem.rs2Value = id_ex.rs2Value;
     ex_mem.control = id_ex.control;
     ex_mem.instructionWord = id_ex.instructionWord;
     ex_mem.instructionNum = id_ex.instructionNum;
     ex_mem.branchTaken = false;
-    int operand1 = id_ex.rs1Value;
-    int operand2 = (id_ex.control.aluSrc ? id_ex.immediate : id_ex.rs2Value);
-    switch(id_ex.instType) {
-        case 'R':
-            if(id_ex.subType=="add") ex_mem.aluResult = operand1+operand2;
-            else if(id_ex.subType=="sub") ex_mem.aluResult = operand1-operand2;
-            else if(id_ex.subType=="sll") ex_mem.aluResult = operand1 << (operand2 & 0x1F);
-            else if(id_ex.subType=="slt") ex_mem.aluResult = (operand1<operand2) ? 1 : 0;
-            else if(id_ex.subType=="sltu") ex_mem.aluResult = ((unsigned int)operand1 < (unsigned int)operand2) ? 1 : 0;
-            else if(id_ex.subType=="xor") ex_mem.aluResult = operand1 ^ operand2;
-            else if(id_ex.subType=="srl") ex_mem.aluResult = (unsigned int)operand1 >> (operand2 & 0x1F);
-            else if(id_ex.subType=="sra") ex_mem.aluResult = operand1 >> (operand2 & 0x1F);
-            else if(id_ex.subType=="or") ex_mem.aluResult = operand1 | operand2;
-            else if(id_ex.subType=="and") ex_mem.aluResult = operand1 & operand2;
-            else if(id_ex.subType=="mul") ex_mem.aluResult = operand1 * operand2;
-            else if(id_ex.subType=="div") ex_mem.aluResult = (operand2 != 0) ? operand1/operand2 : -1;
-            else if(id_ex.subType=="rem") ex_mem.aluResult = (operand2 != 0) ? operand1 % operand2 : operand1;
-            else ex_mem.aluResult = 0;
-            break;
-        case 'I':
-            if(id_ex.subType=="addi") ex_mem.aluResult = operand1+operand2;
-            else if(id_ex.subType=="slti") ex_mem.aluResult = (operand1<operand2) ? 1 : 0;
-            else if(id_ex.subType=="sltiu") ex_mem.aluResult = ((unsigned int)operand1 < (unsigned int)operand2) ? 1 : 0;
-            else if(id_ex.subType=="xori") ex_mem.aluResult = operand1 ^ operand2;
-            else if(id_ex.subType=="ori") ex_mem.aluResult = operand1 | operand2;
-            else if(id_ex.subType=="andi") ex_mem.aluResult = operand1 & operand2;
-            else if(id_ex.subType=="slli") ex_mem.aluResult = operand1 << (operand2 & 0x1F);
-            else if(id_ex.subType=="srli") ex_mem.aluResult = (unsigned int)operand1 >> (operand2 & 0x1F);
-            else if(id_ex.subType=="srai") ex_mem.aluResult = operand1 >> (operand2 & 0x1F);
-            else if(id_ex.subType=="jalr") {
-                ex_mem.aluResult = id_ex.pc+4;
-                int targetPC = (operand1 + operand2) & ~1;
-                unsigned int index = (id_ex.pc/4)%BTB_SIZE;
-                bool pred = false;
-                if(BTB[index].valid && BTB[index].branchPC==id_ex.pc)
-                    pred = PHT[index];
-                if(pred != true || (BTB[index].valid && BTB[index].targetPC != targetPC)) {
-                    flush_pipeline = true;
-                    nextPC = targetPC;
-                    stats.controlHazardCount++;
-                    stats.controlHazardStalls++;
-                    stats.branchMispredCount++;
-                    PHT[index] = true;
-                    BTB[index].valid = true;
-                    BTB[index].branchPC = id_ex.pc;
-                    BTB[index].targetPC = targetPC;
-                }
-            }
-            else if(id_ex.subType=="lb" || id_ex.subType=="lh" || id_ex.subType=="lw" ||
-                    id_ex.subType=="lbu" || id_ex.subType=="lhu") {
-                ex_mem.aluResult = operand1+operand2;
-                ex_mem.memAddress = operand1+operand2;
-            }
-            else ex_mem.aluResult = 0;
-            break;
-        case 'S':
-            ex_mem.aluResult = operand1+operand2;
-            ex_mem.memAddress = operand1+operand2;
-            break;
-        case 'B': {
-            bool branch_taken = false;
-            if(id_ex.subType=="beq") branch_taken = (operand1 == id_ex.rs2Value);
-            else if(id_ex.subType=="bne") branch_taken = (operand1 != id_ex.rs2Value);
-            else if(id_ex.subType=="blt") branch_taken = (operand1 < id_ex.rs2Value);
-            else if(id_ex.subType=="bge") branch_taken = (operand1 >= id_ex.rs2Value);
-            else if(id_ex.subType=="bltu") branch_taken = ((unsigned int)operand1 < (unsigned int)id_ex.rs2Value);
-            else if(id_ex.subType=="bgeu") branch_taken = ((unsigned int)operand1 >= (unsigned int)id_ex.rs2Value);
-            int targetPC = branch_taken ? id_ex.pc + id_ex.immediate : id_ex.pc+4;
-            unsigned int index = (id_ex.pc/4)%BTB_SIZE;
-            bool pred = false;
-            if(BTB[index].valid && BTB[index].branchPC==id_ex.pc)
-                pred = PHT[index];
-            bool mispredicted = (pred!=branch_taken) || (branch_taken && BTB[index].targetPC != targetPC);
-            if(mispredicted) {
-                flush_pipeline = true;
-                nextPC = targetPC;
-                stats.controlHazardCount++;
-                stats.controlHazardStalls++;
-                stats.branchMispredCount++;
-                PHT[index] = branch_taken;
-                BTB[index].valid = true;
-                BTB[index].branchPC = id_ex.pc;
-                BTB[index].targetPC = targetPC;
-                if (knobs.printPipelineRegisters) {
-                    outputControlHazardInfo(id_ex.pc, pred, branch_taken);
-                }
-            }
-            ex_mem.branchTaken = branch_taken;
-            ex_mem.aluResult = id_ex.pc+4;
-            break;
-        }
-        case 'J': {
-            ex_mem.aluResult = id_ex.pc+4;
-            int targetPC = id_ex.pc+id_ex.immediate;
-            unsigned int index = (id_ex.pc/4)%BTB_SIZE;
-            bool pred = false;
-            if(BTB[index].valid && BTB[index].branchPC==id_ex.pc)
-                pred = PHT[index];
-            bool mispredicted = (!pred) || (BTB[index].targetPC != targetPC);
-            if(mispredicted) {
-                flush_pipeline = true;
-                nextPC = targetPC;
-                stats.controlHazardCount++;
-                stats.controlHazardStalls++;
-                stats.branchMispredCount++;
-                PHT[index] = true;
-                BTB[index].valid = true;
-                BTB[index].branchPC = id_ex.pc;
-                BTB[index].targetPC = targetPC;
-                if (knobs.printPipelineRegisters) {
-                    outputControlHazardInfo(id_ex.pc, pred, true);
-                }
-            }
-            break;
-        }
-        case 'U':
-            if(id_ex.subType=="lui")
-                ex_mem.aluResult = id_ex.immediate;
-            else if(id_ex.subType=="auipc")
-                ex_mem.aluResult = id_ex.pc + id_ex.immediate;
-            break;
-        default:
-            ex_mem.aluResult = 0;
-            break;
+    ex_mem.traced = false;
+    // Trace-driven: the functional stream already has the results of every
+    // correct-path instruction, so only the branch/jump outcome is resolved
+    // here (anything else is wrong-path and runs as usual)
+    const RetiredInst *retired = feed ? feed->peek(feedReader) : NULL;
+    if (retired && retired->pc == id_ex.pc) {
+        ex_mem.traced = true;
+        ex_mem.memAddress = retired->memAddress;
+        ex_mem.aluResult = (id_ex.control.memRead || id_ex.control.memWrite) ? (int)retired->memAddress : retired->result;
+        ex_mem.loadValue = retired->result;
+        ex_mem.rs2Value = retired->storeData;
+        bool taken = retired->taken;
+        unsigned int targetPC = retired->nextPC;
+        feed->consume(feedReader);
+        if (id_ex.control.branch)
+            resolve_branch(id_ex, ex_mem, taken, targetPC);
+        else if (id_ex.op == OP_JAL)
+            resolve_jal(id_ex, targetPC);
+        else if (id_ex.op == OP_JALR)
+            resolve_jalr(id_ex, targetPC);
+    } else {
+        int operand1 = id_ex.rs1Value;
+        int operand2 = (id_ex.control.aluSrc ? id_ex.immediate : id_ex.rs2Value);
+        (this->*EXEC_HANDLERS[id_ex.op])(id_ex, ex_mem, operand1, operand2);
     }
     
-    if (id_ex.instType == 'S'
+    if (!ex_mem.traced && id_ex.instType == 'S'
         && tempResults.memValid
         && tempResults.memRd == id_ex.rs2
       ) {
@@ -1670,137 +2317,222 @@ void execute() {
         currentTrace.executeCycle = clockCycles + 1;
         currentTrace.executeResult = ex_mem.aluResult;
         
-        cout << "\nEXECUTE at cycle " << dec << clockCycles + 1 << endl;
+        console << "\nEXECUTE at cycle " << dec << clockCycles + 1 << endl;
         // Contents of Exe/Mem buffer are ...
-        cout << " Contents of Exe/Mem buffer are: " << endl;
-        cout << "  PC: 0x" << hex << ex_mem.pc << dec << endl;
-        cout << "  Instruction: 0x" << hex << ex_mem.instructionWord << dec << endl;
-        cout << "  Instruction Type: " << ex_mem.instType << endl;
-        cout << "  Subtype: " << ex_mem.subType << endl;
+        console << " Contents of Exe/Mem buffer are: " << endl;
+        console << "  PC: 0x" << hex << ex_mem.pc << dec << endl;
+        console << "  Instruction: 0x" << hex << ex_mem.instructionWord << dec << endl;
+        console << "  Instruction Type: " << ex_mem.instType << endl;
+        console << "  Subtype: " << OP_NAMES[ex_mem.op] << endl;
         
-        cout << "  ALU Result: " << dec << ex_mem.aluResult << " (0x" << hex << ex_mem.aluResult << dec << ")" << endl;
+        console << "  ALU Result: " << dec << ex_mem.aluResult << " (0x" << hex << ex_mem.aluResult << dec << ")" << endl;
         
         if (ex_mem.instType == 'B') {
-            cout << "  Branch: " << (ex_mem.branchTaken ? "Taken" : "Not Taken") << endl;
+            console << "  Branch: " << (ex_mem.branchTaken ? "Taken" : "Not Taken") << endl;
         } else if (ex_mem.instType == 'J' || 
-                 (ex_mem.instType == 'I' && ex_mem.subType == "jalr")) {
-            cout << "  Jump target: 0x" << hex << nextPC << dec << endl;
+                 (ex_mem.instType == 'I' && ex_mem.op == OP_JALR)) {
+            console << "  Jump target: 0x" << hex << nextPC << dec << endl;
         }
         
         if (flush_pipeline) {
-            cout << "  ** Caused Pipeline Flush **" << endl;
+            console << "  ** Caused Pipeline Flush **" << endl;
         }
     }
 
 }
  
+//------------------------------------------------------
+// Memory access helpers for mem_op()
+//------------------------------------------------------
+// Loads (OP_LB..OP_LHU) and stores (OP_SB..OP_SW) straight against guest memory
+typedef int (*MemLoadFunc)(const GuestMemory &mem, unsigned int address);
+typedef void (*MemStoreFunc)(GuestMemory &mem, unsigned int address, int data);
+
+static int mem_lb(const GuestMemory &mem, unsigned int address)  { return (int)(signed char)mem.load8(address); }
+static int mem_lh(const GuestMemory &mem, unsigned int address)  { return (int)(short)mem.load16(address); }
+static int mem_lw(const GuestMemory &mem, unsigned int address)  { return (int)mem.load32(address); }
+static int mem_lbu(const GuestMemory &mem, unsigned int address) { return (int)mem.load8(address); }
+static int mem_lhu(const GuestMemory &mem, unsigned int address) { return (int)mem.load16(address); }
+
+static void mem_sb(GuestMemory &mem, unsigned int address, int data) { mem.store8(address, (unsigned char)data); }
+static void mem_sh(GuestMemory &mem, unsigned int address, int data) { mem.store16(address, (unsigned short)data); }
+static void mem_sw(GuestMemory &mem, unsigned int address, int data) { mem.store32(address, (unsigned int)data); }
+
+static const MemLoadFunc MEM_LOADS[OP_LHU - OP_LB + 1] = {
+    mem_lb, mem_lh, mem_lw, mem_lbu, mem_lhu
+};
+static const MemStoreFunc MEM_STORES[OP_SW - OP_SB + 1] = {
+    mem_sb, mem_sh, mem_sw
+};
+
+//------------------------------------------------------
+// D-Cache Timing at MEM
+//------------------------------------------------------
+// Checked at the start of every cycle. The first cycle a load or store sits
+// in EX/MEM looks the D-cache up; while its latency has not passed, MEM sends
+// a bubble to WB and EX/MEM, ID/EX and IF/ID hold (write-back still drains).
+// Only correct-path instructions reach EX/MEM, so nothing here is squashed.
+//
+// With --dcache-mshrs the cache is non-blocking: a miss only spends the hit
+// latency in MEM and leaves its fill to an MSHR, and a later miss to the same
+// line joins that MSHR. The load's data is read from guest memory as usual;
+// what waits is its destination register (regMshr), which hazardDetection()
+// holds its consumers on. A miss with every MSHR busy blocks in MEM.
+bool Simulator::dcache_busy() {
+    const EX_MEM_Register &ex_mem = cur_latches().ex_mem;
+    if(dcache.config.mshrs > 0)
+        complete_misses();
+    if(!dcache.enabled() || !ex_mem.valid || !(ex_mem.control.memRead || ex_mem.control.memWrite))
+        return false;
+    if(!memAccessStarted) {
+        if(dcache.config.mshrs > 0) {
+            if(!start_nonblocking_access(ex_mem))
+                return true;
+        } else {
+            memAccess = demand_access(dcache, stats.dcache, dprefetch, ex_mem.pc, ex_mem.memAddress,
+                                      ex_mem.control.memWrite);
+        }
+        memAccessStarted = true;
+    }
+    if(!access_done(memAccess)) {
+        stats.dcache.stallCycles++;
+        stats.totalStalls++;
+        return true;
+    }
+    memAccessStarted = false;
+    return false;
+}
+
+// Start the EX/MEM access on the non-blocking D-cache, or count why it cannot
+// start this cycle
+bool Simulator::start_nonblocking_access(const EX_MEM_Register &ex_mem) {
+    unsigned int address = ex_mem.memAddress;
+    bool write = ex_mem.control.memWrite;
+    if(write && regMshr[PREDECODED[ex_mem.pc / 4].rs2] != NO_MSHR) {
+        stats.missUseStalls++; // Storing a missing load's result (forwarded past decode)
+        stats.dcache.stallCycles++;
+        stats.totalStalls++;
+        return false;
+    }
+
+    unsigned int misses = stats.dcache.misses, useful = stats.dcache.usefulPrefetches;
+    unsigned int lineAddress = address / dcache.config.lineSize;
+    unsigned int slot = NO_MSHR, freeSlot = NO_MSHR;
+    for(unsigned int m = 0; m < dcache.config.mshrs; m++) {
+        if(mshrs[m].valid && mshrs[m].lineAddress == lineAddress)
+            slot = m;
+        else if(!mshrs[m].valid && freeSlot == NO_MSHR)
+            freeSlot = m;
+    }
+    PendingAccess lookup = {clockCycles, clockCycles + dcache.config.hitLatency - 1, NO_DRAM_REQUEST, 0, false};
+    PendingAccess prefetched;
+    if(slot != NO_MSHR) {
+        // Secondary miss: counted as a miss even though the tags already hold the line
+        CacheStats merged;
+        CacheOutcome outcome = dcache.access(address, write, merged);
+        if(outcome.writeback)
+            write_below(outcome.victimAddress);
+        if(outcome.writeThrough)
+            write_below(address);
+        stats.dcache.misses++;
+        stats.dcache.evictions += merged.evictions;
+        stats.dcache.writebacks += merged.writebacks;
+        stats.dcache.writeThroughs += merged.writeThroughs;
+        stats.mshrMerges++;
+        memAccess = lookup;
+    } else if(claim_prefetch(dcache, stats.dcache, dprefetch, address, write, prefetched)) {
+        // A late prefetch becomes this miss's MSHR, or MEM waits it out when none is free
+        memAccess = prefetched;
+        if(freeSlot != NO_MSHR) {
+            Mshr fill = {true, lineAddress, prefetched};
+            mshrs[freeSlot] = fill;
+            slot = freeSlot;
+            memAccess = lookup;
+        }
+    } else {
+        bool allocates = !write || dcache.config.writeAllocate;
+        if(freeSlot == NO_MSHR && allocates && !dcache.contains(address)) {
+            stats.mshrFullStalls++;
+            stats.dcache.stallCycles++;
+            stats.totalStalls++;
+            return false;
+        }
+        memAccess = begin_access(dcache, stats.dcache, address, write);
+        if(memAccess.fill) {
+            Mshr fill = {true, lineAddress, memAccess};
+            mshrs[freeSlot] = fill;
+            slot = freeSlot;
+            memAccess = lookup;
+        }
+    }
+    if(slot != NO_MSHR && ex_mem.control.memRead && ex_mem.rd != 0)
+        regMshr[ex_mem.rd] = (unsigned char)slot;
+    if(dprefetch.engine)
+        run_prefetcher(dcache, stats.dcache, dprefetch, ex_mem.pc, address,
+                       stats.dcache.misses != misses || stats.dcache.usefulPrefetches != useful);
+    return true;
+}
+
+// Free the MSHRs whose line has arrived, and the registers waiting on them
+void Simulator::complete_misses() {
+    for(unsigned int m = 0; m < dcache.config.mshrs; m++) {
+        if(!mshrs[m].valid || !access_done(mshrs[m].access))
+            continue;
+        mshrs[m].valid = false;
+        for(unsigned int r = 0; r < 32; r++) {
+            if(regMshr[r] == m)
+                regMshr[r] = NO_MSHR;
+        }
+    }
+}
+
+// True if inst reads a register a missing load has yet to fill, or would
+// overwrite one before the fill lands
+bool Simulator::waits_on_miss(const DecodedInst &inst) const {
+    if(dcache.config.mshrs == 0)
+        return false;
+    return ((inst.useMask & USES_RS1) && regMshr[inst.rs1] != NO_MSHR) ||
+           ((inst.useMask & USES_RS2) && regMshr[inst.rs2] != NO_MSHR) ||
+           (inst.control.regWrite && regMshr[inst.rd] != NO_MSHR);
+}
+
 //------------------------------------------------------
 // Memory Operation Stage
 //------------------------------------------------------
-void mem_op() {
-    if(!ex_mem.valid) {
+void Simulator::mem_op() {
+    const EX_MEM_Register &ex_mem = cur_latches().ex_mem;
+    MEM_WB_Register &mem_wb = next_latches().mem_wb;
+    if(!ex_mem.valid || stall_memory) {
         mem_wb.valid = false;
         return;
     }
     mem_wb.valid = true;
     mem_wb.pc = ex_mem.pc;
     mem_wb.instType = ex_mem.instType;
-    mem_wb.subType = ex_mem.subType;
+    mem_wb.op = ex_mem.op;
     mem_wb.rd = ex_mem.rd;
     mem_wb.aluResult = ex_mem.aluResult;
     mem_wb.control = ex_mem.control;
     mem_wb.instructionWord = ex_mem.instructionWord;
     mem_wb.instructionNum = ex_mem.instructionNum;
     mem_wb.memData = 0;
-    if(ex_mem.control.memRead) {
+    mem_wb.traced = ex_mem.traced;
+    if(ex_mem.control.memRead || ex_mem.control.memWrite) {
         unsigned int address = ex_mem.memAddress;
-        if(address >= STACK_BOTTOM && address <= STACK_TOP) {
-            unsigned int stack_index = (STACK_TOP - address) / 4;
-            if(stack_index < STACK_MEMORY_SIZE) {
-                if(ex_mem.subType=="lw")
-                    mem_wb.memData = STACKMEM[stack_index];
-                else if(ex_mem.subType=="lh") {
-                    int halfword = (STACKMEM[stack_index] >> ((address % 4) * 8)) & 0xFFFF;
-                    mem_wb.memData = (halfword & 0x8000) ? (halfword | 0xFFFF0000) : halfword;
-                }
-                else if(ex_mem.subType=="lb") {
-                    int byte = (STACKMEM[stack_index] >> ((address % 4) * 8)) & 0xFF;
-                    mem_wb.memData = (byte & 0x80) ? (byte | 0xFFFFFF00) : byte;
-                }
-                else if(ex_mem.subType=="lhu")
-                    mem_wb.memData = (STACKMEM[stack_index] >> ((address % 4) * 8)) & 0xFFFF;
-                else if(ex_mem.subType=="lbu")
-                    mem_wb.memData = (STACKMEM[stack_index] >> ((address % 4) * 8)) & 0xFF;
-            }
-            else {
-                cout << "Error: Stack memory access out of bounds at address 0x" << hex << address << endl;
-            }
-        }
-        else {
-            unsigned int data_index = (address - DATA_MEMORY_BASE) / 4;
-            if(data_index < DATA_MEMORY_SIZE) {
-                if(ex_mem.subType=="lw")
-                    mem_wb.memData = DMEM[data_index];
-                else if(ex_mem.subType=="lh") {
-                    int halfword = (DMEM[data_index] >> ((address % 4) * 8)) & 0xFFFF;
-                    mem_wb.memData = (halfword & 0x8000) ? (halfword | 0xFFFF0000) : halfword;
-                }
-                else if(ex_mem.subType=="lb") {
-                    int byte = (DMEM[data_index] >> ((address % 4) * 8)) & 0xFF;
-                    mem_wb.memData = (byte & 0x80) ? (byte | 0xFFFFFF00) : byte;
-                }
-                else if(ex_mem.subType=="lhu")
-                    mem_wb.memData = (DMEM[data_index] >> ((address % 4) * 8)) & 0xFFFF;
-                else if(ex_mem.subType=="lbu")
-                    mem_wb.memData = (DMEM[data_index] >> ((address % 4) * 8)) & 0xFF;
-            }
-            else {
-                cout << "Error: Data memory access out of bounds at address 0x" << hex << address << endl;
-            }
-        }
-    }
-    else if(ex_mem.control.memWrite) {
-        unsigned int address = ex_mem.memAddress;
-        int data = ex_mem.rs2Value;
-        if(address >= STACK_BOTTOM && address <= STACK_TOP) {
-            unsigned int stack_index = (STACK_TOP - address) / 4;
-            if(stack_index < STACK_MEMORY_SIZE) {
-                if(ex_mem.subType=="sw")
-                    STACKMEM[stack_index] = data;
-                else if(ex_mem.subType=="sh") {
-                    unsigned int shift = (address % 4)*8;
-                    unsigned int mask = ~(0xFFFF << shift);
-                    STACKMEM[stack_index] = (STACKMEM[stack_index] & mask) | ((data & 0xFFFF) << shift);
-                }
-                else if(ex_mem.subType=="sb") {
-                    unsigned int shift = (address % 4)*8;
-                    unsigned int mask = ~(0xFF << shift);
-                    STACKMEM[stack_index] = (STACKMEM[stack_index] & mask) | ((data & 0xFF) << shift);
-                }
-            }
-            else {
-                cout << "Error: Stack memory access out of bounds at address 0x" << hex << address << endl;
-            }
+        if(ex_mem.control.memRead) {
+            mem_wb.memData = ex_mem.traced ? ex_mem.loadValue : MEM_LOADS[ex_mem.op - OP_LB](guestMem, address);
+            if(debugArmed)
+                check_watchpoints(ex_mem.pc, address, ex_mem.op, false, 0);
         }
-        else {
-            unsigned int data_index = (address - DATA_MEMORY_BASE) / 4;
-            if(data_index < DATA_MEMORY_SIZE) {
-                if(ex_mem.subType=="sw")
-                    DMEM[data_index] = data;
-                else if(ex_mem.subType=="sh") {
-                    unsigned int shift = (address % 4)*8;
-                    unsigned int mask = ~(0xFFFF << shift);
-                    DMEM[data_index] = (DMEM[data_index] & mask) | ((data & 0xFFFF) << shift);
-                }
-                else if(ex_mem.subType=="sb") {
-                    unsigned int shift = (address % 4)*8;
-                    unsigned int mask = ~(0xFF << shift);
-                    DMEM[data_index] = (DMEM[data_index] & mask) | ((data & 0xFF) << shift);
-                }
-            }
-            else {
-                cout << "Error: Data memory access out of bounds at address 0x" << hex << address << endl;
-            }
+        // A traced store is already done; only one that fetch must see (into
+        // the code segment) or a watchpoint must compare is made here too
+        else if(!ex_mem.traced || address < sz * 4 || debugArmed) {
+            unsigned int before = debugArmed ? watched_bytes(address, ex_mem.op) : 0;
+            MEM_STORES[ex_mem.op - OP_SB](guestMem, address, ex_mem.rs2Value);
+            if(address < sz * 4) // Store into the code segment: refresh its decoded records
+                predecode_range(address / 4, (address + 3) / 4 + 1);
+            if(debugArmed)
+                check_watchpoints(ex_mem.pc, address, ex_mem.op, true, before);
         }
     }
     
@@ -1819,23 +2551,23 @@ void mem_op() {
         currentTrace.memoryCycle = clockCycles + 1;
         currentTrace.memoryResult = mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult;
         
-        cout << "\nMEMORY at cycle " << dec << clockCycles + 1 << endl;
+        console << "\nMEMORY at cycle " << dec << clockCycles + 1 << endl;
         // Contents of Mem/WB buffer are ...
-        cout<<"Contents of Mem/WB buffer are: " << endl;
-        cout << "  PC: 0x" << hex << mem_wb.pc << dec << endl;
-        cout << "  Instruction: 0x" << hex << mem_wb.instructionWord << dec << endl;
-        cout << "  Instruction Type: " << mem_wb.instType << endl;
-        cout << "  Subtype: " << mem_wb.subType << endl;
-        cout << "  ALU Result: " << dec << mem_wb.aluResult << " (0x" << hex << mem_wb.aluResult << dec << ")" << endl;
+        console<<"Contents of Mem/WB buffer are: " << endl;
+        console << "  PC: 0x" << hex << mem_wb.pc << dec << endl;
+        console << "  Instruction: 0x" << hex << mem_wb.instructionWord << dec << endl;
+        console << "  Instruction Type: " << mem_wb.instType << endl;
+        console << "  Subtype: " << OP_NAMES[mem_wb.op] << endl;
+        console << "  ALU Result: " << dec << mem_wb.aluResult << " (0x" << hex << mem_wb.aluResult << dec << ")" << endl;
         
         if (mem_wb.control.memRead) {
-            cout << "  Memory Read: Address 0x" << hex << ex_mem.memAddress 
-                 << ", Data " << dec << mem_wb.memData << endl;
+            console << "  Memory Read: Address 0x" << hex << ex_mem.memAddress 
+                    << ", Data " << dec << mem_wb.memData << endl;
         } else if (ex_mem.control.memWrite) {
-            cout << "  Memory Write: Address 0x" << hex << ex_mem.memAddress 
-                 << ", Data " << dec << ex_mem.rs2Value << endl;
+            console << "  Memory Write: Address 0x" << hex << ex_mem.memAddress 
+                    << ", Data " << dec << ex_mem.rs2Value << endl;
         } else {
-            cout << "  No memory operation" << endl;
+            console << "  No memory operation" << endl;
         }
     }
 
@@ -1844,31 +2576,38 @@ void mem_op() {
 //------------------------------------------------------
 // Write-Back Stage
 //------------------------------------------------------
-void write_back() {
-    if(!mem_wb.valid)
+void Simulator::write_back() {
+    const MEM_WB_Register &mem_wb = cur_latches().mem_wb;
+    const EX_MEM_Register &ex_mem = cur_latches().ex_mem;
+    WB_Complete_Register &wb_complete = next_latches().wb_complete;
+    if(!mem_wb.valid) {
+        wb_complete = cur_latches().wb_complete; // Keep showing the last completed instruction
         return;
+    }
     if(mem_wb.control.regWrite) {
         if(mem_wb.rd != 0) {
-            if(mem_wb.control.memToReg)
-                X[mem_wb.rd] = mem_wb.memData;
-            else
-                X[mem_wb.rd] = mem_wb.aluResult;
+            // Trace-driven: the functional stream owns the architectural registers
+            if(!mem_wb.traced)
+                X[mem_wb.rd] = mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult;
             if(knobs.printPipelineRegisters) {
-                cout << "Write-Back: Writing " << (mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult)
-                     << " to register x" << mem_wb.rd << endl;
+                console << "Write-Back: Writing " << (mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult)
+                        << " to register x" << mem_wb.rd << endl;
             }
         } else if(knobs.printPipelineRegisters)
-            cout << "Write-Back: Write to x0 ignored" << endl;
+            console << "Write-Back: Write to x0 ignored" << endl;
     } else if(knobs.printPipelineRegisters)
-        cout << "Write-Back: No register write" << endl;
+        console << "Write-Back: No register write" << endl;
 
     // Add at the end of write_back() function, before the trace code
     // This ensures we're tracking what just completed writeback
     if(mem_wb.valid) {
+        stats.instructionsRetired++;
+        if(debugArmed && pc_break_set(retireBreakBits, mem_wb.pc))
+            record_debug_hit(STOP_RETIRE, mem_wb.pc, 0, 0, 0);
         wb_complete.valid = true;
         wb_complete.pc = mem_wb.pc;
         wb_complete.instType = mem_wb.instType;
-        wb_complete.subType = mem_wb.subType;
+        wb_complete.op = mem_wb.op;
         wb_complete.rd = mem_wb.rd;
         wb_complete.regWrite = mem_wb.control.regWrite;
         wb_complete.destReg = mem_wb.rd;
@@ -1892,36 +2631,36 @@ void write_back() {
         currentTrace.writebackCycle = clockCycles;
         currentTrace.writebackResult = mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult;
         
-        cout << "\nWRITE-BACK at cycle " << dec << clockCycles << endl;
+        console << "\nWRITE-BACK at cycle " << dec << clockCycles << endl;
         if (mem_wb.control.regWrite && mem_wb.rd != 0) {
-            cout << "  Register Write: x" << dec << mem_wb.rd << " = " << dec 
-                 << (mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult) 
-                 << " (0x" << hex << (mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult) << dec << ")" << endl;
+            console << "  Register Write: x" << dec << mem_wb.rd << " = " << dec 
+                    << (mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult) 
+                    << " (0x" << hex << (mem_wb.control.memToReg ? mem_wb.memData : mem_wb.aluResult) << dec << ")" << endl;
         } else {
-            cout << "  No register write" << endl;
+            console << "  No register write" << endl;
         }
         
         // Print full trace summary
-        cout << "\n--- TRACE SUMMARY:"<<endl;
-        cout<<" Instruction " << currentTrace.instructionNum 
+        console << "\n--- TRACE SUMMARY:"<<endl;
+        console<<" Instruction " << currentTrace.instructionNum 
              << " (0x" << hex << currentTrace.instruction << dec << ") ---" << endl;
-        cout << "  PC: 0x" << hex << currentTrace.pc << dec << endl;
-        cout << "  Fetch Cycle: " << currentTrace.fetchCycle << endl;
-        cout << "  Decode Cycle: " << currentTrace.decodeCycle << endl;
-        cout << "  Execute Cycle: " << currentTrace.executeCycle << endl;
-        cout << "  Memory Cycle: " << currentTrace.memoryCycle << endl;
-        cout << "  Writeback Cycle: " << currentTrace.writebackCycle << endl;
-        cout << "  Total Cycles in Pipeline: " 
-             << (currentTrace.writebackCycle - currentTrace.fetchCycle + 1) << endl;
+        console << "  PC: 0x" << hex << currentTrace.pc << dec << endl;
+        console << "  Fetch Cycle: " << currentTrace.fetchCycle << endl;
+        console << "  Decode Cycle: " << currentTrace.decodeCycle << endl;
+        console << "  Execute Cycle: " << currentTrace.executeCycle << endl;
+        console << "  Memory Cycle: " << currentTrace.memoryCycle << endl;
+        console << "  Writeback Cycle: " << currentTrace.writebackCycle << endl;
+        console << "  Total Cycles in Pipeline: " 
+                << (currentTrace.writebackCycle - currentTrace.fetchCycle + 1) << endl;
         
                // Define NUM_REGISTERS if not already defined
         #define NUM_REGISTERS 32
         
         // Contents of RegisterFile are ...
-        cout << "  Register File Contents:" << endl;
+        console << "  Register File Contents:" << endl;
         for (int i = 0; i < NUM_REGISTERS; i++) {
-            cout << "    x" << dec << i << ": " << dec << X[i] 
-                 << " (0x" << hex << X[i] << ")" << endl;
+            console << "    x" << dec << i << ": " << dec << X[i] 
+                    << " (0x" << hex << X[i] << ")" << endl;
         }
         // Reset for next instruction to trace
         currentTrace = InstructionTrace();
@@ -1932,45 +2671,198 @@ void write_back() {
 //------------------------------------------------------
 // Pipeline Register Update (Shifting)
 //------------------------------------------------------
-void update_pipeline() {
-    WB_Complete_Register new_wb_complete = wb_complete;  // Add this line
-    MEM_WB_Register new_mem_wb = mem_wb;
-    EX_MEM_Register new_ex_mem = ex_mem;
-    ID_EX_Register new_id_ex = id_ex;
-    IF_ID_Register new_if_id = if_id;
+void Simulator::update_pipeline() {
+    const PipelineLatches &stages = cur_latches();
+    PipelineLatches &next = next_latches();
     if(flush_pipeline) {
-        new_if_id.valid = false;
-        new_id_ex.valid = false;
+        next.if_id.valid = false;
+        next.id_ex.valid = false;
         flush_pipeline = false;
         pc = nextPC;
         if(knobs.printPipelineRegisters) {
-            cout << "Pipeline Flush: New PC = 0x" << hex << pc << endl;
+            console << "Pipeline Flush: New PC = 0x" << hex << pc << endl;
         }
     }
     if(stall_decode) {
-        new_id_ex.valid = false;
-        new_if_id = if_id;
-        stats.totalStalls++;
-        stats.dataHazardStalls++;
+        next.id_ex.valid = false;
+        next.if_id = stages.if_id;
+        if(!stall_miss_use) { // Already counted by hazardDetection()
+            stats.totalStalls++;
+            stats.dataHazardStalls++;
+        }
     }
     if(stall_fetch) {
-        new_if_id = if_id;
-        stats.totalStalls++;
+        next.if_id = stages.if_id;
+        if(!stall_miss_use)
+            stats.totalStalls++;
     }
-    wb_complete = new_wb_complete;  // Add this line
-    mem_wb = new_mem_wb;
-    ex_mem = new_ex_mem;
-    id_ex = new_id_ex;
-    if_id = new_if_id;
+    if(stall_memory) {
+        next.if_id = stages.if_id;
+        next.id_ex = stages.id_ex;
+        next.ex_mem = stages.ex_mem;
+    }
+    latches.cur ^= 1; // The next bank becomes visible
     stall_decode = false;
     stall_fetch = false;
+    stall_memory = false;
+    stall_miss_use = false;
     stats.totalCycles = clockCycles;
 }
  
+//------------------------------------------------------
+// Functional Fast-Forward Engine
+//------------------------------------------------------
+// Executes instructions architecturally, one per call, straight from
+// PREDECODED[] with ALU_FUNCS and the load/store tables: no latches, hazards
+// or timing. The registers, guest memory and pc it leaves behind are exactly
+// what the pipelined core needs to carry on from. Returns false when pc is
+// outside the program or at an unknown opcode (the end-of-program marker).
+bool Simulator::functional_step(bool warmPredictor, RetiredInst *retired) {
+    if((unsigned int)pc >= sz * 4)
+        return false;
+    const DecodedInst &d = PREDECODED[pc / 4];
+    if(d.instType == 0)
+        return false;
+
+    int operand1 = X[d.rs1];
+    int operand2 = d.control.aluSrc ? d.immediate : (int)X[d.rs2];
+    unsigned int next = pc + 4;
+    int result;
+    if(d.op >= OP_LB && d.op <= OP_LHU) {
+        result = MEM_LOADS[d.op - OP_LB](guestMem, alu_add(operand1, d.immediate));
+    }
+    else if(d.op >= OP_SB && d.op <= OP_SW) {
+        unsigned int address = alu_add(operand1, d.immediate);
+        MEM_STORES[d.op - OP_SB](guestMem, address, X[d.rs2]);
+        if(address < sz * 4) // Store into the code segment: refresh its decoded records
+            predecode_range(address / 4, (address + 3) / 4 + 1);
+        result = 0;
+    }
+    else if(d.op >= OP_BEQ && d.op <= OP_BGEU) {
+        bool taken = ALU_FUNCS[d.op](operand1, operand2) != 0;
+        if(taken)
+            next = pc + d.immediate;
+        if(warmPredictor)
+            resolve_prediction(pc, true, taken, next, predict_next_pc(pc, false));
+        result = 0;
+    }
+    else if(d.op == OP_JAL || d.op == OP_JALR) {
+        result = pc + 4;
+        next = (d.op == OP_JAL) ? pc + d.immediate : (alu_add(operand1, d.immediate) & ~1);
+        if(warmPredictor) {
+            bool fromRAS;
+            resolve_prediction(pc, false, true, next, predict_jump_target(pc, predict_next_pc(pc, false), false, fromRAS));
+            if(d.op == OP_JALR && !is_return(d.rd, d.rs1) && ITC.enabled())
+                ITC.update(pc, next);
+        }
+    }
+    else if(d.op == OP_LUI) {
+        result = d.immediate;
+    }
+    else if(d.op == OP_AUIPC) {
+        result = pc + d.immediate;
+    }
+    else {
+        result = ALU_FUNCS[d.op](operand1, operand2);
+    }
+
+    if(retired) {
+        retired->pc = pc;
+        retired->nextPC = next;
+        retired->result = result;
+        retired->storeData = X[d.rs2];
+        retired->memAddress = alu_add(operand1, d.immediate);
+        retired->taken = (next != (unsigned int)pc + 4);
+    }
+    if(d.control.regWrite && d.rd != 0)
+        X[d.rd] = result;
+    pc = next;
+    return true;
+}
+
+// Run up to `count` instructions functionally, then leave the pipeline empty
+// and pointed at the next instruction so cycle-level simulation resumes there.
+unsigned int Simulator::fast_forward(unsigned int count, bool warmPredictor) {
+    unsigned int done = 0;
+    while(done < count && functional_step(warmPredictor))
+        done++;
+    reset_latches();
+    stall_fetch = false;
+    stall_decode = false;
+    flush_pipeline = false;
+    nextPC = pc;
+    tempResults = TempResults();
+    stats.fastForwarded += done;
+    return done;
+}
+
+// Apply --fast-forward (if any) to a freshly loaded program
+void Simulator::apply_fast_forward() {
+    if(knobs.fastForward == 0)
+        return;
+    unsigned int done = fast_forward(knobs.fastForward, knobs.fastForwardWarmBP);
+    console << "Fast-forwarded " << dec << done << " instructions; detailed simulation starts at PC 0x"
+            << hex << pc << dec << endl;
+}
+ 
 //------------------------------------------------------
 // Print Final Statistics Report and Dump State Files
 //------------------------------------------------------
-void printFinalStatistics() {
+// One block per enabled cache; only the L1s stall the pipeline themselves
+static void print_cache_stats(ostream &oss, const char *name, const Cache &cache, const CacheStats &counters,
+                              bool stalls) {
+    if (!cache.enabled())
+        return;
+    unsigned int accesses = counters.hits + counters.misses;
+    double missRate = (accesses > 0) ? 100.0 * counters.misses / accesses : 0.0;
+    oss << name << " Cache: " << cache.config.size << " B, " << cache.config.ways << "-way, "
+        << cache.config.lineSize << " B lines" << endl;
+    oss << name << " Hits: " << counters.hits << ", Misses: " << counters.misses
+        << " (" << setprecision(1) << missRate << "% miss rate)" << endl;
+    oss << name << " Evictions: " << counters.evictions << ", Writebacks: " << counters.writebacks
+        << ", Write-Throughs: " << counters.writeThroughs << endl;
+    if (stalls)
+        oss << name << " Stall Cycles: " << counters.stallCycles << endl;
+}
+
+// Accuracy: prefetched lines used; coverage: misses they took the place of;
+// timeliness: of the used ones, those that were in before the demand access
+static void print_prefetch_stats(ostream &oss, const string &name, const PrefetchUnit &prefetch,
+                                 const CacheStats &counters) {
+    if (!prefetch.engine)
+        return;
+    double accuracy = (counters.prefetches > 0) ? 100.0 * counters.usefulPrefetches / counters.prefetches : 0.0;
+    unsigned int wouldMiss = counters.usefulPrefetches + counters.misses;
+    double coverage = (wouldMiss > 0) ? 100.0 * counters.usefulPrefetches / wouldMiss : 0.0;
+    double timeliness = (counters.usefulPrefetches > 0) ?
+                        100.0 * (counters.usefulPrefetches - counters.latePrefetches) / counters.usefulPrefetches : 0.0;
+    oss << name << " Prefetcher: " << prefetcher_name(prefetch.config.kind) << ", degree " << prefetch.config.degree
+        << ", distance " << prefetch.config.distance << endl;
+    oss << name << " Prefetches: " << counters.prefetches << ", Useful: " << counters.usefulPrefetches
+        << ", Late: " << counters.latePrefetches << ", Dropped: " << counters.droppedPrefetches << endl;
+    oss << name << " Prefetch Accuracy: " << setprecision(1) << accuracy << "%, Coverage: " << coverage
+        << "%, Timeliness: " << timeliness << "%" << endl;
+}
+
+static void print_dram_stats(ostream &oss, const DramController &dram, const DramStats &counters,
+                             unsigned int cycles) {
+    if (!dram.enabled())
+        return;
+    unsigned int requests = counters.reads + counters.writes;
+    unsigned int issued = counters.rowHits + counters.rowEmpty + counters.rowConflicts;
+    double rowHitRate = (issued > 0) ? 100.0 * counters.rowHits / issued : 0.0;
+    double latency = (issued > 0) ? (double)counters.latencyCycles / issued : 0.0;
+    double utilisation = (cycles > 0) ? 100.0 * counters.busBusyCycles / ((double)cycles * dram.config.channels) : 0.0;
+    oss << "DRAM: " << dram.config.channels << " channel(s) x " << dram.config.banks << " banks, "
+        << (dram.config.rowPolicy == ROW_OPEN ? "open" : "closed") << "-row" << endl;
+    oss << "DRAM Requests: " << requests << " (Reads: " << counters.reads << ", Writes: " << counters.writes << ")" << endl;
+    oss << "DRAM Row Hits: " << counters.rowHits << ", Empty: " << counters.rowEmpty << ", Conflicts: "
+        << counters.rowConflicts << " (" << setprecision(1) << rowHitRate << "% row-hit rate)" << endl;
+    oss << "DRAM Average Latency: " << setprecision(2) << latency << " cycles" << endl;
+    oss << "DRAM Bandwidth Utilisation: " << setprecision(1) << utilisation << "%" << endl;
+}
+
+void Simulator::printFinalStatistics() {
     ostringstream oss;
     oss << "-------------------------------------" << endl;
     oss << "Simulation Finished" << endl;
@@ -1979,9 +2871,17 @@ void printFinalStatistics() {
         // Non-pipelined statistics
         double CPI_np = 1.0; // Always 1.0 in non-pipelined
         oss << "Execution Mode: Non-Pipelined" << endl;
-        oss << "Total Cycles: " << clockCycles_np << endl;
-        oss << "Instructions Executed: " << sz_np << endl;
+        oss << "Total Cycles: " << functionalCore.clockCycles_np << endl;
+        oss << "Instructions Executed: " << functionalCore.clockCycles_np << endl;
         oss << "CPI: " << fixed << setprecision(2) << CPI_np << endl;
+        static const char *tierNames[TIER_COUNT] = {"Interpreted", "Threaded", "JIT"};
+        for (int t = 0; t < TIER_COUNT; t++) {
+            double share = (functionalCore.clockCycles_np > 0) ? 100.0 * functionalCore.tierStats_np.instructions[t] / functionalCore.clockCycles_np : 0.0;
+            oss << tierNames[t] << " Instructions: " << functionalCore.tierStats_np.instructions[t]
+                << " (" << setprecision(1) << share << "%)" << endl;
+        }
+        oss << "Blocks Promoted to Threaded: " << functionalCore.tierStats_np.promotions[TIER_THREADED] << endl;
+        oss << "Blocks Promoted to JIT: " << functionalCore.tierStats_np.promotions[TIER_JIT] << endl;
     } else {
         // Pipelined statistics
         double CPI = (stats.instructionsExecuted > 0) ? 
@@ -1996,17 +2896,45 @@ void printFinalStatistics() {
         oss << "Total Stalls: " << stats.totalStalls << endl;
         oss << "Data Hazard Stalls: " << stats.dataHazardStalls << endl;
         oss << "Control Hazard Stalls: " << stats.controlHazardStalls << endl;
+        if (dcache.enabled() && dcache.config.mshrs > 0)
+            oss << "MSHR-Full Stalls: " << stats.mshrFullStalls << endl;
         oss << "Data Hazards Detected: " << stats.dataHazardCount << endl;
         oss << "Control Hazards Detected: " << stats.controlHazardCount << endl;
         oss << "Branch Mispredictions: " << stats.branchMispredCount << endl;
+        oss << "Conditional Branch Mispredictions: " << stats.conditionalMispredCount << endl;
+        if (stats.indirectJumps > 0)
+            oss << "Indirect Jumps: " << stats.indirectJumps << ", Mispredicted: " << stats.indirectMispredCount << endl;
+        if (knobs.predictor != PREDICT_NOT_TAKEN)
+            oss << "BTB Hits: " << stats.btbHits << ", Misses: " << stats.btbMisses << endl;
+        if (RAS.depth() > 0) {
+            double accuracy = (stats.rasPredictions > 0) ?
+                              100.0 * (stats.rasPredictions - stats.rasMispredictions) / stats.rasPredictions : 0.0;
+            oss << "RAS Returns Predicted: " << stats.rasPredictions << ", Correct: "
+                << stats.rasPredictions - stats.rasMispredictions << " (" << setprecision(1) << accuracy << "%)" << endl;
+            oss << "RAS Overflows: " << stats.rasOverflows << ", Underflows: " << stats.rasUnderflows << endl;
+        }
+        print_cache_stats(oss, "L1-I", icache, stats.icache, true);
+        print_prefetch_stats(oss, "L1-I", iprefetch, stats.icache);
+        print_cache_stats(oss, "L1-D", dcache, stats.dcache, true);
+        print_prefetch_stats(oss, "L1-D", dprefetch, stats.dcache);
+        if (dcache.enabled() && dcache.config.mshrs > 0)
+            oss << "L1-D MSHRs: " << dcache.config.mshrs << ", Merged Misses: " << stats.mshrMerges
+                << ", Miss-Use Stalls: " << stats.missUseStalls << endl;
+        print_cache_stats(oss, "L2", l2, stats.l2, false);
+        print_dram_stats(oss, dram, stats.dram, stats.totalCycles);
+        if (stats.memoryFills > 0 && (l2.enabled() || dram.enabled()))
+            oss << "Average Memory Latency: " << setprecision(2) << (double)stats.memoryFillCycles / stats.memoryFills
+                << " cycles over " << stats.memoryFills << " L1 misses" << endl;
+        if (stats.fastForwarded > 0)
+            oss << "Fast-Forwarded Instructions: " << stats.fastForwarded << endl;
     }
     
-    cout << oss.str();
+    console << oss.str();
     ofstream outfile("stats.out");
     if(outfile.is_open()){
         outfile << oss.str();
         outfile.close();
-        cout << "Final statistics written to stats.out" << endl;
+        console << "Final statistics written to stats.out" << endl;
     }
     else {
         cerr << "Error: Could not open stats.out for writing." << endl;
@@ -2015,22 +2943,8 @@ void printFinalStatistics() {
     // Dump state files
     if (!knobs.pipeliningEnabled) {
         // Use non-pipelined dumping functions
-        FILE *fp = fopen("register.mem", "w");
-        if (fp) {
-            for (unsigned int i = 0; i < 32; i++) {
-                fprintf(fp, "x%u - %u\n", i, X_np[i]);
-            }
-            fclose(fp);
-        }
-        
-        fp = fopen("D_Memory.mem", "w");
-        if (fp) {
-            // Print DMEM
-            for (unsigned int i = 0; i < 50; i++) {
-                fprintf(fp, "Addr 0x%08x: 0x%08x\n", 0x10000000 + i*4, DMEM_np[i]);
-            }
-            fclose(fp);
-        }
+        functionalCore.load_resister_np();
+        functionalCore.load_Memory_np();
     } else {
         // Use pipelined dumping functions
         dump_registers();
@@ -2039,63 +2953,472 @@ void printFinalStatistics() {
     }
 }
  
+//------------------------------------------------------
+// Simulator Reset and Cycle Driver
+//------------------------------------------------------
+// Put registers, memory, predictor and pipeline back in their power-on state
+void Simulator::reset_simulator() {
+    memset(X, 0, sizeof(X));
+    guestMem.clear();
+    pageFileValid = false; // Page slots restart with the touched list
+    initializeBranchPredictor();
+    initializeCaches();
+    X[2] = STACK_TOP; // Stack pointer initialization
+    pc = 0;           // Start from PC 0
+    clockCycles = 0;  // Reset clock
+    instructionCounter = 0; // Reset counter
+    stats = {}; // Reset statistics
+    // Reset pipeline registers to initial state
+    reset_latches();
+    // Reset pipeline control flags
+    stall_fetch = false;
+    stall_decode = false;
+    flush_pipeline = false;
+    nextPC = 0;
+    // Reset temp results
+    tempResults = TempResults();
+    snapshots.clear();
+}
+
+bool Simulator::programFinished() {
+    return (unsigned int)pc >= sz * 4 && pipelineEmpty();
+}
+
+// Advance the pipelined core by one clock cycle
+void Simulator::run_cycle() {
+    tempResults.clear(); // Clear temp results at the start of the cycle
+    if(dram.enabled())
+        dram.tick(clockCycles, stats.dram);
+    if(iprefetch.engine)
+        complete_prefetches(iprefetch);
+    if(dprefetch.engine)
+        complete_prefetches(dprefetch);
+    stall_memory = dcache_busy(); // A D-cache wait freezes everything up to MEM
+    if(!stall_memory)
+        hazardDetection();
+    // Run stages in reverse order for correct data flow simulation within a cycle
+    write_back();
+    mem_op();
+    if(!stall_memory) {
+        execute();
+        decode();
+        if(!stall_fetch) fetch(); // Fetch depends on stall detection
+    }
+    update_pipeline();       // Shift pipeline registers
+
+    clockCycles++; // Increment clock *after* completing the cycle
+}
+
+// Optional per-cycle printing and snapshot capture for the run loops
+void Simulator::report_cycle() {
+    if(knobs.printPipelineRegisters) {
+         console << "\nPipeline State After Cycle " << clockCycles << ":" << endl;
+         outputPipelineStageDetails();
+         outputPipelineRegisterSummary();
+    }
+    if(knobs.printRegisterEachCycle) {
+         console << "\nRegister File After Cycle " << clockCycles << ":" << endl;
+         for(int i = 0; i < 32; i++){
+             console << "x" << i << " = 0x" << hex << X[i] << " (" << dec << X[i] << ")\t";
+             if((i+1) % 4 == 0) console << endl;
+         }
+         console << endl;
+    }
+    if(knobs.printBranchPredictorInfo) {
+         console << "\nBranch Predictor After Cycle " << clockCycles << ":" << endl;
+         printBranchPredictor();
+    }
+
+    if(knobs.saveCycleSnapshots) {
+         store_pipeline_snapshot();
+    }
+}
+
+
+RunResult Simulator::runUntil(RunLimit limit, unsigned int value) {
+    unsigned int startCycle = clockCycles;
+    debugHit.reason = STOP_NONE;
+    while(true) {
+        // Check termination condition *before* starting the cycle
+        if(programFinished())
+            return RUN_PROGRAM_FINISHED;
+        if((limit == RUN_CYCLES && clockCycles - startCycle >= value) ||
+           (limit == RUN_TO_CYCLE && clockCycles >= value) ||
+           (limit == RUN_TO_RETIRE && stats.instructionsRetired >= value))
+            return RUN_LIMIT_REACHED;
+
+        run_cycle();
+        report_cycle();
+
+        if(debugArmed && debugHit.reason != STOP_NONE)
+            return RUN_DEBUG_STOP;
+        if(limit == RUN_TO_PC && cur_latches().if_id.valid && cur_latches().if_id.pc == value)
+            return RUN_LIMIT_REACHED;
+        if(clockCycles > MAX_SIMULATION_CYCLES)
+            return RUN_CYCLE_CAP;
+    }
+}
+
+//------------------------------------------------------
+// Serve Mode: persistent simulator driven by line commands
+//------------------------------------------------------
+// One command per line and one reply per command. Replies start with "ok"
+// or "err <message>"; numbers may be decimal or 0x-prefixed hex.
+//   step [N]                     run N cycles (default 1)
+//   run-to pc|cycle|retire V     run until PC V is fetched / cycle V / V retired
+//   status                       cycle, PC, retired count and finished flag
+//   regs                         x0..x31 in hex
+//   mem ADDR WORDS               WORDS words starting at ADDR, in hex
+//   snapshot K                   pipeline state after cycle K, then "end"
+//   break fetch|retire ADDR      stop when ADDR is fetched / retires
+//   watch r|w|c ADDR [LEN]       stop on a read, write or value change in LEN bytes
+//   clear-breaks                 remove every breakpoint and watchpoint
+//   dump                         write register.mem, D_Memory.mem, stack_mem.mem, BP_info.txt
+//   reset                        reload the input program
+//   quit
+// Console logging is sent to stderr while serving.
+const unsigned int SERVE_MAX_MEM_WORDS = 65536;
+
+void Simulator::serve_status(ostream &out, bool stopped) {
+    out << "ok cycle=" << dec << clockCycles << " pc=0x" << hex << pc << dec
+        << " retired=" << stats.instructionsRetired
+        << " finished=" << (programFinished() ? 1 : 0);
+    if(stopped) {
+        out << " stop=";
+        describe_debug_hit(out);
+    }
+    out << "\n";
+}
+
+// "r", "w", "c" or a combination such as "rw"
+static bool parse_watch_kinds(const string &token, unsigned char &kinds) {
+    kinds = 0;
+    for(size_t i = 0; i < token.size(); i++) {
+        if(token[i] == 'r') kinds |= WATCH_READ;
+        else if(token[i] == 'w') kinds |= WATCH_WRITE;
+        else if(token[i] == 'c') kinds |= WATCH_CHANGE;
+        else return false;
+    }
+    return kinds != 0;
+}
+
+bool Simulator::serve_reset() {
+    reset_simulator();
+    if(!loadInputFile(knobs.inputFile))
+        return false;
+    apply_fast_forward();
+    return true;
+}
+
+// Handle one session; returns false once "quit" has been received
+bool Simulator::serve_session(istream &in, ostream &out) {
+    string line;
+    while(getline(in, line)) {
+        stringstream ss(line);
+        string cmd, arg1, arg2;
+        ss >> cmd >> arg1 >> arg2;
+        if(cmd.empty())
+            continue;
+
+        if(cmd == "step" || cmd == "run-to") {
+            RunLimit limit = RUN_CYCLES;
+            unsigned int value = 1;
+            bool ok = true;
+            if(cmd == "step")
+                ok = arg1.empty() || parse_number(arg1, value);
+            else {
+                if(arg1 == "pc") limit = RUN_TO_PC;
+                else if(arg1 == "cycle") limit = RUN_TO_CYCLE;
+                else if(arg1 == "retire") limit = RUN_TO_RETIRE;
+                else ok = false;
+                ok = ok && parse_number(arg2, value);
+            }
+            if(!ok) {
+                out << "err usage: step [N] | run-to pc|cycle|retire VALUE\n";
+            } else {
+                RunResult result = runUntil(limit, value);
+                if(result == RUN_PROGRAM_FINISHED && !finalReported) {
+                    printFinalStatistics();
+                    finalReported = true;
+                }
+                if(result == RUN_CYCLE_CAP)
+                    out << "err cycle limit exceeded\n";
+                else
+                    serve_status(out, result == RUN_DEBUG_STOP);
+            }
+        }
+        else if(cmd == "status") {
+            serve_status(out);
+        }
+        else if(cmd == "regs") {
+            out << "ok" << hex;
+            for(int i = 0; i < 32; i++)
+                out << " " << X[i];
+            out << dec << "\n";
+        }
+        else if(cmd == "mem") {
+            unsigned int address, words;
+            if(!parse_number(arg1, address) || !parse_number(arg2, words) || words > SERVE_MAX_MEM_WORDS) {
+                out << "err usage: mem ADDR WORDS (at most " << SERVE_MAX_MEM_WORDS << " words)\n";
+            } else if((unsigned long long)address + 4ULL * words > 0x100000000ULL) {
+                out << "err range runs past 0xFFFFFFFF\n";
+            } else {
+                out << "ok" << hex;
+                for(unsigned int i = 0; i < words; i++)
+                    out << " " << guestMem.load32(address + i * 4);
+                out << dec << "\n";
+            }
+        }
+        else if(cmd == "snapshot") {
+            unsigned int cycle;
+            if(!parse_number(arg1, cycle) || cycle == 0 || cycle > snapshots.size()) {
+                out << "err no snapshot for cycle " << arg1 << "\n";
+            } else {
+                out << "ok\n";
+                write_pipeline_snapshot(out, snapshots[cycle - 1]);
+                out << "end\n";
+            }
+        }
+        else if(cmd == "break") {
+            unsigned int address;
+            if((arg1 != "fetch" && arg1 != "retire") || !parse_number(arg2, address)) {
+                out << "err usage: break fetch|retire ADDR\n";
+            } else if(!set_pc_breakpoint(address, arg1 == "retire")) {
+                out << "err address is outside the code segment\n";
+            } else {
+                out << "ok\n";
+            }
+        }
+        else if(cmd == "watch") {
+            unsigned char kinds;
+            unsigned int address, length = 4;
+            string arg3;
+            ss >> arg3;
+            if(!parse_watch_kinds(arg1, kinds) || !parse_number(arg2, address) ||
+               (!arg3.empty() && !parse_number(arg3, length))) {
+                out << "err usage: watch r|w|c ADDR [LEN]\n";
+            } else {
+                add_watchpoint(address, length, kinds);
+                out << "ok\n";
+            }
+        }
+        else if(cmd == "clear-breaks") {
+            clear_debug_points();
+            out << "ok\n";
+        }
+        else if(cmd == "dump") {
+            dump_registers();
+            dump_memory();
+            dump_BP();
+            out << "ok\n";
+        }
+        else if(cmd == "reset") {
+            finalReported = false;
+            if(serve_reset())
+                serve_status(out);
+            else
+                out << "err could not load " << knobs.inputFile << "\n";
+        }
+        else if(cmd == "quit") {
+            out << "ok\n";
+            out.flush();
+            return false;
+        }
+        else {
+            out << "err unknown command '" << cmd << "'\n";
+        }
+        out.flush();
+    }
+    return true;
+}
+
+#ifndef _WIN32
+// Minimal streambuf over a file descriptor, used for socket sessions
+class FdStreamBuf : public streambuf {
+public:
+    explicit FdStreamBuf(int fd) : fd(fd) {
+        setg(inBuf, inBuf, inBuf);
+        setp(outBuf, outBuf + sizeof(outBuf));
+    }
+    ~FdStreamBuf() { sync(); }
+
+protected:
+    int underflow() {
+        ssize_t n = read(fd, inBuf, sizeof(inBuf));
+        if(n <= 0)
+            return traits_type::eof();
+        setg(inBuf, inBuf, inBuf + n);
+        return traits_type::to_int_type(*gptr());
+    }
+    int overflow(int c) {
+        if(sync() != 0)
+            return traits_type::eof();
+        if(c != traits_type::eof()) {
+            *pptr() = (char)c;
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+    int sync() {
+        for(char *p = pbase(); p < pptr(); ) {
+            ssize_t n = write(fd, p, pptr() - p);
+            if(n <= 0)
+                return -1;
+            p += n;
+        }
+        setp(outBuf, outBuf + sizeof(outBuf));
+        return 0;
+    }
+
+private:
+    int fd;
+    char inBuf[4096];
+    char outBuf[4096];
+};
+
+// Accept clients on a Unix domain socket, one session at a time, until "quit"
+int Simulator::serve_socket(const string &path) {
+    sockaddr_un addr;
+    if(path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Error: Socket path '" << path << "' is too long." << endl;
+        return 1;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0) {
+        perror("Error creating serve socket");
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    if(bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 1) != 0) {
+        perror("Error binding serve socket");
+        close(listener);
+        return 1;
+    }
+    cerr << "Serving on " << path << endl;
+    bool running = true;
+    while(running) {
+        int client = accept(listener, NULL, NULL);
+        if(client < 0)
+            break;
+        {
+            FdStreamBuf buf(client);
+            iostream stream(&buf);
+            running = serve_session(stream, stream);
+        }
+        close(client);
+    }
+    close(listener);
+    unlink(path.c_str());
+    return 0;
+}
+#endif
+
+// `replies` is the original stdout buffer; console has already been pointed at stderr
+int Simulator::serve(streambuf *replies) {
+    int rc = 0;
+    if(knobs.serveSocket.empty()) {
+        ostream reply(replies);
+        serve_session(cin, reply);
+    } else {
+#ifndef _WIN32
+        rc = serve_socket(knobs.serveSocket);
+#else
+        cerr << "Error: --serve-socket is not supported on this platform; use --serve." << endl;
+        rc = 1;
+#endif
+    }
+    console.rdbuf(replies);
+    return rc;
+}
+ 
 //------------------------------------------------------
 // Main Simulation Loop (Alternate Main to Support --input Flag)
 //------------------------------------------------------
-int mainEntry(int argc, char *argv[]) {
+int Simulator::mainEntry(int argc, char *argv[]) {
     parseCommandLineArgs(argc, argv);
+    for (size_t i = 0; i < knobs.unknownOptions.size(); i++)
+        cerr << "Warning: Ignoring unknown option " << knobs.unknownOptions[i] << "." << endl;
+
+    // Batch, sweep and fan-out runs each get their own Simulators; this one only drives them
+    if (!knobs.batchFile.empty())
+        return run_batch(knobs, console);
+    if (!knobs.sweepFile.empty())
+        return run_sweep(knobs, console);
+    if (!knobs.fanoutFile.empty())
+        return run_fanout(knobs, console);
+
+    // Reserve the guest address space; pages are committed (zero-filled) on first touch
+    if (!guestMem.reserve()) {
+        cerr << "Error: Could not reserve the 4 GiB guest address space." << endl;
+        return 1;
+    }
+
+    if (knobs.serveMode && !knobs.pipeliningEnabled) {
+        cerr << "Critical Error: Serve mode requires the pipelined simulator. Exiting." << endl;
+        return 1;
+    }
+
+    // Replies own stdout while serving; everything the simulator logs goes to stderr
+    streambuf *replies = console.rdbuf();
+    if (knobs.serveMode)
+        console.rdbuf(cerr.rdbuf());
 
     // Determine mode (step or continuous)
-    bool step_mode = false;
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--step") == 0) {
-            step_mode = true;
-            break;
+    bool step_mode = knobs.stepMode && !knobs.serveMode;
+
+    // Non-pipelined execution has its own state, loader and state file format
+    if (!knobs.pipeliningEnabled) {
+        console << (step_mode ? "Step" : "Continuous")
+            << " mode: running non-pipelined simulator." << endl;
+
+        // Initialize non-pipelined simulator
+        functionalCore.reset_proc_np();
+        functionalCore.set_jit_np(knobs.jitEnabled);
+        
+        // Load program into non-pipelined memory
+        if (!knobs.inputFile.empty()) {
+            if (!functionalCore.load_program_memory_np(knobs.inputFile, false)) {
+                cerr << "Critical Error: Failed to load input file '" << knobs.inputFile << "'. Exiting." << endl;
+                return 1;
+            }
+        } else {
+            cerr << "Critical Error: No input file specified for non-pipelined mode." << endl;
+            return 1;
+        }
+
+        // Run in appropriate mode
+        if (step_mode) {
+            return functionalCore.run_step_np(); // Returns 0 to continue, 1 to exit
+        } else {
+            functionalCore.run_riscvsim_np(); // Runs until completion
+            printFinalStatistics();
+            return 0;
         }
     }
 
     bool stateLoaded = false;
     if (step_mode) {
-        cout << "Step mode activated. Attempting to load previous state..." << endl;
+        console << "Step mode activated. Attempting to load previous state..." << endl;
         stateLoaded = load_state();
         if (stateLoaded) {
-             cout << "State loaded. Proceeding with step execution." << endl;
+             console << "State loaded. Proceeding with step execution." << endl;
              // State is loaded, including memory. Do NOT re-initialize or reload input file.
         } else {
-            cout << "Failed to load state (or first run). Initializing simulator..." << endl;
+            console << "Failed to load state (or first run). Initializing simulator..." << endl;
             // Initialize memory, registers, BP ONLY if state load failed.
-            memset(X, 0, sizeof(X));
-            memset(MEM, 0, sizeof(MEM)); // Initialize instruction memory too
-            memset(DMEM, 0, sizeof(DMEM));
-            memset(STACKMEM, 0, sizeof(STACKMEM));
-            initializeBranchPredictor();
-            X[2] = STACK_TOP; // Stack pointer initialization
-            pc = 0;           // Start from PC 0
-            clockCycles = 0;  // Reset clock
-            instructionCounter = 0; // Reset counter
-            stats = {}; // Reset statistics
-            // Reset pipeline registers to initial state
-            if_id = {false, 0, 0, 0};
-            id_ex = {false, 0, '0', "", 0, 0, 0, 0, 0, 0, {false, false, false, false, false, false, false, 0}, 0, 0};
-            ex_mem = {false, 0, '0', "", 0, 0, 0, 0, false, {false, false, false, false, false, false, false, 0}, 0, 0};
-            mem_wb = {false, 0, '0', "", 0, 0, 0, {false, false, false, false, false, false, false, 0}, 0, 0};
-            wb_complete = {false, 0, '0', "", 0, 0, false, 0, 0}; // Add this line
-            // Reset pipeline control flags
-            stall_fetch = false;
-            stall_decode = false;
-            flush_pipeline = false;
-            nextPC = 0;
-            // Reset temp results
-            tempResults = TempResults();
-
+            reset_simulator();
 
             // If state load failed AND an input file is provided, load it now.
             if (!knobs.inputFile.empty()) {
-                cout << "Loading program from input file: " << knobs.inputFile << endl;
+                console << "Loading program from input file: " << knobs.inputFile << endl;
                 if (!loadInputFile(knobs.inputFile)) {
                     cerr << "Critical Error: Failed to load input file '" << knobs.inputFile << "' after failed state load. Exiting." << endl;
                     return 1;
                 }
+                apply_fast_forward();
             } else {
                 // If no state loaded and no input file, we can't run.
                  cerr << "Critical Error: Failed to load state and no input file specified via --input. Exiting." << endl;
@@ -2104,133 +3427,69 @@ int mainEntry(int argc, char *argv[]) {
         }
     } else {
         // Continuous mode: Always initialize and load the input file.
-        cout << "Continuous mode activated. Initializing simulator..." << endl;
-        memset(X, 0, sizeof(X));
-        memset(MEM, 0, sizeof(MEM));
-        memset(DMEM, 0, sizeof(DMEM));
-        memset(STACKMEM, 0, sizeof(STACKMEM));
-        initializeBranchPredictor();
-        X[2] = STACK_TOP; // Stack pointer initialization
-        pc = 0;           // Start from PC 0
-        clockCycles = 0;  // Reset clock
-        instructionCounter = 0; // Reset counter
-        stats = {}; // Reset statistics
-         // Reset pipeline registers to initial state
-        if_id = {false, 0, 0, 0};
-        id_ex = {false, 0, '0', "", 0, 0, 0, 0, 0, 0, {false, false, false, false, false, false, false, 0}, 0, 0};
-        ex_mem = {false, 0, '0', "", 0, 0, 0, 0, false, {false, false, false, false, false, false, false, 0}, 0, 0};
-        mem_wb = {false, 0, '0', "", 0, 0, 0, {false, false, false, false, false, false, false, 0}, 0, 0};
-         // Reset pipeline control flags
-        stall_fetch = false;
-        stall_decode = false;
-        flush_pipeline = false;
-        nextPC = 0;
-         // Reset temp results
-        tempResults = TempResults();
-
+        console << (knobs.serveMode ? "Serve" : "Continuous") << " mode activated. Initializing simulator..." << endl;
+        reset_simulator();
 
         if (!knobs.inputFile.empty()) {
-            cout << "Loading program from input file: " << knobs.inputFile << endl;
+            console << "Loading program from input file: " << knobs.inputFile << endl;
             if (!loadInputFile(knobs.inputFile)) {
                 cerr << "Critical Error: Failed to load input file '" << knobs.inputFile << "'. Exiting." << endl;
                 return 1;
             }
+            apply_fast_forward();
         } else {
             cerr << "Critical Error: No input file specified via --input for continuous run. Exiting." << endl;
             return 1;
         }
     }
 
-    // In the mainEntry function where you handle non-pipelined execution:
-    if (!knobs.pipeliningEnabled) {
-        cout << (step_mode ? "Step" : "Continuous")
-            << " mode: running non-pipelined simulator." << endl;
-
-        // Initialize non-pipelined simulator
-        reset_proc_np(); 
-        
-        // Load program into non-pipelined memory
-        if (!knobs.inputFile.empty()) {
-            // Fix: Pass only a boolean argument instead of string and boolean
-            load_program_memory_np(false);
-        } else {
-            cerr << "Critical Error: No input file specified for non-pipelined mode." << endl;
-            return 1;
-        }
-
-        // Run in appropriate mode
-        if (step_mode) {
-            return run_step_np(); // Returns 0 to continue, 1 to exit
-        } else {
-            run_riscvsim_np(); // Runs until completion
-            return 0;
-        }
+    if (knobs.serveMode) {
+        knobs.saveCycleSnapshots = true; // "snapshot K" reads the stored history
+        return serve(replies);
     }
 
-
     // --- Simulation Loop ---
 
     if (step_mode) {
-        cout << "\n--- Executing Single Cycle ---" << endl;
+        if (knobs.stepLimit == RUN_TO_PC)
+            console << "\n--- Running to PC 0x" << hex << knobs.stepValue << dec << " ---" << endl;
+        else if (knobs.stepLimit == RUN_TO_CYCLE)
+            console << "\n--- Running to cycle " << knobs.stepValue << " ---" << endl;
+        else if (knobs.stepLimit == RUN_TO_RETIRE)
+            console << "\n--- Running until " << knobs.stepValue << " instructions retire ---" << endl;
+        else
+            console << "\n--- Executing " << knobs.stepValue << " Cycle(s) ---" << endl;
 
         // Print initial state for the step (if requested)
         if(knobs.printPipelineRegisters) {
-             cout << "Pipeline State Before Cycle " << clockCycles + 1 << ":" << endl;
+             console << "Pipeline State Before Cycle " << clockCycles + 1 << ":" << endl;
              outputPipelineStageDetails(); // Use the detailed print function
         }
         if(knobs.printRegisterEachCycle) {
-            cout << "Register File Before Cycle:" << endl;
+            console << "Register File Before Cycle:" << endl;
             for(int i = 0; i < 32; i++){
-                cout << "x" << i << " = 0x" << hex << X[i] << " (" << dec << X[i] << ")\t";
-                if((i+1) % 4 == 0) cout << endl;
+                console << "x" << i << " = 0x" << hex << X[i] << " (" << dec << X[i] << ")\t";
+                if((i+1) % 4 == 0) console << endl;
             }
-            cout << endl;
+            console << endl;
         }
         if(knobs.printBranchPredictorInfo) {
-             cout << "Branch Predictor Before Cycle:" << endl;
+             console << "Branch Predictor Before Cycle:" << endl;
              printBranchPredictor();
         }
 
-        // Execute one cycle
-        tempResults.clear(); // Clear temp results at the start of the cycle
-        hazardDetection();
-        // Run stages in reverse order for correct data flow simulation within a cycle
-        write_back();
-        mem_op();
-        execute();
-        decode();
-        if(!stall_fetch) fetch(); // Fetch depends on stall detection
-        update_pipeline();       // Shift pipeline registers
-
-        clockCycles++; // Increment clock *after* completing the cycle
-
-        // Print state after the cycle (if requested)
-        if(knobs.printPipelineRegisters) {
-            cout << "\nPipeline State After Cycle " << clockCycles << ":" << endl;
-            outputPipelineStageDetails(); // Use the detailed print function
-            cout << "--- Pipeline Register Summary ---" << endl;
-            cout << "IF/ID:  Valid=" << (if_id.valid ? "T" : "F") << ", PC=0x" << hex << if_id.pc << ", Inst=0x" << if_id.instruction << ", PredPC=0x" << if_id.predictedPC << dec << endl;
-            cout << "ID/EX:  Valid=" << (id_ex.valid ? "T" : "F"); if(id_ex.valid) cout << ", PC=0x" << hex << id_ex.pc << ", Type=" << id_ex.instType << ", Sub=" << id_ex.subType << dec; cout << endl;
-            cout << "EX/MEM: Valid=" << (ex_mem.valid ? "T" : "F"); if(ex_mem.valid) cout << ", PC=0x" << hex << ex_mem.pc << ", Type=" << ex_mem.instType << ", Sub=" << ex_mem.subType << ", ALU= " << dec << ex_mem.aluResult; cout << endl;
-            cout << "MEM/WB: Valid=" << (mem_wb.valid ? "T" : "F"); if(mem_wb.valid) cout << ", PC=0x" << hex << mem_wb.pc << ", Type=" << mem_wb.instType << ", Sub=" << mem_wb.subType; cout << endl;
-            cout << "-------------------------------" << endl;
-        }
-        if(knobs.printRegisterEachCycle) {
-            cout << "\nRegister File After Cycle:" << endl;
-            for(int i = 0; i < 32; i++){
-                cout << "x" << i << " = 0x" << hex << X[i] << " (" << dec << X[i] << ")\t";
-                if((i+1) % 4 == 0) cout << endl;
-            }
-            cout << endl;
-        }
-        if(knobs.printBranchPredictorInfo) {
-            cout << "\nBranch Predictor After Cycle " << clockCycles << ":" << endl;
-            printBranchPredictor();
+        // Run in-process until the limit; state is only saved once at the end
+        RunResult result = runUntil(knobs.stepLimit, knobs.stepValue);
+        if (result == RUN_CYCLE_CAP)
+            cerr << "Warning: Simulation exceeded maximum cycle limit. Stopping." << endl;
+        else if (result == RUN_DEBUG_STOP) {
+            console << "\nStopped at breakpoint: ";
+            describe_debug_hit(console);
+            console << endl;
         }
 
         if(knobs.saveCycleSnapshots) {
-            store_pipeline_snapshot();
-            dump_pipeline_snapshots(); // Optionally dump immediately or just at the end
+            dump_pipeline_snapshots();
         }
 
         // Dump memory/registers state always at end of step for external tools
@@ -2240,78 +3499,33 @@ int mainEntry(int argc, char *argv[]) {
         // Save state for the *next* step.
         save_state();
 
-        cout << "--- Cycle " << clockCycles << " Complete ---" << endl;
+        console << "--- Cycle " << clockCycles << " Complete ---" << endl;
 
         // Check for program termination condition
-        bool pipeline_empty = !if_id.valid && !id_ex.valid && !ex_mem.valid && !mem_wb.valid;
-        if (pc >= sz * 4 && pipeline_empty) {
-            cout << "\nProgram finished." << endl;
+        if (programFinished()) {
+            console << "\nProgram finished." << endl;
             printFinalStatistics();
             // Optionally clean up state file on completion?
             // remove("sim_state.dat");
         } else {
-             cout << "\nReady for next step. Run with --step again." << endl;
+             console << "\nReady for next step. Run with --step again." << endl;
         }
 
         return 0; // Exit after one step
 
     } else {
         // --- Continuous Run Mode ---
-        cout << "\n--- Starting Continuous Simulation ---" << endl;
-        while(true) {
-             // Check termination condition *before* starting the cycle
-             bool pipeline_empty = !if_id.valid && !id_ex.valid && !ex_mem.valid && !mem_wb.valid;
-             if (pc >= sz * 4 && pipeline_empty) {
-                 cout << "\n--- Simulation Complete ---" << endl;
-                 break; // Exit the loop
-             }
-
-            // Execute one cycle
-            tempResults.clear();
-            hazardDetection();
-            write_back();
-            mem_op();
-            execute();
-            decode();
-            if(!stall_fetch) fetch();
-            update_pipeline();
-
-            clockCycles++;
-
-            // Optional per-cycle printing for continuous mode (can be verbose)
-            if(knobs.printPipelineRegisters) {
-                 cout << "\nPipeline State After Cycle " << clockCycles << ":" << endl;
-                 outputPipelineStageDetails();
-                 cout << "--- Pipeline Register Summary ---" << endl;
-                 cout << "IF/ID:  Valid=" << (if_id.valid ? "T" : "F") << ", PC=0x" << hex << if_id.pc << ", Inst=0x" << if_id.instruction << ", PredPC=0x" << if_id.predictedPC << dec << endl;
-                 cout << "ID/EX:  Valid=" << (id_ex.valid ? "T" : "F"); if(id_ex.valid) cout << ", PC=0x" << hex << id_ex.pc << ", Type=" << id_ex.instType << ", Sub=" << id_ex.subType << dec; cout << endl;
-                 cout << "EX/MEM: Valid=" << (ex_mem.valid ? "T" : "F"); if(ex_mem.valid) cout << ", PC=0x" << hex << ex_mem.pc << ", Type=" << ex_mem.instType << ", Sub=" << ex_mem.subType << ", ALU= " << dec << ex_mem.aluResult; cout << endl;
-                 cout << "MEM/WB: Valid=" << (mem_wb.valid ? "T" : "F"); if(mem_wb.valid) cout << ", PC=0x" << hex << mem_wb.pc << ", Type=" << mem_wb.instType << ", Sub=" << mem_wb.subType; cout << endl;
-                 cout << "-------------------------------" << endl;
-            }
-            if(knobs.printRegisterEachCycle) {
-                 cout << "\nRegister File After Cycle " << clockCycles << ":" << endl;
-                 for(int i = 0; i < 32; i++){
-                     cout << "x" << i << " = 0x" << hex << X[i] << " (" << dec << X[i] << ")\t";
-                     if((i+1) % 4 == 0) cout << endl;
-                 }
-                 cout << endl;
-            }
-            if(knobs.printBranchPredictorInfo) {
-                 cout << "\nBranch Predictor After Cycle " << clockCycles << ":" << endl;
-                 printBranchPredictor();
-            }
-
-            if(knobs.saveCycleSnapshots) {
-                 store_pipeline_snapshot();
-            }
-
-             // Limit cycles to prevent infinite loops in case of issues
-             if (clockCycles > 500000) { // Adjust limit as needed
-                 cerr << "Warning: Simulation exceeded maximum cycle limit. Terminating." << endl;
-                 break;
-             }
-        } // end while loop
+        console << "\n--- Starting " << (knobs.decoupled ? "Decoupled" : "Continuous") << " Simulation ---" << endl;
+        RunResult result = knobs.decoupled ? run_decoupled(*this) : runUntil(RUN_TO_CYCLE, MAX_SIMULATION_CYCLES + 1);
+        if (result == RUN_PROGRAM_FINISHED)
+            console << "\n--- Simulation Complete ---" << endl;
+        else if (result == RUN_DEBUG_STOP) {
+            console << "\n--- Stopped at breakpoint: ";
+            describe_debug_hit(console);
+            console << " ---" << endl;
+        }
+        else
+            cerr << "Warning: Simulation exceeded maximum cycle limit. Terminating." << endl;
 
         // Final actions after continuous run completes
         if(knobs.saveCycleSnapshots) {
@@ -2329,5 +3543,6 @@ int mainEntry(int argc, char *argv[]) {
 // Main Entry Point
 //------------------------------------------------------
 int main(int argc, char *argv[]) {
-    return mainEntry(argc, argv);
+    Simulator sim;
+    return sim.mainEntry(argc, argv);
 }
\ No newline at end of file